@@ -42,6 +42,10 @@ public:
     virtual mfxStatus PostProcessing(FrameSplitterInfo* frame, mfxU32 sliceNum) = 0;
 
     virtual void ResetCurrentState() = 0;
+
+    // assemble frames directly into the given buffer instead of the internal one,
+    // NULL restores the internal buffer
+    virtual mfxStatus SetFrameBuffer(mfxU8* buffer, mfxU32 size) = 0;
 };
 
 #endif // _ABSTRACT_SPL_H__
@@ -0,0 +1,116 @@
+/*############################################################################
+  # Copyright (C) 2024 Intel Corporation
+  #
+  # SPDX-License-Identifier: MIT
+  ############################################################################*/
+
+#ifndef __AU_INDEX_H__
+#define __AU_INDEX_H__
+
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include "vpl/mfxstructures.h"
+#include "vpl/mfxvp8.h"
+
+struct AUIndexEntry {
+    mfxU64 Offset; // position of the access unit in the file
+    mfxU32 Size;
+    mfxU16 FrameType; // MFX_FRAMETYPE_I/P/B, MFX_FRAMETYPE_IDR for key frames
+    mfxU16 KeyFrame; // decoding can be started from this access unit
+    mfxU64 TimeStamp; // 90 kHz units, MFX_TIMESTAMP_UNKNOWN if stream has no timing
+};
+
+// parameter set NAL unit of AVC/HEVC stream, decoding from a key frame needs the last
+// parameter sets of every id which precede it
+struct AUIndexParamSet {
+    mfxU64 Offset; // position of the NAL unit in the file, including its start code
+    mfxU32 Size;
+    mfxU16 Type; // AUIndexParamSetType
+    mfxU16 Id;
+};
+
+// parameter sets are sent to decoder in this order, as later ones refer to earlier
+enum AUIndexParamSetType { AU_INDEX_VPS = 0, AU_INDEX_SPS = 1, AU_INDEX_PPS = 2 };
+
+// consecutive access units which can be decoded independently of the rest of the stream
+struct AUIndexRange {
+    mfxU32 FirstAU;
+    mfxU32 NumAU;
+    mfxU64 Offset;
+    mfxU64 Size;
+};
+
+/** \brief Access unit index of an elementary stream or IVF file.
+ *
+ * Index is built once by scanning the stream with the same splitter which is used
+ * by frame readers and can be saved next to the stream, so following runs can seek
+ * to a key frame or split the stream into GOP ranges without parsing it again.
+ * Every IDR is a key frame, parameter sets it refers to are kept in the index, so that
+ * they can be sent to decoder before the key frame when a stream doesn't repeat them.
+ */
+class CAUIndex {
+public:
+    CAUIndex();
+
+    // scans the stream, frame rate is used to derive time stamps for elementary streams
+    mfxStatus Build(const char* strFileName,
+                    mfxU32 codecId,
+                    mfxU32 frameRateExtN = 0,
+                    mfxU32 frameRateExtD = 0);
+
+    // index is loaded only if it was built for the stream of the same size and modification time
+    mfxStatus Load(const char* strIndexFile, const char* strFileName);
+    mfxStatus Save(const char* strIndexFile) const;
+
+    // loads saved index of the stream, or builds and saves it if there is no valid one
+    mfxStatus LoadOrBuild(const char* strFileName,
+                          mfxU32 codecId,
+                          mfxU32 frameRateExtN = 0,
+                          mfxU32 frameRateExtD = 0);
+
+    // returns index of key frame at or before given access unit, -1 if there is none
+    mfxI32 FindKeyFrame(mfxU32 auNum) const;
+
+    // parameter sets which are needed to decode given access unit and aren't in it
+    std::vector<AUIndexParamSet> GetParameterSets(mfxU32 auNum) const;
+
+    // reads parameter sets of given access unit from the stream, Annex-B start codes included
+    mfxStatus ReadParameterSets(const char* strFileName,
+                                mfxU32 auNum,
+                                std::vector<mfxU8>& data) const;
+
+    /** \brief Splits the stream into ranges starting from key frames.
+     *
+     * @param numRanges number of ranges of similar size in bytes, 0 means one range per GOP
+     */
+    std::vector<AUIndexRange> SplitToRanges(mfxU32 numRanges) const;
+
+    const std::vector<AUIndexEntry>& GetEntries() const {
+        return m_entries;
+    }
+
+    mfxU32 GetCodecId() const {
+        return m_codecId;
+    }
+
+    void Clear();
+
+    static std::string GetDefaultIndexName(const char* strFileName) {
+        return std::string(strFileName) + ".auidx";
+    }
+
+protected:
+    mfxStatus BuildAVC(FILE* pFile, mfxU32 frameRateExtN, mfxU32 frameRateExtD);
+    mfxStatus BuildHEVC(FILE* pFile, mfxU32 frameRateExtN, mfxU32 frameRateExtD);
+    mfxStatus BuildIVF(FILE* pFile, mfxU64 fileSize);
+
+    std::vector<AUIndexEntry> m_entries;
+    std::vector<AUIndexParamSet> m_paramSets; // sorted by offset
+    mfxU32 m_codecId;
+    mfxU64 m_streamSize;
+    mfxU64 m_streamTime;
+};
+
+#endif // __AU_INDEX_H__
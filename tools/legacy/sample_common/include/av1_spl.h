@@ -0,0 +1,99 @@
+/*############################################################################
+  # Copyright (C) 2024 Intel Corporation
+  #
+  # SPDX-License-Identifier: MIT
+  ############################################################################*/
+
+#ifndef _AV1_SPL_H__
+#define _AV1_SPL_H__
+
+#include <vector>
+
+#include "abstract_splitter.h"
+
+namespace ProtectedLibrary {
+
+enum AV1_OBU_Type {
+    OBU_SEQUENCE_HEADER        = 1,
+    OBU_TEMPORAL_DELIMITER     = 2,
+    OBU_FRAME_HEADER           = 3,
+    OBU_TILE_GROUP             = 4,
+    OBU_METADATA               = 5,
+    OBU_FRAME                  = 6,
+    OBU_REDUNDANT_FRAME_HEADER = 7,
+    OBU_TILE_LIST              = 8,
+    OBU_PADDING                = 15
+};
+
+/** \brief Splits AV1 OBU stream into temporal units.
+ *
+ * Both low overhead bitstream format (section 5 of the specification) and length delimited
+ * format (Annex B) are accepted, the format is detected by the first temporal delimiter.
+ * Temporal units are always produced in low overhead format, which is expected by decoder,
+ * so every OBU of Annex B stream gets obu_size field.
+ */
+class AV1_Spl : public AbstractSplitter {
+public:
+    AV1_Spl();
+
+    virtual ~AV1_Spl();
+
+    virtual mfxStatus Reset();
+
+    virtual mfxStatus GetFrame(mfxBitstream* bs_in, FrameSplitterInfo** frame);
+
+    virtual mfxStatus PostProcessing(FrameSplitterInfo* frame, mfxU32 sliceNum);
+
+    virtual void ResetCurrentState();
+
+    virtual mfxStatus SetFrameBuffer(mfxU8* buffer, mfxU32 size);
+
+protected:
+    enum StreamFormat { FORMAT_UNKNOWN, FORMAT_LOW_OVERHEAD, FORMAT_ANNEX_B };
+
+    // OBU header together with length fields of Annex B which precede OBU payload
+    struct OBUPrefix {
+        mfxU32 PayloadSize;
+        mfxU32 TemporalUnitLeft; // Annex B, bytes left in temporal unit after this OBU
+        mfxU32 FrameUnitLeft; // Annex B, bytes left in frame unit after this OBU
+        mfxU8 Type;
+        mfxU8 Header[10]; // OBU header with obu_size field as it is written to the frame
+        mfxU8 HeaderSize;
+    };
+
+    mfxStatus DetectFormat(mfxBitstream* bs_in);
+
+    // returns MFX_ERR_MORE_DATA until all fields are accumulated in m_prefix
+    mfxStatus ParsePrefix(OBUPrefix& prefix);
+
+    mfxStatus StartOBU();
+    void CompleteOBU();
+
+    // internal buffer grows, buffer given by SetFrameBuffer can only be replaced by caller
+    mfxStatus CheckFrameBuffer(mfxU64 size);
+
+    StreamFormat m_format;
+
+    std::vector<mfxU8> m_prefix;
+    mfxU32 m_prefixSize; // accumulated bytes of the next OBU prefix
+    bool m_prefixReady; // OBU prefix is parsed, but OBU isn't started yet
+    OBUPrefix m_obu;
+
+    mfxU32 m_temporalUnitLeft; // Annex B only
+    mfxU32 m_frameUnitLeft; // Annex B only
+    mfxU32 m_payloadLeft; // bytes of current OBU payload still to be copied
+    mfxU32 m_payloadOffset; // position of current OBU payload in the frame
+    bool m_reducedStillPictureHeader;
+
+    enum { BUFFER_SIZE = 1024 * 1024 };
+
+    std::vector<mfxU8> m_currentFrame;
+    mfxU32 m_frameBufferSize;
+
+    std::vector<SliceSplitterInfo> m_slices;
+    FrameSplitterInfo m_frame;
+};
+
+} // namespace ProtectedLibrary
+
+#endif // _AV1_SPL_H__
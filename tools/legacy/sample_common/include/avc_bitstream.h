@@ -12,20 +12,14 @@
 
 namespace ProtectedLibrary {
 
-#define AVCPeek1Bit(current_data, offset) ((current_data[0] >> (offset)) & 1)
-
-#define AVCDrop1Bit(current_data, offset) \
-    {                                     \
-        offset -= 1;                      \
-        if (offset < 0) {                 \
-            offset = 31;                  \
-            current_data += 1;            \
-        }                                 \
-    }
-
 // NAL unit definitions
 enum { NAL_STORAGE_IDC_BITS = 0x60, NAL_UNITTYPE_BITS = 0x1f };
 
+/* Reads bits from the buffer prepared by BytesSwapper::SwapMemory, i.e. dwords with the first
+ * byte of the stream in the most significant byte. Bits are taken from a 64-bit cache which is
+ * refilled by a whole dword, so reads of up to 32 bits need a single refill check. Reading
+ * beyond the end of the buffer returns zero bits.
+ */
 class AVCBaseBitstream {
 public:
     AVCBaseBitstream();
@@ -34,10 +28,17 @@ public:
 
     // Reset the bitstream with new data pointer
     void Reset(mfxU8* const pb, mfxU32 maxsize);
+    // offset is the position of the first bit to read in the first dword (31 - MSB, 0 - LSB)
     void Reset(mfxU8* const pb, mfxI32 offset, mfxU32 maxsize);
 
+    // Reads up to 32 bits
     inline mfxU32 GetBits(mfxU32 nbits);
 
+    // Returns up to 32 next bits without moving the position
+    inline mfxU32 PeekBits(mfxU32 nbits);
+
+    void SkipBits(mfxU32 nbits);
+
     // Read one VLC mfxI32 or mfxU32 value from bitstream
     mfxI32 GetVLCElement(bool bIsSigned);
 
@@ -57,9 +58,16 @@ public:
     void AlignPointerRight(void);
 
 protected:
-    mfxU32* m_pbs; // pointer to the current position of the buffer.
-    mfxI32 m_bitOffset; // the bit position (0 to 31) in the dword pointed by m_pbs.
-    mfxU32* m_pbsBase; // pointer to the first byte of the buffer.
+    // loads the next dword, keeps at least 32 bits in the cache
+    inline void Refill();
+
+    void SetBitPosition(mfxU32 position);
+
+    const mfxU32* m_pbsBase; // pointer to the first dword of the buffer.
+    mfxU32 m_nextDword; // index of the dword to be loaded into the cache next.
+    mfxU32 m_numDwords; // number of dwords available in the buffer.
+    mfxU64 m_cache; // not consumed bits aligned to MSB, the rest of bits are zero.
+    mfxU32 m_cacheBits; // number of not consumed bits in m_cache.
     mfxU32 m_maxBsSize; // maximum buffer size in bytes.
 };
 
@@ -119,76 +127,52 @@ private:
 
 void SetDefaultScalingLists(AVCSeqParamSet* sps);
 
-extern const mfxU32 bits_data[];
-
-#define _avcGetBits(current_data, offset, nbits, data) \
-    {                                                  \
-        mfxU32 x;                                      \
-                                                       \
-        SAMPLE_ASSERT((nbits) > 0 && (nbits) <= 32);   \
-        SAMPLE_ASSERT(offset >= 0 && offset <= 31);    \
-                                                       \
-        offset -= (nbits);                             \
-                                                       \
-        if (offset >= 0) {                             \
-            x = current_data[0] >> (offset + 1);       \
-        }                                              \
-        else {                                         \
-            offset += 32;                              \
-                                                       \
-            x = current_data[1] >> (offset);           \
-            x >>= 1;                                   \
-            x += current_data[0] << (31 - offset);     \
-            current_data++;                            \
-        }                                              \
-                                                       \
-        SAMPLE_ASSERT(offset >= 0 && offset <= 31);    \
-                                                       \
-        (data) = x & bits_data[nbits];                 \
-    }
-
-#define avcGetBits1(current_data, offset, data)     \
-    {                                               \
-        data = ((current_data[0] >> (offset)) & 1); \
-        offset -= 1;                                \
-        if (offset < 0) {                           \
-            offset = 31;                            \
-            current_data += 1;                      \
-        }                                           \
-    }
-
-#define avcUngetNBits(current_data, offset, nbits)  \
-    {                                               \
-        SAMPLE_ASSERT(offset >= 0 && offset <= 31); \
-                                                    \
-        offset += (nbits);                          \
-        if (offset > 31) {                          \
-            offset -= 32;                           \
-            current_data--;                         \
-        }                                           \
-                                                    \
-        SAMPLE_ASSERT(offset >= 0 && offset <= 31); \
-    }
-
-#define avcGetNBits(current_data, offset, nbits, data) \
-    _avcGetBits(current_data, offset, nbits, data);
+inline void AVCBaseBitstream::Refill() {
+    mfxU64 dword = (m_nextDword < m_numDwords) ? m_pbsBase[m_nextDword] : 0;
+    m_nextDword++;
+    m_cache |= dword << (32 - m_cacheBits);
+    m_cacheBits += 32;
+}
 
 inline mfxU32 AVCBaseBitstream::GetBits(mfxU32 nbits) {
-    mfxU32 w, n = nbits;
+    SAMPLE_ASSERT(nbits <= 32);
+
+    if (m_cacheBits < nbits)
+        Refill();
 
-    avcGetNBits(m_pbs, m_bitOffset, n, w);
+    // two shifts keep zero nbits valid
+    mfxU32 w = (mfxU32)((m_cache >> 1) >> (63 - nbits));
+    m_cache <<= nbits;
+    m_cacheBits -= nbits;
     return w;
 }
 
+inline mfxU32 AVCBaseBitstream::PeekBits(mfxU32 nbits) {
+    SAMPLE_ASSERT(nbits <= 32);
+
+    if (m_cacheBits < nbits)
+        Refill();
+
+    return (mfxU32)((m_cache >> 1) >> (63 - nbits));
+}
+
 inline mfxU32 AVCBaseBitstream::Get1Bit() {
-    mfxU32 w;
-    avcGetBits1(m_pbs, m_bitOffset, w);
+    if (!m_cacheBits)
+        Refill();
+
+    mfxU32 w = (mfxU32)(m_cache >> 63);
+    m_cache <<= 1;
+    m_cacheBits--;
     return w;
 
 } // AVCBitstream::Get1Bit()
 
+inline mfxU32 AVCBaseBitstream::BitsDecoded() {
+    return m_nextDword * 32 - m_cacheBits;
+}
+
 inline mfxU32 AVCBaseBitstream::BytesDecoded() {
-    return static_cast<mfxU32>((mfxU8*)m_pbs - (mfxU8*)m_pbsBase) + ((31 - m_bitOffset) >> 3);
+    return BitsDecoded() >> 3;
 }
 
 inline mfxU32 AVCBaseBitstream::BytesLeft() {
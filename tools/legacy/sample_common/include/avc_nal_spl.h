@@ -58,6 +58,8 @@ public:
     virtual void Release();
 
     virtual mfxI32 CheckNalUnitType(mfxBitstream* source);
+    // returns AVC NAL unit type, destination is NULL until complete NAL unit is found,
+    // splitters of other codecs take the type from NAL unit header in destination
     virtual mfxI32 GetNalUnits(mfxBitstream* source, mfxBitstream*& destination);
 
     virtual void Reset();
@@ -72,6 +74,9 @@ protected:
     mfxBitstream m_bitstream;
 };
 
+// returns pointer to the first 00 00 01 prefix in [begin, end) or end if there is none
+mfxU8* FindStartCodePrefix(mfxU8* begin, mfxU8* end);
+
 void SwapMemoryAndRemovePreventingBytes(mfxU8* pDestination,
                                         mfxU32& nDstSize,
                                         mfxU8* pSource,
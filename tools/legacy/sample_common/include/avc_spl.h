@@ -75,6 +75,8 @@ public:
 
     void ResetCurrentState();
 
+    virtual mfxStatus SetFrameBuffer(mfxU8* buffer, mfxU32 size);
+
 protected:
     std::unique_ptr<NALUnitSplitter> m_pNALSplitter;
 
@@ -93,8 +95,12 @@ protected:
 
     mfxU8* GetMemoryForSwapping(mfxU32 size);
 
+    // internal buffer grows, buffer given by SetFrameBuffer can only be replaced by caller
+    mfxStatus CheckFrameBuffer(mfxU64 size);
     mfxStatus AddNalUnit(mfxBitstream* nalUnit);
     mfxStatus AddSliceNalUnit(mfxBitstream* nalUnit, AVCSlice* pSlice);
+    // adds NAL unit, keeps it pending if it doesn't fit the frame buffer
+    mfxStatus AddOrKeepNalUnit(mfxBitstream* nalUnit, AVCSlice* pSlice);
     bool IsFieldOfOneFrame(AVCFrameInfo* frame,
                            const AVCSliceHeader* slice1,
                            const AVCSliceHeader* slice2);
@@ -108,9 +114,14 @@ protected:
 
     mfxBitstream* m_lastNalUnit;
 
+    // NAL unit which didn't fit the frame buffer, it is added on the next GetFrame call
+    mfxBitstream* m_pendingNalUnit;
+    AVCSlice* m_pendingSlice;
+
     enum { BUFFER_SIZE = 1024 * 1024 };
 
     std::vector<mfxU8> m_currentFrame;
+    mfxU32 m_frameBufferSize;
     std::vector<mfxU8> m_swappingMemory;
     std::list<AVCSlice> m_slicesStorage;
 
@@ -40,6 +40,7 @@ public:
     virtual mfxStatus UnlockFrame(mfxMemId mid, mfxFrameData* ptr)                          = 0;
     virtual mfxStatus GetFrameHDL(mfxMemId mid, mfxHDL* handle)                             = 0;
     virtual mfxStatus FreeFrames(mfxFrameAllocResponse* response)                           = 0;
+    virtual mfxStatus ReleaseResponseFrame(mfxFrameAllocResponse* response, mfxU16 index)   = 0;
     virtual mfxStatus Create3DLutMemory(mfxMemId memId, const char* lut3d_file_name)        = 0;
     virtual mfxStatus Create3DLutMemory(mfxMemId memId, const std::string& lut3d_file_name) = 0;
     virtual mfxStatus Release3DLutMemory(mfxMemId memId)                                    = 0;
@@ -76,6 +77,11 @@ public:
                                    mfxU16 memType,
                                    mfxMemId* midOut);
     virtual mfxStatus FreeFrames(mfxFrameAllocResponse* response);
+    // Releases single frame of the response ahead of FreeFrames, e.g. when surface pool shrinks.
+    // Mid of the frame is reset in the response, so FreeFrames skips it later. The first frame
+    // identifies the response and stays till FreeFrames, frames of responses shared between
+    // components stay as well.
+    virtual mfxStatus ReleaseResponseFrame(mfxFrameAllocResponse* response, mfxU16 index);
 
     virtual mfxStatus Create3DLutMemory(mfxMemId memId, const char* lut3d_file_name) {
         return MFX_ERR_NONE;
@@ -174,6 +180,11 @@ protected:
 
     // frees memory attached to response
     virtual mfxStatus ReleaseResponse(mfxFrameAllocResponse* response) = 0;
+    // returns memory of the frame to the system, allocators which can't do it for single frame
+    // return MFX_ERR_UNSUPPORTED
+    virtual mfxStatus ReleaseFrameImpl(mfxFrameAllocResponse* response, mfxU16 index) {
+        return MFX_ERR_UNSUPPORTED;
+    }
     // allocates memory
     virtual mfxStatus AllocImpl(mfxFrameAllocRequest* request, mfxFrameAllocResponse* response) = 0;
     virtual mfxStatus ReallocImpl(mfxMemId midIn,
@@ -9,12 +9,11 @@
 
 #include "base_allocator.h"
 #include "sample_utils.h"
+#include "sysmem_allocator.h"
 
 #include <map>
 #include <memory>
 
-class SysMemFrameAllocator;
-
 // Wrapper on standard allocator for concurrent allocation of
 // D3D and system surfaces
 class GeneralAllocator : public BaseFrameAllocator {
@@ -25,12 +24,26 @@ public:
     virtual mfxStatus Init(mfxAllocatorParams* pParams);
     virtual mfxStatus Close();
 
+    // placement of system memory frames, takes effect on Init
+    void SetSysMemPlacement(const SysMemPlacement& placement) {
+        m_SYSPlacement = placement;
+    }
+
+    // slab, pool and zero init modes of system memory frames (see SysMemAllocatorParams),
+    // all are off by default, takes effect on Init
+    void SetSysMemModes(bool bUseSlab, bool bUsePool, bool bZeroInit) {
+        m_SYSUseSlab  = bUseSlab;
+        m_SYSUsePool  = bUsePool;
+        m_SYSZeroInit = bZeroInit;
+    }
+
 protected:
     virtual mfxStatus LockFrame(mfxMemId mid, mfxFrameData* ptr);
     virtual mfxStatus UnlockFrame(mfxMemId mid, mfxFrameData* ptr);
     virtual mfxStatus GetFrameHDL(mfxMemId mid, mfxHDL* handle);
 
     virtual mfxStatus ReleaseResponse(mfxFrameAllocResponse* response);
+    virtual mfxStatus ReleaseFrameImpl(mfxFrameAllocResponse* response, mfxU16 index);
     virtual mfxStatus AllocImpl(mfxFrameAllocRequest* request, mfxFrameAllocResponse* response);
     virtual mfxStatus ReallocImpl(mfxMemId midIn,
                                   const mfxFrameInfo* info,
@@ -46,6 +59,10 @@ protected:
     std::map<mfxHDL, bool> m_Mids;
     std::unique_ptr<BaseFrameAllocator> m_D3DAllocator;
     std::unique_ptr<SysMemFrameAllocator> m_SYSAllocator;
+    SysMemPlacement m_SYSPlacement;
+    bool m_SYSUseSlab;
+    bool m_SYSUsePool;
+    bool m_SYSZeroInit;
 
 private:
     DISALLOW_COPY_AND_ASSIGN(GeneralAllocator);
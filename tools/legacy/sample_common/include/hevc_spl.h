@@ -0,0 +1,114 @@
+/*############################################################################
+  # Copyright (C) 2024 Intel Corporation
+  #
+  # SPDX-License-Identifier: MIT
+  ############################################################################*/
+
+#ifndef _HEVC_SPL_H__
+#define _HEVC_SPL_H__
+
+#include <memory>
+#include <vector>
+
+#include "abstract_splitter.h"
+
+#include "avc_bitstream.h"
+#include "avc_nal_spl.h"
+
+namespace ProtectedLibrary {
+
+enum HEVC_NAL_Unit_Type {
+    HEVC_NAL_UT_BLA_W_LP    = 16,
+    HEVC_NAL_UT_IDR_W_RADL  = 19,
+    HEVC_NAL_UT_IDR_N_LP    = 20,
+    HEVC_NAL_UT_RSV_IRAP_23 = 23,
+    HEVC_NAL_UT_VPS         = 32,
+    HEVC_NAL_UT_SPS         = 33,
+    HEVC_NAL_UT_PPS         = 34,
+    HEVC_NAL_UT_AUD         = 35,
+    HEVC_NAL_UT_EOS         = 36,
+    HEVC_NAL_UT_EOB         = 37,
+    HEVC_NAL_UT_FD          = 38,
+    HEVC_NAL_UT_PREFIX_SEI  = 39,
+    HEVC_NAL_UT_SUFFIX_SEI  = 40,
+    HEVC_NAL_UT_RSV_NVCL_41 = 41,
+    HEVC_NAL_UT_RSV_NVCL_44 = 44,
+    HEVC_NAL_UT_UNSPEC_48   = 48,
+    HEVC_NAL_UT_UNSPEC_55   = 55
+};
+
+enum { HEVC_MAX_NUM_SEQ_PARAM_SETS = 16, HEVC_MAX_NUM_PIC_PARAM_SETS = 64 };
+
+/** \brief Splits HEVC elementary stream into access units.
+ *
+ * Boundaries of access units are detected as described in 7.4.2.4.4 of the standard: access unit
+ * starts from AUD, VPS, SPS, PPS or prefix SEI of the base layer or from slice segment with
+ * first_slice_segment_in_pic_flag set. Only fields of parameter sets which are needed to get
+ * slice types are parsed.
+ */
+class HEVC_Spl : public AbstractSplitter {
+public:
+    HEVC_Spl();
+
+    virtual ~HEVC_Spl();
+
+    virtual mfxStatus Reset();
+
+    virtual mfxStatus GetFrame(mfxBitstream* bs_in, FrameSplitterInfo** frame);
+
+    virtual mfxStatus PostProcessing(FrameSplitterInfo* frame, mfxU32 sliceNum);
+
+    virtual void ResetCurrentState();
+
+    virtual mfxStatus SetFrameBuffer(mfxU8* buffer, mfxU32 size);
+
+protected:
+    struct HEVCSeqParams {
+        bool Valid;
+        mfxU32 SliceAddressBits; // length of slice_segment_address
+    };
+
+    struct HEVCPicParams {
+        bool Valid;
+        mfxU32 SeqParamSetId;
+        bool DependentSliceSegmentsEnabled;
+        mfxU32 NumExtraSliceHeaderBits;
+    };
+
+    // returns MFX_ERR_NONE when NAL unit starts the next access unit
+    mfxStatus ProcessNalUnit(mfxBitstream* nalUnit);
+
+    mfxStatus AddNalUnit(const mfxU8* data, mfxU32 size, mfxU64 timeStamp);
+
+    // internal buffer grows, buffer given by SetFrameBuffer can only be replaced by caller
+    mfxStatus CheckFrameBuffer(mfxU64 size);
+
+    // removes emulation prevention bytes from the beginning of NAL unit
+    void InitBitstream(AVCBaseBitstream& bitStream, const mfxU8* data, mfxU32 size);
+
+    void DecodeSeqParamSet(const mfxU8* data, mfxU32 size);
+    void DecodePicParamSet(const mfxU8* data, mfxU32 size);
+    SliceTypeCode DecodeSliceType(const mfxU8* data, mfxU32 size);
+
+    std::unique_ptr<NALUnitSplitter> m_pNALSplitter;
+
+    // NAL unit which starts the next access unit or doesn't fit into the buffer
+    std::vector<mfxU8> m_pendingNalUnit;
+    mfxU64 m_pendingTimeStamp;
+
+    std::vector<HEVCSeqParams> m_seqParams;
+    std::vector<HEVCPicParams> m_picParams;
+    std::vector<mfxU8> m_swappingMemory;
+
+    enum { BUFFER_SIZE = 1024 * 1024 };
+
+    std::vector<mfxU8> m_currentFrame;
+    mfxU32 m_frameBufferSize;
+
+    std::vector<SliceSplitterInfo> m_slices;
+    FrameSplitterInfo m_frame;
+};
+
+} // namespace ProtectedLibrary
+
+#endif // _HEVC_SPL_H__
@@ -8,6 +8,7 @@
 #define __MFX_BUFFERING_H__
 
 #include <stdio.h>
+#include <atomic>
 #include <mutex>
 
 #include "vpl/mfxstructures.h"
@@ -17,6 +18,8 @@
 #include "vm/thread_defs.h"
 #include "vm/time_defs.h"
 
+class msdkFreeSurfacesPool;
+
 struct msdkFrameSurface {
     mfxFrameSurface1
         frame; // NOTE: this _should_ be the first item (see CBuffering::FindUsedSurface())
@@ -24,6 +27,8 @@ struct msdkFrameSurface {
     mfxU16 render_lock; // signifies that frame is locked for rendering
     msdkFrameSurface* prev;
     msdkFrameSurface* next;
+    msdkFreeSurfacesPool* pool; // pool the surface is returned to after rendering
+    std::atomic<mfxU32> link; // index + 1 of the next surface in lists of msdkFreeSurfacesPool
 };
 
 struct msdkOutputSurface {
@@ -55,78 +60,133 @@ struct msdkOutputSurface {
 
 class CBuffering;
 
-// LIFO list of frame surfaces
+// LIFO list of frame surfaces, lock-free
 class msdkFreeSurfacesPool {
     friend class CBuffering;
 
 public:
-    msdkFreeSurfacesPool(std::mutex& mutex) : m_pSurfaces(NULL), m_rMutex(mutex) {}
+    msdkFreeSurfacesPool() : m_pSurfaces(NULL), m_SurfacesNumber(0), m_Head(0), m_Released(0) {}
 
     ~msdkFreeSurfacesPool() {
         m_pSurfaces = NULL;
     }
     /** \brief The function adds free surface to the free surfaces array.
      *
-     * @note That's caller responsibility to pass valid surface.
+     * @note That's caller responsibility to pass valid surface of this pool.
      * @note We always add and get free surface from the array head. In case not all surfaces
      * will be actually used we have good chance to avoid actual allocation of the surface memory.
+     * @note Any thread can add surfaces.
      */
     inline void AddSurface(msdkFrameSurface* surface) {
-        std::lock_guard<std::mutex> lock(m_rMutex);
-        AddSurfaceUnsafe(surface);
+        MSDK_SELF_CHECK(surface);
+        MSDK_SELF_CHECK(!surface->prev);
+        MSDK_SELF_CHECK(!surface->next);
+
+        mfxU32 index = GetIndex(surface);
+        mfxU64 head  = m_Head.load(std::memory_order_relaxed);
+        do {
+            surface->link.store((mfxU32)head, std::memory_order_relaxed);
+        } while (!m_Head.compare_exchange_weak(head,
+                                               NextHead(head, index),
+                                               std::memory_order_release,
+                                               std::memory_order_relaxed));
     }
     /** \brief The function gets the next free surface from the free surfaces array.
      *
      * @note Surface is detached from the free surfaces array.
+     * @note Head of the array is tagged with the count of its changes, so surface which was taken
+     * and returned by other threads meanwhile doesn't break the array.
      */
     inline msdkFrameSurface* GetSurface() {
-        std::lock_guard<std::mutex> lock(m_rMutex);
-        return GetSurfaceUnsafe();
-    }
-
-private:
-    inline void AddSurfaceUnsafe(msdkFrameSurface* surface) {
-        msdkFrameSurface* head;
+        msdkFrameSurface* surface = NULL;
+        mfxU64 head               = m_Head.load(std::memory_order_acquire);
+        do {
+            if (!(mfxU32)head)
+                return NULL;
+            surface = &m_pSurfaces[(mfxU32)head - 1];
+        } while (!m_Head.compare_exchange_weak(
+            head,
+            NextHead(head, surface->link.load(std::memory_order_relaxed)),
+            std::memory_order_acquire,
+            std::memory_order_acquire));
 
+        surface->prev = surface->next = NULL;
+        return surface;
+    }
+    /** \brief The function takes surface back after the last render lock is released.
+     *
+     * Surface which is still locked by Media SDK is kept aside until CBuffering syncs surfaces,
+     * then it is checked together with the used surfaces.
+     */
+    inline void ReleaseSurface(msdkFrameSurface* surface) {
         MSDK_SELF_CHECK(surface);
-        MSDK_SELF_CHECK(!surface->prev);
-        MSDK_SELF_CHECK(!surface->next);
 
-        head              = m_pSurfaces;
-        m_pSurfaces       = surface;
-        m_pSurfaces->next = head;
+        if (!surface->frame.Data.Locked) {
+            AddSurface(surface);
+            return;
+        }
+
+        mfxU32 index = GetIndex(surface);
+        mfxU32 head  = m_Released.load(std::memory_order_relaxed);
+        do {
+            surface->link.store(head, std::memory_order_relaxed);
+        } while (!m_Released.compare_exchange_weak(head,
+                                                   index,
+                                                   std::memory_order_release,
+                                                   std::memory_order_relaxed));
     }
-    inline msdkFrameSurface* GetSurfaceUnsafe() {
-        msdkFrameSurface* surface = NULL;
 
-        if (m_pSurfaces) {
-            surface       = m_pSurfaces;
-            m_pSurfaces   = m_pSurfaces->next;
-            surface->prev = surface->next = NULL;
-            MSDK_SELF_CHECK(!surface->prev);
-            MSDK_SELF_CHECK(!surface->next);
+private:
+    // links all surfaces of the array into the pool, must not run concurrently with other calls
+    void Reset(msdkFrameSurface* surfaces, mfxU32 number) {
+        m_pSurfaces      = surfaces;
+        m_SurfacesNumber = number;
+        for (mfxU32 i = 0; i < number; ++i) {
+            surfaces[i].pool = this;
+            surfaces[i].prev = surfaces[i].next = NULL;
+            surfaces[i].link.store(i + 1 < number ? i + 2 : 0, std::memory_order_relaxed);
         }
+        m_Head.store(number ? 1 : 0);
+        m_Released.store(0);
+    }
+    // detaches surfaces released by ReleaseSurface() while they were locked, returns the first
+    // of them for GetReleasedSurface()
+    inline mfxU32 TakeReleasedSurfaces() {
+        return m_Released.exchange(0, std::memory_order_acquire);
+    }
+    inline msdkFrameSurface* GetReleasedSurface(mfxU32& index) {
+        if (!index)
+            return NULL;
+        msdkFrameSurface* surface = &m_pSurfaces[index - 1];
+        index                     = surface->link.load(std::memory_order_relaxed);
         return surface;
     }
+    inline mfxU32 GetIndex(msdkFrameSurface* surface) {
+        MSDK_SELF_CHECK(surface >= m_pSurfaces && surface < m_pSurfaces + m_SurfacesNumber);
+        return (mfxU32)(surface - m_pSurfaces) + 1;
+    }
+    // head keeps index + 1 of the first surface in the low half and the tag in the high one
+    static inline mfxU64 NextHead(mfxU64 head, mfxU32 index) {
+        return (((head >> 32) + 1) << 32) | index;
+    }
 
 protected:
     msdkFrameSurface* m_pSurfaces;
-    std::mutex& m_rMutex;
+    mfxU32 m_SurfacesNumber;
+    std::atomic<mfxU64> m_Head;
+    std::atomic<mfxU32> m_Released; // index + 1 of the last released surface
 
 private:
     msdkFreeSurfacesPool(const msdkFreeSurfacesPool&);
     void operator=(const msdkFreeSurfacesPool&);
 };
 
-// random access, predicted as FIFO
+// random access, predicted as FIFO, accessed only by the thread which runs Media SDK component
 class msdkUsedSurfacesPool {
     friend class CBuffering;
 
 public:
-    msdkUsedSurfacesPool(std::mutex& mutex)
-            : m_pSurfacesHead(NULL),
-              m_pSurfacesTail(NULL),
-              m_rMutex(mutex) {}
+    msdkUsedSurfacesPool() : m_pSurfacesHead(NULL), m_pSurfacesTail(NULL) {}
 
     ~msdkUsedSurfacesPool() {
         m_pSurfacesHead = NULL;
@@ -142,22 +202,26 @@ public:
      * head.
      */
     inline void AddSurface(msdkFrameSurface* surface) {
-        std::lock_guard<std::mutex> lock(m_rMutex);
-        AddSurfaceUnsafe(surface);
+        MSDK_SELF_CHECK(surface);
+        MSDK_SELF_CHECK(!surface->prev);
+        MSDK_SELF_CHECK(!surface->next);
+
+        surface->prev = m_pSurfacesTail;
+        surface->next = NULL;
+        if (m_pSurfacesTail) {
+            m_pSurfacesTail->next = surface;
+            m_pSurfacesTail       = m_pSurfacesTail->next;
+        }
+        else {
+            m_pSurfacesHead = m_pSurfacesTail = surface;
+        }
     }
 
     /** \brief The function detaches surface from the used surfaces array.
      *
      * @note That's caller responsibility to pass valid surface.
      */
-
     inline void DetachSurface(msdkFrameSurface* surface) {
-        std::lock_guard<std::mutex> lock(m_rMutex);
-        DetachSurfaceUnsafe(surface);
-    }
-
-private:
-    inline void DetachSurfaceUnsafe(msdkFrameSurface* surface) {
         MSDK_SELF_CHECK(surface);
 
         msdkFrameSurface* prev = surface->prev;
@@ -182,26 +246,10 @@ private:
         MSDK_SELF_CHECK(!surface->prev);
         MSDK_SELF_CHECK(!surface->next);
     }
-    inline void AddSurfaceUnsafe(msdkFrameSurface* surface) {
-        MSDK_SELF_CHECK(surface);
-        MSDK_SELF_CHECK(!surface->prev);
-        MSDK_SELF_CHECK(!surface->next);
-
-        surface->prev = m_pSurfacesTail;
-        surface->next = NULL;
-        if (m_pSurfacesTail) {
-            m_pSurfacesTail->next = surface;
-            m_pSurfacesTail       = m_pSurfacesTail->next;
-        }
-        else {
-            m_pSurfacesHead = m_pSurfacesTail = surface;
-        }
-    }
 
 protected:
     msdkFrameSurface* m_pSurfacesHead; // oldest surface
     msdkFrameSurface* m_pSurfacesTail; // youngest surface
-    std::mutex& m_rMutex;
 
 private:
     msdkUsedSurfacesPool(const msdkUsedSurfacesPool&);
@@ -298,10 +346,32 @@ protected: // functions
     /** \brief The function syncs arrays of free and used surfaces.
      *
      * If Media SDK used surface for internal needs and unlocked it, the function moves such a surface
-     * back to the free surfaces array.
+     * back to the free surfaces array. Surfaces locked for rendering aren't in the used surfaces
+     * array, they come back with ReleaseRenderLock().
      */
     void SyncFrameSurfaces();
     void SyncVppFrameSurfaces();
+    static void SyncSurfaces(msdkFreeSurfacesPool& freePool, msdkUsedSurfacesPool& usedPool);
+
+    /** \brief The function hands surface over to rendering.
+     *
+     * @note Surface is detached from the used surfaces array if it is there.
+     */
+    inline void LockSurfaceForRendering(msdkUsedSurfacesPool& usedPool, msdkFrameSurface* surface) {
+        if (surface->prev || surface == usedPool.m_pSurfacesHead)
+            usedPool.DetachSurface(surface);
+        msdk_atomic_inc16(&(surface->render_lock));
+    }
+
+    /** \brief The function releases render lock of the surface.
+     *
+     * The last release returns surface to its free surfaces array, so the thread which runs
+     * Media SDK component doesn't need to check surfaces which are being rendered.
+     */
+    static inline void ReleaseRenderLock(msdkFrameSurface* surface) {
+        if (!msdk_atomic_dec16(&(surface->render_lock)) && surface->pool)
+            surface->pool->ReleaseSurface(surface);
+    }
 
     /** \brief Returns surface which corresponds to the given one in Media SDK format (mfxFrameSurface1).
      *
@@ -352,7 +422,7 @@ protected: // functions
         MSDK_SELF_CHECK(output_surface->surface);
         MSDK_SELF_CHECK(output_surface->syncp);
 
-        msdk_atomic_dec16(&(output_surface->surface->render_lock));
+        ReleaseRenderLock(output_surface->surface);
 
         output_surface->surface = NULL;
         output_surface->syncp   = NULL;
@@ -367,7 +437,7 @@ protected: // variables
     msdkFrameSurface* m_pVppSurfaces;
     std::mutex m_Mutex;
 
-    // LIFO list of frame surfaces
+    // LIFO list of frame surfaces, lock-free
     msdkFreeSurfacesPool m_FreeSurfacesPool;
     msdkFreeSurfacesPool m_FreeVppSurfacesPool;
 
@@ -10,6 +10,7 @@
 #include <stdio.h>
 #include <algorithm>
 #include <fstream>
+#include <functional>
 #include <map>
 #include <memory>
 #include <mutex>
@@ -43,6 +44,8 @@
 #include "avc_headers.h"
 #include "avc_nal_spl.h"
 #include "avc_spl.h"
+#include "av1_spl.h"
+#include "hevc_spl.h"
 #include "vpl_implementation_loader.h"
 
 #include "vpl/mfxsurfacepool.h"
@@ -537,23 +540,20 @@ public:
 
 /** ExtBufHolder is an utility class which
  *  provide interface for mfxExtBuffer objects management in any mfx structure (e.g. mfxVideoParam)
+ *
+ *  Extension buffers are placed into an arena: small ones go to storage inside the object and
+ *  larger ones go to heap chunks which are kept until destruction. Reset() returns the holder to
+ *  its initial state without releasing the memory, so a holder which is reused for every frame
+ *  stops allocating once it has seen the largest set of buffers.
  */
 template <typename T>
 class ExtBufHolder : public T {
 public:
-    ExtBufHolder() : T() {
-        m_ext_buf.reserve(max_num_ext_buffers);
-    }
+    ExtBufHolder() : T() {}
 
-    ~ExtBufHolder() // only buffers allocated by wrapper can be released
-    {
-        for (auto it = m_ext_buf.begin(); it != m_ext_buf.end(); it++) {
-            delete[](mfxU8*)(*it);
-        }
-    }
+    ~ExtBufHolder() = default;
 
-    ExtBufHolder(const ExtBufHolder& ref) {
-        m_ext_buf.reserve(max_num_ext_buffers);
+    ExtBufHolder(const ExtBufHolder& ref) : T() {
         *this = ref; // call to operator=
     }
 
@@ -563,7 +563,7 @@ public:
         return *this;
     }
 
-    ExtBufHolder(const T& ref) {
+    ExtBufHolder(const T& ref) : T() {
         *this = ref; // call to operator=
     }
 
@@ -598,8 +598,25 @@ public:
         return *this;
     }
 
-    ExtBufHolder(ExtBufHolder&&)            = default;
-    ExtBufHolder& operator=(ExtBufHolder&&) = default;
+    // noexcept lets std::vector move holders on reallocation instead of copying them
+    ExtBufHolder(ExtBufHolder&& ref) noexcept : T() {
+        MoveBuffers(ref);
+    }
+
+    ExtBufHolder& operator=(ExtBufHolder&& ref) noexcept {
+        if (this != &ref) {
+            ClearBuffers();
+            MoveBuffers(ref);
+        }
+        return *this;
+    }
+
+    // resets main structure and removes all extension buffers, memory is kept for reuse
+    void Reset() {
+        T* dst_base = this;
+        *dst_base   = T();
+        ClearBuffers();
+    }
 
     mfxExtBuffer* AddExtBuffer(mfxU32 id, mfxU32 size) {
         return AddExtBuffer(id, size, false);
@@ -613,28 +630,6 @@ public:
         return (TB*)b;
     }
 
-    template <typename TB>
-    void RemoveExtBuffer() {
-        auto it = std::find_if(m_ext_buf.begin(),
-                               m_ext_buf.end(),
-                               CmpExtBufById(mfx_ext_buffer_id<TB>::id));
-        if (it != m_ext_buf.end()) {
-            delete[](mfxU8*)(*it);
-            it = m_ext_buf.erase(it);
-
-            if (IsPairedMfxExtBuffer<TB>::value) {
-                if (it == m_ext_buf.end() || (*it)->BufferId != mfx_ext_buffer_id<TB>::id)
-                    throw mfxError(MFX_ERR_NULL_PTR,
-                                   "RemoveExtBuffer: ExtBuffer's parity has been broken");
-
-                delete[](mfxU8*)(*it);
-                m_ext_buf.erase(it);
-            }
-
-            RefreshBuffers();
-        }
-    }
-
     template <typename TB>
     TB* GetExtBuffer(uint32_t fieldId = 0) const {
         return (TB*)FindExtBuffer(mfx_ext_buffer_id<TB>::id, fieldId);
@@ -651,13 +646,165 @@ public:
     }
 
 private:
+    // list of attached buffers which keeps its first entries inside the object
+    class ExtBufList {
+    public:
+        ExtBufList() : m_inline(), m_heap(), m_size(0) {}
+
+        mfxExtBuffer** begin() {
+            return data();
+        }
+        mfxExtBuffer** end() {
+            return data() + m_size;
+        }
+        mfxExtBuffer* const* begin() const {
+            return data();
+        }
+        mfxExtBuffer* const* end() const {
+            return data() + m_size;
+        }
+        mfxExtBuffer** data() {
+            return m_heap.empty() ? m_inline : m_heap.data();
+        }
+        mfxExtBuffer* const* data() const {
+            return m_heap.empty() ? m_inline : m_heap.data();
+        }
+        size_t size() const {
+            return m_size;
+        }
+        mfxExtBuffer*& operator[](size_t i) {
+            return data()[i];
+        }
+        mfxExtBuffer*& back() {
+            return data()[m_size - 1];
+        }
+
+        void push_back(mfxExtBuffer* buf) {
+            if (m_heap.empty() && m_size == inline_count) {
+                m_heap.assign(m_inline, m_inline + m_size);
+            }
+            if (m_heap.empty()) {
+                m_inline[m_size] = buf;
+            }
+            else if (m_size < m_heap.size()) {
+                m_heap[m_size] = buf;
+            }
+            else {
+                m_heap.push_back(buf);
+            }
+            m_size++;
+        }
+        // capacity is kept, so list which once grew to heap doesn't allocate anymore
+        void clear() {
+            m_size = 0;
+        }
+        void Take(ExtBufList& other) {
+            std::copy(other.m_inline, other.m_inline + inline_count, m_inline);
+            m_heap = std::move(other.m_heap);
+            m_size = other.m_size;
+
+            other.m_heap.clear();
+            other.m_size = 0;
+        }
+
+    private:
+        enum { inline_count = 8 };
+
+        mfxExtBuffer* m_inline[inline_count];
+        std::vector<mfxExtBuffer*> m_heap;
+        size_t m_size;
+
+        ExtBufList(const ExtBufList&);
+        void operator=(const ExtBufList&);
+    };
+
+    // bump allocator for buffer memory, chunks are released only by destructor
+    class ExtBufArena {
+    public:
+        ExtBufArena() : m_inline(), m_inline_used(0), m_chunks(), m_chunk(0) {}
+
+        mfxU8* Alloc(size_t size) {
+            size = (size + alignment - 1) & ~(alignment - 1);
+
+            if (inline_size - m_inline_used >= size) {
+                mfxU8* ptr = m_inline + m_inline_used;
+                m_inline_used += size;
+                return ptr;
+            }
+
+            for (; m_chunk < m_chunks.size(); m_chunk++) {
+                Chunk& chunk = m_chunks[m_chunk];
+                if (chunk.size - chunk.used >= size) {
+                    mfxU8* ptr = chunk.data.get() + chunk.used;
+                    chunk.used += size;
+                    return ptr;
+                }
+            }
+
+            size_t chunk_size = m_chunks.empty() ? min_chunk_size : 2 * m_chunks.back().size;
+            Chunk chunk;
+            chunk.size = std::max(size, chunk_size);
+            chunk.used = size;
+            chunk.data.reset(new mfxU8[chunk.size]);
+            m_chunks.push_back(std::move(chunk));
+            m_chunk = m_chunks.size() - 1;
+            return m_chunks.back().data.get();
+        }
+
+        void Clear() {
+            m_inline_used = 0;
+            for (auto& chunk : m_chunks) {
+                chunk.used = 0;
+            }
+            m_chunk = 0;
+        }
+
+        bool IsInline(const void* ptr) const {
+            return std::less_equal<const void*>()(m_inline, ptr) &&
+                   std::less<const void*>()(ptr, m_inline + inline_size);
+        }
+
+        // takes all memory of other arena, buffers from its inline storage are copied to the same
+        // offsets, so their new location is Relocate(ptr)
+        void Take(ExtBufArena& other) {
+            memcpy(m_inline, other.m_inline, other.m_inline_used);
+            m_inline_used = other.m_inline_used;
+            m_chunks      = std::move(other.m_chunks);
+            m_chunk       = other.m_chunk;
+
+            other.m_chunks.clear();
+            other.Clear();
+        }
+
+        mfxU8* Relocate(const ExtBufArena& other, mfxU8* ptr) {
+            return other.IsInline(ptr) ? m_inline + (ptr - other.m_inline) : ptr;
+        }
+
+    private:
+        enum { alignment = 8, inline_size = 256, min_chunk_size = 4096 };
+
+        struct Chunk {
+            std::unique_ptr<mfxU8[]> data;
+            size_t size = 0;
+            size_t used = 0;
+        };
+
+        alignas(alignment) mfxU8 m_inline[inline_size];
+        size_t m_inline_used;
+        std::vector<Chunk> m_chunks;
+        size_t m_chunk; // first chunk which may have space
+
+        ExtBufArena(const ExtBufArena&);
+        void operator=(const ExtBufArena&);
+    };
+
     mfxExtBuffer* AddExtBuffer(mfxU32 id, mfxU32 size, bool isPairedExtBuffer) {
         if (!size || !id)
             throw mfxError(MFX_ERR_NULL_PTR, "AddExtBuffer: wrong size or id!");
 
         auto it = std::find_if(m_ext_buf.begin(), m_ext_buf.end(), CmpExtBufById(id));
         if (it == m_ext_buf.end()) {
-            auto buf = (mfxExtBuffer*)new mfxU8[size];
+            auto buf = (mfxExtBuffer*)m_arena.Alloc(size);
             memset(buf, 0, size);
             m_ext_buf.push_back(buf);
 
@@ -666,7 +813,7 @@ private:
 
             if (isPairedExtBuffer) {
                 // Allocate the other mfxExtBuffer _right_after_ the first one ...
-                buf = (mfxExtBuffer*)new mfxU8[size];
+                buf = (mfxExtBuffer*)m_arena.Alloc(size);
                 memset(buf, 0, size);
                 m_ext_buf.push_back(buf);
 
@@ -700,13 +847,23 @@ private:
     }
 
     void ClearBuffers() {
-        if (m_ext_buf.size()) {
-            for (auto it = m_ext_buf.begin(); it != m_ext_buf.end(); it++) {
-                delete[](mfxU8*)(*it);
-            }
-            m_ext_buf.clear();
+        m_ext_buf.clear();
+        m_arena.Clear();
+        RefreshBuffers();
+    }
+
+    void MoveBuffers(ExtBufHolder& ref) {
+        T* dst_base       = this;
+        const T* src_base = &ref;
+        *dst_base         = *src_base;
+
+        m_arena.Take(ref.m_arena);
+        m_ext_buf.Take(ref.m_ext_buf);
+        for (auto& buf : m_ext_buf) {
+            buf = (mfxExtBuffer*)m_arena.Relocate(ref.m_arena, (mfxU8*)buf);
         }
         RefreshBuffers();
+        ref.RefreshBuffers();
     }
 
     bool IsCopyAllowed(mfxU32 id) {
@@ -744,7 +901,8 @@ private:
         return s;
     }
 
-    std::vector<mfxExtBuffer*> m_ext_buf;
+    ExtBufList m_ext_buf;
+    ExtBufArena m_arena;
 };
 
 using MfxVideoParamsWrapper = ExtBufHolder<mfxVideoParam>;
@@ -784,7 +942,8 @@ public:
         if (MaxLength >= n_bytes)
             return;
 
-        m_data.reserve(n_bytes);
+        // data is kept, readers extend the bitstream which holds a part of the stream
+        m_data.resize(n_bytes);
 
         Data      = m_data.data();
         MaxLength = n_bytes;
@@ -828,6 +987,8 @@ public:
                                      bool isPrint         = true,
                                      bool isCompleteFrame = true);
     virtual mfxStatus WriteNextFrame(mfxBitstream* pMfxBitstream, mfxU32 targetID, mfxU32 frameNum);
+    virtual mfxStatus GetWrittenFrames(mfxU32 targetID, std::vector<mfxBitstream*>& written);
+    virtual mfxStatus WaitForWrittenFrames(mfxU32 targetID, mfxU32 timeout);
     virtual mfxStatus Reset();
     virtual void Close();
     mfxU32 m_nProcessedFramesNum;
@@ -878,6 +1039,9 @@ public:
     virtual void Close();
     virtual mfxStatus Init(const char* strFileName);
     virtual mfxStatus ReadNextFrame(mfxBitstream* pBS);
+    //moves position to given offset, e.g. to key frame found in CAUIndex, prefix is read
+    //before the data at the offset, e.g. parameter sets the key frame refers to
+    virtual mfxStatus Seek(mfxU64 offset, const std::vector<mfxU8>& prefix = {});
 
 protected:
     CSmplBitstreamReader(CSmplBitstreamReader const&)                  = delete;
@@ -885,33 +1049,55 @@ protected:
 
     FILE* m_fSource;
     bool m_bInited;
+    std::vector<mfxU8> m_prefix;
+    size_t m_prefixPos;
 };
 
-class CH264FrameReader : public CSmplBitstreamReader {
+//provides output bistream with exactly 1 frame assembled by splitter of given codec
+class CSplitterFrameReader : public CSmplBitstreamReader {
 public:
-    CH264FrameReader();
-    virtual ~CH264FrameReader();
+    explicit CSplitterFrameReader(mfxU32 codecId);
+    virtual ~CSplitterFrameReader();
 
     /** Free resources.*/
     virtual void Close();
+    virtual void Reset();
     virtual mfxStatus Init(const char* strFileName);
     virtual mfxStatus ReadNextFrame(mfxBitstream* pBS);
+    virtual mfxStatus Seek(mfxU64 offset, const std::vector<mfxU8>& prefix = {});
 
 private:
-    mfxBitstream* m_processedBS;
+    mfxU32 m_codecId;
+
     // input bit stream
     mfxBitstreamWrapper m_originalBS;
 
-    mfxStatus PrepareNextFrame(mfxBitstream* in, mfxBitstream** out);
+    // splitter assembles frame right in the output bitstream
+    mfxStatus PrepareNextFrame(mfxBitstream* in, mfxBitstream* out);
+
+    void ResetSplitter();
 
     // is stream ended
     bool m_isEndOfStream;
 
     std::unique_ptr<AbstractSplitter> m_pNALSplitter;
     FrameSplitterInfo* m_frame;
-    mfxU8* m_plainBuffer;
-    mfxU32 m_plainBufferSize;
-    mfxBitstream m_outBS;
+};
+
+class CH264FrameReader : public CSplitterFrameReader {
+public:
+    CH264FrameReader() : CSplitterFrameReader(MFX_CODEC_AVC) {}
+};
+
+class CHEVCFrameReader : public CSplitterFrameReader {
+public:
+    CHEVCFrameReader() : CSplitterFrameReader(MFX_CODEC_HEVC) {}
+};
+
+// reads AV1 stream in Annex B or low overhead format, IVF files are read by CIVFFrameReader
+class CAV1FrameReader : public CSplitterFrameReader {
+public:
+    CAV1FrameReader() : CSplitterFrameReader(MFX_CODEC_AV1) {}
 };
 
 //provides output bistream with at least 1 frame, reports about error
@@ -1388,6 +1574,11 @@ inline mfxStatus msdk_opt_read(const std::string& string, T& value) {
     return msdk_opt_read(string.c_str(), value);
 }
 
+// reads list of CPUs like "0-3,8,10-11", the result is sorted and has no duplicates
+mfxStatus ParseCpuList(const char* string, std::vector<mfxU32>& cpus);
+// makes list of sorted CPUs in the same format
+std::string CpuListToString(const std::vector<mfxU32>& cpus);
+
 mfxStatus StrFormatToCodecFormatFourCC(char* strInput, mfxU32& codecFormat);
 const char* StatusToString(mfxStatus sts);
 mfxI32 getMonitorType(char* str);
@@ -1569,22 +1760,41 @@ private:
     using CSmplBitstreamWriter::WriteNextFrame;
 };
 
+// Writes GOPs encoded by several encoders to one file in display order. Frame which arrives
+// ahead of its turn is held by reference, WriteNextFrame returns MFX_WRN_IN_EXECUTION and
+// the caller keeps the bitstream intact until GetWrittenFrames returns it. Frames which become
+// in order are written to the file at once.
+// Encoders either interleave GOPs of m_GopSize frames or, if segments are added, each of them
+// encodes one continuous segment of the stream.
 class CBitstreamWriterForParallelEncoding : public CSmplBitstreamWriter {
 public:
     virtual mfxStatus WriteNextFrame(mfxBitstream* pMfxBitstream, mfxU32 targetID, mfxU32 frameNum);
+    virtual mfxStatus GetWrittenFrames(mfxU32 targetID, std::vector<mfxBitstream*>& written);
+    virtual mfxStatus WaitForWrittenFrames(mfxU32 targetID, mfxU32 timeout);
     virtual mfxStatus Reset();
 
+    // frames of the encoder go to the file starting from firstFrame, the first skipFrames
+    // frames only warm up the encoder and are discarded
+    void AddSegment(mfxU32 targetID, mfxU32 firstFrame, mfxU32 skipFrames);
+
+    // maximum number of frames which have been held at once
+    mfxU32 GetMaxReorderDepth();
+
     mfxU32 m_GopSize          = 0;
     mfxU32 m_NumberOfEncoders = 0;
     mfxU32 m_BaseEncoderID    = 0;
     bool m_WriteBsToStdout    = false;
 
 private:
-    int m_LastWrittenFrameNumber = -1;
+    mfxStatus WriteFrames(const std::vector<mfxBitstream*>& frames);
+
+    mfxU32 m_NextFrameNumber = 0;
     std::mutex m_Mutex{};
-    std::map<mfxU32, std::vector<mfxU8>> m_Buffer{}; //key is targetID
-    std::map<mfxU32, mfxU32> m_FirstFrameInBuffer{}; //key is target ID
-    std::map<mfxU32, mfxU32> m_LastFrameInBuffer{}; //key is target ID
+    std::condition_variable m_FramesWritten{};
+    std::map<mfxU32, std::pair<mfxU32, mfxBitstream*>> m_HeldFrames{}; //key is global frame number
+    std::map<mfxU32, std::vector<mfxBitstream*>> m_WrittenFrames{}; //key is target ID
+    std::map<mfxU32, std::pair<mfxU32, mfxU32>> m_Segments{}; //first and skipped frames
+    mfxU32 m_MaxReorderDepth = 0;
 };
 
 mfxStatus SetParameters(mfxSession session, MfxVideoParamsWrapper& par, const std::string& params);
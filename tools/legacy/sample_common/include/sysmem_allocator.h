@@ -8,6 +8,8 @@
 #define __SYSMEM_ALLOCATOR_H__
 
 #include <stdlib.h>
+#include <list>
+#include <mutex>
 #include <vector>
 #include "base_allocator.h"
 
@@ -15,6 +17,7 @@ struct sBuffer {
     mfxU32 id;
     mfxU32 nbytes;
     mfxU16 type;
+    size_t mappedSize; // size of mapped memory, 0 if buffer is allocated on the heap
 };
 
 struct sFrame {
@@ -22,9 +25,53 @@ struct sFrame {
     mfxFrameInfo info;
 };
 
+// frames of one response carved from a single allocation
+struct sSlab {
+    mfxU32 id;
+    mfxU32 refCount; // frames of the slab which are not released yet
+    void* memory; // pointer to free
+    size_t mappedSize; // size of mapped memory, 0 if slab is allocated on the heap
+};
+
+struct sSlabFrame {
+    sFrame frame;
+    sSlab* slab;
+    mfxU8* data;
+};
+
+enum {
+    SYSMEM_NUMA_NODE_ANY   = -1, // memory is placed by the system on first touch
+    SYSMEM_NUMA_NODE_LOCAL = -2 // node of CPUs the allocating thread is pinned to
+};
+
+// Placement of system memory, supported on Linux only. Huge pages are explicit (MAP_HUGETLB)
+// if they are reserved in the system, transparent otherwise. NUMA node is preferred, memory
+// comes from other nodes if the node is out of memory.
+struct SysMemPlacement {
+    SysMemPlacement() : bHugePages(false), NumaNode(SYSMEM_NUMA_NODE_ANY) {}
+    bool bHugePages;
+    mfxI32 NumaNode; // node id or SYSMEM_NUMA_NODE_*
+};
+
 struct SysMemAllocatorParams : mfxAllocatorParams {
-    SysMemAllocatorParams() : mfxAllocatorParams(), pBufferAllocator(NULL) {}
+    SysMemAllocatorParams()
+            : mfxAllocatorParams(),
+              pBufferAllocator(NULL),
+              bUseSlab(false),
+              bZeroInit(false),
+              bUsePool(false) {}
     MFXBufferAllocator* pBufferAllocator;
+    // allocate all frames of a response at once with page aligned planes, pBufferAllocator
+    // isn't used for frames then
+    bool bUseSlab;
+    // zero slab memory including frames reused from the pool, otherwise frames have undefined
+    // content until they are written
+    bool bZeroInit;
+    // keep released frames and reuse them for frames of the same FourCC and size, including
+    // reallocated ones, reused frames keep their previous content unless bZeroInit is set
+    bool bUsePool;
+    // placement of frames and of buffers of own buffer allocator
+    SysMemPlacement Placement;
 };
 
 class SysMemFrameAllocator : public BaseFrameAllocator {
@@ -41,6 +88,7 @@ public:
 protected:
     virtual mfxStatus CheckRequestType(mfxFrameAllocRequest* request);
     virtual mfxStatus ReleaseResponse(mfxFrameAllocResponse* response);
+    virtual mfxStatus ReleaseFrameImpl(mfxFrameAllocResponse* response, mfxU16 index);
     virtual mfxStatus AllocImpl(mfxFrameAllocRequest* request, mfxFrameAllocResponse* response);
     virtual mfxStatus ReallocImpl(mfxMemId midIn,
                                   const mfxFrameInfo* info,
@@ -54,8 +102,42 @@ protected:
         return MFX_ERR_NONE;
     }
 
+    mfxStatus AllocSlab(const mfxFrameInfo& info, mfxU32 nbytes, mfxU16 numFrames, mfxMemId* mids);
+    void FreeSlabFrame(mfxMemId mid);
+
+    // single frame from the pool or from new memory
+    mfxStatus AllocFrame(const mfxFrameInfo& info, mfxU32 nbytes, mfxU16 type, mfxMemId* mid);
+    // returns frame to the pool or frees it
+    mfxStatus ReleaseFrame(mfxMemId mid);
+    mfxStatus FreeFrame(mfxMemId mid);
+    mfxStatus GetFrameInfo(mfxMemId mid, mfxFrameInfo* info);
+    mfxStatus SetFrameInfo(mfxMemId mid, const mfxFrameInfo& info);
+
+    bool TakePooledFrame(mfxU32 fourCC, size_t size, mfxMemId* mid);
+    void AddInUse(size_t size);
+    // frees pooled frames above the limit, the least recently released ones first
+    void TrimPool(size_t limit);
+
     MFXBufferAllocator* m_pBufferAllocator;
     bool m_bOwnBufferAllocator;
+    bool m_bUseSlab;
+    bool m_bZeroInit;
+    bool m_bUsePool;
+    SysMemPlacement m_placement;
+
+    struct PooledFrame {
+        mfxU32 FourCC;
+        size_t size; // page aligned size of frame data
+        mfxMemId mid;
+    };
+
+    // released frames, the most recently released frame is the last one
+    std::list<PooledFrame> m_pool;
+    std::mutex m_poolMutex;
+    size_t m_pooledBytes;
+    size_t m_inUseBytes;
+    // pool never keeps more memory than frames have ever used at once
+    size_t m_peakInUseBytes;
 
     std::vector<mfxFrameAllocResponse*> m_vResp;
 
@@ -64,12 +146,15 @@ protected:
 
 class SysMemBufferAllocator : public MFXBufferAllocator {
 public:
-    SysMemBufferAllocator();
+    SysMemBufferAllocator(const SysMemPlacement& placement = SysMemPlacement());
     virtual ~SysMemBufferAllocator();
     virtual mfxStatus AllocBuffer(mfxU32 nbytes, mfxU16 type, mfxMemId* mid);
     virtual mfxStatus LockBuffer(mfxMemId mid, mfxU8** ptr);
     virtual mfxStatus UnlockBuffer(mfxMemId mid);
     virtual mfxStatus FreeBuffer(mfxMemId mid);
+
+protected:
+    SysMemPlacement m_placement;
 };
 
 #endif // __SYSMEM_ALLOCATOR_H__
\ No newline at end of file
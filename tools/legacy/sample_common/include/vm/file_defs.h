@@ -15,12 +15,18 @@
 
     #define MSDK_FOPEN(file, name, mode) fopen_s(&file, name, mode)
 
+    #define MSDK_FSEEK64(file, offset, origin) _fseeki64(file, offset, origin)
+    #define MSDK_FTELL64(file)                 _ftelli64(file)
+
     #define msdk_fgets _fgetts
 #else // #if defined(_WIN32) || defined(_WIN64)
     #include <unistd.h>
 
     #define MSDK_FOPEN(file, name, mode) (file = fopen(name, mode))
 
+    #define MSDK_FSEEK64(file, offset, origin) fseeko(file, (off_t)(offset), origin)
+    #define MSDK_FTELL64(file)                 ftello(file)
+
     #define msdk_fgets fgets
 #endif // #if defined(_WIN32) || defined(_WIN64)
 
@@ -7,6 +7,8 @@
 #ifndef __THREAD_DEFS_H__
 #define __THREAD_DEFS_H__
 
+#include <vector>
+
 #include "vm/strings_defs.h"
 #include "vpl/mfxdefs.h"
 
@@ -35,22 +37,30 @@ struct msdkThreadHandle {
     #include <pthread.h>
     #include <sys/resource.h>
     #include <sys/time.h>
+    #include <atomic>
 
+// Semaphore and event are futexes: waiters spin for a while first (see thread_linux.cpp) and
+// park in the kernel only if the wait is long, so signaling thread enters the kernel only when
+// there are parked waiters.
 struct msdkSemaphoreHandle {
-    msdkSemaphoreHandle(mfxU32 count) : m_count(count) {}
+    msdkSemaphoreHandle(mfxU32 count) : m_count(count), m_waiters(0), m_avgWait(0) {}
 
-    mfxU32 m_count;
-    pthread_cond_t m_semaphore;
-    pthread_mutex_t m_mutex;
+    std::atomic<mfxU32> m_count; // futex word
+    std::atomic<mfxU32> m_waiters; // threads which park or are about to park
+    std::atomic<mfxU32> m_avgWait; // recent wait time in ns, defines the spin phase
 };
 
 struct msdkEventHandle {
-    msdkEventHandle(bool manual, bool state) : m_manual(manual), m_state(state) {}
+    msdkEventHandle(bool manual, bool state)
+            : m_manual(manual),
+              m_state(state ? 1 : 0),
+              m_waiters(0),
+              m_avgWait(0) {}
 
     bool m_manual;
-    bool m_state;
-    pthread_cond_t m_event;
-    pthread_mutex_t m_mutex;
+    std::atomic<mfxU32> m_state; // futex word, 1 - signaled
+    std::atomic<mfxU32> m_waiters; // threads which park or are about to park
+    std::atomic<mfxU32> m_avgWait; // recent wait time in ns, defines the spin phase
 };
 
 class MSDKEvent;
@@ -121,4 +131,11 @@ mfxStatus msdk_setrlimit_vmem(mfxU64 size);
 mfxStatus msdk_thread_get_schedtype(const char*, mfxI32& type);
 void msdk_thread_printf_scheduling_help();
 
+// CPUs the calling thread may run on, threads which it creates inherit them (Linux only)
+mfxStatus msdk_thread_set_affinity(const std::vector<mfxU32>& cpus);
+mfxStatus msdk_thread_get_affinity(std::vector<mfxU32>& cpus);
+// online NUMA nodes and their CPUs (Linux only)
+mfxStatus msdk_get_numa_nodes(std::vector<mfxU32>& nodes);
+mfxStatus msdk_get_numa_node_cpus(mfxU32 node, std::vector<mfxU32>& cpus);
+
 #endif //__THREAD_DEFS_H__
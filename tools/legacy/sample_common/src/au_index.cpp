@@ -0,0 +1,872 @@
+/*############################################################################
+  # Copyright (C) 2024 Intel Corporation
+  #
+  # SPDX-License-Identifier: MIT
+  ############################################################################*/
+
+#include "au_index.h"
+
+#include <string.h>
+#include <sys/stat.h>
+#include <algorithm>
+
+#include "avc_spl.h"
+#include "hevc_spl.h"
+#include "sample_defs.h"
+#include "vm/file_defs.h"
+
+using namespace ProtectedLibrary;
+
+namespace {
+
+const mfxU32 AU_INDEX_SIGNATURE = MFX_MAKEFOURCC('A', 'U', 'I', 'X');
+const mfxU32 AU_INDEX_VERSION   = 3;
+
+// size of saved entry and parameter set, see CAUIndex::Save
+const mfxU64 AU_INDEX_ENTRY_SIZE     = 24;
+const mfxU64 AU_INDEX_PARAM_SET_SIZE = 16;
+
+bool GetFileInfo(const char* strFileName, mfxU64& size, mfxU64& time) {
+#if defined(_WIN32) || defined(_WIN64)
+    struct _stat64 st;
+    if (_stat64(strFileName, &st))
+        return false;
+#else
+    struct stat st;
+    if (stat(strFileName, &st))
+        return false;
+#endif
+    size = (mfxU64)st.st_size;
+    time = (mfxU64)st.st_mtime;
+    return true;
+}
+
+// iterates over NAL units of Annex-B stream and reports their position in the file
+class CNalUnitReader {
+public:
+    explicit CNalUnitReader(FILE* pFile)
+            : m_pFile(pFile),
+              m_buffer(4 * 1024 * 1024),
+              m_begin(0),
+              m_end(0),
+              m_bufferOffset(0),
+              m_dataOffset(0),
+              m_bZeroByte(false),
+              m_bEOF(false) {}
+
+    // returns false at the end of stream, data is valid till the next call
+    bool Next(mfxU64& offset, mfxU8*& data, mfxU32& size) {
+        // start code of the current NAL unit
+        for (;;) {
+            mfxU8* sc = FindStartCodePrefix(Begin(), End());
+            if (sc != End()) {
+                m_begin = sc - &m_buffer[0];
+                break;
+            }
+            // keep possible beginning of split start code
+            m_begin = m_end - std::min<size_t>(m_end - m_begin, 2);
+            if (!Fill())
+                return false;
+        }
+
+        // start code of the next one is the end of current
+        for (;;) {
+            mfxU8* next = FindStartCodePrefix(Begin() + 3, End());
+            if (next == End() && !m_bEOF) {
+                if (!Fill())
+                    m_bEOF = true;
+                continue;
+            }
+
+            offset       = m_bufferOffset + m_begin - (m_bZeroByte ? 1 : 0);
+            data         = Begin() + 3;
+            m_dataOffset = m_bufferOffset + m_begin + 3;
+
+            mfxU8* last = next;
+            while (last > data && !last[-1])
+                last--;
+            m_bZeroByte = (last != next);
+
+            size    = (mfxU32)(last - data);
+            m_begin = next - &m_buffer[0];
+            return true;
+        }
+    }
+
+    mfxU64 GetPosition() const {
+        return m_bufferOffset + m_end;
+    }
+
+    // position of data returned by the last Next, i.e. of the NAL unit after its start code
+    mfxU64 GetDataOffset() const {
+        return m_dataOffset;
+    }
+
+protected:
+    mfxU8* Begin() {
+        return &m_buffer[0] + m_begin;
+    }
+    mfxU8* End() {
+        return &m_buffer[0] + m_end;
+    }
+
+    bool Fill() {
+        if (m_begin) {
+            memmove(&m_buffer[0], Begin(), m_end - m_begin);
+            m_bufferOffset += m_begin;
+            m_end -= m_begin;
+            m_begin = 0;
+        }
+        if (m_end == m_buffer.size())
+            m_buffer.resize(m_buffer.size() * 2);
+
+        size_t nBytesRead = fread(End(), 1, m_buffer.size() - m_end, m_pFile);
+        m_end += nBytesRead;
+        return nBytesRead != 0;
+    }
+
+    FILE* m_pFile;
+    std::vector<mfxU8> m_buffer;
+    size_t m_begin;
+    size_t m_end;
+    mfxU64 m_bufferOffset;
+    mfxU64 m_dataOffset;
+    bool m_bZeroByte;
+    bool m_bEOF;
+};
+
+class CBitReader {
+public:
+    CBitReader(const mfxU8* data, mfxU32 size) : m_data(data), m_size(size), m_pos(0) {}
+
+    mfxU32 GetBits(mfxU32 n) {
+        mfxU32 value = 0;
+        for (; n; n--, m_pos++) {
+            mfxU32 bit = (m_pos < m_size * 8) ? (m_data[m_pos >> 3] >> (7 - (m_pos & 7))) & 1 : 0;
+            value      = (value << 1) | bit;
+        }
+        return value;
+    }
+
+    // ue(v), 9.1 of AVC standard
+    mfxU32 GetUE() {
+        mfxU32 zeros = 0;
+        while (zeros < 32 && !GetBits(1))
+            zeros++;
+        return zeros < 32 ? (1u << zeros) - 1 + GetBits(zeros) : 0;
+    }
+
+protected:
+    const mfxU8* m_data;
+    mfxU32 m_size;
+    mfxU32 m_pos;
+};
+
+mfxU16 GetFrameType(const FrameSplitterInfo* frame) {
+    mfxU16 type = MFX_FRAMETYPE_I;
+    for (mfxU32 i = 0; i < frame->SliceNum; i++) {
+        if (frame->Slice[i].SliceType == TYPE_B)
+            return MFX_FRAMETYPE_B;
+        if (frame->Slice[i].SliceType == TYPE_P)
+            type = MFX_FRAMETYPE_P;
+    }
+    return type;
+}
+
+// adds access unit found by one of Annex-B splitters
+void AddEntry(std::vector<AUIndexEntry>& entries,
+              mfxU64 auStart,
+              mfxU64 auEnd,
+              const FrameSplitterInfo* frame,
+              bool bIDR,
+              mfxU32 frameRateExtN,
+              mfxU32 frameRateExtD) {
+    AUIndexEntry entry = {};
+    entry.Offset       = auStart;
+    entry.Size         = (mfxU32)(auEnd - auStart);
+    entry.FrameType    = GetFrameType(frame);
+    entry.KeyFrame     = bIDR;
+    entry.TimeStamp    = (mfxU64)MFX_TIMESTAMP_UNKNOWN;
+    if (bIDR)
+        entry.FrameType |= MFX_FRAMETYPE_IDR;
+    if (frameRateExtN && frameRateExtD)
+        entry.TimeStamp = (mfxU64)entries.size() * 90000 * frameRateExtD / frameRateExtN;
+    entries.push_back(entry);
+}
+
+// first bytes of NAL unit payload with emulation prevention bytes removed
+std::vector<mfxU8> GetRBSP(const mfxU8* data, mfxU32 size, mfxU32 maxSize) {
+    std::vector<mfxU8> rbsp;
+    mfxU32 zeros = 0;
+    for (mfxU32 i = 0; i < size && rbsp.size() < maxSize; i++) {
+        if (zeros >= 2 && data[i] == 3) {
+            zeros = 0;
+            continue;
+        }
+        zeros = data[i] ? 0 : zeros + 1;
+        rbsp.push_back(data[i]);
+    }
+    return rbsp;
+}
+
+// id of AVC SPS or PPS, data starts from NAL unit header
+mfxU16 GetAVCParamSetId(const mfxU8* data, mfxU32 size, mfxU8 nalType) {
+    std::vector<mfxU8> rbsp = GetRBSP(data + 1, size - 1, 16);
+    CBitReader bs(rbsp.data(), (mfxU32)rbsp.size());
+    if (nalType == NAL_UT_SPS)
+        bs.GetBits(24); // profile_idc, constraint flags, level_idc
+    return (mfxU16)bs.GetUE();
+}
+
+// id of HEVC VPS, SPS or PPS, data starts from NAL unit header
+mfxU16 GetHEVCParamSetId(const mfxU8* data, mfxU32 size, mfxU8 nalType) {
+    // enough for profile_tier_level() of 7 sub-layers
+    std::vector<mfxU8> rbsp = GetRBSP(data + 2, size - 2, 128);
+    CBitReader bs(rbsp.data(), (mfxU32)rbsp.size());
+    if (nalType == HEVC_NAL_UT_VPS)
+        return (mfxU16)bs.GetBits(4);
+    if (nalType == HEVC_NAL_UT_PPS)
+        return (mfxU16)bs.GetUE();
+
+    bs.GetBits(4); // sps_video_parameter_set_id
+    mfxU32 maxSubLayersMinus1 = bs.GetBits(3);
+    bs.GetBits(1); // sps_temporal_id_nesting_flag
+
+    // profile_tier_level(), 7.3.3 of HEVC standard: 88 bits of general profile and level_idc
+    bs.GetBits(32);
+    bs.GetBits(32);
+    bs.GetBits(32);
+    mfxU32 profilePresent = 0, levelPresent = 0;
+    for (mfxU32 i = 0; i < maxSubLayersMinus1; i++) {
+        profilePresent |= bs.GetBits(1) << i;
+        levelPresent |= bs.GetBits(1) << i;
+    }
+    if (maxSubLayersMinus1)
+        bs.GetBits(2 * (8 - maxSubLayersMinus1)); // reserved_zero_2bits
+    for (mfxU32 i = 0; i < maxSubLayersMinus1; i++) {
+        if (profilePresent & (1 << i)) {
+            bs.GetBits(32);
+            bs.GetBits(32);
+            bs.GetBits(24);
+        }
+        if (levelPresent & (1 << i))
+            bs.GetBits(8);
+    }
+    return (mfxU16)bs.GetUE();
+}
+
+void AddParamSet(std::vector<AUIndexParamSet>& paramSets,
+                 mfxU16 type,
+                 mfxU16 id,
+                 mfxU64 offset,
+                 mfxU64 end) {
+    AUIndexParamSet paramSet = {};
+    paramSet.Offset          = offset;
+    paramSet.Size            = (mfxU32)(end - offset);
+    paramSet.Type            = type;
+    paramSet.Id              = id;
+    paramSets.push_back(paramSet);
+}
+
+bool IsVP8KeyFrame(const mfxU8* data, mfxU32 size) {
+    return size && !(data[0] & 1);
+}
+
+bool IsVP9KeyFrame(const mfxU8* data, mfxU32 size) {
+    CBitReader bs(data, size);
+    if (bs.GetBits(2) != 2) // frame_marker
+        return false;
+
+    mfxU32 profile = bs.GetBits(1);
+    profile |= bs.GetBits(1) << 1;
+    if (profile == 3)
+        bs.GetBits(1); // reserved_zero
+
+    if (bs.GetBits(1)) // show_existing_frame
+        return false;
+
+    return bs.GetBits(1) == 0; // frame_type
+}
+
+bool IsAV1KeyFrame(const mfxU8* data, mfxU32 size) {
+    enum { OBU_SEQUENCE_HEADER = 1, OBU_FRAME_HEADER = 3, OBU_FRAME = 6 };
+
+    bool bSeqHeader   = false;
+    bool bReducedHdr  = false;
+    const mfxU8* end  = data + size;
+    const mfxU8* next = data;
+
+    for (const mfxU8* obu = data; obu < end; obu = next) {
+        mfxU8 header  = *obu++;
+        mfxU8 obuType = (header >> 3) & 0xf;
+
+        if ((header & 0x4) && obu < end) // obu_extension_flag
+            obu++;
+
+        mfxU64 obuSize = end - obu;
+        if (header & 0x2) { // obu_has_size_field, leb128
+            obuSize = 0;
+            for (mfxU32 i = 0; i < 8 && obu < end; i++) {
+                mfxU8 byte = *obu++;
+                obuSize |= (mfxU64)(byte & 0x7f) << (i * 7);
+                if (!(byte & 0x80))
+                    break;
+            }
+        }
+        if (obuSize > (mfxU64)(end - obu))
+            return false;
+        next = obu + obuSize;
+
+        CBitReader bs(obu, (mfxU32)obuSize);
+        if (obuType == OBU_SEQUENCE_HEADER) {
+            bs.GetBits(3); // seq_profile
+            bs.GetBits(1); // still_picture
+            bReducedHdr = bs.GetBits(1) != 0;
+            bSeqHeader  = true;
+        }
+        else if (obuType == OBU_FRAME_HEADER || obuType == OBU_FRAME) {
+            // decoding can start only where sequence header is repeated
+            if (!bSeqHeader)
+                return false;
+            if (bReducedHdr)
+                return true;
+            if (bs.GetBits(1)) // show_existing_frame
+                return false;
+            return bs.GetBits(2) == 0; // KEY_FRAME
+        }
+    }
+
+    return false;
+}
+
+} // namespace
+
+CAUIndex::CAUIndex() : m_entries(), m_paramSets(), m_codecId(0), m_streamSize(0), m_streamTime(0) {}
+
+void CAUIndex::Clear() {
+    m_entries.clear();
+    m_paramSets.clear();
+    m_codecId    = 0;
+    m_streamSize = 0;
+    m_streamTime = 0;
+}
+
+mfxStatus CAUIndex::Build(const char* strFileName,
+                          mfxU32 codecId,
+                          mfxU32 frameRateExtN,
+                          mfxU32 frameRateExtD) {
+    MSDK_CHECK_POINTER(strFileName, MFX_ERR_NULL_PTR);
+
+    Clear();
+
+    mfxU64 streamSize = 0, streamTime = 0;
+    if (!GetFileInfo(strFileName, streamSize, streamTime))
+        return MFX_ERR_NOT_FOUND;
+
+    FILE* pFile = NULL;
+    MSDK_FOPEN(pFile, strFileName, "rb");
+    MSDK_CHECK_POINTER(pFile, MFX_ERR_NULL_PTR);
+
+    mfxStatus sts = MFX_ERR_UNSUPPORTED;
+    switch (codecId) {
+        case MFX_CODEC_AVC:
+            sts = BuildAVC(pFile, frameRateExtN, frameRateExtD);
+            break;
+        case MFX_CODEC_HEVC:
+            sts = BuildHEVC(pFile, frameRateExtN, frameRateExtD);
+            break;
+        case MFX_CODEC_VP8:
+        case MFX_CODEC_VP9:
+        case MFX_CODEC_AV1:
+            sts = BuildIVF(pFile, streamSize);
+            break;
+        default:
+            break;
+    }
+    fclose(pFile);
+
+    if (sts != MFX_ERR_NONE) {
+        Clear();
+        return sts;
+    }
+
+    m_codecId    = codecId;
+    m_streamSize = streamSize;
+    m_streamTime = streamTime;
+    return MFX_ERR_NONE;
+}
+
+mfxStatus CAUIndex::LoadOrBuild(const char* strFileName,
+                                mfxU32 codecId,
+                                mfxU32 frameRateExtN,
+                                mfxU32 frameRateExtD) {
+    MSDK_CHECK_POINTER(strFileName, MFX_ERR_NULL_PTR);
+
+    std::string strIndexFile = GetDefaultIndexName(strFileName);
+    if (Load(strIndexFile.c_str(), strFileName) == MFX_ERR_NONE && m_codecId == codecId)
+        return MFX_ERR_NONE;
+
+    mfxStatus sts = Build(strFileName, codecId, frameRateExtN, frameRateExtD);
+    if (sts != MFX_ERR_NONE)
+        return sts;
+
+    // index is a cache, the stream may be in read-only location
+    if (Save(strIndexFile.c_str()) != MFX_ERR_NONE)
+        printf("WARNING: failed to save index of %s\n", strFileName);
+
+    return MFX_ERR_NONE;
+}
+
+mfxStatus CAUIndex::BuildAVC(FILE* pFile, mfxU32 frameRateExtN, mfxU32 frameRateExtD) {
+    AVC_Spl splitter;
+    CNalUnitReader reader(pFile);
+
+    // splitter keeps the first slice of the next frame by reference,
+    // so the previous NAL unit has to stay valid while the current one is processed
+    std::vector<mfxU8> nalBuffers[2];
+    mfxU32 curBuffer = 0;
+
+    mfxU64 auStart           = 0;
+    mfxU64 auCandidate       = 0; // first NAL unit which may start the next access unit
+    bool bCandidate          = false;
+    bool bIDR                = false;
+    FrameSplitterInfo* frame = NULL;
+
+    mfxU64 offset = 0;
+    mfxU8* data   = NULL;
+    mfxU32 size   = 0;
+    while (reader.Next(offset, data, size)) {
+        if (!size)
+            continue;
+
+        mfxU8 nalType = data[0] & NAL_UNITTYPE_BITS;
+        bool bVCL     = (nalType >= NAL_UT_SLICE && nalType <= NAL_UT_IDR_SLICE) ||
+                    (nalType == NAL_UT_CODED_SLICE_EXTENSION);
+
+        // 7.4.1.2.3 of AVC standard, these NAL units precede the first slice of access unit
+        if ((nalType >= NAL_UT_SEI && nalType <= NAL_UT_AUD) ||
+            (nalType >= NAL_UT_SPS_EX && nalType <= 18)) {
+            if (!bCandidate) {
+                auCandidate = offset;
+                bCandidate  = true;
+            }
+        }
+
+        if (nalType == NAL_UT_SPS || nalType == NAL_UT_PPS)
+            AddParamSet(m_paramSets,
+                        nalType == NAL_UT_SPS ? AU_INDEX_SPS : AU_INDEX_PPS,
+                        GetAVCParamSetId(data, size, nalType),
+                        offset,
+                        reader.GetDataOffset() + size);
+
+        mfxU64 picStart = offset;
+        if (bVCL) {
+            if (bCandidate)
+                picStart = auCandidate;
+            bCandidate = false;
+        }
+
+        std::vector<mfxU8>& nal = nalBuffers[curBuffer];
+        curBuffer ^= 1;
+        nal.assign({ 0, 0, 1 });
+        nal.insert(nal.end(), data, data + size);
+
+        mfxBitstream bs = {};
+        bs.Data         = &nal[0];
+        bs.DataLength   = (mfxU32)nal.size();
+        bs.MaxLength    = bs.DataLength;
+        bs.DataFlag     = MFX_BITSTREAM_COMPLETE_FRAME;
+
+        if (splitter.GetFrame(&bs, &frame) == MFX_ERR_NONE && frame) {
+            AddEntry(m_entries, auStart, picStart, frame, bIDR, frameRateExtN, frameRateExtD);
+            splitter.ResetCurrentState();
+            auStart = picStart;
+            bIDR    = false;
+        }
+
+        if (nalType == NAL_UT_IDR_SLICE)
+            bIDR = true;
+    }
+
+    if (splitter.GetFrame(NULL, &frame) == MFX_ERR_NONE && frame)
+        AddEntry(m_entries,
+                 auStart,
+                 reader.GetPosition(),
+                 frame,
+                 bIDR,
+                 frameRateExtN,
+                 frameRateExtD);
+
+    return m_entries.empty() ? MFX_ERR_MORE_DATA : MFX_ERR_NONE;
+}
+
+mfxStatus CAUIndex::BuildHEVC(FILE* pFile, mfxU32 frameRateExtN, mfxU32 frameRateExtD) {
+    HEVC_Spl splitter;
+    CNalUnitReader reader(pFile);
+
+    // splitter detects the first NAL unit of the next access unit itself and keeps its copy
+    std::vector<mfxU8> nal;
+
+    mfxU64 auStart           = 0;
+    bool bIDR                = false;
+    FrameSplitterInfo* frame = NULL;
+
+    mfxU64 offset = 0;
+    mfxU8* data   = NULL;
+    mfxU32 size   = 0;
+    while (reader.Next(offset, data, size)) {
+        if (size < 2)
+            continue;
+
+        nal.assign({ 0, 0, 1 });
+        nal.insert(nal.end(), data, data + size);
+
+        mfxBitstream bs = {};
+        bs.Data         = &nal[0];
+        bs.DataLength   = (mfxU32)nal.size();
+        bs.MaxLength    = bs.DataLength;
+        bs.DataFlag     = MFX_BITSTREAM_COMPLETE_FRAME;
+
+        if (splitter.GetFrame(&bs, &frame) == MFX_ERR_NONE && frame) {
+            AddEntry(m_entries, auStart, offset, frame, bIDR, frameRateExtN, frameRateExtD);
+            splitter.ResetCurrentState();
+            auStart = offset;
+            bIDR    = false;
+        }
+
+        // CRA and BLA pictures are not key frames, their leading pictures are dropped by decoder
+        mfxU8 nalType = (data[0] >> 1) & 0x3f;
+        mfxU8 layerId = ((data[0] & 0x1) << 5) | (data[1] >> 3);
+        if (!layerId && (nalType == HEVC_NAL_UT_IDR_W_RADL || nalType == HEVC_NAL_UT_IDR_N_LP))
+            bIDR = true;
+
+        if (!layerId && nalType >= HEVC_NAL_UT_VPS && nalType <= HEVC_NAL_UT_PPS)
+            AddParamSet(m_paramSets,
+                        (mfxU16)(AU_INDEX_VPS + nalType - HEVC_NAL_UT_VPS),
+                        GetHEVCParamSetId(data, size, nalType),
+                        offset,
+                        reader.GetDataOffset() + size);
+    }
+
+    if (splitter.GetFrame(NULL, &frame) == MFX_ERR_NONE && frame)
+        AddEntry(m_entries,
+                 auStart,
+                 reader.GetPosition(),
+                 frame,
+                 bIDR,
+                 frameRateExtN,
+                 frameRateExtD);
+
+    return m_entries.empty() ? MFX_ERR_MORE_DATA : MFX_ERR_NONE;
+}
+
+mfxStatus CAUIndex::BuildIVF(FILE* pFile, mfxU64 fileSize) {
+    /*bytes 0-3    signature: 'DKIF'
+      bytes 6-7    length of header in bytes
+      bytes 8-11   codec FourCC
+      bytes 16-19  frame rate
+      bytes 20-23  time scale*/
+    mfxU8 hdr[32] = {};
+    if (fread(hdr, 1, sizeof(hdr), pFile) != sizeof(hdr))
+        return MFX_ERR_MORE_DATA;
+
+    mfxU32 dkif, codec, frameRate, timeScale;
+    mfxU16 headerLen;
+    MSDK_MEMCPY_VAR(dkif, hdr, sizeof(dkif));
+    MSDK_MEMCPY_VAR(headerLen, hdr + 6, sizeof(headerLen));
+    MSDK_MEMCPY_VAR(codec, hdr + 8, sizeof(codec));
+    MSDK_MEMCPY_VAR(frameRate, hdr + 16, sizeof(frameRate));
+    MSDK_MEMCPY_VAR(timeScale, hdr + 20, sizeof(timeScale));
+
+    MSDK_CHECK_NOT_EQUAL(MFX_MAKEFOURCC('D', 'K', 'I', 'F'), dkif, MFX_ERR_UNSUPPORTED);
+
+    bool (*IsKeyFrame)(const mfxU8*, mfxU32) = NULL;
+    if (codec == MFX_MAKEFOURCC('V', 'P', '8', '0'))
+        IsKeyFrame = IsVP8KeyFrame;
+    else if (codec == MFX_MAKEFOURCC('V', 'P', '9', '0'))
+        IsKeyFrame = IsVP9KeyFrame;
+    else if (codec == MFX_MAKEFOURCC('A', 'V', '0', '1'))
+        IsKeyFrame = IsAV1KeyFrame;
+    else
+        return MFX_ERR_UNSUPPORTED;
+
+    mfxU64 offset = headerLen;
+    MSDK_CHECK_NOT_EQUAL(MSDK_FSEEK64(pFile, offset, SEEK_SET), 0, MFX_ERR_UNSUPPORTED);
+
+    std::vector<mfxU8> frame;
+    for (;;) {
+        /*bytes 0-3    size of frame in bytes (not including the 12-byte header)
+          bytes 4-11   64-bit presentation timestamp*/
+        mfxU8 frameHdr[12];
+        if (fread(frameHdr, 1, sizeof(frameHdr), pFile) != sizeof(frameHdr))
+            break;
+
+        mfxU32 frameSize;
+        mfxU64 pts;
+        MSDK_MEMCPY_VAR(frameSize, frameHdr, sizeof(frameSize));
+        MSDK_MEMCPY_VAR(pts, frameHdr + 4, sizeof(pts));
+
+        // truncated or corrupted frame header ends the stream
+        if (frameSize > fileSize - std::min(fileSize, offset + sizeof(frameHdr)))
+            break;
+
+        frame.resize(frameSize);
+        if (frameSize && fread(&frame[0], 1, frameSize, pFile) != frameSize)
+            break;
+
+        AUIndexEntry entry = {};
+        entry.Offset       = offset;
+        entry.Size         = (mfxU32)sizeof(frameHdr) + frameSize;
+        entry.KeyFrame     = frameSize && IsKeyFrame(&frame[0], frameSize);
+        entry.FrameType =
+            entry.KeyFrame ? (mfxU16)(MFX_FRAMETYPE_I | MFX_FRAMETYPE_IDR) : (mfxU16)MFX_FRAMETYPE_P;
+        entry.TimeStamp = frameRate ? pts * 90000 * timeScale / frameRate
+                                    : (mfxU64)MFX_TIMESTAMP_UNKNOWN;
+        m_entries.push_back(entry);
+
+        offset += entry.Size;
+    }
+
+    return m_entries.empty() ? MFX_ERR_MORE_DATA : MFX_ERR_NONE;
+}
+
+/* index file layout, little endian:
+   bytes 0-3    signature: 'AUIX'
+   bytes 4-7    version
+   bytes 8-11   codec id
+   bytes 12-15  number of entries
+   bytes 16-23  size of the stream
+   bytes 24-31  modification time of the stream
+   then 24 bytes per entry: offset(8), size(4), frame type(2), key frame(2), time stamp(8)
+   then number of parameter sets(4) and 16 bytes per set: offset(8), size(4), type(2), id(2) */
+mfxStatus CAUIndex::Save(const char* strIndexFile) const {
+    MSDK_CHECK_POINTER(strIndexFile, MFX_ERR_NULL_PTR);
+
+    FILE* pFile = NULL;
+    MSDK_FOPEN(pFile, strIndexFile, "wb");
+    MSDK_CHECK_POINTER(pFile, MFX_ERR_NULL_PTR);
+
+    mfxU32 hdr[4] = { AU_INDEX_SIGNATURE, AU_INDEX_VERSION, m_codecId, (mfxU32)m_entries.size() };
+    mfxU64 stream[2] = { m_streamSize, m_streamTime };
+    bool bOk         = fwrite(hdr, sizeof(hdr), 1, pFile) == 1 &&
+               fwrite(stream, sizeof(stream), 1, pFile) == 1;
+
+    for (size_t i = 0; bOk && i < m_entries.size(); i++) {
+        const AUIndexEntry& entry = m_entries[i];
+        bOk = fwrite(&entry.Offset, sizeof(entry.Offset), 1, pFile) == 1 &&
+              fwrite(&entry.Size, sizeof(entry.Size), 1, pFile) == 1 &&
+              fwrite(&entry.FrameType, sizeof(entry.FrameType), 1, pFile) == 1 &&
+              fwrite(&entry.KeyFrame, sizeof(entry.KeyFrame), 1, pFile) == 1 &&
+              fwrite(&entry.TimeStamp, sizeof(entry.TimeStamp), 1, pFile) == 1;
+    }
+
+    mfxU32 numParamSets = (mfxU32)m_paramSets.size();
+    bOk                 = bOk && fwrite(&numParamSets, sizeof(numParamSets), 1, pFile) == 1;
+
+    for (size_t i = 0; bOk && i < m_paramSets.size(); i++) {
+        const AUIndexParamSet& paramSet = m_paramSets[i];
+        bOk = fwrite(&paramSet.Offset, sizeof(paramSet.Offset), 1, pFile) == 1 &&
+              fwrite(&paramSet.Size, sizeof(paramSet.Size), 1, pFile) == 1 &&
+              fwrite(&paramSet.Type, sizeof(paramSet.Type), 1, pFile) == 1 &&
+              fwrite(&paramSet.Id, sizeof(paramSet.Id), 1, pFile) == 1;
+    }
+
+    fclose(pFile);
+    return bOk ? MFX_ERR_NONE : MFX_ERR_DEVICE_FAILED;
+}
+
+mfxStatus CAUIndex::Load(const char* strIndexFile, const char* strFileName) {
+    MSDK_CHECK_POINTER(strIndexFile, MFX_ERR_NULL_PTR);
+    MSDK_CHECK_POINTER(strFileName, MFX_ERR_NULL_PTR);
+
+    Clear();
+
+    mfxU64 indexSize = 0, indexTime = 0, streamSize = 0, streamTime = 0;
+    if (!GetFileInfo(strIndexFile, indexSize, indexTime) ||
+        !GetFileInfo(strFileName, streamSize, streamTime))
+        return MFX_ERR_NOT_FOUND;
+
+    FILE* pFile = NULL;
+    MSDK_FOPEN(pFile, strIndexFile, "rb");
+    MSDK_CHECK_POINTER(pFile, MFX_ERR_NULL_PTR);
+
+    mfxU32 hdr[4]    = {};
+    mfxU64 stream[2] = {};
+    bool bOk = fread(hdr, sizeof(hdr), 1, pFile) == 1 && hdr[0] == AU_INDEX_SIGNATURE &&
+               hdr[1] == AU_INDEX_VERSION && fread(stream, sizeof(stream), 1, pFile) == 1;
+
+    // index of other version of the stream is stale, corrupted one isn't trusted to allocate
+    // memory for entries
+    mfxU64 entriesEnd = sizeof(hdr) + sizeof(stream) + (mfxU64)hdr[3] * AU_INDEX_ENTRY_SIZE;
+    bOk = bOk && stream[0] == streamSize && stream[1] == streamTime &&
+          entriesEnd + sizeof(mfxU32) <= indexSize;
+
+    if (bOk)
+        m_entries.resize(hdr[3]);
+
+    for (size_t i = 0; bOk && i < m_entries.size(); i++) {
+        AUIndexEntry& entry = m_entries[i];
+        bOk = fread(&entry.Offset, sizeof(entry.Offset), 1, pFile) == 1 &&
+              fread(&entry.Size, sizeof(entry.Size), 1, pFile) == 1 &&
+              fread(&entry.FrameType, sizeof(entry.FrameType), 1, pFile) == 1 &&
+              fread(&entry.KeyFrame, sizeof(entry.KeyFrame), 1, pFile) == 1 &&
+              fread(&entry.TimeStamp, sizeof(entry.TimeStamp), 1, pFile) == 1;
+    }
+
+    mfxU32 numParamSets = 0;
+    bOk = bOk && fread(&numParamSets, sizeof(numParamSets), 1, pFile) == 1 &&
+          entriesEnd + sizeof(numParamSets) + numParamSets * AU_INDEX_PARAM_SET_SIZE == indexSize;
+
+    if (bOk)
+        m_paramSets.resize(numParamSets);
+
+    for (size_t i = 0; bOk && i < m_paramSets.size(); i++) {
+        AUIndexParamSet& paramSet = m_paramSets[i];
+        bOk = fread(&paramSet.Offset, sizeof(paramSet.Offset), 1, pFile) == 1 &&
+              fread(&paramSet.Size, sizeof(paramSet.Size), 1, pFile) == 1 &&
+              fread(&paramSet.Type, sizeof(paramSet.Type), 1, pFile) == 1 &&
+              fread(&paramSet.Id, sizeof(paramSet.Id), 1, pFile) == 1;
+    }
+
+    fclose(pFile);
+
+    if (!bOk) {
+        Clear();
+        return MFX_ERR_UNSUPPORTED;
+    }
+
+    m_codecId    = hdr[2];
+    m_streamSize = streamSize;
+    m_streamTime = streamTime;
+    return MFX_ERR_NONE;
+}
+
+mfxI32 CAUIndex::FindKeyFrame(mfxU32 auNum) const {
+    if (m_entries.empty())
+        return -1;
+
+    for (mfxI32 i = (mfxI32)std::min<size_t>(auNum, m_entries.size() - 1); i >= 0; i--) {
+        if (m_entries[i].KeyFrame)
+            return i;
+    }
+    return -1;
+}
+
+std::vector<AUIndexParamSet> CAUIndex::GetParameterSets(mfxU32 auNum) const {
+    std::vector<AUIndexParamSet> paramSets;
+    if (auNum >= m_entries.size())
+        return paramSets;
+
+    const AUIndexEntry& entry = m_entries[auNum];
+    auto isSame               = [](const AUIndexParamSet& a, const AUIndexParamSet& b) {
+        return a.Type == b.Type && a.Id == b.Id;
+    };
+
+    // the last set of every id before the access unit replaces the previous ones
+    auto it = m_paramSets.begin();
+    for (; it != m_paramSets.end() && it->Offset < entry.Offset; ++it) {
+        auto same = std::find_if(paramSets.begin(), paramSets.end(), [&](const AUIndexParamSet& p) {
+            return isSame(p, *it);
+        });
+        if (same != paramSets.end())
+            *same = *it;
+        else
+            paramSets.push_back(*it);
+    }
+
+    // sets repeated by the access unit itself aren't needed
+    auto auEnd = it;
+    while (auEnd != m_paramSets.end() && auEnd->Offset < entry.Offset + entry.Size)
+        ++auEnd;
+    paramSets.erase(std::remove_if(paramSets.begin(),
+                                   paramSets.end(),
+                                   [&](const AUIndexParamSet& p) {
+                                       return std::any_of(it,
+                                                          auEnd,
+                                                          [&](const AUIndexParamSet& q) {
+                                                              return isSame(p, q);
+                                                          });
+                                   }),
+                    paramSets.end());
+
+    std::stable_sort(paramSets.begin(),
+                     paramSets.end(),
+                     [](const AUIndexParamSet& a, const AUIndexParamSet& b) {
+                         return a.Type < b.Type;
+                     });
+    return paramSets;
+}
+
+mfxStatus CAUIndex::ReadParameterSets(const char* strFileName,
+                                      mfxU32 auNum,
+                                      std::vector<mfxU8>& data) const {
+    MSDK_CHECK_POINTER(strFileName, MFX_ERR_NULL_PTR);
+
+    data.clear();
+    std::vector<AUIndexParamSet> paramSets = GetParameterSets(auNum);
+    if (paramSets.empty())
+        return MFX_ERR_NONE;
+
+    FILE* pFile = NULL;
+    MSDK_FOPEN(pFile, strFileName, "rb");
+    MSDK_CHECK_POINTER(pFile, MFX_ERR_NULL_PTR);
+
+    bool bOk = true;
+    for (size_t i = 0; bOk && i < paramSets.size(); i++) {
+        size_t pos = data.size();
+        data.resize(pos + paramSets[i].Size);
+        bOk = !MSDK_FSEEK64(pFile, paramSets[i].Offset, SEEK_SET) &&
+              fread(&data[pos], 1, paramSets[i].Size, pFile) == paramSets[i].Size;
+    }
+    fclose(pFile);
+
+    if (!bOk) {
+        data.clear();
+        return MFX_ERR_MORE_DATA;
+    }
+    return MFX_ERR_NONE;
+}
+
+std::vector<AUIndexRange> CAUIndex::SplitToRanges(mfxU32 numRanges) const {
+    std::vector<AUIndexRange> gops;
+
+    for (mfxU32 i = 0; i < (mfxU32)m_entries.size(); i++) {
+        // access units before the first key frame can't be decoded independently
+        if (m_entries[i].KeyFrame || gops.empty()) {
+            AUIndexRange gop = {};
+            gop.FirstAU      = i;
+            gop.Offset       = m_entries[i].Offset;
+            gops.push_back(gop);
+        }
+        gops.back().NumAU++;
+        gops.back().Size = m_entries[i].Offset + m_entries[i].Size - gops.back().Offset;
+    }
+
+    if (!numRanges || numRanges >= gops.size())
+        return gops;
+
+    // merge GOPs into ranges of similar size
+    mfxU64 totalSize = 0;
+    for (const auto& gop : gops)
+        totalSize += gop.Size;
+
+    std::vector<AUIndexRange> ranges;
+    mfxU64 accumulated = 0;
+    for (size_t i = 0; i < gops.size(); i++) {
+        size_t rangesLeft = numRanges - ranges.size();
+        // next range starts when the current one got its share of the stream
+        // or when every remaining GOP is needed to fill the remaining ranges
+        if (ranges.empty() ||
+            (rangesLeft && (accumulated >= totalSize * ranges.size() / numRanges ||
+                            gops.size() - i <= rangesLeft))) {
+            ranges.push_back(gops[i]);
+        }
+        else {
+            ranges.back().NumAU += gops[i].NumAU;
+            ranges.back().Size = gops[i].Offset + gops[i].Size - ranges.back().Offset;
+        }
+        accumulated += gops[i].Size;
+    }
+
+    return ranges;
+}
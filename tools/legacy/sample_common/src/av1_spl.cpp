@@ -0,0 +1,387 @@
+/*############################################################################
+  # Copyright (C) 2024 Intel Corporation
+  #
+  # SPDX-License-Identifier: MIT
+  ############################################################################*/
+
+#include <string.h>
+#include <algorithm>
+
+#include "av1_spl.h"
+#include "sample_defs.h"
+
+namespace ProtectedLibrary {
+
+enum {
+    AV1_MAX_PREFIX_SIZE = 32, // 3 leb128 length fields of Annex B and OBU header
+    AV1_MAX_LEB128_SIZE = 8
+};
+
+static const mfxU64 AV1_MAX_LEB128_VALUE = 0xffffffff; // (1 << 32) - 1 as per the specification
+
+// returns number of bytes taken by leb128 value, 0 if value is not complete
+static mfxU32 ReadLeb128(const mfxU8* data, mfxU32 size, mfxU32& value) {
+    mfxU64 result = 0;
+    for (mfxU32 i = 0; i < std::min<mfxU32>(size, AV1_MAX_LEB128_SIZE); i++) {
+        result |= (mfxU64)(data[i] & 0x7f) << (i * 7);
+        if (!(data[i] & 0x80)) {
+            value = (mfxU32)std::min<mfxU64>(result, AV1_MAX_LEB128_VALUE);
+            return i + 1;
+        }
+    }
+    return 0;
+}
+
+static mfxU32 WriteLeb128(mfxU32 value, mfxU8* data) {
+    mfxU32 size = 0;
+    do {
+        data[size] = (mfxU8)(value & 0x7f);
+        value >>= 7;
+        if (value)
+            data[size] |= 0x80;
+        size++;
+    } while (value);
+    return size;
+}
+
+AV1_Spl::AV1_Spl()
+        : m_format(FORMAT_UNKNOWN),
+          m_prefix(AV1_MAX_PREFIX_SIZE),
+          m_prefixSize(0),
+          m_prefixReady(false),
+          m_obu(),
+          m_temporalUnitLeft(0),
+          m_frameUnitLeft(0),
+          m_payloadLeft(0),
+          m_payloadOffset(0),
+          m_reducedStillPictureHeader(false),
+          m_currentFrame(BUFFER_SIZE),
+          m_frameBufferSize(BUFFER_SIZE),
+          m_slices(16),
+          m_frame() {
+    m_frame.Data  = &m_currentFrame[0];
+    m_frame.Slice = &m_slices[0];
+}
+
+AV1_Spl::~AV1_Spl() {}
+
+mfxStatus AV1_Spl::Reset() {
+    m_format           = FORMAT_UNKNOWN;
+    m_prefixSize       = 0;
+    m_prefixReady      = false;
+    m_temporalUnitLeft = 0;
+    m_frameUnitLeft    = 0;
+    m_payloadLeft      = 0;
+    return MFX_ERR_NONE;
+}
+
+void AV1_Spl::ResetCurrentState() {
+    m_frame.DataLength         = 0;
+    m_frame.SliceNum           = 0;
+    m_frame.FirstFieldSliceNum = 0;
+}
+
+mfxStatus AV1_Spl::SetFrameBuffer(mfxU8* buffer, mfxU32 size) {
+    if (!buffer) {
+        if (m_currentFrame.size() < m_frame.DataLength)
+            m_currentFrame.resize(m_frame.DataLength);
+        buffer = &m_currentFrame[0];
+        size   = (mfxU32)m_currentFrame.size();
+    }
+
+    if (buffer == m_frame.Data) {
+        m_frameBufferSize = size;
+        return MFX_ERR_NONE;
+    }
+
+    // keep the part of temporal unit which is already assembled
+    if (m_frame.DataLength > size)
+        return MFX_ERR_NOT_ENOUGH_BUFFER;
+
+    if (m_frame.DataLength)
+        memmove(buffer, m_frame.Data, m_frame.DataLength);
+
+    m_frame.Data      = buffer;
+    m_frameBufferSize = size;
+
+    return MFX_ERR_NONE;
+}
+
+mfxStatus AV1_Spl::CheckFrameBuffer(mfxU64 size) {
+    mfxU64 required = m_frame.DataLength + size;
+    if (required <= m_frameBufferSize)
+        return MFX_ERR_NONE;
+
+    if (m_frame.Data != &m_currentFrame[0] || required > AV1_MAX_LEB128_VALUE)
+        return MFX_ERR_NOT_ENOUGH_BUFFER;
+
+    m_currentFrame.resize((size_t)std::max<mfxU64>(required, 2 * m_currentFrame.size()));
+    m_frame.Data      = &m_currentFrame[0];
+    m_frameBufferSize = (mfxU32)m_currentFrame.size();
+
+    return MFX_ERR_NONE;
+}
+
+mfxStatus AV1_Spl::DetectFormat(mfxBitstream* bs_in) {
+    if (bs_in->DataLength < 3)
+        return MFX_ERR_MORE_DATA;
+
+    // low overhead stream starts from temporal delimiter with obu_size field equal to 0,
+    // in Annex B stream it is preceded by temporal_unit_size
+    const mfxU8* data = bs_in->Data + bs_in->DataOffset;
+    mfxU32 sizePos    = (data[0] & 0x4) ? 2 : 1;
+    if ((data[0] & 0xfb) == ((OBU_TEMPORAL_DELIMITER << 3) | 0x2) && data[sizePos] == 0)
+        m_format = FORMAT_LOW_OVERHEAD;
+    else
+        m_format = FORMAT_ANNEX_B;
+
+    return MFX_ERR_NONE;
+}
+
+mfxStatus AV1_Spl::ParsePrefix(OBUPrefix& prefix) {
+    const mfxU8* data = &m_prefix[0];
+    mfxU32 pos        = 0;
+    mfxU32 size       = 0;
+
+    mfxU32 temporalUnitLeft = m_temporalUnitLeft;
+    mfxU32 frameUnitLeft    = m_frameUnitLeft;
+    mfxU32 obuLength        = 0;
+
+    if (m_format == FORMAT_ANNEX_B) {
+        if (!temporalUnitLeft) {
+            size = ReadLeb128(data + pos, m_prefixSize - pos, temporalUnitLeft);
+            if (!size)
+                return MFX_ERR_MORE_DATA;
+            pos += size;
+        }
+
+        if (!frameUnitLeft) {
+            size = ReadLeb128(data + pos, m_prefixSize - pos, frameUnitLeft);
+            if (!size)
+                return MFX_ERR_MORE_DATA;
+            if ((mfxU64)size + frameUnitLeft > temporalUnitLeft)
+                return MFX_ERR_UNDEFINED_BEHAVIOR;
+            pos += size;
+            temporalUnitLeft -= size;
+        }
+
+        size = ReadLeb128(data + pos, m_prefixSize - pos, obuLength);
+        if (!size)
+            return MFX_ERR_MORE_DATA;
+        if ((mfxU64)size + obuLength > frameUnitLeft)
+            return MFX_ERR_UNDEFINED_BEHAVIOR;
+        pos += size;
+        temporalUnitLeft -= size + obuLength;
+        frameUnitLeft -= size + obuLength;
+    }
+
+    mfxU32 headerPos = pos;
+    if (pos >= m_prefixSize)
+        return MFX_ERR_MORE_DATA;
+
+    mfxU8 header = data[pos++];
+    if (header & 0x80) // obu_forbidden_bit
+        return MFX_ERR_UNDEFINED_BEHAVIOR;
+
+    if (header & 0x4) { // obu_extension_flag
+        if (pos >= m_prefixSize)
+            return MFX_ERR_MORE_DATA;
+        pos++;
+    }
+
+    mfxU32 obuSize = 0;
+    if (header & 0x2) { // obu_has_size_field
+        size = ReadLeb128(data + pos, m_prefixSize - pos, obuSize);
+        if (!size)
+            return MFX_ERR_MORE_DATA;
+        pos += size;
+    }
+    else if (m_format == FORMAT_LOW_OVERHEAD) {
+        // size of OBU is unknown in low overhead format
+        return MFX_ERR_UNDEFINED_BEHAVIOR;
+    }
+
+    prefix.Type             = (header >> 3) & 0xf;
+    prefix.TemporalUnitLeft = temporalUnitLeft;
+    prefix.FrameUnitLeft    = frameUnitLeft;
+
+    if (m_format == FORMAT_LOW_OVERHEAD) {
+        prefix.PayloadSize = obuSize;
+        prefix.HeaderSize  = (mfxU8)(pos - headerPos);
+        memcpy(prefix.Header, data + headerPos, prefix.HeaderSize);
+        return MFX_ERR_NONE;
+    }
+
+    // Annex B OBU gets obu_size field, which is optional there
+    mfxU32 headerSize = pos - headerPos;
+    if (headerSize > obuLength)
+        return MFX_ERR_UNDEFINED_BEHAVIOR;
+
+    prefix.PayloadSize = obuLength - headerSize;
+    prefix.Header[0]   = header | 0x2;
+    prefix.HeaderSize  = 1;
+    if (header & 0x4)
+        prefix.Header[prefix.HeaderSize++] = data[headerPos + 1];
+    prefix.HeaderSize += (mfxU8)WriteLeb128(prefix.PayloadSize, prefix.Header + prefix.HeaderSize);
+
+    return MFX_ERR_NONE;
+}
+
+mfxStatus AV1_Spl::StartOBU() {
+    // whole OBU is placed in the buffer, so it isn't split between buffers
+    mfxStatus sts = CheckFrameBuffer((mfxU64)m_obu.HeaderSize + m_obu.PayloadSize);
+    if (sts != MFX_ERR_NONE)
+        return sts;
+
+    MSDK_MEMCPY_BUF(m_frame.Data,
+                    m_frame.DataLength,
+                    m_frameBufferSize,
+                    m_obu.Header,
+                    m_obu.HeaderSize);
+    m_frame.DataLength += m_obu.HeaderSize;
+
+    if (m_format == FORMAT_ANNEX_B) {
+        m_temporalUnitLeft = m_obu.TemporalUnitLeft;
+        m_frameUnitLeft    = m_obu.FrameUnitLeft;
+    }
+
+    m_payloadOffset = m_frame.DataLength;
+    m_payloadLeft   = m_obu.PayloadSize;
+    m_prefixSize    = 0;
+    m_prefixReady   = false;
+
+    return MFX_ERR_NONE;
+}
+
+void AV1_Spl::CompleteOBU() {
+    const mfxU8* payload = m_frame.Data + m_payloadOffset;
+    SliceTypeCode type   = TYPE_UNKNOWN;
+
+    switch (m_obu.Type) {
+        case OBU_SEQUENCE_HEADER:
+            if (m_obu.PayloadSize)
+                m_reducedStillPictureHeader = (payload[0] >> 3) & 1;
+            return;
+
+        case OBU_FRAME_HEADER:
+        case OBU_FRAME:
+            if (m_reducedStillPictureHeader)
+                type = TYPE_I;
+            else if (m_obu.PayloadSize && !(payload[0] & 0x80)) { // show_existing_frame
+                mfxU8 frameType = (payload[0] >> 5) & 0x3; // KEY, INTER, INTRA_ONLY, SWITCH
+                type            = (frameType == 0 || frameType == 2) ? TYPE_I : TYPE_P;
+            }
+            break;
+
+        case OBU_TILE_GROUP:
+            if (m_frame.SliceNum)
+                type = m_slices[m_frame.SliceNum - 1].SliceType;
+            break;
+
+        default:
+            return;
+    }
+
+    if (m_slices.size() <= m_frame.SliceNum) {
+        m_slices.resize(m_frame.SliceNum + 16);
+        m_frame.Slice = &m_slices[0];
+    }
+
+    SliceSplitterInfo& slice = m_slices[m_frame.SliceNum++];
+    slice.DataOffset         = m_payloadOffset - m_obu.HeaderSize;
+    slice.DataLength         = m_obu.HeaderSize + m_obu.PayloadSize;
+    slice.HeaderLength       = m_obu.HeaderSize;
+    slice.SliceType          = type;
+    m_frame.FirstFieldSliceNum++;
+}
+
+mfxStatus AV1_Spl::GetFrame(mfxBitstream* bs_in, FrameSplitterInfo** frame) {
+    *frame = NULL;
+
+    if (m_format == FORMAT_UNKNOWN) {
+        if (!bs_in)
+            return MFX_ERR_MORE_DATA;
+
+        mfxStatus sts = DetectFormat(bs_in);
+        if (sts != MFX_ERR_NONE)
+            return sts;
+    }
+
+    bool bComplete = false;
+    while (!bComplete) {
+        if (m_payloadLeft) {
+            if (!bs_in || !bs_in->DataLength)
+                break;
+
+            mfxU32 size = std::min(m_payloadLeft, bs_in->DataLength);
+            MSDK_MEMCPY_BUF(m_frame.Data,
+                            m_frame.DataLength,
+                            m_frameBufferSize,
+                            bs_in->Data + bs_in->DataOffset,
+                            size);
+            m_frame.DataLength += size;
+            bs_in->DataOffset += size;
+            bs_in->DataLength -= size;
+            m_payloadLeft -= size;
+
+            if (!m_payloadLeft) {
+                CompleteOBU();
+                // length of Annex B temporal unit is known, so it's ready without next one
+                bComplete = (m_format == FORMAT_ANNEX_B && !m_temporalUnitLeft);
+            }
+            continue;
+        }
+
+        if (!m_prefixReady) {
+            if (!bs_in || !bs_in->DataLength)
+                break;
+
+            m_prefix[m_prefixSize++] = bs_in->Data[bs_in->DataOffset];
+            bs_in->DataOffset++;
+            bs_in->DataLength--;
+
+            mfxStatus sts = ParsePrefix(m_obu);
+            if (sts == MFX_ERR_MORE_DATA && m_prefixSize < m_prefix.size())
+                continue;
+            if (sts != MFX_ERR_NONE)
+                return MFX_ERR_UNDEFINED_BEHAVIOR;
+
+            m_prefixReady = true;
+        }
+
+        // temporal delimiter of low overhead stream completes previous temporal unit
+        if (m_obu.Type == OBU_TEMPORAL_DELIMITER && m_format == FORMAT_LOW_OVERHEAD &&
+            m_frame.DataLength) {
+            bComplete = true;
+            break;
+        }
+
+        if (!m_frame.DataLength && bs_in)
+            m_frame.TimeStamp = bs_in->TimeStamp;
+
+        mfxStatus sts = StartOBU();
+        if (sts != MFX_ERR_NONE)
+            return sts;
+
+        if (!m_payloadLeft) {
+            CompleteOBU();
+            bComplete = (m_format == FORMAT_ANNEX_B && !m_temporalUnitLeft);
+        }
+    }
+
+    if (bComplete || (!bs_in && m_frame.SliceNum)) {
+        m_payloadLeft = 0;
+        *frame        = &m_frame;
+        return MFX_ERR_NONE;
+    }
+
+    return MFX_ERR_MORE_DATA;
+}
+
+mfxStatus AV1_Spl::PostProcessing(FrameSplitterInfo* frame, mfxU32 sliceNum) {
+    UNREFERENCED_PARAMETER(frame);
+    UNREFERENCED_PARAMETER(sliceNum);
+    return MFX_ERR_NONE;
+}
+
+} // namespace ProtectedLibrary
@@ -9,6 +9,21 @@
 #include "avc_structures.h"
 #include "sample_defs.h"
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+    #include <emmintrin.h>
+    #if defined(_MSC_VER)
+        #include <intrin.h>
+    #endif
+    #define MFX_START_CODE_SEARCH_SSE2
+    #if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+        #include <immintrin.h>
+        #define MFX_START_CODE_SEARCH_AVX2
+    #endif
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+    #include <arm_neon.h>
+    #define MFX_START_CODE_SEARCH_NEON
+#endif
+
 namespace ProtectedLibrary {
 
 static const mfxU32 MFX_TIME_STAMP_FREQUENCY = 90000; // will go to mfxdefs.h
@@ -22,7 +37,12 @@ inline mfxU64 GetMfxTimeStamp(mfxF64 ts) {
     return ts < 0.0 ? MFX_TIME_STAMP_INVALID : (mfxU64)(ts * MFX_TIME_STAMP_FREQUENCY + .5);
 }
 
-enum { AVC_NAL_UNITTYPE_BITS_MASK = 0x1f };
+enum {
+    AVC_NAL_UNITTYPE_BITS_MASK = 0x1f,
+    // marks found NAL unit in the iterator's codes, so NAL unit with zero header byte
+    // (e.g. HEVC TRAIL_N) is not taken for missing start code
+    NAL_UNIT_FOUND = 0x100
+};
 
 inline bool IsHeaderCode(mfxI32 iCode) {
     return (NAL_UT_SPS == (iCode & AVC_NAL_UNITTYPE_BITS_MASK)) ||
@@ -36,16 +56,125 @@ inline bool IsVLCCode(mfxI32 iCode) {
            (NAL_UT_AUXILIARY == (iCode & AVC_NAL_UNITTYPE_BITS_MASK));
 }
 
+// searches for 00 00 <lastByte> pattern, which is start code prefix (lastByte is 1) or
+// emulation prevention sequence (lastByte is 3)
+static inline mfxU8* FindZeroPairScalar(mfxU8* pb, mfxU8* end, mfxU8 lastByte) {
+    for (; pb + 3 <= end; pb++) {
+        if (pb[2] && pb[2] != lastByte)
+            pb += 2;
+        else if (!pb[0] && !pb[1] && pb[2] == lastByte)
+            return pb;
+    }
+    return end;
+}
+
+#if defined(MFX_START_CODE_SEARCH_SSE2)
+    #if defined(MFX_START_CODE_SEARCH_AVX2)
+__attribute__((target("avx2"))) static mfxU8* FindZeroPairAVX2(mfxU8* pb,
+                                                               mfxU8* end,
+                                                               mfxU8 lastByte) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i last = _mm256_set1_epi8((char)lastByte);
+
+    // 3 loads cover positions pb..pb+31 as first, second and third byte of the pattern
+    for (; pb + 34 <= end; pb += 32) {
+        __m256i b0 = _mm256_loadu_si256((const __m256i*)pb);
+        __m256i b2 = _mm256_loadu_si256((const __m256i*)(pb + 2));
+        // most of positions are rejected by absence of the last byte two bytes later
+        mfxU32 mask = (mfxU32)_mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(b0, zero), _mm256_cmpeq_epi8(b2, last)));
+        if (!mask)
+            continue;
+
+        __m256i b1 = _mm256_loadu_si256((const __m256i*)(pb + 1));
+        mask &= (mfxU32)_mm256_movemask_epi8(_mm256_cmpeq_epi8(b1, zero));
+        if (mask)
+            return pb + __builtin_ctz(mask);
+    }
+
+    return FindZeroPairScalar(pb, end, lastByte);
+}
+    #endif
+
+static mfxU8* FindZeroPairSSE2(mfxU8* pb, mfxU8* end, mfxU8 lastByte) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i last = _mm_set1_epi8((char)lastByte);
+
+    for (; pb + 18 <= end; pb += 16) {
+        __m128i b0 = _mm_loadu_si128((const __m128i*)pb);
+        __m128i b2 = _mm_loadu_si128((const __m128i*)(pb + 2));
+        mfxU32 mask = (mfxU32)_mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(b0, zero), _mm_cmpeq_epi8(b2, last)));
+        if (!mask)
+            continue;
+
+        __m128i b1 = _mm_loadu_si128((const __m128i*)(pb + 1));
+        mask &= (mfxU32)_mm_movemask_epi8(_mm_cmpeq_epi8(b1, zero));
+        if (mask) {
+    #if defined(_MSC_VER)
+            unsigned long idx = 0;
+            _BitScanForward(&idx, mask);
+            return pb + idx;
+    #else
+            return pb + __builtin_ctz(mask);
+    #endif
+        }
+    }
+
+    return FindZeroPairScalar(pb, end, lastByte);
+}
+#elif defined(MFX_START_CODE_SEARCH_NEON)
+static mfxU8* FindZeroPairNEON(mfxU8* pb, mfxU8* end, mfxU8 lastByte) {
+    const uint8x16_t zero = vdupq_n_u8(0);
+    const uint8x16_t last = vdupq_n_u8(lastByte);
+
+    for (; pb + 18 <= end; pb += 16) {
+        uint8x16_t m = vandq_u8(vceqq_u8(vld1q_u8(pb), zero), vceqq_u8(vld1q_u8(pb + 2), last));
+        m            = vandq_u8(m, vceqq_u8(vld1q_u8(pb + 1), zero));
+        // no movemask on NEON, exact position is taken by scalar code
+        if (vmaxvq_u8(m))
+            return FindZeroPairScalar(pb, pb + 18, lastByte);
+    }
+
+    return FindZeroPairScalar(pb, end, lastByte);
+}
+#endif
+
+static mfxU8* FindZeroPair(mfxU8* begin, mfxU8* end, mfxU8 lastByte) {
+    if (!begin || end < begin + 3)
+        return end;
+
+#if defined(MFX_START_CODE_SEARCH_AVX2)
+    static const bool hasAVX2 = __builtin_cpu_supports("avx2");
+    if (hasAVX2)
+        return FindZeroPairAVX2(begin, end, lastByte);
+#endif
+#if defined(MFX_START_CODE_SEARCH_SSE2)
+    return FindZeroPairSSE2(begin, end, lastByte);
+#elif defined(MFX_START_CODE_SEARCH_NEON)
+    return FindZeroPairNEON(begin, end, lastByte);
+#else
+    return FindZeroPairScalar(begin, end, lastByte);
+#endif
+}
+
+mfxU8* FindStartCodePrefix(mfxU8* begin, mfxU8* end) {
+    return FindZeroPair(begin, end, 1);
+}
+
 static mfxI32 FindStartCode(mfxU8*(&pb), mfxU32& nSize) {
     // there is no data
     if (nSize < 4)
         return 0;
 
-    // find start code
-    while ((4 <= nSize) && ((0 != pb[0]) || (0 != pb[1]) || (1 != pb[2]))) {
-        pb += 1;
-        nSize -= 1;
-    }
+    // find start code, one byte after it has to be available
+    mfxU8* end = pb + nSize - 1;
+    mfxU8* sc  = FindStartCodePrefix(pb, end);
+    if (sc == end)
+        sc = end - 2;
+
+    nSize -= (mfxU32)(sc - pb);
+    pb = sc;
 
     if (4 <= nSize)
         return ((pb[0] << 24) | (pb[1] << 16) | (pb[2] << 8) | (pb[3]));
@@ -187,7 +316,9 @@ mfxI32 StartCodeIterator::GetNALUnit(mfxBitstream* src, mfxBitstream* dst) {
         if (m_prev.size()) // assertion: it should be
             return 0;
 
-        size_t sz = source - (src->Data + src->DataOffset);
+        // trailing zeros may be taken for the beginning of next start code, but zero NAL unit
+        // header (HEVC TRAIL_N) is kept anyway, since non-empty m_prev marks collected NAL unit
+        size_t sz = std::max<size_t>(source - (src->Data + src->DataOffset), 1);
         if (sz > m_suggestedSize) {
             sz = m_suggestedSize;
         }
@@ -236,41 +367,33 @@ mfxI32 StartCodeIterator::EndOfStream(mfxBitstream* dst) {
 }
 
 mfxI32 StartCodeIterator::FindStartCode(mfxU8*(&pb), mfxU32& size, mfxI32& startCodeSize) {
-    mfxU32 zeroCount = 0;
-
-    for (mfxU32 i = 0; i < (mfxU32)size; i++, pb++) {
-        switch (pb[0]) {
-            case 0x00:
-                zeroCount++;
-                break;
-            case 0x01:
-                if (zeroCount >= 2) {
-                    startCodeSize = std::min(zeroCount + 1, 4u);
-                    size -= i + 1;
-                    pb++; // remove 0x01 symbol
-                    zeroCount = 0;
-                    if (size >= 1) {
-                        return pb[0] & AVC_NAL_UNITTYPE_BITS_MASK;
-                    }
-                    else {
-                        pb -= startCodeSize;
-                        size += startCodeSize;
-                        startCodeSize = 0;
-                        return 0;
-                    }
-                }
-                zeroCount = 0;
-                break;
-            default:
-                zeroCount = 0;
-                break;
+    mfxU8* begin = pb;
+    mfxU8* end   = pb + size;
+    mfxU8* sc    = FindStartCodePrefix(begin, end);
+
+    if (sc != end) {
+        // one more leading zero makes 4 bytes start code
+        startCodeSize = (sc > begin && sc[-1] == 0) ? 4 : 3;
+
+        pb   = sc + 3; // remove 0x01 symbol
+        size = (mfxU32)(end - pb);
+        if (size >= 1) {
+            return NAL_UNIT_FOUND | pb[0];
         }
+
+        pb -= startCodeSize;
+        size += startCodeSize;
+        startCodeSize = 0;
+        return 0;
     }
 
-    zeroCount = std::min(zeroCount, 3u);
-    pb -= zeroCount;
-    size += zeroCount;
-    zeroCount     = 0;
+    // keep trailing zeros, they can be the beginning of start code split between buffers
+    mfxU32 zeroCount = 0;
+    while (zeroCount < 3 && end - zeroCount > begin && !end[-(mfxI32)zeroCount - 1])
+        zeroCount++;
+
+    pb            = end - zeroCount;
+    size          = zeroCount;
     startCodeSize = 0;
     return 0;
 }
@@ -301,7 +424,7 @@ void NALUnitSplitter::Reset() {
 void NALUnitSplitter::Release() {}
 
 mfxI32 NALUnitSplitter::CheckNalUnitType(mfxBitstream* source) {
-    return m_pStartCodeIter.CheckNalUnitType(source);
+    return m_pStartCodeIter.CheckNalUnitType(source) & AVC_NAL_UNITTYPE_BITS_MASK;
 }
 
 mfxI32 NALUnitSplitter::GetNalUnits(mfxBitstream* source, mfxBitstream*& destination) {
@@ -313,148 +436,38 @@ mfxI32 NALUnitSplitter::GetNalUnits(mfxBitstream* source, mfxBitstream*& destina
     }
 
     destination = &m_bitstream;
-    return iCode;
+    return iCode & AVC_NAL_UNITTYPE_BITS_MASK;
 }
 
-/* temporal class definition */
-class H264DwordPointer_ {
-public:
-    // Default constructor
-    H264DwordPointer_(void) {
-        m_pDest    = NULL;
-        m_nByteNum = 0;
-        m_iCur     = 0;
-    }
-
-    H264DwordPointer_ operator=(void* pDest) {
-        m_pDest    = (mfxU32*)pDest;
-        m_nByteNum = 0;
-        m_iCur     = 0;
-
-        return *this;
-    }
-
-    // Increment operator
-    H264DwordPointer_& operator++(void) {
-        if (4 == ++m_nByteNum) {
-            *m_pDest = m_iCur;
-            m_pDest += 1;
-            m_nByteNum = 0;
-            m_iCur     = 0;
-        }
-        else
-            m_iCur <<= 8;
-
-        return *this;
-    }
-
-    mfxU8 operator=(mfxU8 nByte) {
-        m_iCur = (m_iCur & ~0x0ff) | ((mfxU32)nByte);
-
-        return nByte;
-    }
-
-protected:
-    mfxU32* m_pDest; // pointer to destination buffer
-    mfxU32 m_nByteNum; // number of current byte in dword
-    mfxU32 m_iCur; // current dword
-};
-
-class H264SourcePointer_ {
-public:
-    // Default constructor
-    H264SourcePointer_(void) {
-        m_pSource       = NULL;
-        m_nRemovedBytes = 0;
-        m_nZeros        = 0;
-    }
-
-    H264SourcePointer_& operator=(mfxU8* pSource) {
-        m_pSource = (mfxU8*)pSource;
-
-        m_nZeros        = 0;
-        m_nRemovedBytes = 0;
-
-        return *this;
-    }
-
-    H264SourcePointer_& operator++(void) {
-        mfxU8 bCurByte = m_pSource[0];
-
-        if (0 == bCurByte)
-            m_nZeros += 1;
-        else {
-            if ((3 == bCurByte) && (2 <= m_nZeros))
-                m_nRemovedBytes += 1;
-            m_nZeros = 0;
-        }
-
-        m_pSource += 1;
-
-        return *this;
-    }
-
-    bool IsPrevent(void) {
-        if ((3 == m_pSource[0]) && (2 <= m_nZeros))
-            return true;
-        else
-            return false;
-    }
-
-    operator mfxU8(void) {
-        return m_pSource[0];
-    }
-
-    mfxU32 GetRemovedBytes(void) {
-        return m_nRemovedBytes;
-    }
-
-protected:
-    mfxU8* m_pSource; // pointer to destination buffer
-    mfxU32 m_nZeros; // number of preceding zeros
-    mfxU32 m_nRemovedBytes; // number of removed bytes
-};
-
 void SwapMemoryAndRemovePreventingBytes(mfxU8* pDestination,
                                         mfxU32& nDstSize,
                                         mfxU8* pSource,
                                         mfxU32 nSrcSize) {
-    H264DwordPointer_ pDst;
-    H264SourcePointer_ pSrc;
-    size_t i;
-
-    // DwordPointer object is swapping written bytes
-    // H264SourcePointer_ removes preventing start-code bytes
-
-    // reset pointer(s)
-    pSrc = pSource;
-    pDst = pDestination;
-
-    // first two bytes
-    i = 0;
-    while (i < std::min(2u, nSrcSize)) {
-        pDst = (mfxU8)pSrc;
-        ++pDst;
-        ++pSrc;
-        ++i;
-    }
-
-    // do swapping
-    while (i < (mfxU32)nSrcSize) {
-        if (false == pSrc.IsPrevent()) {
-            pDst = (mfxU8)pSrc;
-            ++pDst;
-        }
-        ++pSrc;
-        ++i;
+    mfxU8* dst = pDestination;
+    mfxU8* end = pSource + nSrcSize;
+
+    // copy runs between emulation prevention bytes, 0x03 is removed only after two zero bytes,
+    // so the pattern can't start inside the removed sequence and the search goes on after it
+    for (mfxU8* src = pSource; src < end;) {
+        mfxU8* epb  = FindZeroPair(src, end, 3);
+        mfxU8* stop = (epb == end) ? end : epb + 2;
+
+        memcpy(dst, src, stop - src);
+        dst += stop - src;
+        src = (epb == end) ? end : epb + 3;
     }
 
     // write padding bytes
-    nDstSize = nSrcSize - pSrc.GetRemovedBytes();
-    while (nDstSize & 3) {
-        pDst = (mfxU8)(0);
-        ++nDstSize;
-        ++pDst;
+    nDstSize = (mfxU32)(dst - pDestination);
+    while (nDstSize & 3)
+        pDestination[nDstSize++] = 0;
+
+    // store dwords with the first byte in the most significant byte, loop is vectorized
+    // by compiler
+    for (mfxU32 i = 0; i < nDstSize; i += 4) {
+        mfxU8* pb   = pDestination + i;
+        mfxU32 code = ((mfxU32)pb[0] << 24) | ((mfxU32)pb[1] << 16) | ((mfxU32)pb[2] << 8) | pb[3];
+        memcpy(pb, &code, sizeof(code));
     }
 }
 
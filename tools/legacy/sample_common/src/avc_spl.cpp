@@ -29,7 +29,10 @@ AVC_Spl::AVC_Spl()
           m_currentInfo(nullptr),
           m_pLastSlice(nullptr),
           m_lastNalUnit(nullptr),
+          m_pendingNalUnit(nullptr),
+          m_pendingSlice(nullptr),
           m_currentFrame(),
+          m_frameBufferSize(0),
           m_swappingMemory(),
           m_slicesStorage(),
           m_slices(),
@@ -53,30 +56,78 @@ mfxStatus AVC_Spl::Init() {
 
     m_currentFrame.resize(BUFFER_SIZE);
 
-    m_pLastSlice  = 0;
-    m_lastNalUnit = 0;
-    m_currentInfo = 0;
+    m_pLastSlice     = 0;
+    m_lastNalUnit    = 0;
+    m_pendingNalUnit = 0;
+    m_pendingSlice   = 0;
+    m_currentInfo    = 0;
 
     m_slices.resize(128);
     memset(&m_frame, 0, sizeof(m_frame));
-    m_frame.Data  = &m_currentFrame[0];
-    m_frame.Slice = &m_slices[0];
+    m_frame.Data      = &m_currentFrame[0];
+    m_frame.Slice     = &m_slices[0];
+    m_frameBufferSize = BUFFER_SIZE;
 
     return MFX_ERR_NONE;
 }
 
 void AVC_Spl::Close() {
-    m_pLastSlice  = 0;
-    m_lastNalUnit = 0;
-    m_currentInfo = 0;
+    m_pLastSlice     = 0;
+    m_lastNalUnit    = 0;
+    m_pendingNalUnit = 0;
+    m_pendingSlice   = 0;
+    m_currentInfo    = 0;
 }
 
 mfxStatus AVC_Spl::Reset() {
     m_pNALSplitter->Reset();
-    m_WaitForIDR  = true;
-    m_lastNalUnit = 0;
-    m_pLastSlice  = 0;
-    m_currentInfo = 0;
+    m_WaitForIDR     = true;
+    m_lastNalUnit    = 0;
+    m_pLastSlice     = 0;
+    m_pendingNalUnit = 0;
+    m_pendingSlice   = 0;
+    m_currentInfo    = 0;
+    return MFX_ERR_NONE;
+}
+
+mfxStatus AVC_Spl::SetFrameBuffer(mfxU8* buffer, mfxU32 size) {
+    if (!buffer) {
+        if (m_currentFrame.size() < m_frame.DataLength)
+            m_currentFrame.resize(m_frame.DataLength);
+        buffer = &m_currentFrame[0];
+        size   = (mfxU32)m_currentFrame.size();
+    }
+
+    if (buffer == m_frame.Data) {
+        m_frameBufferSize = size;
+        return MFX_ERR_NONE;
+    }
+
+    // keep the part of access unit which is already assembled
+    if (m_frame.DataLength > size)
+        return MFX_ERR_NOT_ENOUGH_BUFFER;
+
+    if (m_frame.DataLength)
+        memmove(buffer, m_frame.Data, m_frame.DataLength);
+
+    m_frame.Data      = buffer;
+    m_frameBufferSize = size;
+
+    return MFX_ERR_NONE;
+}
+
+mfxStatus AVC_Spl::CheckFrameBuffer(mfxU64 size) {
+    mfxU64 required = m_frame.DataLength + size;
+    if (required <= m_frameBufferSize)
+        return MFX_ERR_NONE;
+
+    if (m_frame.Data != &m_currentFrame[0] || required > 0xffffffff)
+        return MFX_ERR_NOT_ENOUGH_BUFFER;
+
+    m_currentFrame.resize((size_t)std::max<mfxU64>(required, 2 * m_currentFrame.size()));
+    m_frame.Data      = &m_currentFrame[0];
+    m_frameBufferSize = (mfxU32)m_currentFrame.size();
+
     return MFX_ERR_NONE;
 }
 
@@ -451,17 +502,17 @@ mfxStatus AVC_Spl::AddSlice(AVCSlice* pSlice) {
 mfxStatus AVC_Spl::AddNalUnit(mfxBitstream* nalUnit) {
     static mfxU8 start_code_prefix[] = { 0, 0, 1 };
 
-    if (m_frame.DataLength + nalUnit->DataLength + sizeof(start_code_prefix) >= BUFFER_SIZE)
+    if (CheckFrameBuffer(nalUnit->DataLength + sizeof(start_code_prefix)) != MFX_ERR_NONE)
         return MFX_ERR_NOT_ENOUGH_BUFFER;
 
     MSDK_MEMCPY_BUF(m_frame.Data,
                     m_frame.DataLength,
-                    BUFFER_SIZE,
+                    m_frameBufferSize,
                     start_code_prefix,
                     sizeof(start_code_prefix));
     MSDK_MEMCPY_BUF(m_frame.Data,
                     m_frame.DataLength + sizeof(start_code_prefix),
-                    BUFFER_SIZE,
+                    m_frameBufferSize,
                     nalUnit->Data + nalUnit->DataOffset,
                     nalUnit->DataLength);
 
@@ -475,17 +526,17 @@ mfxStatus AVC_Spl::AddSliceNalUnit(mfxBitstream* nalUnit, AVCSlice* slice) {
 
     mfxU32 sliceLength = (mfxU32)(nalUnit->DataLength + sizeof(start_code_prefix));
 
-    if (m_frame.DataLength + sliceLength >= BUFFER_SIZE)
+    if (CheckFrameBuffer(sliceLength) != MFX_ERR_NONE)
         return MFX_ERR_NOT_ENOUGH_BUFFER;
 
     MSDK_MEMCPY_BUF(m_frame.Data,
                     m_frame.DataLength,
-                    BUFFER_SIZE,
+                    m_frameBufferSize,
                     start_code_prefix,
                     sizeof(start_code_prefix));
     MSDK_MEMCPY_BUF(m_frame.Data,
                     m_frame.DataLength + sizeof(start_code_prefix),
-                    BUFFER_SIZE,
+                    m_frameBufferSize,
                     nalUnit->Data + nalUnit->DataOffset,
                     nalUnit->DataLength);
 
@@ -534,10 +585,22 @@ mfxStatus AVC_Spl::AddSliceNalUnit(mfxBitstream* nalUnit, AVCSlice* slice) {
     return MFX_ERR_NONE;
 }
 
+mfxStatus AVC_Spl::AddOrKeepNalUnit(mfxBitstream* nalUnit, AVCSlice* pSlice) {
+    mfxStatus sts = pSlice ? AddSliceNalUnit(nalUnit, pSlice) : AddNalUnit(nalUnit);
+    if (sts == MFX_ERR_NOT_ENOUGH_BUFFER) {
+        // NAL unit stays in the NAL splitter buffer until the next GetNalUnits call
+        m_pendingNalUnit = nalUnit;
+        m_pendingSlice   = pSlice;
+    }
+    return sts;
+}
+
 mfxStatus AVC_Spl::ProcessNalUnit(mfxI32 nalType, mfxBitstream* nalUnit) {
     if (!nalUnit)
         return MFX_ERR_MORE_DATA;
 
+    mfxStatus stsAdd = MFX_ERR_NONE;
+
     switch (nalType) {
         case NAL_UT_IDR_SLICE:
         case NAL_UT_SLICE:
@@ -550,7 +613,7 @@ mfxStatus AVC_Spl::ProcessNalUnit(mfxI32 nalType, mfxBitstream* nalUnit) {
                 }
 
                 if (!m_pLastSlice) {
-                    AddSliceNalUnit(nalUnit, pSlice);
+                    stsAdd = AddOrKeepNalUnit(nalUnit, pSlice);
                 }
                 else {
                     m_lastNalUnit = nalUnit;
@@ -568,15 +631,15 @@ mfxStatus AVC_Spl::ProcessNalUnit(mfxI32 nalType, mfxBitstream* nalUnit) {
         case NAL_UNIT_SUBSET_SPS:
         case NAL_UNIT_PREFIX:
             DecodeHeader(nalUnit);
-            AddNalUnit(nalUnit);
+            stsAdd = AddOrKeepNalUnit(nalUnit, NULL);
             break;
 
         case NAL_UT_SEI:
             DecodeSEI(nalUnit);
-            AddNalUnit(nalUnit);
+            stsAdd = AddOrKeepNalUnit(nalUnit, NULL);
             break;
         case NAL_UT_AUD:
-            AddNalUnit(nalUnit);
+            stsAdd = AddOrKeepNalUnit(nalUnit, NULL);
             break;
 
         case NAL_UT_DPA:
@@ -588,19 +651,29 @@ mfxStatus AVC_Spl::ProcessNalUnit(mfxI32 nalType, mfxBitstream* nalUnit) {
 
         case NAL_END_OF_STREAM:
         case NAL_END_OF_SEQ: {
-            AddNalUnit(nalUnit);
+            stsAdd = AddOrKeepNalUnit(nalUnit, NULL);
         } break;
 
         default:
             break;
     };
 
-    return MFX_ERR_MORE_DATA;
+    return stsAdd == MFX_ERR_NOT_ENOUGH_BUFFER ? stsAdd : MFX_ERR_MORE_DATA;
 }
 
 mfxStatus AVC_Spl::GetFrame(mfxBitstream* bs_in, FrameSplitterInfo** frame) {
     *frame = 0;
 
+    // NAL unit which didn't fit the frame buffer on the previous call
+    if (m_pendingNalUnit) {
+        mfxStatus sts = m_pendingSlice ? AddSliceNalUnit(m_pendingNalUnit, m_pendingSlice)
+                                       : AddNalUnit(m_pendingNalUnit);
+        if (sts != MFX_ERR_NONE)
+            return sts;
+        m_pendingNalUnit = 0;
+        m_pendingSlice   = 0;
+    }
+
     do {
         if (m_pLastSlice) {
             AVCSlice* pSlice = m_pLastSlice;
@@ -609,8 +682,11 @@ mfxStatus AVC_Spl::GetFrame(mfxBitstream* bs_in, FrameSplitterInfo** frame) {
                 printf("ERROR: m_lastNalUnit=NULL\n");
                 return MFX_ERR_NULL_PTR;
             }
-            AddSliceNalUnit(m_lastNalUnit, pSlice);
-            m_lastNalUnit = 0;
+            mfxBitstream* nalUnit = m_lastNalUnit;
+            m_lastNalUnit         = 0;
+            mfxStatus stsAdd      = AddOrKeepNalUnit(nalUnit, pSlice);
+            if (stsAdd != MFX_ERR_NONE)
+                return stsAdd;
             if (sts == MFX_ERR_NONE)
                 return MFX_ERR_NONE;
         }
@@ -618,6 +694,8 @@ mfxStatus AVC_Spl::GetFrame(mfxBitstream* bs_in, FrameSplitterInfo** frame) {
         mfxBitstream* destination = NULL;
         mfxI32 nalType            = m_pNALSplitter->GetNalUnits(bs_in, destination);
         mfxStatus sts             = ProcessNalUnit(nalType, destination);
+        if (sts == MFX_ERR_NOT_ENOUGH_BUFFER)
+            return sts;
 
         if (sts == MFX_ERR_NONE || (!bs_in && m_frame.SliceNum)) {
             m_currentInfo = 0;
@@ -188,6 +188,35 @@ mfxStatus BaseFrameAllocator::FreeFrames(mfxFrameAllocResponse* response) {
     return MFX_ERR_INVALID_HANDLE;
 }
 
+mfxStatus BaseFrameAllocator::ReleaseResponseFrame(mfxFrameAllocResponse* response, mfxU16 index) {
+    std::lock_guard<std::mutex> lock(mtx);
+
+    if (!response || !response->mids || index >= response->NumFrameActual ||
+        !response->mids[index])
+        return MFX_ERR_INVALID_HANDLE;
+
+    if (!index)
+        return MFX_ERR_UNSUPPORTED;
+
+    auto isSame = std::bind(IsSame(), std::placeholders::_1, *response);
+    std::list<UniqueResponse>::iterator i =
+        std::find_if(m_ExtResponses.begin(), m_ExtResponses.end(), isSame);
+    if (i != m_ExtResponses.end()) {
+        // other component may use the frame
+        if (i->m_refCount > 1)
+            return MFX_ERR_UNSUPPORTED;
+    }
+    else if (std::find_if(m_responses.begin(), m_responses.end(), isSame) == m_responses.end()) {
+        return MFX_ERR_INVALID_HANDLE;
+    }
+
+    mfxStatus sts = ReleaseFrameImpl(response, index);
+    if (MFX_ERR_NONE == sts)
+        response->mids[index] = NULL;
+
+    return sts;
+}
+
 mfxStatus BaseFrameAllocator::Close() {
     std::lock_guard<std::mutex> lock(mtx);
 
@@ -27,7 +27,11 @@ GeneralAllocator::GeneralAllocator()
         : m_MidsGuard(),
           m_Mids(),
           m_D3DAllocator(),
-          m_SYSAllocator(){};
+          m_SYSAllocator(),
+          m_SYSPlacement(),
+          m_SYSUseSlab(false),
+          m_SYSUsePool(false),
+          m_SYSZeroInit(false){};
 GeneralAllocator::~GeneralAllocator(){};
 mfxStatus GeneralAllocator::Init(mfxAllocatorParams* pParams) {
     mfxStatus sts = MFX_ERR_NONE;
@@ -54,8 +58,14 @@ mfxStatus GeneralAllocator::Init(mfxAllocatorParams* pParams) {
         MSDK_CHECK_STATUS(sts, "m_D3DAllocator.get failed");
     }
 
+    SysMemAllocatorParams sysParams;
+    sysParams.bUseSlab  = m_SYSUseSlab;
+    sysParams.bZeroInit = m_SYSZeroInit;
+    sysParams.bUsePool  = m_SYSUsePool;
+    sysParams.Placement = m_SYSPlacement;
+
     m_SYSAllocator.reset(new SysMemFrameAllocator());
-    sts = m_SYSAllocator->Init(0);
+    sts = m_SYSAllocator->Init(&sysParams);
     MSDK_CHECK_STATUS(sts, "m_SYSAllocator.get failed");
 
     return sts;
@@ -101,6 +111,21 @@ mfxStatus GeneralAllocator::ReleaseResponse(mfxFrameAllocResponse* response) {
         return m_SYSAllocator.get()->Free(m_SYSAllocator.get(), response);
 }
 
+mfxStatus GeneralAllocator::ReleaseFrameImpl(mfxFrameAllocResponse* response, mfxU16 index) {
+    mfxMemId mid = response->mids[index];
+
+    // video memory frames are released together with the response
+    if (isD3DMid(mid) && m_D3DAllocator.get())
+        return MFX_ERR_UNSUPPORTED;
+
+    mfxStatus sts = m_SYSAllocator.get()->ReleaseResponseFrame(response, index);
+    if (MFX_ERR_NONE == sts) {
+        std::lock_guard<std::mutex> midsGuard(m_MidsGuard);
+        m_Mids.erase(mid);
+    }
+    return sts;
+}
+
 mfxStatus GeneralAllocator::ReallocImpl(mfxMemId mid,
                                         const mfxFrameInfo* info,
                                         mfxU16 memType,
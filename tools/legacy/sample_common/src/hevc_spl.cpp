@@ -0,0 +1,404 @@
+/*############################################################################
+  # Copyright (C) 2024 Intel Corporation
+  #
+  # SPDX-License-Identifier: MIT
+  ############################################################################*/
+
+#include <string.h>
+#include <algorithm>
+
+#include "hevc_spl.h"
+#include "sample_defs.h"
+
+namespace ProtectedLibrary {
+
+enum {
+    HEVC_NAL_UNIT_HEADER_SIZE = 2,
+    // parameter set fields and beginning of slice header which are parsed fit into it
+    HEVC_PARSED_HEADER_SIZE = 256
+};
+
+static const mfxU8 start_code_prefix[] = { 0, 0, 1 };
+
+static inline mfxU8 GetNalUnitType(const mfxU8* data) {
+    return (data[0] >> 1) & 0x3f;
+}
+
+static inline mfxU8 GetLayerId(const mfxU8* data) {
+    return (mfxU8)(((data[0] & 0x1) << 5) | (data[1] >> 3));
+}
+
+static void SkipProfileTierLevel(AVCBaseBitstream& bitStream, mfxU32 maxSubLayersMinus1) {
+    // general_profile_space .. general_inbld_flag, general_level_idc
+    bitStream.SkipBits(88 + 8);
+
+    bool subLayerProfilePresent[8] = {};
+    bool subLayerLevelPresent[8]   = {};
+    for (mfxU32 i = 0; i < maxSubLayersMinus1; i++) {
+        subLayerProfilePresent[i] = bitStream.Get1Bit() != 0;
+        subLayerLevelPresent[i]   = bitStream.Get1Bit() != 0;
+    }
+
+    if (maxSubLayersMinus1 > 0)
+        bitStream.SkipBits(2 * (8 - maxSubLayersMinus1)); // reserved_zero_2bits
+
+    for (mfxU32 i = 0; i < maxSubLayersMinus1; i++) {
+        if (subLayerProfilePresent[i])
+            bitStream.SkipBits(88);
+        if (subLayerLevelPresent[i])
+            bitStream.SkipBits(8);
+    }
+}
+
+static mfxU32 CeilLog2(mfxU32 value) {
+    mfxU32 bits = 0;
+    while (((mfxU64)1 << bits) < value)
+        bits++;
+    return bits;
+}
+
+HEVC_Spl::HEVC_Spl()
+        : m_pNALSplitter(new NALUnitSplitter()),
+          m_pendingNalUnit(),
+          m_pendingTimeStamp(0),
+          m_seqParams(HEVC_MAX_NUM_SEQ_PARAM_SETS),
+          m_picParams(HEVC_MAX_NUM_PIC_PARAM_SETS),
+          m_swappingMemory(HEVC_PARSED_HEADER_SIZE + 8),
+          m_currentFrame(BUFFER_SIZE),
+          m_frameBufferSize(BUFFER_SIZE),
+          m_slices(128),
+          m_frame() {
+    m_pNALSplitter->Init();
+    m_frame.Data  = &m_currentFrame[0];
+    m_frame.Slice = &m_slices[0];
+}
+
+HEVC_Spl::~HEVC_Spl() {}
+
+mfxStatus HEVC_Spl::Reset() {
+    m_pNALSplitter->Reset();
+    m_pendingNalUnit.clear();
+    return MFX_ERR_NONE;
+}
+
+void HEVC_Spl::ResetCurrentState() {
+    m_frame.DataLength         = 0;
+    m_frame.SliceNum           = 0;
+    m_frame.FirstFieldSliceNum = 0;
+}
+
+mfxStatus HEVC_Spl::SetFrameBuffer(mfxU8* buffer, mfxU32 size) {
+    if (!buffer) {
+        if (m_currentFrame.size() < m_frame.DataLength)
+            m_currentFrame.resize(m_frame.DataLength);
+        buffer = &m_currentFrame[0];
+        size   = (mfxU32)m_currentFrame.size();
+    }
+
+    if (buffer == m_frame.Data) {
+        m_frameBufferSize = size;
+        return MFX_ERR_NONE;
+    }
+
+    // keep the part of access unit which is already assembled
+    if (m_frame.DataLength > size)
+        return MFX_ERR_NOT_ENOUGH_BUFFER;
+
+    if (m_frame.DataLength)
+        memmove(buffer, m_frame.Data, m_frame.DataLength);
+
+    m_frame.Data      = buffer;
+    m_frameBufferSize = size;
+
+    return MFX_ERR_NONE;
+}
+
+mfxStatus HEVC_Spl::CheckFrameBuffer(mfxU64 size) {
+    mfxU64 required = m_frame.DataLength + size;
+    if (required <= m_frameBufferSize)
+        return MFX_ERR_NONE;
+
+    if (m_frame.Data != &m_currentFrame[0] || required > 0xffffffff)
+        return MFX_ERR_NOT_ENOUGH_BUFFER;
+
+    m_currentFrame.resize((size_t)std::max<mfxU64>(required, 2 * m_currentFrame.size()));
+    m_frame.Data      = &m_currentFrame[0];
+    m_frameBufferSize = (mfxU32)m_currentFrame.size();
+
+    return MFX_ERR_NONE;
+}
+
+void HEVC_Spl::InitBitstream(AVCBaseBitstream& bitStream, const mfxU8* data, mfxU32 size) {
+    mfxU32 swappingSize = std::min<mfxU32>(size, HEVC_PARSED_HEADER_SIZE);
+
+    BytesSwapper::SwapMemory(&m_swappingMemory[0],
+                             swappingSize,
+                             const_cast<mfxU8*>(data),
+                             swappingSize);
+
+    bitStream.Reset(&m_swappingMemory[0], swappingSize);
+    bitStream.SkipBits(8 * HEVC_NAL_UNIT_HEADER_SIZE);
+}
+
+void HEVC_Spl::DecodeSeqParamSet(const mfxU8* data, mfxU32 size) {
+    AVCBaseBitstream bitStream;
+
+    try {
+        InitBitstream(bitStream, data, size);
+
+        bitStream.GetBits(4); // sps_video_parameter_set_id
+        mfxU32 maxSubLayersMinus1 = bitStream.GetBits(3);
+        bitStream.GetBits(1); // sps_temporal_id_nesting_flag
+
+        SkipProfileTierLevel(bitStream, maxSubLayersMinus1);
+
+        mfxU32 spsId = bitStream.GetVLCElement(false);
+        if (spsId >= HEVC_MAX_NUM_SEQ_PARAM_SETS)
+            return;
+
+        mfxU32 chromaFormatIdc = bitStream.GetVLCElement(false);
+        if (chromaFormatIdc == 3)
+            bitStream.GetBits(1); // separate_colour_plane_flag
+
+        mfxU32 width  = bitStream.GetVLCElement(false);
+        mfxU32 height = bitStream.GetVLCElement(false);
+
+        if (bitStream.Get1Bit()) { // conformance_window_flag
+            for (mfxU32 i = 0; i < 4; i++)
+                bitStream.GetVLCElement(false);
+        }
+
+        bitStream.GetVLCElement(false); // bit_depth_luma_minus8
+        bitStream.GetVLCElement(false); // bit_depth_chroma_minus8
+        bitStream.GetVLCElement(false); // log2_max_pic_order_cnt_lsb_minus4
+
+        mfxU32 i = bitStream.Get1Bit() ? 0 : maxSubLayersMinus1;
+        for (; i <= maxSubLayersMinus1; i++) {
+            bitStream.GetVLCElement(false); // sps_max_dec_pic_buffering_minus1
+            bitStream.GetVLCElement(false); // sps_max_num_reorder_pics
+            bitStream.GetVLCElement(false); // sps_max_latency_increase_plus1
+        }
+
+        mfxU32 log2MinCbSize = bitStream.GetVLCElement(false) + 3;
+        mfxU32 log2CtbSize   = log2MinCbSize + bitStream.GetVLCElement(false);
+        if (log2CtbSize > 6 || !width || !height)
+            return;
+
+        mfxU32 ctbSize = 1 << log2CtbSize;
+        mfxU64 picSizeInCtbs =
+            (mfxU64)((width + ctbSize - 1) >> log2CtbSize) * ((height + ctbSize - 1) >> log2CtbSize);
+        if (picSizeInCtbs > 0xffffffff)
+            return;
+
+        m_seqParams[spsId].Valid            = true;
+        m_seqParams[spsId].SliceAddressBits = CeilLog2((mfxU32)picSizeInCtbs);
+
+        // coded picture hardly exceeds raw 4:4:4 picture
+        m_pNALSplitter->SetSuggestedSize((mfxU32)std::min<mfxU64>((mfxU64)width * height * 3,
+                                                                  0x7fffffff));
+    }
+    catch (...) {
+    }
+}
+
+void HEVC_Spl::DecodePicParamSet(const mfxU8* data, mfxU32 size) {
+    AVCBaseBitstream bitStream;
+
+    try {
+        InitBitstream(bitStream, data, size);
+
+        mfxU32 ppsId = bitStream.GetVLCElement(false);
+        mfxU32 spsId = bitStream.GetVLCElement(false);
+        if (ppsId >= HEVC_MAX_NUM_PIC_PARAM_SETS || spsId >= HEVC_MAX_NUM_SEQ_PARAM_SETS)
+            return;
+
+        HEVCPicParams& pps                = m_picParams[ppsId];
+        pps.SeqParamSetId                 = spsId;
+        pps.DependentSliceSegmentsEnabled = bitStream.Get1Bit() != 0;
+        bitStream.GetBits(1); // output_flag_present_flag
+        pps.NumExtraSliceHeaderBits = bitStream.GetBits(3);
+        pps.Valid                   = true;
+    }
+    catch (...) {
+    }
+}
+
+SliceTypeCode HEVC_Spl::DecodeSliceType(const mfxU8* data, mfxU32 size) {
+    AVCBaseBitstream bitStream;
+    mfxU8 nalUnitType = GetNalUnitType(data);
+
+    try {
+        InitBitstream(bitStream, data, size);
+
+        bool firstSliceSegment = bitStream.Get1Bit() != 0;
+        if (nalUnitType >= HEVC_NAL_UT_BLA_W_LP && nalUnitType <= HEVC_NAL_UT_RSV_IRAP_23)
+            bitStream.GetBits(1); // no_output_of_prior_pics_flag
+
+        mfxU32 ppsId = bitStream.GetVLCElement(false);
+        if (ppsId >= HEVC_MAX_NUM_PIC_PARAM_SETS || !m_picParams[ppsId].Valid)
+            return TYPE_UNKNOWN;
+
+        const HEVCPicParams& pps = m_picParams[ppsId];
+        const HEVCSeqParams& sps = m_seqParams[pps.SeqParamSetId];
+
+        if (!firstSliceSegment) {
+            bool dependentSliceSegment =
+                pps.DependentSliceSegmentsEnabled && bitStream.Get1Bit() != 0;
+            if (!sps.Valid)
+                return TYPE_UNKNOWN;
+
+            bitStream.SkipBits(sps.SliceAddressBits); // slice_segment_address
+
+            // dependent slice segment takes slice type from the previous one
+            if (dependentSliceSegment)
+                return m_frame.SliceNum ? m_slices[m_frame.SliceNum - 1].SliceType : TYPE_UNKNOWN;
+        }
+
+        bitStream.SkipBits(pps.NumExtraSliceHeaderBits); // slice_reserved_flag
+
+        switch (bitStream.GetVLCElement(false)) {
+            case 0:
+                return TYPE_B;
+            case 1:
+                return TYPE_P;
+            case 2:
+                return TYPE_I;
+            default:
+                return TYPE_UNKNOWN;
+        }
+    }
+    catch (...) {
+        return TYPE_UNKNOWN;
+    }
+}
+
+mfxStatus HEVC_Spl::AddNalUnit(const mfxU8* data, mfxU32 size, mfxU64 timeStamp) {
+    mfxStatus sts = CheckFrameBuffer((mfxU64)size + sizeof(start_code_prefix));
+    if (sts != MFX_ERR_NONE)
+        return sts;
+
+    mfxU32 offset = m_frame.DataLength;
+
+    MSDK_MEMCPY_BUF(m_frame.Data,
+                    m_frame.DataLength,
+                    m_frameBufferSize,
+                    start_code_prefix,
+                    sizeof(start_code_prefix));
+    MSDK_MEMCPY_BUF(m_frame.Data,
+                    m_frame.DataLength + sizeof(start_code_prefix),
+                    m_frameBufferSize,
+                    data,
+                    size);
+    m_frame.DataLength += (mfxU32)(size + sizeof(start_code_prefix));
+
+    mfxU8 nalUnitType = GetNalUnitType(data);
+    if (nalUnitType == HEVC_NAL_UT_SPS) {
+        DecodeSeqParamSet(data, size);
+    }
+    else if (nalUnitType == HEVC_NAL_UT_PPS) {
+        DecodePicParamSet(data, size);
+    }
+    else if (nalUnitType < HEVC_NAL_UT_VPS) { // VCL NAL unit
+        if (m_slices.size() <= m_frame.SliceNum) {
+            m_slices.resize(m_frame.SliceNum + 10);
+            m_frame.Slice = &m_slices[0];
+        }
+
+        SliceSplitterInfo& slice = m_slices[m_frame.SliceNum];
+        slice.SliceType          = DecodeSliceType(data, size);
+        slice.DataOffset         = offset;
+        slice.DataLength         = (mfxU32)(size + sizeof(start_code_prefix));
+        // slice header isn't parsed completely, only start code and NAL unit header are counted
+        slice.HeaderLength = sizeof(start_code_prefix) + HEVC_NAL_UNIT_HEADER_SIZE;
+
+        if (!m_frame.SliceNum)
+            m_frame.TimeStamp = timeStamp;
+
+        m_frame.SliceNum++;
+        m_frame.FirstFieldSliceNum++;
+    }
+
+    return MFX_ERR_NONE;
+}
+
+mfxStatus HEVC_Spl::ProcessNalUnit(mfxBitstream* nalUnit) {
+    const mfxU8* data = nalUnit->Data + nalUnit->DataOffset;
+    mfxU32 size       = nalUnit->DataLength;
+
+    if (size < HEVC_NAL_UNIT_HEADER_SIZE)
+        return MFX_ERR_MORE_DATA;
+
+    mfxU8 nalUnitType = GetNalUnitType(data);
+
+    // first NAL unit of the next access unit completes the current one
+    if (m_frame.SliceNum && !GetLayerId(data)) {
+        bool bFirst = false;
+        if (nalUnitType < HEVC_NAL_UT_VPS)
+            bFirst = size > HEVC_NAL_UNIT_HEADER_SIZE &&
+                     (data[HEVC_NAL_UNIT_HEADER_SIZE] & 0x80); // first_slice_segment_in_pic_flag
+        else
+            bFirst = (nalUnitType >= HEVC_NAL_UT_VPS && nalUnitType <= HEVC_NAL_UT_AUD) ||
+                     nalUnitType == HEVC_NAL_UT_PREFIX_SEI ||
+                     (nalUnitType >= HEVC_NAL_UT_RSV_NVCL_41 &&
+                      nalUnitType <= HEVC_NAL_UT_RSV_NVCL_44) ||
+                     (nalUnitType >= HEVC_NAL_UT_UNSPEC_48 && nalUnitType <= HEVC_NAL_UT_UNSPEC_55);
+
+        if (bFirst) {
+            m_pendingNalUnit.assign(data, data + size);
+            m_pendingTimeStamp = nalUnit->TimeStamp;
+            return MFX_ERR_NONE;
+        }
+    }
+
+    mfxStatus sts = AddNalUnit(data, size, nalUnit->TimeStamp);
+    if (sts == MFX_ERR_NOT_ENOUGH_BUFFER) {
+        // NAL unit returned by splitter is valid until the next call only
+        m_pendingNalUnit.assign(data, data + size);
+        m_pendingTimeStamp = nalUnit->TimeStamp;
+        return sts;
+    }
+
+    return (sts == MFX_ERR_NONE) ? MFX_ERR_MORE_DATA : sts;
+}
+
+mfxStatus HEVC_Spl::GetFrame(mfxBitstream* bs_in, FrameSplitterInfo** frame) {
+    *frame = NULL;
+
+    if (!m_pendingNalUnit.empty()) {
+        mfxStatus sts = AddNalUnit(&m_pendingNalUnit[0],
+                                   (mfxU32)m_pendingNalUnit.size(),
+                                   m_pendingTimeStamp);
+        if (sts != MFX_ERR_NONE)
+            return sts;
+        m_pendingNalUnit.clear();
+    }
+
+    do {
+        mfxBitstream* nalUnit = NULL;
+        m_pNALSplitter->GetNalUnits(bs_in, nalUnit);
+
+        mfxStatus sts = nalUnit ? ProcessNalUnit(nalUnit) : MFX_ERR_MORE_DATA;
+        if (sts == MFX_ERR_NONE) {
+            *frame = &m_frame;
+            return MFX_ERR_NONE;
+        }
+        else if (sts != MFX_ERR_MORE_DATA) {
+            return sts;
+        }
+    } while (bs_in && bs_in->DataLength > MINIMAL_DATA_SIZE);
+
+    if (!bs_in && m_frame.SliceNum) {
+        *frame = &m_frame;
+        return MFX_ERR_NONE;
+    }
+
+    return MFX_ERR_MORE_DATA;
+}
+
+mfxStatus HEVC_Spl::PostProcessing(FrameSplitterInfo* frame, mfxU32 sliceNum) {
+    UNREFERENCED_PARAMETER(frame);
+    UNREFERENCED_PARAMETER(sliceNum);
+    return MFX_ERR_NONE;
+}
+
+} // namespace ProtectedLibrary
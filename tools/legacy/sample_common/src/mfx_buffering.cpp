@@ -15,10 +15,10 @@ CBuffering::CBuffering()
           m_OutputSurfacesNumber(0),
           m_pSurfaces(NULL),
           m_pVppSurfaces(NULL),
-          m_FreeSurfacesPool(m_Mutex),
-          m_FreeVppSurfacesPool(m_Mutex),
-          m_UsedSurfacesPool(m_Mutex),
-          m_UsedVppSurfacesPool(m_Mutex),
+          m_FreeSurfacesPool(),
+          m_FreeVppSurfacesPool(),
+          m_UsedSurfacesPool(),
+          m_UsedVppSurfacesPool(),
           m_pFreeOutputSurfaces(NULL),
           m_OutputSurfacesPool(m_Mutex),
           m_DeliveredSurfacesPool(m_Mutex) {}
@@ -106,70 +106,47 @@ void CBuffering::FreeBuffers() {
     m_OutputSurfacesPool.m_pSurfacesHead  = NULL;
     m_OutputSurfacesPool.m_pSurfacesTail  = NULL;
 
-    m_FreeSurfacesPool.m_pSurfaces    = NULL;
-    m_FreeVppSurfacesPool.m_pSurfaces = NULL;
+    m_FreeSurfacesPool.Reset(NULL, 0);
+    m_FreeVppSurfacesPool.Reset(NULL, 0);
 }
 
 void CBuffering::ResetBuffers() {
-    mfxU32 i;
-    msdkFrameSurface* pFreeSurf = m_FreeSurfacesPool.m_pSurfaces = m_pSurfaces;
-
-    for (i = 0; i < m_SurfacesNumber; ++i) {
-        if (i < (m_SurfacesNumber - 1)) {
-            pFreeSurf[i].next     = &(pFreeSurf[i + 1]);
-            pFreeSurf[i + 1].prev = &(pFreeSurf[i]);
-        }
-    }
+    m_FreeSurfacesPool.Reset(m_pSurfaces, m_SurfacesNumber);
 }
 
 void CBuffering::ResetVppBuffers() {
-    mfxU32 i;
-    msdkFrameSurface* pFreeVppSurf = m_FreeVppSurfacesPool.m_pSurfaces = m_pVppSurfaces;
-
-    for (i = 0; i < m_OutputSurfacesNumber; ++i) {
-        if (i < (m_OutputSurfacesNumber - 1)) {
-            pFreeVppSurf[i].next     = &(pFreeVppSurf[i + 1]);
-            pFreeVppSurf[i + 1].prev = &(pFreeVppSurf[i]);
-        }
-    }
+    m_FreeVppSurfacesPool.Reset(m_pVppSurfaces, m_OutputSurfacesNumber);
 }
 
-void CBuffering::SyncFrameSurfaces() {
-    std::lock_guard<std::mutex> lock(m_Mutex);
-    msdkFrameSurface* next = NULL;
-    msdkFrameSurface* cur  = m_UsedSurfacesPool.m_pSurfacesHead;
+void CBuffering::SyncSurfaces(msdkFreeSurfacesPool& freePool, msdkUsedSurfacesPool& usedPool) {
+    // surfaces released by rendering while Media SDK still locked them
+    mfxU32 released       = freePool.TakeReleasedSurfaces();
+    msdkFrameSurface* cur = NULL;
+    while ((cur = freePool.GetReleasedSurface(released)) != NULL) {
+        usedPool.AddSurface(cur);
+    }
 
+    cur = usedPool.m_pSurfacesHead;
     while (cur) {
+        msdkFrameSurface* next = cur->next;
         if (cur->frame.Data.Locked || cur->render_lock) {
             // frame is still locked: just moving to the next one
-            cur = cur->next;
+            cur = next;
         }
         else {
             // frame was unlocked: moving it to the free surfaces array
-            m_UsedSurfacesPool.DetachSurfaceUnsafe(cur);
-            m_FreeSurfacesPool.AddSurfaceUnsafe(cur);
+            usedPool.DetachSurface(cur);
+            freePool.AddSurface(cur);
 
             cur = next;
         }
     }
 }
 
-void CBuffering::SyncVppFrameSurfaces() {
-    std::lock_guard<std::mutex> lock(m_Mutex);
-    msdkFrameSurface* next = NULL;
-    msdkFrameSurface* cur  = m_UsedVppSurfacesPool.m_pSurfacesHead;
-
-    while (cur) {
-        if (cur->frame.Data.Locked || cur->render_lock) {
-            // frame is still locked: just moving to the next one
-            cur = cur->next;
-        }
-        else {
-            // frame was unlocked: moving it to the free surfaces array
-            m_UsedVppSurfacesPool.DetachSurfaceUnsafe(cur);
-            m_FreeVppSurfacesPool.AddSurfaceUnsafe(cur);
+void CBuffering::SyncFrameSurfaces() {
+    SyncSurfaces(m_FreeSurfacesPool, m_UsedSurfacesPool);
+}
 
-            cur = next;
-        }
-    }
+void CBuffering::SyncVppFrameSurfaces() {
+    SyncSurfaces(m_FreeVppSurfacesPool, m_UsedVppSurfacesPool);
 }
@@ -39,7 +39,11 @@
 
 #else
 
+    #include <errno.h>
+    #include <limits.h>
     #include <link.h>
+    #include <sched.h>
+    #include <sys/uio.h>
     #include <string>
 
 #endif // #if defined(_WIN32) || defined(_WIN64)
@@ -590,89 +594,158 @@ mfxStatus CSmplBitstreamWriter::WriteNextFrame(mfxBitstream*, mfxU32, mfxU32) {
     return MFX_ERR_NOT_IMPLEMENTED;
 }
 
+mfxStatus CSmplBitstreamWriter::GetWrittenFrames(mfxU32, std::vector<mfxBitstream*>&) {
+    return MFX_ERR_NOT_IMPLEMENTED;
+}
+
+mfxStatus CSmplBitstreamWriter::WaitForWrittenFrames(mfxU32, mfxU32) {
+    return MFX_ERR_NOT_IMPLEMENTED;
+}
+
 mfxStatus CBitstreamWriterForParallelEncoding::WriteNextFrame(mfxBitstream* pMfxBitstream,
                                                               mfxU32 targetID,
                                                               mfxU32 frameNum) {
+    MSDK_CHECK_POINTER(pMfxBitstream, MFX_ERR_NULL_PTR);
     std::unique_lock<std::mutex> guard(m_Mutex);
 
-    mfxU32 EncoderNumber = targetID - m_BaseEncoderID;
+    mfxU32 GlobalFrameNum = 0;
+    if (!m_Segments.empty()) {
+        auto segment = m_Segments.find(targetID);
+        if (segment == m_Segments.end() || frameNum == 0) {
+            return MFX_ERR_UNDEFINED_BEHAVIOR;
+        }
 
-    //sanity check
-    if (m_GopSize == 0 || m_NumberOfEncoders == 0 || EncoderNumber > 64) {
-        return MFX_ERR_UNDEFINED_BEHAVIOR;
+        if (frameNum <= segment->second.second) {
+            //overlap with the previous segment, this frame is written by another encoder
+            pMfxBitstream->DataLength = 0;
+            pMfxBitstream->DataOffset = 0;
+            return MFX_ERR_NONE;
+        }
+        GlobalFrameNum = segment->second.first + frameNum - 1 - segment->second.second;
     }
+    else {
+        mfxU32 EncoderNumber = targetID - m_BaseEncoderID;
 
-    mfxU32 GlobalFrameNum = m_NumberOfEncoders * m_GopSize * ((frameNum - 1) / m_GopSize) +
-                            m_GopSize * EncoderNumber + (frameNum - 1) % m_GopSize;
+        //sanity check
+        if (m_GopSize == 0 || m_NumberOfEncoders == 0 || EncoderNumber > 64) {
+            return MFX_ERR_UNDEFINED_BEHAVIOR;
+        }
 
-    if (GlobalFrameNum == (mfxU32)(m_LastWrittenFrameNumber + 1)) {
-        //write bitstream directly to file
-        m_LastWrittenFrameNumber = GlobalFrameNum;
+        GlobalFrameNum = m_NumberOfEncoders * m_GopSize * ((frameNum - 1) / m_GopSize) +
+                         m_GopSize * EncoderNumber + (frameNum - 1) % m_GopSize;
+    }
 
-        if (pMfxBitstream->DataLength) {
-            mfxU32 nBytesWritten = 0;
-            nBytesWritten        = (mfxU32)fwrite(pMfxBitstream->Data + pMfxBitstream->DataOffset,
-                                           1,
-                                           pMfxBitstream->DataLength,
-                                           m_fSource);
-            MSDK_CHECK_NOT_EQUAL(nBytesWritten,
-                                 pMfxBitstream->DataLength,
-                                 MFX_ERR_UNDEFINED_BEHAVIOR);
-            pMfxBitstream->DataLength = 0;
-            pMfxBitstream->DataOffset = 0;
-            m_nProcessedFramesNum++;
-        }
+    if (GlobalFrameNum != m_NextFrameNumber) {
+        //this encoder is ahead of others, keep the frame till previous ones are written
+        m_HeldFrames[GlobalFrameNum] = std::make_pair(targetID, pMfxBitstream);
+        m_MaxReorderDepth = std::max(m_MaxReorderDepth, (mfxU32)m_HeldFrames.size());
+        return MFX_WRN_IN_EXECUTION;
+    }
 
-        //if it has been last frame in GOP, check can we output buffered frames from other encoders
-        for (bool bufferWritten = true; bufferWritten;) {
-            bufferWritten = false;
-            for (auto& buf : m_Buffer) {
-                if (buf.second.empty()) {
-                    continue;
-                }
+    //write the frame together with held ones which follow it
+    std::vector<mfxBitstream*> frames(1, pMfxBitstream);
+    m_NextFrameNumber++;
 
-                if (m_FirstFrameInBuffer[buf.first] == (mfxU32)(m_LastWrittenFrameNumber + 1)) {
-                    bufferWritten        = true;
-                    mfxU32 nBytesWritten = 0;
+    bool released = false;
+    for (auto it = m_HeldFrames.begin();
+         it != m_HeldFrames.end() && it->first == m_NextFrameNumber;
+         it = m_HeldFrames.erase(it)) {
+        frames.push_back(it->second.second);
+        m_WrittenFrames[it->second.first].push_back(it->second.second);
+        m_NextFrameNumber++;
+        released = true;
+    }
 
-                    nBytesWritten =
-                        (mfxU32)fwrite(buf.second.data(), 1, buf.second.size(), m_fSource);
-                    if (nBytesWritten != mfxU32(buf.second.size())) {
-                        return MFX_ERR_UNDEFINED_BEHAVIOR;
-                    }
-                    buf.second.clear();
-                    m_LastWrittenFrameNumber = m_LastFrameInBuffer[buf.first];
-                }
-            }
-        }
-        return MFX_ERR_NONE;
+    mfxStatus sts = WriteFrames(frames);
+    if (released) {
+        m_FramesWritten.notify_all();
     }
+    return sts;
+}
 
-    //write bitstream to buffer
-    static const int timeToSleepInMilliseconds = 10;
-    for (int i = 0; i < MSDK_ENC_WAIT_INTERVAL / timeToSleepInMilliseconds; i++) {
-        //check if buffer holds complete GOP
-        if (m_Buffer[targetID].empty() || GlobalFrameNum == m_LastFrameInBuffer[targetID] + 1) {
-            if (m_Buffer[targetID].empty()) {
-                m_FirstFrameInBuffer[targetID] = GlobalFrameNum;
+mfxStatus CBitstreamWriterForParallelEncoding::WriteFrames(
+    const std::vector<mfxBitstream*>& frames) {
+#if defined(_WIN32) || defined(_WIN64)
+    for (mfxBitstream* pBS : frames) {
+        if (pBS->DataLength) {
+            size_t nBytesWritten =
+                fwrite(pBS->Data + pBS->DataOffset, 1, pBS->DataLength, m_fSource);
+            MSDK_CHECK_NOT_EQUAL(nBytesWritten, pBS->DataLength, MFX_ERR_UNDEFINED_BEHAVIOR);
+        }
+    }
+#else
+    //whole run goes to the file with one system call, stdio buffer is bypassed
+    fflush(m_fSource);
+    std::vector<struct iovec> iov;
+    for (mfxBitstream* pBS : frames) {
+        if (pBS->DataLength) {
+            iov.push_back({ pBS->Data + pBS->DataOffset, pBS->DataLength });
+        }
+    }
+
+    int fd = fileno(m_fSource);
+    for (size_t first = 0; first < iov.size();) {
+        int count = (int)std::min<size_t>(iov.size() - first, IOV_MAX);
+        ssize_t nBytesWritten = writev(fd, &iov[first], count);
+        if (nBytesWritten < 0) {
+            if (errno == EINTR) {
+                continue;
             }
-            m_LastFrameInBuffer[targetID] = GlobalFrameNum;
+            return MFX_ERR_UNDEFINED_BEHAVIOR;
+        }
 
-            m_Buffer[targetID].insert(
-                m_Buffer[targetID].end(),
-                pMfxBitstream->Data + pMfxBitstream->DataOffset,
-                pMfxBitstream->Data + pMfxBitstream->DataOffset + pMfxBitstream->DataLength);
-            return MFX_ERR_NONE;
+        //skip written buffers, partial write continues from the middle of buffer
+        for (; first < iov.size() && (size_t)nBytesWritten >= iov[first].iov_len; first++) {
+            nBytesWritten -= iov[first].iov_len;
+        }
+        if (first < iov.size()) {
+            iov[first].iov_base = (mfxU8*)iov[first].iov_base + nBytesWritten;
+            iov[first].iov_len -= nBytesWritten;
         }
+    }
+#endif
 
-        //we have complete GOP in buffer, this channel is ahead of others, wait till buffer will be written to file
-        guard.unlock();
-        MSDK_SLEEP(timeToSleepInMilliseconds);
-        guard.lock();
+    for (mfxBitstream* pBS : frames) {
+        pBS->DataLength = 0;
+        pBS->DataOffset = 0;
+        m_nProcessedFramesNum++;
     }
+    return MFX_ERR_NONE;
+}
+
+mfxStatus CBitstreamWriterForParallelEncoding::GetWrittenFrames(
+    mfxU32 targetID,
+    std::vector<mfxBitstream*>& written) {
+    std::lock_guard<std::mutex> guard(m_Mutex);
+    auto it = m_WrittenFrames.find(targetID);
+    if (it != m_WrittenFrames.end()) {
+        written.insert(written.end(), it->second.begin(), it->second.end());
+        it->second.clear();
+    }
+    return MFX_ERR_NONE;
+}
 
-    //we've failed to write frame to buffer, this happens when one of the other channels has failed or hung
-    return MFX_ERR_UNDEFINED_BEHAVIOR;
+mfxStatus CBitstreamWriterForParallelEncoding::WaitForWrittenFrames(mfxU32 targetID,
+                                                                    mfxU32 timeout) {
+    std::unique_lock<std::mutex> guard(m_Mutex);
+    bool written = m_FramesWritten.wait_for(guard, std::chrono::milliseconds(timeout), [&] {
+        return !m_WrittenFrames[targetID].empty();
+    });
+
+    //timeout happens when one of the other channels has failed or hung
+    return written ? MFX_ERR_NONE : MFX_ERR_UNDEFINED_BEHAVIOR;
+}
+
+void CBitstreamWriterForParallelEncoding::AddSegment(mfxU32 targetID,
+                                                     mfxU32 firstFrame,
+                                                     mfxU32 skipFrames) {
+    std::lock_guard<std::mutex> guard(m_Mutex);
+    m_Segments[targetID] = std::make_pair(firstFrame, skipFrames);
+}
+
+mfxU32 CBitstreamWriterForParallelEncoding::GetMaxReorderDepth() {
+    std::lock_guard<std::mutex> guard(m_Mutex);
+    return m_MaxReorderDepth;
 }
 
 mfxStatus CBitstreamWriterForParallelEncoding::Reset() {
@@ -738,8 +811,9 @@ void CSmplBitstreamDuplicateWriter::Close() {
 }
 
 CSmplBitstreamReader::CSmplBitstreamReader() {
-    m_fSource = NULL;
-    m_bInited = false;
+    m_fSource   = NULL;
+    m_bInited   = false;
+    m_prefixPos = 0;
 }
 
 CSmplBitstreamReader::~CSmplBitstreamReader() {
@@ -752,7 +826,9 @@ void CSmplBitstreamReader::Close() {
         m_fSource = NULL;
     }
 
-    m_bInited = false;
+    m_prefix.clear();
+    m_prefixPos = 0;
+    m_bInited   = false;
 }
 
 void CSmplBitstreamReader::Reset() {
@@ -760,6 +836,8 @@ void CSmplBitstreamReader::Reset() {
         return;
 
     fseek(m_fSource, 0, SEEK_SET);
+    m_prefix.clear();
+    m_prefixPos = 0;
 }
 
 mfxStatus CSmplBitstreamReader::Init(const char* strFileName) {
@@ -777,6 +855,16 @@ mfxStatus CSmplBitstreamReader::Init(const char* strFileName) {
     return MFX_ERR_NONE;
 }
 
+mfxStatus CSmplBitstreamReader::Seek(mfxU64 offset, const std::vector<mfxU8>& prefix) {
+    if (!m_bInited)
+        return MFX_ERR_NOT_INITIALIZED;
+
+    MSDK_CHECK_NOT_EQUAL(MSDK_FSEEK64(m_fSource, offset, SEEK_SET), 0, MFX_ERR_UNSUPPORTED);
+    m_prefix    = prefix;
+    m_prefixPos = 0;
+    return MFX_ERR_NONE;
+}
+
 #define CHECK_SET_EOS(pBitstream)                  \
     if (feof(m_fSource)) {                         \
         pBitstream->DataFlag |= MFX_BITSTREAM_EOS; \
@@ -794,6 +882,20 @@ mfxStatus CSmplBitstreamReader::ReadNextFrame(mfxBitstream* pBS) {
 
     memmove(pBS->Data, pBS->Data + pBS->DataOffset, pBS->DataLength);
     pBS->DataOffset = 0;
+
+    //prefix set by Seek goes first
+    if (m_prefixPos < m_prefix.size()) {
+        mfxU32 nBytesCopied = (mfxU32)std::min<size_t>(m_prefix.size() - m_prefixPos,
+                                                       pBS->MaxLength - pBS->DataLength);
+        MSDK_MEMCPY(pBS->Data + pBS->DataLength,
+                    pBS->MaxLength - pBS->DataLength,
+                    &m_prefix[m_prefixPos],
+                    nBytesCopied);
+        m_prefixPos += nBytesCopied;
+        pBS->DataLength += nBytesCopied;
+        return MFX_ERR_NONE;
+    }
+
     mfxU32 nBytesRead =
         (mfxU32)fread(pBS->Data + pBS->DataLength, 1, pBS->MaxLength - pBS->DataLength, m_fSource);
 
@@ -2487,6 +2589,60 @@ bool IsPluginCodecSupported(mfxU32 codecFormat) {
     return true;
 }
 
+#if defined(_WIN32) || defined(_WIN64)
+static const mfxU32 MaxCpuCount = 4096;
+#else
+static const mfxU32 MaxCpuCount = CPU_SETSIZE; // cpu_set_t of msdk_thread_set_affinity
+#endif
+
+mfxStatus ParseCpuList(const char* string, std::vector<mfxU32>& cpus) {
+    cpus.clear();
+    if (!string)
+        return MFX_ERR_NULL_PTR;
+
+    std::stringstream ss(string);
+    std::string range;
+    while (std::getline(ss, range, ',')) {
+        char* stopCharacter = nullptr;
+        if (range.empty() || !isdigit(range[0]))
+            return MFX_ERR_UNKNOWN;
+        mfxU32 first = (mfxU32)strtoul(range.c_str(), &stopCharacter, 10);
+        mfxU32 last  = first;
+        if (*stopCharacter == '-') {
+            if (!isdigit(stopCharacter[1]))
+                return MFX_ERR_UNKNOWN;
+            last = (mfxU32)strtoul(stopCharacter + 1, &stopCharacter, 10);
+        }
+        // CPU indices are bounded by the affinity mask size, it also limits size of the list
+        if (*stopCharacter || first > last || last >= MaxCpuCount)
+            return MFX_ERR_UNKNOWN;
+
+        for (mfxU32 cpu = first; cpu <= last; cpu++)
+            cpus.push_back(cpu);
+    }
+
+    std::sort(cpus.begin(), cpus.end());
+    cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+    return cpus.empty() ? MFX_ERR_UNKNOWN : MFX_ERR_NONE;
+}
+
+std::string CpuListToString(const std::vector<mfxU32>& cpus) {
+    std::stringstream ss;
+    for (size_t i = 0; i < cpus.size();) {
+        size_t j = i;
+        while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1)
+            j++;
+
+        if (i)
+            ss << ",";
+        ss << cpus[i];
+        if (j > i)
+            ss << "-" << cpus[j];
+        i = j + 1;
+    }
+    return ss.str();
+}
+
 mfxStatus StrFormatToCodecFormatFourCC(char* strInput, mfxU32& codecFormat) {
     mfxStatus sts = MFX_ERR_NONE;
     codecFormat   = 0;
@@ -2661,30 +2817,21 @@ mfxI32 getMonitorType(char* str) {
     return MFX_MONITOR_MAXNUMBER;
 }
 
-CH264FrameReader::CH264FrameReader()
+CSplitterFrameReader::CSplitterFrameReader(mfxU32 codecId)
         : CSmplBitstreamReader(),
-          m_processedBS(0),
+          m_codecId(codecId),
           m_originalBS(),
           m_isEndOfStream(false),
           m_pNALSplitter(),
-          m_frame(0),
-          m_plainBuffer(0),
-          m_plainBufferSize(0),
-          m_outBS() {}
+          m_frame(0) {}
 
-CH264FrameReader::~CH264FrameReader() {}
+CSplitterFrameReader::~CSplitterFrameReader() {}
 
-void CH264FrameReader::Close() {
+void CSplitterFrameReader::Close() {
     CSmplBitstreamReader::Close();
-
-    if (NULL != m_plainBuffer) {
-        free(m_plainBuffer);
-        m_plainBuffer     = NULL;
-        m_plainBufferSize = 0;
-    }
 }
 
-mfxStatus CH264FrameReader::Init(const char* strFileName) {
+mfxStatus CSplitterFrameReader::Init(const char* strFileName) {
     mfxStatus sts = MFX_ERR_NONE;
 
     sts = CSmplBitstreamReader::Init(strFileName);
@@ -2692,20 +2839,60 @@ mfxStatus CH264FrameReader::Init(const char* strFileName) {
         return sts;
 
     m_isEndOfStream = false;
-    m_processedBS   = NULL;
 
     m_originalBS.Extend(1024 * 1024);
 
-    m_pNALSplitter.reset(new ProtectedLibrary::AVC_Spl());
+    switch (m_codecId) {
+        case MFX_CODEC_AVC:
+            m_pNALSplitter.reset(new ProtectedLibrary::AVC_Spl());
+            break;
+        case MFX_CODEC_HEVC:
+            m_pNALSplitter.reset(new ProtectedLibrary::HEVC_Spl());
+            break;
+        case MFX_CODEC_AV1:
+            m_pNALSplitter.reset(new ProtectedLibrary::AV1_Spl());
+            break;
+        default:
+            return MFX_ERR_UNSUPPORTED;
+    }
 
-    m_frame           = 0;
-    m_plainBuffer     = 0;
-    m_plainBufferSize = 0;
+    m_frame = 0;
 
     return sts;
 }
 
-mfxStatus CH264FrameReader::ReadNextFrame(mfxBitstream* pBS) {
+void CSplitterFrameReader::ResetSplitter() {
+    // drop data read before, splitter starts from the new position
+    m_originalBS.DataOffset = 0;
+    m_originalBS.DataLength = 0;
+    m_isEndOfStream         = false;
+    m_frame                 = NULL;
+    if (m_pNALSplitter) {
+        m_pNALSplitter->Reset();
+        m_pNALSplitter->ResetCurrentState();
+    }
+}
+
+void CSplitterFrameReader::Reset() {
+    CSmplBitstreamReader::Reset();
+    ResetSplitter();
+}
+
+mfxStatus CSplitterFrameReader::Seek(mfxU64 offset, const std::vector<mfxU8>& prefix) {
+    mfxStatus sts = CSmplBitstreamReader::Seek(offset, prefix);
+    if (sts != MFX_ERR_NONE)
+        return sts;
+
+    ResetSplitter();
+
+    return MFX_ERR_NONE;
+}
+
+mfxStatus CSplitterFrameReader::ReadNextFrame(mfxBitstream* pBS) {
+    MSDK_CHECK_POINTER(pBS, MFX_ERR_NULL_PTR);
+    MSDK_CHECK_POINTER(pBS->Data, MFX_ERR_NOT_ENOUGH_BUFFER);
+    MSDK_CHECK_POINTER(m_pNALSplitter.get(), MFX_ERR_NOT_INITIALIZED);
+
     mfxStatus sts = MFX_ERR_NONE;
     pBS->DataFlag = MFX_BITSTREAM_COMPLETE_FRAME;
     //read bit stream from source
@@ -2719,8 +2906,19 @@ mfxStatus CH264FrameReader::ReadNextFrame(mfxBitstream* pBS) {
         }
     }
 
+    // data not consumed by the caller is kept (e.g. partial header for DecodeHeader),
+    // NAL units of the next frame are copied from the read buffer right after it
+    if (pBS->DataOffset) {
+        memmove(pBS->Data, pBS->Data + pBS->DataOffset, pBS->DataLength);
+        pBS->DataOffset = 0;
+    }
+    sts = m_pNALSplitter->SetFrameBuffer(pBS->Data + pBS->DataLength,
+                                         pBS->MaxLength - pBS->DataLength);
+    if (sts != MFX_ERR_NONE)
+        return sts;
+
     do {
-        sts = PrepareNextFrame(m_isEndOfStream ? NULL : &m_originalBS, &m_processedBS);
+        sts = PrepareNextFrame(m_isEndOfStream ? NULL : &m_originalBS, pBS);
 
         if (sts == MFX_ERR_MORE_DATA) {
             if (m_isEndOfStream) {
@@ -2730,32 +2928,39 @@ mfxStatus CH264FrameReader::ReadNextFrame(mfxBitstream* pBS) {
             sts = CSmplBitstreamReader::ReadNextFrame(&m_originalBS);
             if (sts == MFX_ERR_MORE_DATA)
                 m_isEndOfStream = true;
+            else if (sts != MFX_ERR_NONE)
+                return sts;
+            // frame is not ready yet, it is assembled from the new data on the next iteration
+            sts = MFX_ERR_MORE_DATA;
             continue;
         }
+        else if (sts == MFX_ERR_NOT_ENOUGH_BUFFER) {
+            // caller reallocates the bitstream, so assembled part of the frame is
+            // moved to the splitter until the next call
+            mfxStatus stsSet = m_pNALSplitter->SetFrameBuffer(NULL, 0);
+            if (stsSet != MFX_ERR_NONE) {
+                // frame doesn't fit the splitter either, it is dropped and the splitter
+                // must not keep the caller's buffer
+                ResetSplitter();
+                m_pNALSplitter->SetFrameBuffer(NULL, 0);
+                return MFX_ERR_UNSUPPORTED;
+            }
+            return sts;
+        }
         else if (MFX_ERR_NONE != sts)
             return sts;
 
     } while (MFX_ERR_NONE != sts);
 
-    // get output stream
-    if (NULL != m_processedBS) {
-        mfxStatus copySts = CopyBitstream2(pBS, m_processedBS);
-        if (copySts < MFX_ERR_NONE)
-            return copySts;
-        m_processedBS = NULL;
-    }
-
     return sts;
 }
 
-mfxStatus CH264FrameReader::PrepareNextFrame(mfxBitstream* in, mfxBitstream** out) {
+mfxStatus CSplitterFrameReader::PrepareNextFrame(mfxBitstream* in, mfxBitstream* out) {
     mfxStatus sts = MFX_ERR_NONE;
 
     if (NULL == out)
         return MFX_ERR_NULL_PTR;
 
-    *out = NULL;
-
     // get frame if it is not ready yet
     if (NULL == m_frame) {
         sts = m_pNALSplitter->GetFrame(in, &m_frame);
@@ -2763,32 +2968,15 @@ mfxStatus CH264FrameReader::PrepareNextFrame(mfxBitstream* in, mfxBitstream** ou
             return sts;
     }
 
-    if (m_plainBufferSize < m_frame->DataLength) {
-        if (NULL != m_plainBuffer) {
-            free(m_plainBuffer);
-            m_plainBuffer     = NULL;
-            m_plainBufferSize = 0;
-        }
-        m_plainBuffer = (mfxU8*)malloc(m_frame->DataLength);
-        if (NULL == m_plainBuffer)
-            return MFX_ERR_MEMORY_ALLOC;
-        m_plainBufferSize = m_frame->DataLength;
-    }
+    if (m_frame->Data != out->Data + out->DataOffset + out->DataLength)
+        return MFX_ERR_UNDEFINED_BEHAVIOR;
 
-    MSDK_MEMCPY_BUF(m_plainBuffer, 0, m_plainBufferSize, m_frame->Data, m_frame->DataLength);
-    m_outBS            = {};
-    m_outBS.Data       = m_plainBuffer;
-    m_outBS.DataOffset = 0;
-    m_outBS.DataLength = m_frame->DataLength;
-    m_outBS.MaxLength  = m_frame->DataLength;
-    m_outBS.DataFlag   = MFX_BITSTREAM_COMPLETE_FRAME;
-    m_outBS.TimeStamp  = m_frame->TimeStamp;
+    out->DataLength += m_frame->DataLength;
+    out->DataFlag   = MFX_BITSTREAM_COMPLETE_FRAME;
 
     m_pNALSplitter->ResetCurrentState();
     m_frame = NULL;
 
-    *out = &m_outBS;
-
     return sts;
 }
 
@@ -5,17 +5,178 @@
   ############################################################################*/
 
 #include "sysmem_allocator.h"
+#include <stdint.h>
 #include <memory>
 #include "sample_utils.h"
 
+#if defined(__linux__)
+    #include <ctype.h>
+    #include <dirent.h>
+    #include <sched.h>
+    #include <sys/mman.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+#endif
+
 #define MSDK_ALIGN32(X)       (((mfxU32)((X) + 31)) & (~(mfxU32)31))
 #define ID_BUFFER             MFX_MAKEFOURCC('B', 'U', 'F', 'F')
 #define ID_FRAME              MFX_MAKEFOURCC('F', 'R', 'M', 'E')
+#define ID_SLAB               MFX_MAKEFOURCC('S', 'L', 'A', 'B')
+#define ID_SLAB_FRAME         MFX_MAKEFOURCC('S', 'F', 'R', 'M')
+#define PAGE_SIZE_BYTES       4096
+#define HUGE_PAGE_SIZE_BYTES  (2 * 1024 * 1024)
 #define ALIGN_TO_PAGE_SIZE(p) (((uint64_t)p + 4095) & (~(uint64_t)4095))
 
+#if defined(__linux__)
+// returns NUMA node of the CPU or -1 if it is unknown
+static mfxI32 GetCpuNumaNode(int cpu) {
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+
+    DIR* dir = opendir(path);
+    if (!dir)
+        return -1;
+
+    mfxI32 node = -1;
+    for (struct dirent* entry = readdir(dir); entry; entry = readdir(dir)) {
+        if (!strncmp(entry->d_name, "node", 4) && isdigit(entry->d_name[4])) {
+            node = atoi(entry->d_name + 4);
+            break;
+        }
+    }
+    closedir(dir);
+    return node;
+}
+
+// returns the node if the thread can run on CPUs of a single node only
+static mfxI32 GetLocalNumaNode() {
+    cpu_set_t cpus;
+    CPU_ZERO(&cpus);
+    if (sched_getaffinity(0, sizeof(cpus), &cpus))
+        return SYSMEM_NUMA_NODE_ANY;
+
+    mfxI32 node = SYSMEM_NUMA_NODE_ANY;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, &cpus))
+            continue;
+
+        mfxI32 cpuNode = GetCpuNumaNode(cpu);
+        if (cpuNode < 0 || (node >= 0 && node != cpuNode))
+            return SYSMEM_NUMA_NODE_ANY;
+        node = cpuNode;
+    }
+    return node;
+}
+
+static void PreferNumaNode(void* ptr, size_t size, mfxI32 node) {
+    const int MPOL_PREFERRED_MODE = 1; // MPOL_PREFERRED of linux/mempolicy.h
+    const size_t bitsPerLong      = 8 * sizeof(unsigned long);
+
+    std::vector<unsigned long> nodeMask(node / bitsPerLong + 1, 0);
+    nodeMask[node / bitsPerLong] |= 1ul << (node % bitsPerLong);
+
+    // best effort: memory is placed on first touch if the kernel has no NUMA support
+    syscall(SYS_mbind,
+            ptr,
+            size,
+            MPOL_PREFERRED_MODE,
+            nodeMask.data(),
+            nodeMask.size() * bitsPerLong + 1,
+            0);
+}
+#endif
+
+static bool IsPlacementRequested(const SysMemPlacement& placement) {
+#if defined(__linux__)
+    return placement.bHugePages || placement.NumaNode != SYSMEM_NUMA_NODE_ANY;
+#else
+    (void)placement;
+    return false;
+#endif
+}
+
+// maps zeroed memory placed as requested, size is rounded up to the page size in use
+static void* MapPages(size_t& size, const SysMemPlacement& placement) {
+#if defined(__linux__)
+    const int prot  = PROT_READ | PROT_WRITE;
+    const int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    void* ptr       = MAP_FAILED;
+
+    if (placement.bHugePages) {
+        size = (size + HUGE_PAGE_SIZE_BYTES - 1) & ~((size_t)HUGE_PAGE_SIZE_BYTES - 1);
+        ptr  = mmap(NULL, size, prot, flags | MAP_HUGETLB, -1, 0);
+
+        if (MAP_FAILED == ptr) {
+            // no reserved huge pages, transparent ones need 2 MB aligned region
+            size_t mapSize = size + HUGE_PAGE_SIZE_BYTES;
+            mfxU8* region  = (mfxU8*)mmap(NULL, mapSize, prot, flags, -1, 0);
+            if (MAP_FAILED == (void*)region)
+                return NULL;
+
+            mfxU8* aligned = (mfxU8*)(((uintptr_t)region + HUGE_PAGE_SIZE_BYTES - 1) &
+                                      ~((uintptr_t)HUGE_PAGE_SIZE_BYTES - 1));
+            if (aligned != region)
+                munmap(region, aligned - region);
+            if (region + mapSize != aligned + size)
+                munmap(aligned + size, region + mapSize - (aligned + size));
+
+            ptr = aligned;
+            madvise(ptr, size, MADV_HUGEPAGE);
+        }
+    }
+    else {
+        size = ALIGN_TO_PAGE_SIZE(size);
+        ptr  = mmap(NULL, size, prot, flags, -1, 0);
+        if (MAP_FAILED == ptr)
+            return NULL;
+    }
+
+    mfxI32 node = placement.NumaNode;
+    if (SYSMEM_NUMA_NODE_LOCAL == node)
+        node = GetLocalNumaNode();
+    if (node >= 0)
+        PreferNumaNode(ptr, size, node);
+
+    return ptr;
+#else
+    (void)size;
+    (void)placement;
+    return NULL;
+#endif
+}
+
+static void UnmapPages(void* ptr, size_t size) {
+#if defined(__linux__)
+    munmap(ptr, size);
+#else
+    (void)ptr;
+    (void)size;
+#endif
+}
+
+// gives physical pages of the region back to the system, the region stays mapped and reads
+// zeroes if it is touched again
+static void DiscardPages(void* ptr, size_t size) {
+#if defined(__linux__)
+    madvise(ptr, size, MADV_DONTNEED);
+#else
+    (void)ptr;
+    (void)size;
+#endif
+}
+
 SysMemFrameAllocator::SysMemFrameAllocator()
         : m_pBufferAllocator(0),
-          m_bOwnBufferAllocator(false) {}
+          m_bOwnBufferAllocator(false),
+          m_bUseSlab(false),
+          m_bZeroInit(false),
+          m_bUsePool(false),
+          m_placement(),
+          m_pool(),
+          m_poolMutex(),
+          m_pooledBytes(0),
+          m_inUseBytes(0),
+          m_peakInUseBytes(0) {}
 
 SysMemFrameAllocator::~SysMemFrameAllocator() {
     Close();
@@ -31,11 +192,15 @@ mfxStatus SysMemFrameAllocator::Init(mfxAllocatorParams* pParams) {
 
         m_pBufferAllocator    = pSysMemParams->pBufferAllocator;
         m_bOwnBufferAllocator = false;
+        m_bUseSlab            = pSysMemParams->bUseSlab;
+        m_bZeroInit           = pSysMemParams->bZeroInit;
+        m_bUsePool            = pSysMemParams->bUsePool;
+        m_placement           = pSysMemParams->Placement;
     }
 
     // if buffer allocator wasn't passed from application create own
     if (!m_pBufferAllocator) {
-        m_pBufferAllocator = new SysMemBufferAllocator;
+        m_pBufferAllocator = new SysMemBufferAllocator(m_placement);
         if (!m_pBufferAllocator)
             return MFX_ERR_MEMORY_ALLOC;
 
@@ -48,6 +213,10 @@ mfxStatus SysMemFrameAllocator::Init(mfxAllocatorParams* pParams) {
 mfxStatus SysMemFrameAllocator::Close() {
     mfxStatus sts = BaseFrameAllocator::Close();
 
+    TrimPool(0);
+    m_inUseBytes     = 0;
+    m_peakInUseBytes = 0;
+
     if (m_bOwnBufferAllocator) {
         delete m_pBufferAllocator;
         m_pBufferAllocator = 0;
@@ -66,20 +235,32 @@ mfxStatus SysMemFrameAllocator::LockFrame(mfxMemId mid, mfxFrameData* ptr) {
     if (!mid && ptr->Y)
         return MFX_ERR_NONE;
 
-    sFrame* fs    = 0;
-    mfxStatus sts = m_pBufferAllocator->Lock(m_pBufferAllocator->pthis, mid, (mfxU8**)&fs);
+    sFrame* fs = 0;
 
-    if (MFX_ERR_NONE != sts)
-        return sts;
+    if (m_bUseSlab) {
+        sSlabFrame* slabFrame = (sSlabFrame*)mid;
+        if (!slabFrame || ID_SLAB_FRAME != slabFrame->frame.id)
+            return MFX_ERR_INVALID_HANDLE;
 
-    if (ID_FRAME != fs->id) {
-        m_pBufferAllocator->Unlock(m_pBufferAllocator->pthis, mid);
-        return MFX_ERR_INVALID_HANDLE;
+        fs     = &slabFrame->frame;
+        ptr->B = ptr->Y = slabFrame->data;
+    }
+    else {
+        mfxStatus sts = m_pBufferAllocator->Lock(m_pBufferAllocator->pthis, mid, (mfxU8**)&fs);
+
+        if (MFX_ERR_NONE != sts)
+            return sts;
+
+        if (ID_FRAME != fs->id) {
+            m_pBufferAllocator->Unlock(m_pBufferAllocator->pthis, mid);
+            return MFX_ERR_INVALID_HANDLE;
+        }
+
+        ptr->B = ptr->Y = (mfxU8*)fs + ALIGN_TO_PAGE_SIZE(sizeof(sFrame));
     }
 
     mfxU16 Width2  = (mfxU16)MSDK_ALIGN32(fs->info.Width);
     mfxU16 Height2 = (mfxU16)MSDK_ALIGN32(fs->info.Height);
-    ptr->B = ptr->Y = (mfxU8*)fs + ALIGN_TO_PAGE_SIZE(sizeof(sFrame));
 
     switch (fs->info.FourCC) {
         case MFX_FOURCC_NV12:
@@ -227,10 +408,13 @@ mfxStatus SysMemFrameAllocator::UnlockFrame(mfxMemId mid, mfxFrameData* ptr) {
     if (!mid && ptr->Y)
         return MFX_ERR_NONE;
 
-    mfxStatus sts = m_pBufferAllocator->Unlock(m_pBufferAllocator->pthis, mid);
+    // slab frames stay mapped, there is nothing to unlock
+    if (!m_bUseSlab) {
+        mfxStatus sts = m_pBufferAllocator->Unlock(m_pBufferAllocator->pthis, mid);
 
-    if (MFX_ERR_NONE != sts)
-        return sts;
+        if (MFX_ERR_NONE != sts)
+            return sts;
+    }
 
     if (NULL != ptr) {
         ptr->Pitch = 0;
@@ -353,27 +537,19 @@ mfxStatus SysMemFrameAllocator::ReallocImpl(mfxMemId mid,
     if (!pmid)
         return MFX_ERR_MEMORY_ALLOC;
 
-    mfxStatus sts = m_pBufferAllocator->Free(m_pBufferAllocator->pthis, *pmid);
+    // new frame is taken first, so the old one stays valid if there is no memory
+    mfxMemId newMid = 0;
+    mfxStatus sts   = AllocFrame(*info, nbytes, MFX_MEMTYPE_SYSTEM_MEMORY, &newMid);
     if (MFX_ERR_NONE != sts)
         return sts;
 
-    sts = m_pBufferAllocator->Alloc(m_pBufferAllocator->pthis,
-                                    MSDK_ALIGN32(nbytes) + ALIGN_TO_PAGE_SIZE(sizeof(sFrame)),
-                                    MFX_MEMTYPE_SYSTEM_MEMORY,
-                                    pmid);
-    if (MFX_ERR_NONE != sts)
+    sts = ReleaseFrame(*pmid);
+    if (MFX_ERR_NONE != sts) {
+        ReleaseFrame(newMid);
         return sts;
+    }
 
-    sFrame* fs;
-    sts = m_pBufferAllocator->Lock(m_pBufferAllocator->pthis, *pmid, (mfxU8**)&fs);
-    if (MFX_ERR_NONE != sts)
-        return sts;
-
-    fs->id   = ID_FRAME;
-    fs->info = *info;
-    m_pBufferAllocator->Unlock(m_pBufferAllocator->pthis, *pmid);
-
-    *midOut = *pmid;
+    *midOut = *pmid = newMid;
     return MFX_ERR_NONE;
 }
 
@@ -392,32 +568,39 @@ mfxStatus SysMemFrameAllocator::AllocImpl(mfxFrameAllocRequest* request,
 
     auto mids = std::make_unique<mfxMemId[]>(request->NumFrameSuggested);
 
-    // allocate frames
-    for (numAllocated = 0; numAllocated < request->NumFrameSuggested; numAllocated++) {
-        mfxStatus sts = m_pBufferAllocator->Alloc(m_pBufferAllocator->pthis,
-                                                  nbytes + ALIGN_TO_PAGE_SIZE(sizeof(sFrame)),
-                                                  request->Type,
-                                                  &(mids[numAllocated]));
-
-        if (MFX_ERR_NONE != sts)
-            break;
-
-        sFrame* fs;
-        sts = m_pBufferAllocator->Lock(m_pBufferAllocator->pthis, mids[numAllocated], (mfxU8**)&fs);
-
-        if (MFX_ERR_NONE != sts)
-            break;
+    mfxStatus sts = MFX_ERR_NONE;
 
-        fs->id   = ID_FRAME;
-        fs->info = request->Info;
-        sts      = m_pBufferAllocator->Unlock(m_pBufferAllocator->pthis, mids[numAllocated]);
+    // pooled frames go first, the rest of the frames are allocated in one slab
+    if (m_bUseSlab) {
+        size_t size = ALIGN_TO_PAGE_SIZE(nbytes);
+        while (numAllocated < request->NumFrameSuggested &&
+               TakePooledFrame(request->Info.FourCC, size, &mids[numAllocated])) {
+            sts = SetFrameInfo(mids[numAllocated++], request->Info);
+            if (MFX_ERR_NONE != sts)
+                break;
+        }
 
-        if (MFX_ERR_NONE != sts)
-            break;
+        mfxU16 numNew = (mfxU16)(request->NumFrameSuggested - numAllocated);
+        if (MFX_ERR_NONE == sts && numNew) {
+            sts = AllocSlab(request->Info, nbytes, numNew, &mids[numAllocated]);
+            if (MFX_ERR_NONE == sts) {
+                numAllocated += numNew;
+                AddInUse(numNew * size);
+            }
+        }
+    }
+    else {
+        for (; numAllocated < request->NumFrameSuggested; numAllocated++) {
+            sts = AllocFrame(request->Info, nbytes, request->Type, &mids[numAllocated]);
+            if (MFX_ERR_NONE != sts)
+                break;
+        }
     }
 
     // check the number of allocated frames
     if (numAllocated < request->NumFrameSuggested) {
+        for (mfxU32 i = 0; i < numAllocated; i++)
+            ReleaseFrame(mids[i]);
         return MFX_ERR_MEMORY_ALLOC;
     }
 
@@ -440,7 +623,7 @@ mfxStatus SysMemFrameAllocator::ReleaseResponse(mfxFrameAllocResponse* response)
     if (response->mids) {
         for (mfxU32 i = 0; i < response->NumFrameActual; i++) {
             if (response->mids[i]) {
-                sts = m_pBufferAllocator->Free(m_pBufferAllocator->pthis, response->mids[i]);
+                sts = ReleaseFrame(response->mids[i]);
                 if (MFX_ERR_NONE != sts)
                     return sts;
             }
@@ -454,7 +637,271 @@ mfxStatus SysMemFrameAllocator::ReleaseResponse(mfxFrameAllocResponse* response)
     return sts;
 }
 
-SysMemBufferAllocator::SysMemBufferAllocator() {}
+mfxStatus SysMemFrameAllocator::ReleaseFrameImpl(mfxFrameAllocResponse* response, mfxU16 index) {
+    if (!m_pBufferAllocator)
+        return MFX_ERR_NOT_INITIALIZED;
+
+    mfxMemId mid = response->mids[index];
+
+    mfxFrameInfo info;
+    mfxStatus sts = GetFrameInfo(mid, &info);
+    if (MFX_ERR_NONE != sts)
+        return sts;
+
+    size_t size = ALIGN_TO_PAGE_SIZE(
+        GetSurfaceSize(info.FourCC, MSDK_ALIGN32(info.Width), MSDK_ALIGN32(info.Height)));
+
+    // frame bypasses the pool, slab keeps its memory till the last frame, so pages of the frame
+    // are discarded right away
+    if (m_bUseSlab)
+        DiscardPages(((sSlabFrame*)mid)->data, size);
+
+    sts = FreeFrame(mid);
+    if (MFX_ERR_NONE != sts)
+        return sts;
+
+    if (m_bUsePool) {
+        std::lock_guard<std::mutex> lock(m_poolMutex);
+        m_inUseBytes -= std::min(m_inUseBytes, size);
+    }
+
+    return MFX_ERR_NONE;
+}
+
+mfxStatus SysMemFrameAllocator::AllocSlab(const mfxFrameInfo& info,
+                                          mfxU32 nbytes,
+                                          mfxU16 numFrames,
+                                          mfxMemId* mids) {
+    // headers go to the first pages, every frame starts from a page boundary
+    size_t headerSize = ALIGN_TO_PAGE_SIZE(sizeof(sSlab) + numFrames * sizeof(sSlabFrame));
+    size_t frameSize  = ALIGN_TO_PAGE_SIZE(nbytes);
+    size_t available  = SIZE_MAX - headerSize - PAGE_SIZE_BYTES;
+    if (!numFrames || frameSize > available / numFrames)
+        return MFX_ERR_MEMORY_ALLOC;
+
+    size_t allocSize  = headerSize + numFrames * frameSize;
+    size_t mappedSize = 0;
+    void* memory      = NULL;
+    mfxU8* base       = NULL;
+
+    if (IsPlacementRequested(m_placement)) {
+        // mapped memory is page aligned and zeroed
+        mappedSize = allocSize;
+        memory     = MapPages(mappedSize, m_placement);
+        base       = (mfxU8*)memory;
+    }
+    else {
+        // extra page to align the region, big calloc gets zero pages from the system
+        allocSize += PAGE_SIZE_BYTES;
+        memory = m_bZeroInit ? calloc(allocSize, 1) : malloc(allocSize);
+        base   = (mfxU8*)ALIGN_TO_PAGE_SIZE(memory);
+    }
+
+    if (!memory)
+        return MFX_ERR_MEMORY_ALLOC;
+
+    sSlab* slab      = (sSlab*)base;
+    slab->id         = ID_SLAB;
+    slab->refCount   = numFrames;
+    slab->memory     = memory;
+    slab->mappedSize = mappedSize;
+
+    sSlabFrame* frames = (sSlabFrame*)(slab + 1);
+    for (mfxU16 i = 0; i < numFrames; i++) {
+        frames[i].frame.id   = ID_SLAB_FRAME;
+        frames[i].frame.info = info;
+        frames[i].slab       = slab;
+        frames[i].data       = base + headerSize + i * frameSize;
+        mids[i]              = &frames[i];
+    }
+
+    return MFX_ERR_NONE;
+}
+
+void SysMemFrameAllocator::FreeSlabFrame(mfxMemId mid) {
+    sSlabFrame* slabFrame = (sSlabFrame*)mid;
+    if (!slabFrame || ID_SLAB_FRAME != slabFrame->frame.id)
+        return;
+
+    slabFrame->frame.id = 0;
+
+    sSlab* slab = slabFrame->slab;
+    if (--slab->refCount)
+        return;
+
+    if (slab->mappedSize)
+        UnmapPages(slab->memory, slab->mappedSize);
+    else
+        free(slab->memory);
+}
+
+mfxStatus SysMemFrameAllocator::AllocFrame(const mfxFrameInfo& info,
+                                           mfxU32 nbytes,
+                                           mfxU16 type,
+                                           mfxMemId* mid) {
+    size_t size = ALIGN_TO_PAGE_SIZE(nbytes);
+    if (TakePooledFrame(info.FourCC, size, mid))
+        return SetFrameInfo(*mid, info);
+
+    mfxStatus sts = MFX_ERR_NONE;
+    if (m_bUseSlab) {
+        sts = AllocSlab(info, nbytes, 1, mid);
+    }
+    else {
+        sts = m_pBufferAllocator->Alloc(m_pBufferAllocator->pthis,
+                                        (mfxU32)(size + ALIGN_TO_PAGE_SIZE(sizeof(sFrame))),
+                                        type,
+                                        mid);
+        if (MFX_ERR_NONE == sts) {
+            sFrame* fs;
+            sts = m_pBufferAllocator->Lock(m_pBufferAllocator->pthis, *mid, (mfxU8**)&fs);
+            if (MFX_ERR_NONE == sts) {
+                fs->id   = ID_FRAME;
+                fs->info = info;
+                sts      = m_pBufferAllocator->Unlock(m_pBufferAllocator->pthis, *mid);
+            }
+            if (MFX_ERR_NONE != sts)
+                m_pBufferAllocator->Free(m_pBufferAllocator->pthis, *mid);
+        }
+    }
+
+    if (MFX_ERR_NONE == sts)
+        AddInUse(size);
+    return sts;
+}
+
+mfxStatus SysMemFrameAllocator::ReleaseFrame(mfxMemId mid) {
+    if (!m_bUsePool)
+        return FreeFrame(mid);
+
+    mfxFrameInfo info;
+    mfxStatus sts = GetFrameInfo(mid, &info);
+    if (MFX_ERR_NONE != sts)
+        return sts;
+
+    size_t size = ALIGN_TO_PAGE_SIZE(
+        GetSurfaceSize(info.FourCC, MSDK_ALIGN32(info.Width), MSDK_ALIGN32(info.Height)));
+    {
+        std::lock_guard<std::mutex> lock(m_poolMutex);
+        m_inUseBytes -= std::min(m_inUseBytes, size);
+        m_pooledBytes += size;
+        m_pool.push_back({ info.FourCC, size, mid });
+    }
+
+    TrimPool(m_peakInUseBytes);
+    return MFX_ERR_NONE;
+}
+
+mfxStatus SysMemFrameAllocator::FreeFrame(mfxMemId mid) {
+    if (m_bUseSlab) {
+        FreeSlabFrame(mid);
+        return MFX_ERR_NONE;
+    }
+    return m_pBufferAllocator->Free(m_pBufferAllocator->pthis, mid);
+}
+
+mfxStatus SysMemFrameAllocator::GetFrameInfo(mfxMemId mid, mfxFrameInfo* info) {
+    if (m_bUseSlab) {
+        sSlabFrame* slabFrame = (sSlabFrame*)mid;
+        if (!slabFrame || ID_SLAB_FRAME != slabFrame->frame.id)
+            return MFX_ERR_INVALID_HANDLE;
+
+        *info = slabFrame->frame.info;
+        return MFX_ERR_NONE;
+    }
+
+    sFrame* fs    = 0;
+    mfxStatus sts = m_pBufferAllocator->Lock(m_pBufferAllocator->pthis, mid, (mfxU8**)&fs);
+    if (MFX_ERR_NONE != sts)
+        return sts;
+
+    if (ID_FRAME == fs->id)
+        *info = fs->info;
+    else
+        sts = MFX_ERR_INVALID_HANDLE;
+
+    m_pBufferAllocator->Unlock(m_pBufferAllocator->pthis, mid);
+    return sts;
+}
+
+mfxStatus SysMemFrameAllocator::SetFrameInfo(mfxMemId mid, const mfxFrameInfo& info) {
+    if (m_bUseSlab) {
+        sSlabFrame* slabFrame = (sSlabFrame*)mid;
+        if (!slabFrame || ID_SLAB_FRAME != slabFrame->frame.id)
+            return MFX_ERR_INVALID_HANDLE;
+
+        slabFrame->frame.info = info;
+        return MFX_ERR_NONE;
+    }
+
+    sFrame* fs    = 0;
+    mfxStatus sts = m_pBufferAllocator->Lock(m_pBufferAllocator->pthis, mid, (mfxU8**)&fs);
+    if (MFX_ERR_NONE != sts)
+        return sts;
+
+    if (ID_FRAME == fs->id)
+        fs->info = info;
+    else
+        sts = MFX_ERR_INVALID_HANDLE;
+
+    m_pBufferAllocator->Unlock(m_pBufferAllocator->pthis, mid);
+    return sts;
+}
+
+bool SysMemFrameAllocator::TakePooledFrame(mfxU32 fourCC, size_t size, mfxMemId* mid) {
+    if (!m_bUsePool)
+        return false;
+
+    {
+        std::lock_guard<std::mutex> lock(m_poolMutex);
+
+        // the most recently released frame is the most likely one to be in cache
+        auto it = std::find_if(m_pool.rbegin(), m_pool.rend(), [&](const PooledFrame& frame) {
+            return frame.FourCC == fourCC && frame.size == size;
+        });
+        if (it == m_pool.rend())
+            return false;
+
+        *mid = it->mid;
+        m_pool.erase(std::next(it).base());
+        m_pooledBytes -= size;
+
+        m_inUseBytes += size;
+        m_peakInUseBytes = std::max(m_peakInUseBytes, m_inUseBytes);
+    }
+
+    // reused frame looks like a new one, it is cleared outside of the lock
+    if (m_bZeroInit && m_bUseSlab)
+        memset(((sSlabFrame*)*mid)->data, 0, size);
+    return true;
+}
+
+void SysMemFrameAllocator::AddInUse(size_t size) {
+    if (!m_bUsePool)
+        return;
+
+    std::lock_guard<std::mutex> lock(m_poolMutex);
+    m_inUseBytes += size;
+    m_peakInUseBytes = std::max(m_peakInUseBytes, m_inUseBytes);
+}
+
+void SysMemFrameAllocator::TrimPool(size_t limit) {
+    std::list<PooledFrame> trimmed;
+    {
+        std::lock_guard<std::mutex> lock(m_poolMutex);
+        while (m_pooledBytes > limit && !m_pool.empty()) {
+            m_pooledBytes -= m_pool.front().size;
+            trimmed.splice(trimmed.end(), m_pool, m_pool.begin());
+        }
+    }
+
+    // memory is freed outside of the lock
+    for (const PooledFrame& frame : trimmed)
+        FreeFrame(frame.mid);
+}
+
+SysMemBufferAllocator::SysMemBufferAllocator(const SysMemPlacement& placement)
+        : m_placement(placement) {}
 
 SysMemBufferAllocator::~SysMemBufferAllocator() {}
 
@@ -466,16 +913,28 @@ mfxStatus SysMemBufferAllocator::AllocBuffer(mfxU32 nbytes, mfxU16 type, mfxMemI
         return MFX_ERR_UNSUPPORTED;
 
     mfxU32 header_size = ALIGN_TO_PAGE_SIZE(sizeof(sBuffer));
-    mfxU8* buffer_ptr  = (mfxU8*)calloc(header_size + ALIGN_TO_PAGE_SIZE(nbytes), 1);
+    size_t mapped_size = 0;
+    mfxU8* buffer_ptr  = NULL;
+
+    if (IsPlacementRequested(m_placement)) {
+        mapped_size = header_size + ALIGN_TO_PAGE_SIZE(nbytes);
+        buffer_ptr  = (mfxU8*)MapPages(mapped_size, m_placement);
+    }
+    else {
+        // extra page to align data, heap memory isn't page aligned
+        buffer_ptr =
+            (mfxU8*)calloc(header_size + ALIGN_TO_PAGE_SIZE(nbytes) + PAGE_SIZE_BYTES, 1);
+    }
 
     if (!buffer_ptr)
         return MFX_ERR_MEMORY_ALLOC;
 
-    sBuffer* bs = (sBuffer*)buffer_ptr;
-    bs->id      = ID_BUFFER;
-    bs->type    = type;
-    bs->nbytes  = nbytes;
-    *mid        = (mfxHDL)bs;
+    sBuffer* bs    = (sBuffer*)buffer_ptr;
+    bs->id         = ID_BUFFER;
+    bs->type       = type;
+    bs->nbytes     = nbytes;
+    bs->mappedSize = mapped_size;
+    *mid           = (mfxHDL)bs;
     return MFX_ERR_NONE;
 }
 
@@ -490,7 +949,7 @@ mfxStatus SysMemBufferAllocator::LockBuffer(mfxMemId mid, mfxU8** ptr) {
     if (ID_BUFFER != bs->id)
         return MFX_ERR_INVALID_HANDLE;
 
-    *ptr = (mfxU8*)ALIGN_TO_PAGE_SIZE(bs + sizeof(sBuffer));
+    *ptr = (mfxU8*)ALIGN_TO_PAGE_SIZE((mfxU8*)bs + sizeof(sBuffer));
     return MFX_ERR_NONE;
 }
 
@@ -508,6 +967,9 @@ mfxStatus SysMemBufferAllocator::FreeBuffer(mfxMemId mid) {
     if (!bs || ID_BUFFER != bs->id)
         return MFX_ERR_INVALID_HANDLE;
 
-    free(bs);
+    if (bs->mappedSize)
+        UnmapPages(bs, bs->mappedSize);
+    else
+        free(bs);
     return MFX_ERR_NONE;
 }
@@ -37,7 +37,7 @@ mfxU16 msdk_atomic_inc16(volatile mfxU16* pVariable) {
 /* Thread-safe 16-bit variable decrementing */
 mfxU16 msdk_atomic_dec16(volatile mfxU16* pVariable) {
     #if defined(__i386__) || defined(__x86_64__)
-    return msdk_atomic_add16(pVariable, (mfxU16)-1) + 1;
+    return msdk_atomic_add16(pVariable, (mfxU16)-1) - 1;
     #else
     return __atomic_sub_fetch(pVariable, 1, __ATOMIC_ACQ_REL);
     #endif
@@ -54,7 +54,7 @@ mfxU32 msdk_atomic_inc32(volatile mfxU32* pVariable) {
 /* Thread-safe 16-bit variable decrementing */
 mfxU32 msdk_atomic_dec32(volatile mfxU32* pVariable) {
     #if defined(__i386__) || defined(__x86_64__)
-    return msdk_atomic_add32(pVariable, (mfxU32)-1) + 1;
+    return msdk_atomic_add32(pVariable, (mfxU32)-1) - 1;
     #else
     return __atomic_sub_fetch(pVariable, 1, __ATOMIC_ACQ_REL);
     #endif
@@ -6,206 +6,246 @@
 
 #if !defined(_WIN32) && !defined(_WIN64)
 
+    #include <limits.h>
+    #include <linux/futex.h>
     #include <sched.h>
     #include <stdio.h> // setrlimit
+    #include <string.h>
     #include <sys/syscall.h>
+    #include <time.h>
     #include <unistd.h>
+    #include <algorithm>
     #include <new> // std::bad_alloc
 
     #include "sample_utils.h"
     #include "vm/thread_defs.h"
 
-MSDKSemaphore::MSDKSemaphore(mfxStatus& sts, mfxU32 count) : msdkSemaphoreHandle(count) {
-    sts     = MFX_ERR_NONE;
-    int res = pthread_cond_init(&m_semaphore, NULL);
-    if (res) {
-        // If pthread_cond_init reports an error m_semaphore was not allocated
-        throw std::bad_alloc();
-    }
-    res = pthread_mutex_init(&m_mutex, NULL);
-    if (res) {
-        if (!pthread_cond_destroy(&m_semaphore)) {
-            // do nothing
-        }
-        throw std::bad_alloc();
+enum {
+    SPIN_MIN_NS       = 2000, // spin phase of the first waits
+    SPIN_MAX_NS       = 50000, // waits which take longer on average park right away
+    WAIT_MAX_NS       = 2 * SPIN_MAX_NS, // longer waits are counted as this long
+    SPIN_CHECK_PERIOD = 16 // spin iterations between clock checks
+};
+
+static bool IsSpinUseful() {
+    // spinning only delays the thread which is going to signal if there is a single CPU
+    static const bool useful = [] {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        return !sched_getaffinity(0, sizeof(cpus), &cpus) && CPU_COUNT(&cpus) > 1;
+    }();
+    return useful;
+}
+
+static inline void CpuRelax() {
+    #if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+    #elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+    #endif
+}
+
+static mfxU64 GetTimeNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (mfxU64)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static_assert(sizeof(std::atomic<mfxU32>) == sizeof(mfxU32), "futex word must be 32 bit");
+
+// sleeps while the word keeps the value, returns false if timeout expires
+static bool FutexWait(std::atomic<mfxU32>& word, mfxU32 value, const mfxU64* pTimeoutNs = NULL) {
+    struct timespec ts;
+    if (pTimeoutNs) {
+        ts.tv_sec  = *pTimeoutNs / 1000000000;
+        ts.tv_nsec = *pTimeoutNs % 1000000000;
     }
+
+    long res = syscall(SYS_futex,
+                       reinterpret_cast<mfxU32*>(&word),
+                       FUTEX_WAIT_PRIVATE,
+                       value,
+                       pTimeoutNs ? &ts : NULL,
+                       NULL,
+                       0);
+    return !(res && ETIMEDOUT == errno);
+}
+
+static void FutexWake(std::atomic<mfxU32>& word, int count) {
+    syscall(SYS_futex, reinterpret_cast<mfxU32*>(&word), FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
 }
 
-MSDKSemaphore::~MSDKSemaphore(void) {
-    if (!pthread_mutex_destroy(&m_mutex)) {
-        // do nothing
+// Spin phase of a wait. Thread spins up to twice the recent average wait, so quick hand-offs
+// between pipeline stages don't go through the scheduler. If hand-offs take long, spinning
+// stops, and the time of parked waits brings it back once hand-offs become quick again.
+class AdaptiveSpin {
+public:
+    AdaptiveSpin(std::atomic<mfxU32>& avgWait)
+            : m_avgWait(avgWait),
+              m_useful(IsSpinUseful()),
+              m_start(m_useful ? GetTimeNs() : 0),
+              m_limit(0),
+              m_iterations(0) {
+        mfxU32 avg = m_avgWait.load(std::memory_order_relaxed);
+        if (m_useful && avg < SPIN_MAX_NS)
+            m_limit = std::max<mfxU32>(2 * avg, SPIN_MIN_NS);
     }
-    if (!pthread_cond_destroy(&m_semaphore)) {
-        // do nothing
+
+    // records time of the wait
+    ~AdaptiveSpin() {
+        if (!m_useful)
+            return;
+
+        mfxI64 waited = (mfxI64)std::min<mfxU64>(GetTimeNs() - m_start, WAIT_MAX_NS);
+        mfxI64 avg    = m_avgWait.load(std::memory_order_relaxed);
+        m_avgWait.store((mfxU32)(avg + (waited - avg) / 8), std::memory_order_relaxed);
     }
-}
 
-mfxStatus MSDKSemaphore::Post(void) {
-    int res = pthread_mutex_lock(&m_mutex);
-    if (!res) {
-        if (0 == m_count++) {
-            res = pthread_cond_signal(&m_semaphore);
-            if (!res) {
-                // do nothing
-            }
-        }
+    // returns false once spin phase is over
+    bool Spin() {
+        if (!m_limit)
+            return false;
+
+        CpuRelax();
+        if (++m_iterations % SPIN_CHECK_PERIOD)
+            return true;
+        if (GetTimeNs() - m_start < m_limit)
+            return true;
+
+        m_limit = 0;
+        return false;
     }
-    int sts = pthread_mutex_unlock(&m_mutex);
-    if (!sts) {
-        // do nothing
+
+private:
+    std::atomic<mfxU32>& m_avgWait;
+    bool m_useful;
+    mfxU64 m_start;
+    mfxU32 m_limit;
+    mfxU32 m_iterations;
+};
+
+// loads are sequentially consistent: waiter announces itself in m_waiters and then checks
+// the futex word, signaling thread changes the word and then checks m_waiters
+static bool TryDecrement(std::atomic<mfxU32>& count) {
+    mfxU32 value = count.load(std::memory_order_seq_cst);
+    while (value) {
+        if (count.compare_exchange_weak(value, value - 1, std::memory_order_seq_cst))
+            return true;
     }
-    if (!res)
-        res = sts;
-    return (res) ? MFX_ERR_UNKNOWN : MFX_ERR_NONE;
+    return false;
+}
+
+MSDKSemaphore::MSDKSemaphore(mfxStatus& sts, mfxU32 count) : msdkSemaphoreHandle(count) {
+    sts = MFX_ERR_NONE;
+}
+
+MSDKSemaphore::~MSDKSemaphore(void) {}
+
+mfxStatus MSDKSemaphore::Post(void) {
+    m_count.fetch_add(1, std::memory_order_seq_cst);
+    if (m_waiters.load(std::memory_order_seq_cst))
+        FutexWake(m_count, 1);
+    return MFX_ERR_NONE;
 }
 
 mfxStatus MSDKSemaphore::Wait(void) {
-    int res = pthread_mutex_lock(&m_mutex);
-    if (!res) {
-        while (!m_count) {
-            res = pthread_cond_wait(&m_semaphore, &m_mutex);
-            if (!res) {
-                // do nothing
-            }
-        }
-        if (!res)
-            --m_count;
-        int sts = pthread_mutex_unlock(&m_mutex);
-        if (!sts) {
-            // do nothing
-        }
-        if (!res)
-            res = sts;
+    if (TryDecrement(m_count))
+        return MFX_ERR_NONE;
+
+    AdaptiveSpin spin(m_avgWait);
+    while (spin.Spin()) {
+        if (TryDecrement(m_count))
+            return MFX_ERR_NONE;
     }
-    return (res) ? MFX_ERR_UNKNOWN : MFX_ERR_NONE;
+
+    m_waiters.fetch_add(1, std::memory_order_seq_cst);
+    while (!TryDecrement(m_count)) {
+        FutexWait(m_count, 0);
+    }
+    m_waiters.fetch_sub(1, std::memory_order_relaxed);
+
+    return MFX_ERR_NONE;
 }
 
 /* ****************************************************************************** */
 
 MSDKEvent::MSDKEvent(mfxStatus& sts, bool manual, bool state) : msdkEventHandle(manual, state) {
     sts = MFX_ERR_NONE;
-    //initialize m_event condition variable
-    int res = pthread_cond_init(&m_event, NULL);
-
-    //zero result indicates success
-    if (!res) {
-        //if successful, initialize the mutex
-        res = pthread_mutex_init(&m_mutex, NULL);
-
-        //zero result indicates success
-        //if not successful, destroy m_event
-        if (res) {
-            if (!pthread_cond_destroy(&m_event)) {
-                // do nothing
-            }
-        }
-    }
-    else {
-        //non-zero means something is wrong, throw bad_alloc
-        throw std::bad_alloc();
-    }
 }
 
-MSDKEvent::~MSDKEvent(void) {
-    if (!pthread_mutex_destroy(&m_mutex)) {
-        // do nothing
-    }
-    if (!pthread_cond_destroy(&m_event)) {
-        // do nothing
-    }
+MSDKEvent::~MSDKEvent(void) {}
+
+// takes the signaled state, auto-reset event is reset meanwhile
+static bool TryConsume(std::atomic<mfxU32>& state, bool manual) {
+    if (manual)
+        return state.load(std::memory_order_seq_cst) != 0;
+
+    mfxU32 signaled = 1;
+    return state.compare_exchange_strong(signaled, 0, std::memory_order_seq_cst);
 }
 
 mfxStatus MSDKEvent::Signal(void) {
-    int res = pthread_mutex_lock(&m_mutex);
-    if (!res) {
-        if (!m_state) {
-            m_state = true;
-            if (m_manual)
-                res = pthread_cond_broadcast(&m_event);
-            else
-                res = pthread_cond_signal(&m_event);
-            if (!res) {
-                // do nothing
-            }
-        }
-        int sts = pthread_mutex_unlock(&m_mutex);
-        if (!sts) {
-            // do nothing
-        }
-        if (!res)
-            res = sts;
-    }
-    return (res) ? MFX_ERR_UNKNOWN : MFX_ERR_NONE;
+    if (!m_state.exchange(1, std::memory_order_seq_cst) &&
+        m_waiters.load(std::memory_order_seq_cst))
+        FutexWake(m_state, m_manual ? INT_MAX : 1);
+    return MFX_ERR_NONE;
 }
 
 mfxStatus MSDKEvent::Reset(void) {
-    int res = pthread_mutex_lock(&m_mutex);
-    if (!res) {
-        if (m_state)
-            m_state = false;
-        res = pthread_mutex_unlock(&m_mutex);
-    }
-    return (res) ? MFX_ERR_UNKNOWN : MFX_ERR_NONE;
+    m_state.store(0, std::memory_order_relaxed);
+    return MFX_ERR_NONE;
 }
 
 mfxStatus MSDKEvent::Wait(void) {
-    int res = pthread_mutex_lock(&m_mutex);
-    if (!res) {
-        while (!m_state) {
-            res = pthread_cond_wait(&m_event, &m_mutex);
-            if (!res) {
-                // do nothing
-            }
-        }
-        if (!m_manual)
-            m_state = false;
-        int sts = pthread_mutex_unlock(&m_mutex);
-        if (!sts) {
-            // do nothing
-        }
-        if (!res)
-            res = sts;
+    if (TryConsume(m_state, m_manual))
+        return MFX_ERR_NONE;
+
+    AdaptiveSpin spin(m_avgWait);
+    while (spin.Spin()) {
+        if (TryConsume(m_state, m_manual))
+            return MFX_ERR_NONE;
     }
-    return (res) ? MFX_ERR_UNKNOWN : MFX_ERR_NONE;
+
+    m_waiters.fetch_add(1, std::memory_order_seq_cst);
+    while (!TryConsume(m_state, m_manual)) {
+        FutexWait(m_state, 0);
+    }
+    m_waiters.fetch_sub(1, std::memory_order_relaxed);
+
+    return MFX_ERR_NONE;
 }
 
 mfxStatus MSDKEvent::TimedWait(mfxU32 msec) {
     if (MFX_INFINITE == msec)
         return MFX_ERR_UNSUPPORTED;
-    mfxStatus mfx_res = MFX_ERR_NOT_INITIALIZED;
-
-    int res = pthread_mutex_lock(&m_mutex);
-    if (!res) {
-        if (!m_state) {
-            struct timeval tval;
-            struct timespec tspec;
-            mfxI32 res;
-
-            gettimeofday(&tval, NULL);
-            msec          = 1000 * msec + tval.tv_usec;
-            tspec.tv_sec  = tval.tv_sec + msec / 1000000;
-            tspec.tv_nsec = (msec % 1000000) * 1000;
-            res           = pthread_cond_timedwait(&m_event, &m_mutex, &tspec);
-            if (!res)
-                mfx_res = MFX_ERR_NONE;
-            else if (ETIMEDOUT == res)
-                mfx_res = MFX_TASK_WORKING;
-            else
-                mfx_res = MFX_ERR_UNKNOWN;
+
+    if (TryConsume(m_state, m_manual))
+        return MFX_ERR_NONE;
+    if (!msec)
+        return MFX_TASK_WORKING;
+
+    mfxU64 deadline = GetTimeNs() + (mfxU64)msec * 1000000;
+
+    AdaptiveSpin spin(m_avgWait);
+    while (spin.Spin()) {
+        if (TryConsume(m_state, m_manual))
+            return MFX_ERR_NONE;
+    }
+
+    mfxStatus sts = MFX_ERR_NONE;
+    m_waiters.fetch_add(1, std::memory_order_seq_cst);
+    while (!TryConsume(m_state, m_manual)) {
+        mfxU64 now     = GetTimeNs();
+        mfxU64 timeout = deadline > now ? deadline - now : 0;
+        if (!timeout || !FutexWait(m_state, 0, &timeout)) {
+            // signal may come right before the timeout
+            sts = TryConsume(m_state, m_manual) ? MFX_ERR_NONE : MFX_TASK_WORKING;
+            break;
         }
-        else
-            mfx_res = MFX_ERR_NONE;
-        if (!m_manual)
-            m_state = false;
-
-        res = pthread_mutex_unlock(&m_mutex);
-        if (res)
-            mfx_res = MFX_ERR_UNKNOWN;
     }
-    else
-        mfx_res = MFX_ERR_UNKNOWN;
+    m_waiters.fetch_sub(1, std::memory_order_relaxed);
 
-    return mfx_res;
+    return sts;
 }
 
 /* ****************************************************************************** */
@@ -319,4 +359,65 @@ mfxU32 msdk_get_current_pid() {
     return syscall(SYS_getpid);
 }
 
+mfxStatus msdk_thread_set_affinity(const std::vector<mfxU32>& cpus) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (mfxU32 cpu : cpus) {
+        if (cpu >= CPU_SETSIZE)
+            return MFX_ERR_UNSUPPORTED;
+        CPU_SET(cpu, &set);
+    }
+
+    // kernel drops CPUs which aren't allowed to the process, it fails if none is left
+    if (sched_setaffinity(0, sizeof(set), &set))
+        return MFX_ERR_UNSUPPORTED;
+    return MFX_ERR_NONE;
+}
+
+mfxStatus msdk_thread_get_affinity(std::vector<mfxU32>& cpus) {
+    cpus.clear();
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set))
+        return MFX_ERR_UNKNOWN;
+
+    for (mfxU32 cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &set))
+            cpus.push_back(cpu);
+    }
+    return MFX_ERR_NONE;
+}
+
+// reads list of CPUs or nodes from sysfs
+static mfxStatus ReadSysfsList(const char* path, std::vector<mfxU32>& list) {
+    list.clear();
+
+    FILE* file = fopen(path, "r");
+    if (!file)
+        return MFX_ERR_NOT_FOUND;
+
+    char line[4096] = {};
+    bool isRead     = fgets(line, sizeof(line), file) != NULL;
+    fclose(file);
+    if (!isRead)
+        return MFX_ERR_NOT_FOUND;
+
+    line[strcspn(line, "\n")] = 0;
+    // node without CPUs has empty list
+    if (!line[0])
+        return MFX_ERR_NONE;
+    return ParseCpuList(line, list);
+}
+
+mfxStatus msdk_get_numa_nodes(std::vector<mfxU32>& nodes) {
+    return ReadSysfsList("/sys/devices/system/node/online", nodes);
+}
+
+mfxStatus msdk_get_numa_node_cpus(mfxU32 node, std::vector<mfxU32>& cpus) {
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%u/cpulist", node);
+    return ReadSysfsList(path, cpus);
+}
+
 #endif // #if !defined(_WIN32) && !defined(_WIN64)
@@ -127,4 +127,23 @@ mfxU32 msdk_get_current_pid() {
     return GetCurrentProcessId();
 }
 
+mfxStatus msdk_thread_set_affinity(const std::vector<mfxU32>& /* cpus */) {
+    return MFX_ERR_UNSUPPORTED;
+}
+
+mfxStatus msdk_thread_get_affinity(std::vector<mfxU32>& cpus) {
+    cpus.clear();
+    return MFX_ERR_UNSUPPORTED;
+}
+
+mfxStatus msdk_get_numa_nodes(std::vector<mfxU32>& nodes) {
+    nodes.clear();
+    return MFX_ERR_UNSUPPORTED;
+}
+
+mfxStatus msdk_get_numa_node_cpus(mfxU32 /* node */, std::vector<mfxU32>& cpus) {
+    cpus.clear();
+    return MFX_ERR_UNSUPPORTED;
+}
+
 #endif // #if defined(_WIN32) || defined(_WIN64)
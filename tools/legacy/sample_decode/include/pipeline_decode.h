@@ -131,6 +131,9 @@ struct sInputParams {
 
     bool bIgnoreLevelConstrain;
 
+    bool bSysMemHugePages = false;
+    mfxI32 nSysMemNumaNode = SYSMEM_NUMA_NODE_ANY; // node id or SYSMEM_NUMA_NODE_*
+
     char strSrcFile[MSDK_MAX_FILENAME_LEN];
     char strDstFile[MSDK_MAX_FILENAME_LEN];
 
@@ -208,6 +211,8 @@ protected: // functions
     mfxStatus GetImpl(const sInputParams& params, mfxIMPL& impl);
     virtual mfxStatus CreateRenderingWindow(sInputParams* pParams);
     virtual mfxStatus InitMfxParams(sInputParams* pParams);
+    // reads next portion of the stream, the bitstream grows if a complete frame doesn't fit it
+    mfxStatus ReadNextFrame(mfxBitstreamWrapper* pBS);
 
     virtual mfxStatus AllocateExtMVCBuffers();
 
@@ -257,6 +262,7 @@ protected: // variables
     MemType m_memType; // memory type of surfaces to use
     bool m_bExternalAlloc; // use memory allocator as external for Media SDK
     bool m_bDecOutSysmem; // use system memory between Decoder and VPP, if false - video memory
+    SysMemPlacement m_sysMemPlacement; // huge pages and NUMA node of system memory surfaces
     mfxFrameAllocResponse m_mfxResponse; // memory allocation response for decoder
     mfxFrameAllocResponse m_mfxVppResponse; // memory allocation response for vpp
 
@@ -201,7 +201,7 @@ mfxStatus CDecodingPipeline::GetImpl(const sInputParams& params, mfxIMPL& impl)
     constexpr mfxU32 realloc_limit =
         4; // Limit for bitstream reallocation (it would be 2^realloc_limit times more than in beginning) before reporting an error in case if SPS couldn't be found
     for (mfxU32 i = 0;; ++i) {
-        sts = m_FileReader->ReadNextFrame(&dummy_stream);
+        sts = ReadNextFrame(&dummy_stream);
 
         if (MFX_ERR_MORE_DATA == sts && i < realloc_limit &&
             dummy_stream.MaxLength == dummy_stream.DataLength) {
@@ -278,6 +278,11 @@ mfxStatus CDecodingPipeline::Init(sInputParams* pParams) {
                 m_bIsCompleteFrame = true;
                 m_bPrintLatency    = pParams->bCalLat;
                 break;
+            case MFX_CODEC_HEVC:
+                m_FileReader.reset(new CHEVCFrameReader());
+                m_bIsCompleteFrame = true;
+                m_bPrintLatency    = pParams->bCalLat;
+                break;
             case MFX_CODEC_JPEG:
                 m_FileReader.reset(new CJPEGFrameReader());
                 m_bIsCompleteFrame = true;
@@ -291,7 +296,7 @@ mfxStatus CDecodingPipeline::Init(sInputParams* pParams) {
                 m_bPrintLatency    = pParams->bCalLat;
                 break;
             default:
-                return MFX_ERR_UNSUPPORTED; // latency mode is supported only for H.264 and JPEG codecs
+                return MFX_ERR_UNSUPPORTED; // latency mode isn't supported for the rest of codecs
         }
     }
     else {
@@ -324,6 +329,9 @@ mfxStatus CDecodingPipeline::Init(sInputParams* pParams) {
     m_strDevicePath = pParams->strDevicePath;
 #endif
 
+    m_sysMemPlacement.bHugePages = pParams->bSysMemHugePages;
+    m_sysMemPlacement.NumaNode   = pParams->nSysMemNumaNode;
+
     if (pParams->memType)
         m_memType = pParams->memType;
     else {
@@ -361,8 +369,15 @@ mfxStatus CDecodingPipeline::Init(sInputParams* pParams) {
     totalBytesProcessed = 0;
     sts                 = m_FileReader->Init(pParams->strSrcFile);
     if (sts == MFX_ERR_UNSUPPORTED && pParams->videoType == MFX_CODEC_AV1) {
-        m_FileReader.reset(new CSmplBitstreamReader());
-        printf("WARNING: Stream is not IVF, default reader\n");
+        if (m_bIsCompleteFrame) {
+            m_FileReader.reset(new CAV1FrameReader());
+            printf("WARNING: Stream is not IVF, OBU stream reader\n");
+        }
+        else {
+            m_FileReader.reset(new CSmplBitstreamReader());
+            printf("WARNING: Stream is not IVF, default reader\n");
+        }
+        sts = m_FileReader->Init(pParams->strSrcFile);
     }
     MSDK_CHECK_STATUS(sts, "m_FileReader->Init failed");
 
@@ -729,6 +744,18 @@ mfxStatus CDecodingPipeline::CreateRenderingWindow(sInputParams* pParams) {
     return sts;
 }
 
+mfxStatus CDecodingPipeline::ReadNextFrame(mfxBitstreamWrapper* pBS) {
+    mfxStatus sts = m_FileReader->ReadNextFrame(pBS);
+
+    // complete frame readers keep the frame until the bitstream is extended
+    for (int i = 0; i < 8 && MFX_ERR_NOT_ENOUGH_BUFFER == sts; i++) { //limit buffer grow to x256
+        pBS->Extend(2 * pBS->MaxLength);
+        sts = m_FileReader->ReadNextFrame(pBS);
+    }
+
+    return sts;
+}
+
 mfxStatus CDecodingPipeline::InitMfxParams(sInputParams* pParams) {
     MSDK_CHECK_POINTER(m_pmfxDEC, MFX_ERR_NULL_PTR);
     mfxStatus sts    = MFX_ERR_NONE;
@@ -774,7 +801,7 @@ mfxStatus CDecodingPipeline::InitMfxParams(sInputParams* pParams) {
             }
             // read a portion of data
             totalBytesProcessed += m_mfxBS.DataOffset;
-            sts = m_FileReader->ReadNextFrame(&m_mfxBS);
+            sts = ReadNextFrame(&m_mfxBS);
             MSDK_CHECK_STATUS(sts, "m_FileReader->ReadNextFrame failed");
 
             continue;
@@ -1386,6 +1413,7 @@ mfxStatus CDecodingPipeline::CreateAllocator() {
     mfxStatus sts = MFX_ERR_NONE;
 
     m_pGeneralAllocator = new GeneralAllocator();
+    m_pGeneralAllocator->SetSysMemPlacement(m_sysMemPlacement);
     if (m_memType != SYSTEM_MEMORY || !m_bDecOutSysmem) {
 #if D3D_SURFACES_SUPPORT
         mfxHDL hdl = NULL;
@@ -1780,7 +1808,7 @@ mfxStatus CDecodingPipeline::RunDecoding() {
         if (pBitstream &&
             ((MFX_ERR_MORE_DATA == sts) || (m_bIsCompleteFrame && !pBitstream->DataLength))) {
             CAutoTimer timer_fread(m_tick_fread);
-            sts = m_FileReader->ReadNextFrame(pBitstream); // read more data to input bit stream
+            sts = ReadNextFrame(&m_mfxBS); // read more data to input bit stream
 
             if (MFX_ERR_MORE_DATA == sts) {
                 sts = MFX_ERR_NONE;
@@ -2055,8 +2083,7 @@ mfxStatus CDecodingPipeline::RunDecoding() {
                         break;
                     }
 
-                    m_UsedVppSurfacesPool.AddSurface(m_pCurrentFreeVppSurface);
-                    msdk_atomic_inc16(&(m_pCurrentFreeVppSurface->render_lock));
+                    LockSurfaceForRendering(m_UsedVppSurfacesPool, m_pCurrentFreeVppSurface);
 
                     m_pCurrentFreeOutputSurface->surface = m_pCurrentFreeVppSurface;
                     m_OutputSurfacesPool.AddSurface(m_pCurrentFreeOutputSurface);
@@ -2068,7 +2095,7 @@ mfxStatus CDecodingPipeline::RunDecoding() {
             else {
                 msdkFrameSurface* surface = FindUsedSurface(pOutSurface);
 
-                msdk_atomic_inc16(&(surface->render_lock));
+                LockSurfaceForRendering(m_UsedSurfacesPool, surface);
 
                 m_pCurrentFreeOutputSurface->surface = surface;
                 m_OutputSurfacesPool.AddSurface(m_pCurrentFreeOutputSurface);
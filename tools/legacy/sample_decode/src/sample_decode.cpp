@@ -68,6 +68,12 @@ void PrintHelp(char* strAppName, const char* strErrorMessage) {
         "   [-dispatcher:fullSearch]  - enable search for all available implementations in Intel® VPL dispatcher\n");
     printf(
         "   [-dispatcher:lowLatency]  - enable limited implementation search and query in Intel® VPL dispatcher\n");
+    printf(
+        "   [-huge_pages]             - back system memory surfaces with 2 MB pages (Linux only)\n");
+    printf(
+        "   [-mem_numa_node node]     - allocate system memory surfaces on the NUMA node (Linux only),\n");
+    printf(
+        "                               'local' - node of CPUs the allocating thread is pinned to\n");
 #if defined(LINUX32) || defined(LINUX64)
     printf("   [-device /path/to/device] - set graphics device for processing\n");
     printf("                                 For example: '-device /dev/dri/card0'\n");
@@ -131,9 +137,9 @@ void PrintHelp(char* strAppName, const char* strErrorMessage) {
     printf("   [-window x y w h]         - set render window position and size\n");
 #endif
     printf(
-        "   [-low_latency]            - configures decoder for low latency mode (supported only for H.264 and JPEG codec)\n");
+        "   [-low_latency]            - configures decoder for low latency mode (supported for H.264, H.265, AV1, VP8, VP9 and JPEG codecs)\n");
     printf(
-        "   [-calc_latency]           - calculates latency during decoding and prints log (supported only for H.264 and JPEG codec)\n");
+        "   [-calc_latency]           - calculates latency during decoding and prints log (supported for H.264, H.265, AV1, VP8, VP9 and JPEG codecs)\n");
     printf(
         "   [-async]                  - depth of asynchronous pipeline. default value is 4. must be between 1 and 20\n");
     printf("   [-gpucopy::<on,off>] Enable or disable GPU copy mode\n");
@@ -327,14 +333,18 @@ mfxStatus ParseInputString(char* strInput[], mfxU32 nArgNum, sInputParams* pPara
             switch (pParams->videoType) {
                 case MFX_CODEC_HEVC:
                 case MFX_CODEC_AVC:
-                case MFX_CODEC_JPEG: {
+                case MFX_CODEC_JPEG:
+                case MFX_CODEC_VP8:
+                case MFX_CODEC_VP9:
+                case MFX_CODEC_AV1: {
                     pParams->bLowLat = true;
                     if (!pParams->bIsMVC)
                         break;
                 }
                 default: {
                     PrintHelp(strInput[0],
-                              "-low_latency mode is suppoted only for H.264 and JPEG codecs");
+                              "-low_latency mode is supported only for H.264, H.265, AV1, VP8, "
+                              "VP9 and JPEG codecs");
                     return MFX_ERR_UNSUPPORTED;
                 }
             }
@@ -561,6 +571,23 @@ mfxStatus ParseInputString(char* strInput[], mfxU32 nArgNum, sInputParams* pPara
         else if (msdk_match(strInput[i], "-dispatcher:lowLatency")) {
             pParams->dispFullSearch = false;
         }
+        else if (msdk_match(strInput[i], "-huge_pages")) {
+            pParams->bSysMemHugePages = true;
+        }
+        else if (msdk_match(strInput[i], "-mem_numa_node")) {
+            if (i + 1 >= nArgNum) {
+                PrintHelp(strInput[0], "Not enough parameters for -mem_numa_node key");
+                return MFX_ERR_UNSUPPORTED;
+            }
+            if (msdk_match(strInput[++i], "local")) {
+                pParams->nSysMemNumaNode = SYSMEM_NUMA_NODE_LOCAL;
+            }
+            else if (MFX_ERR_NONE != msdk_opt_read(strInput[i], pParams->nSysMemNumaNode) ||
+                     pParams->nSysMemNumaNode < 0) {
+                PrintHelp(strInput[0], "-mem_numa_node value is invalid");
+                return MFX_ERR_UNSUPPORTED;
+            }
+        }
         else if (msdk_match(strInput[i], "-dxgiFs")) {
 #if defined(_WIN32) || defined(_WIN64)
             pParams->bDxgiFs = true;
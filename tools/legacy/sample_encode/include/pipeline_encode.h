@@ -329,6 +329,9 @@ protected:
     sTask* m_pTasks;
     mfxU32 m_nPoolSize;
     mfxU32 m_nTaskBufferStart;
+    // tasks are synchronized in submission order, so busy tasks form the ring
+    // [m_nTaskBufferStart, m_nTaskBufferStart + m_nBusyTasks)
+    mfxU32 m_nBusyTasks;
 
     bool m_bGpuHangRecovery;
 
@@ -337,6 +340,7 @@ protected:
     CTimeStatistics m_statOverall;
     CTimeStatistics m_statFile;
     virtual mfxU32 GetFreeTaskIndex();
+    void UpdateBusyTasks();
 };
 
 /* This class implements a pipeline with 2 mfx components: vpp (video preprocessing) and encode */
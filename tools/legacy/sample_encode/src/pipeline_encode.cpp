@@ -82,6 +82,7 @@ CEncTaskPool::CEncTaskPool()
     m_pTasks           = NULL;
     m_pmfxSession      = NULL;
     m_nTaskBufferStart = 0;
+    m_nBusyTasks       = 0;
     m_nPoolSize        = 0;
     m_bGpuHangRecovery = false;
 }
@@ -149,6 +150,8 @@ mfxStatus CEncTaskPool::SynchronizeFirstTask(mfxU32 syncOpTimeout) {
     mfxStatus sts = MFX_ERR_NONE;
     bool bGpuHang = false;
 
+    UpdateBusyTasks();
+
     // non-null sync point indicates that task is in execution
     if (NULL != m_pTasks[m_nTaskBufferStart].EncSyncP) {
         int iteration = 0;
@@ -188,13 +191,13 @@ mfxStatus CEncTaskPool::SynchronizeFirstTask(mfxU32 syncOpTimeout) {
                 sts = m_pTasks[m_nTaskBufferStart].Reset();
                 MSDK_CHECK_STATUS(sts, "m_pTasks[m_nTaskBufferStart].Reset failed");
 
-                // move task buffer start to the next executing task
-                // the first transform frame to the right with non zero sync point
-                for (mfxU32 i = 0; i < m_nPoolSize; i++) {
+                // move task buffer start to the next executing task, if there is none
+                // the start stays at the completed task, which becomes the next free one
+                if (m_nBusyTasks > 1) {
                     m_nTaskBufferStart = (m_nTaskBufferStart + 1) % m_nPoolSize;
-                    if (NULL != m_pTasks[m_nTaskBufferStart].EncSyncP) {
-                        break;
-                    }
+                }
+                if (m_nBusyTasks) {
+                    m_nBusyTasks--;
                 }
             }
             else if (MFX_ERR_NONE_PARTIAL_OUTPUT == sts) {
@@ -236,21 +239,24 @@ mfxStatus CEncTaskPool::SynchronizeFirstTask(mfxU32 syncOpTimeout) {
     return bGpuHang ? MFX_ERR_GPU_HANG : sts;
 }
 
+void CEncTaskPool::UpdateBusyTasks() {
+    // task returned by GetFreeTask becomes busy when caller stores its sync point
+    while (m_nBusyTasks < m_nPoolSize &&
+           NULL != m_pTasks[(m_nTaskBufferStart + m_nBusyTasks) % m_nPoolSize].EncSyncP) {
+        m_nBusyTasks++;
+    }
+}
+
 mfxU32 CEncTaskPool::GetFreeTaskIndex() {
-    mfxU32 off = 0;
+    if (!m_pTasks)
+        return m_nPoolSize;
 
-    if (m_pTasks) {
-        for (off = 0; off < m_nPoolSize; off++) {
-            if (NULL == m_pTasks[(m_nTaskBufferStart + off) % m_nPoolSize].EncSyncP) {
-                break;
-            }
-        }
-    }
+    UpdateBusyTasks();
 
-    if (off >= m_nPoolSize)
+    if (m_nBusyTasks >= m_nPoolSize)
         return m_nPoolSize;
 
-    return (m_nTaskBufferStart + off) % m_nPoolSize;
+    return (m_nTaskBufferStart + m_nBusyTasks) % m_nPoolSize;
 }
 
 mfxStatus CEncTaskPool::GetFreeTask(sTask** ppTask) {
@@ -280,6 +286,7 @@ void CEncTaskPool::Close() {
 
     m_pmfxSession      = NULL;
     m_nTaskBufferStart = 0;
+    m_nBusyTasks       = 0;
     m_nPoolSize        = 0;
 }
 
@@ -292,6 +299,7 @@ void CEncTaskPool::ClearTasks() {
         m_pTasks[i].Reset();
     }
     m_nTaskBufferStart = 0;
+    m_nBusyTasks       = 0;
 }
 
 mfxStatus sTask::Init(mfxU32 nBufferSize, mfxU32 nCodecID, void* pwriter, bool bHWLib) {
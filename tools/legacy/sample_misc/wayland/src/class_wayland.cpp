@@ -516,7 +516,7 @@ void Wayland::RemoveBufferFromList(struct wl_buffer* buffer) {
         if (m_buffer->buffer == buffer) {
             if (m_buffer->pInSurface) {
                 msdkFrameSurface* surface = FindUsedSurface(m_buffer->pInSurface);
-                msdk_atomic_dec16(&(surface->render_lock));
+                ReleaseRenderLock(surface);
             }
             m_buffer->buffer     = NULL;
             m_buffer->pInSurface = NULL;
@@ -533,7 +533,7 @@ void Wayland::DestroyBufferList() {
         m_buffer = m_buffers_list.front();
         if (m_buffer->pInSurface) {
             msdkFrameSurface* surface = FindUsedSurface(m_buffer->pInSurface);
-            msdk_atomic_dec16(&(surface->render_lock));
+            ReleaseRenderLock(surface);
         }
         wl_buffer_destroy(m_buffer->buffer);
         m_buffer->buffer     = NULL;
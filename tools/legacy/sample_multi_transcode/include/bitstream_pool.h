@@ -0,0 +1,53 @@
+/*############################################################################
+  # Copyright (C) 2024 Intel Corporation
+  #
+  # SPDX-License-Identifier: MIT
+  ############################################################################*/
+
+#ifndef __BITSTREAM_POOL_H__
+#define __BITSTREAM_POOL_H__
+
+#include <map>
+#include <mutex>
+#include <vector>
+
+#include "vpl/mfxdefs.h"
+
+namespace TranscodingSample {
+
+// Process-wide pool of output bitstream buffers shared by encoders of all sessions.
+// Buffer sizes are rounded up to power of two size classes, so buffers of sessions with similar
+// settings are interchangeable. Encoders hold a buffer only while a frame is encoded and written,
+// so memory is bounded by the peak number of frames in flight rather than by the number of
+// bitstream slots of all sessions.
+class BitstreamBufferPool {
+public:
+    static BitstreamBufferPool& GetInstance();
+
+    // returns buffer of the smallest class which fits size, size is updated to the class size
+    mfxU8* Borrow(mfxU32& size);
+    void Return(mfxU8* pData, mfxU32 size);
+
+    static mfxU32 GetClassSize(mfxU32 size);
+    static mfxU32 GetNextClassSize(mfxU32 size);
+
+    mfxU64 GetAllocatedSize();
+
+protected:
+    BitstreamBufferPool();
+    ~BitstreamBufferPool();
+
+    enum { MIN_CLASS_SIZE = 64 * 1024 };
+
+    std::mutex m_mutex;
+    std::map<mfxU32, std::vector<mfxU8*>> m_FreeBuffers; // key is class size
+    mfxU64 m_AllocatedSize;
+
+private:
+    BitstreamBufferPool(const BitstreamBufferPool&);
+    void operator=(const BitstreamBufferPool&);
+};
+
+} // namespace TranscodingSample
+
+#endif // __BITSTREAM_POOL_H__
@@ -9,9 +9,12 @@
 
 #include <stddef.h>
 
+#include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <condition_variable>
 #include <ctime>
+#include <deque>
 #include <future>
 #include <iomanip>
 #include <iostream>
@@ -22,6 +25,7 @@
 #include <vector>
 
 #include "base_allocator.h"
+#include "bitstream_pool.h"
 #include "mfx_multi_vpp.h"
 #include "rotate_plugin_api.h"
 #include "sample_defs.h"
@@ -107,7 +111,7 @@ public:
         mfxU32 TargetID      = 0; //ID of the target channel
         mfxU16 SurfaceWidth  = 0; //not aligned
         mfxU16 SurfaceHeight = 0;
-        mfxU16 Size          = 20;
+        mfxU16 Size          = 20; //minimal number of surfaces, computed by PlanCascade
 
         mfxFrameAllocRequest AllocReq{};
         mfxFrameAllocResponse AllocResp{};
@@ -116,10 +120,13 @@ public:
     TargetDescriptor GetDesc(mfxU32 id);
     void PropagateCascadeParameters();
     void CreatePoolList();
+    void PlanCascade();
+    void PrintCascade();
     bool SkipFrame(mfxU32 targetID, mfxU32 frameNum);
 
     bool ParFileImported          = false;
     bool CascadeScalerRequired    = false;
+    bool CascadeScalerAuto        = false; //cascade is built by PlanCascade, not by par file
     bool ParallelEncodingRequired = false;
     mfxU32 GopSize                = 0;
 
@@ -162,6 +169,7 @@ struct ExtendedBS {
     mfxBitstreamWrapper Bitstream;
     mfxSyncPoint Syncp     = nullptr;
     PreEncAuxBuffer* pCtrl = nullptr;
+    mfxU32 PoolBufferSize  = 0; // non-zero if Bitstream.Data is borrowed from BitstreamBufferPool
 };
 
 class CIOStat : public CTimeStatistics {
@@ -244,36 +252,90 @@ protected:
 
 class ExtendedBSStore {
 public:
-    explicit ExtendedBSStore(mfxU32 size) {
+    explicit ExtendedBSStore(mfxU32 size) : m_BorrowedSize(0), m_PeakBorrowedSize(0) {
         m_pExtBS.resize(size);
+        m_FreeIndices.reserve(size);
+        ReleaseAll();
     }
     virtual ~ExtendedBSStore() {
+        ReleaseAll();
         m_pExtBS.clear();
     }
     ExtendedBS* GetNext() {
-        for (mfxU32 i = 0; i < m_pExtBS.size(); i++) {
-            if (m_pExtBS[i].IsFree) {
-                m_pExtBS[i].IsFree = false;
-                return &m_pExtBS[i];
-            }
+        if (m_FreeIndices.empty()) {
+            return NULL;
         }
-        return NULL;
+        ExtendedBS* pBS = &m_pExtBS[m_FreeIndices.back()];
+        m_FreeIndices.pop_back();
+        pBS->IsFree = false;
+        return pBS;
     }
     void Release(ExtendedBS* pBS) {
-        for (mfxU32 i = 0; i < m_pExtBS.size(); i++) {
-            if (&m_pExtBS[i] == pBS) {
-                m_pExtBS[i].IsFree = true;
-                return;
-            }
+        // m_pExtBS is never resized after construction, so slot index is found by pointer
+        if (!pBS || pBS < m_pExtBS.data() || pBS >= m_pExtBS.data() + m_pExtBS.size() ||
+            pBS->IsFree) {
+            return;
         }
+        DetachBuffer(pBS);
+        pBS->IsFree = true;
+        m_FreeIndices.push_back((mfxU32)(pBS - m_pExtBS.data()));
         return;
     }
     void ReleaseAll() {
-        for (mfxU32 i = 0; i < m_pExtBS.size(); i++) {
-            m_pExtBS[i].IsFree = true;
+        m_FreeIndices.clear();
+        // the first slot goes on top of the stack, so slots are handed out in order after reset
+        for (mfxU32 i = (mfxU32)m_pExtBS.size(); i > 0; i--) {
+            DetachBuffer(&m_pExtBS[i - 1]);
+            m_pExtBS[i - 1].IsFree = true;
+            m_FreeIndices.push_back(i - 1);
         }
         return;
     }
+    // borrows buffer of at least size bytes from BitstreamBufferPool, data of the bitstream is kept
+    mfxStatus AttachBuffer(ExtendedBS* pBS, mfxU32 size) {
+        mfxBitstreamWrapper& bs = pBS->Bitstream;
+        if (pBS->PoolBufferSize >= size)
+            return MFX_ERR_NONE;
+
+        mfxU32 bufferSize = size;
+        mfxU8* pData      = BitstreamBufferPool::GetInstance().Borrow(bufferSize);
+        if (!pData)
+            return MFX_ERR_MEMORY_ALLOC;
+
+        if (bs.Data && bs.DataLength) {
+            std::copy(bs.Data + bs.DataOffset, bs.Data + bs.DataOffset + bs.DataLength, pData);
+        }
+        bs.DataOffset = 0;
+
+        DetachBuffer(pBS, false);
+        bs.Data             = pData;
+        bs.MaxLength        = bufferSize;
+        pBS->PoolBufferSize = bufferSize;
+
+        m_BorrowedSize += bufferSize;
+        m_PeakBorrowedSize = std::max(m_PeakBorrowedSize, m_BorrowedSize);
+        return MFX_ERR_NONE;
+    }
+    // returns borrowed buffer to BitstreamBufferPool
+    void DetachBuffer(ExtendedBS* pBS, bool bResetData = true) {
+        if (!pBS->PoolBufferSize)
+            return;
+
+        BitstreamBufferPool::GetInstance().Return(pBS->Bitstream.Data, pBS->PoolBufferSize);
+        m_BorrowedSize -= pBS->PoolBufferSize;
+        pBS->PoolBufferSize = 0;
+
+        pBS->Bitstream.Data      = NULL;
+        pBS->Bitstream.MaxLength = 0;
+        if (bResetData) {
+            pBS->Bitstream.DataLength = 0;
+            pBS->Bitstream.DataOffset = 0;
+        }
+    }
+    // the largest amount of memory held by the store at once
+    mfxU64 GetPeakBorrowedSize() const {
+        return m_PeakBorrowedSize;
+    }
     void FlushAll() {
         for (mfxU32 i = 0; i < m_pExtBS.size(); i++) {
             m_pExtBS[i].Bitstream.DataLength = 0;
@@ -284,6 +346,9 @@ public:
 
 protected:
     std::vector<ExtendedBS> m_pExtBS;
+    std::vector<mfxU32> m_FreeIndices; // stack of free slots, last released is reused first
+    mfxU64 m_BorrowedSize;
+    mfxU64 m_PeakBorrowedSize;
 
 private:
     DISALLOW_COPY_AND_ASSIGN(ExtendedBSStore);
@@ -292,6 +357,9 @@ private:
 class CTranscodingPipeline;
 // thread safety buffer heterogeneous pipeline
 // only for join sessions
+// Every buffer has one writer (source session) and one reader (sink session), so surfaces are
+// passed through a ring without locks. Surfaces which don't fit into the ring go to the overflow
+// list protected by mutex, the reader takes them after the ring.
 class SafetySurfaceBuffer {
 public:
     //this is used only for sanity check
@@ -299,9 +367,10 @@ public:
     ProlongStatus Prolong = NormalFrame;
 
     struct SurfaceDescriptor {
-        SurfaceDescriptor() : ExtSurface(), Locked(false) {}
+        SurfaceDescriptor() : ExtSurface(), Locked(0) {}
         ExtendedSurface ExtSurface;
-        mfxU32 Locked;
+        // surface reference is dropped by the one who resets it
+        std::atomic<mfxU32> Locked;
     };
 
     SafetySurfaceBuffer(SafetySurfaceBuffer* pNext);
@@ -319,9 +388,19 @@ public:
     SafetySurfaceBuffer* m_pNext;
 
 protected:
+    static void Unlock(SurfaceDescriptor& sDescriptor);
+
+    enum { RING_SIZE = 64 }; // power of 2
+
+    SurfaceDescriptor m_Ring[RING_SIZE];
+    std::atomic<mfxU32> m_RingHead; // next surface to read, changed by reader only
+    std::atomic<mfxU32> m_RingTail; // next slot to write, changed by writer only
+
     std::mutex m_mutex;
-    std::list<SurfaceDescriptor> m_SList;
-    bool m_IsBufferingAllowed;
+    std::deque<SurfaceDescriptor> m_Overflow;
+    std::atomic<mfxU32> m_OverflowSize;
+
+    std::atomic<bool> m_IsBufferingAllowed;
     MSDKEvent* pRelEvent;
     MSDKEvent* pInsEvent;
 
@@ -342,6 +421,8 @@ public:
     virtual mfxStatus ProcessOutputBitstream(mfxBitstreamWrapper* pBitstream,
                                              mfxU32 targetID,
                                              mfxU32 frameNum);
+    virtual mfxStatus GetWrittenFrames(mfxU32 targetID, std::vector<mfxBitstream*>& written);
+    virtual mfxStatus WaitForWrittenFrames(mfxU32 targetID, mfxU32 timeout);
     virtual mfxStatus ResetInput();
     virtual mfxStatus ResetOutput();
     virtual bool IsNulOutput();
@@ -361,6 +442,61 @@ typedef std::vector<mfxFrameSurface1*> SurfPointersArray;
 typedef std::vector<PreEncAuxBuffer> PreEncAuxArray;
 typedef std::list<ExtendedBS*> BSList;
 
+class FreeSurfaceTracker;
+
+// Surface of a pool allocated by the pipeline. It keeps the tracker of its pool, so release of
+// the last reference is reported to the pool without any lookup. Surfaces allocated by the
+// library have FrameInterface set and aren't tracked.
+struct TrackedSurface : public mfxFrameSurfaceWrap {
+    std::atomic<FreeSurfaceTracker*> pTracker{ nullptr };
+};
+
+// Looks up free surfaces of one surface pool.
+// Data.Locked stays the only source of truth because the library locks and unlocks surfaces
+// without notifying the application. Search starts from the surface which follows the last one
+// handed out, so in steady state the first candidate is the oldest surface and is usually free.
+// Waiters sleep until the application drops the last reference to a surface of the pool (see
+// TrackedSurface) or until the given interval expires, which covers releases made by the library.
+// Surfaces given to Reset must be TrackedSurface.
+class FreeSurfaceTracker {
+public:
+    FreeSurfaceTracker();
+    ~FreeSurfaceTracker();
+
+    void Reset(const SurfPointersArray& surfaces);
+    void Clear();
+
+    // returns NULL if there is no free surface after waiting up to msec
+    mfxFrameSurface1* GetSurface(mfxU32 msec);
+    mfxU32 GetFreeCount();
+    // wakes up all waiters, e.g. when session is stopped
+    void Notify();
+
+    // usage of the pool: surfaces handed out so far and the most of them in use at once;
+    // the peak costs a pass over the pool per surface, so it is collected only on request
+    void EnableUsageStatistics(bool bEnable);
+    mfxU64 GetHandedOutCount();
+    mfxU32 GetPeakInUse();
+    // removes free surfaces above the limit from the pool, the last ones first, and returns
+    // them; the caller must be the only one who takes surfaces from the pool
+    SurfPointersArray Shrink(mfxU32 limit);
+
+protected:
+    mfxFrameSurface1* FindFreeSurface();
+
+    std::mutex m_mutex;
+    std::condition_variable m_released;
+    mfxU64 m_releaseCount;
+    SurfPointersArray m_surfaces;
+    size_t m_next;
+    mfxU64 m_handedOut;
+    mfxU32 m_peakInUse;
+    bool m_bCollectUsage;
+
+private:
+    DISALLOW_COPY_AND_ASSIGN(FreeSurfaceTracker);
+};
+
 // Bitstream is external via BitstreamProcessor
 class CTranscodingPipeline {
 public:
@@ -383,6 +519,10 @@ public:
     virtual mfxStatus Reset(VPLImplementationLoader* mfxLoader);
     virtual mfxStatus Join(MFXVideoSession* pChildSession);
     virtual mfxStatus Run();
+    // runs one iteration of transcoding loop, returns delay before the next one to keep frame rate
+    virtual mfxStatus RunStep(mfxU32& delayUs);
+    // transcoding loop can be split into steps only when the session doesn't wait for others
+    bool IsSteppable();
     virtual mfxStatus FlushLastFrames() {
         return MFX_ERR_NONE;
     }
@@ -391,6 +531,11 @@ public:
         return m_nProcessedFramesNum;
     }
 
+    // peak size of bitstream buffers borrowed from BitstreamBufferPool by this session
+    mfxU64 GetBitstreamPoolPeak() {
+        return m_pBSStore ? m_pBSStore->GetPeakBorrowedSize() : 0;
+    }
+
     bool GetJoiningFlag() {
         return m_bIsJoinSession;
     }
@@ -479,13 +624,16 @@ protected:
     virtual mfxStatus Decode();
     virtual mfxStatus Encode();
     virtual mfxStatus Transcode();
+    virtual mfxStatus TranscodeStep(mfxU32& delayUs);
+    // writes bitstreams left in the pool once the end of stream is reached
+    mfxStatus FinishTranscode();
     virtual mfxStatus DecodeOneFrame(ExtendedSurface* pExtSurface);
     virtual mfxStatus CreateBlackFrame(ExtendedSurface* pExtSurface);
     virtual mfxStatus DecodeLastFrame(ExtendedSurface* pExtSurface);
     virtual mfxStatus VPPOneFrame(ExtendedSurface* pSurfaceIn,
                                   ExtendedSurface* pExtSurface,
                                   mfxU32 ID = 0);
-    virtual mfxStatus EncodeOneFrame(ExtendedSurface* pExtSurface, mfxBitstreamWrapper* pBS);
+    virtual mfxStatus EncodeOneFrame(ExtendedSurface* pExtSurface, ExtendedBS* pBS);
     virtual mfxStatus DecodePreInit(sInputParams* pParams);
     virtual mfxStatus VPPPreInit(sInputParams* pParams);
     virtual mfxStatus EncodePreInit(sInputParams* pParams);
@@ -517,6 +665,8 @@ protected:
     mfxFrameSurface1* GetFreeSurface(bool isDec, mfxU64 timeout);
     mfxFrameSurface1* GetFreeSurfaceForCS(bool isDec, mfxU64 timeout, mfxU32 ID);
     mfxU32 GetFreeSurfacesCount(bool isDec);
+    // shrinks the pool to the peak usage once warm-up is over, system memory pools only
+    void TuneSurfacePool(bool isDec);
     PreEncAuxBuffer* GetFreePreEncAuxBuffer();
     void SetEncCtrlRT(ExtendedSurface& extSurface, bool bInsertIDR);
 
@@ -534,8 +684,19 @@ protected:
     void FreeVppDoNotUse();
     void FreeMVCSeqDesc();
 
-    mfxStatus AllocateSufficientBuffer(mfxBitstreamWrapper* pBS);
+    // caches the bitstream size the encoder asks for, call after encoder Init/Reset
+    mfxStatus UpdateEncBufferSize();
+    mfxStatus AllocateSufficientBuffer(ExtendedBS* pBS);
     mfxStatus PutBS();
+    // syncTimeout 0 polls the encoder, MFX_WRN_IN_EXECUTION is returned while it is busy
+    mfxStatus PutBS(mfxU32 syncTimeout);
+    // polls and writes ready bitstreams till fewer than maxQueued are left in the pool
+    mfxStatus PollBS(size_t maxQueued);
+    // checks if the next step would wait for a free surface
+    bool IsSurfaceWaitNeeded();
+    mfxStatus GetFreeBS(ExtendedBS*& pBS);
+    mfxStatus ReleaseWrittenBS();
+    mfxStatus WaitForWrittenBS();
 
     mfxStatus DumpSurface2File(mfxFrameSurface1* pSurface);
     mfxStatus ReplaceBlackSurface(mfxFrameSurface1* pSurface);
@@ -602,13 +763,24 @@ protected:
 
     std::map<mfxU32, SurfPointersArray> m_CSSurfacePools;
 
+    FreeSurfaceTracker m_DecSurfaceTracker;
+    FreeSurfaceTracker m_EncSurfaceTracker;
+    std::map<mfxU32, std::unique_ptr<FreeSurfaceTracker>> m_CSSurfaceTrackers;
+
     mfxU16 m_EncSurfaceType; // actual type of encoder surface pool
     mfxU16 m_DecSurfaceType; // actual type of decoder surface pool
 
+    // surfaces to hand out before pools are shrunk to the peak usage, 0 - pools aren't shrunk
+    mfxU32 m_nPoolAutoTuneFrames;
+    bool m_bDecPoolTuned;
+    bool m_bEncPoolTuned;
+
     PreEncAuxArray m_pPreEncAuxPool;
 
     // transcoding pipeline specific
     BSList m_BSPool;
+    // parallel encoding, frames which are held by writer till frames of other encoders are written
+    BSList m_HeldBS;
 
     mfxInitParamlWrap m_initPar;
 
@@ -686,6 +858,8 @@ protected:
     bool m_shouldUseShifted10BitEnc;
 
     std::unique_ptr<ExtendedBSStore> m_pBSStore;
+    // bytes the encoder needs for one frame, updated on encoder Init/Reset
+    mfxU32 m_nEncBufferSize;
 
     mfxU32 m_FrameNumberPreference;
     mfxU32 m_MaxFramesForTranscode;
@@ -694,11 +868,31 @@ protected:
     mfxU16 m_ExactNframe;
     mfxU16 m_Prolonged;
 
+    // session transcodes one segment of the input, see -segments
+    bool m_bSegmentEncoding;
+    mfxU32 m_SegmentSkipFrames;
+
     // pointer to already extended bs processor
     FileBitstreamProcessor* m_pBSProcessor;
 
     msdk_tick m_nReqFrameTime; // time required to transcode one frame
 
+    // locals of Transcode loop, kept between the steps
+    struct TranscodeLoopState {
+        bool bStarted;
+        ExtendedSurface DecExtSurface;
+        ExtendedSurface VppExtSurface;
+        bool bNeedDecodedFrames; // indicates if we need to decode frames
+        bool bEndOfFile;
+        bool bLastCycle;
+        bool shouldReadNextFrame;
+        bool bDraining; // end of stream is reached, only buffered bitstreams are left
+        msdk_tick waitStart; // when the step started to wait for the encoder or free surfaces
+        time_t start;
+    } m_TranscodeLoop;
+    // steps return and ask for a delay instead of waiting, set for sessions run by the scheduler
+    bool m_bPollSync;
+
     mfxU32 statisticsWindowSize; // Sliding window size for Statistics
     mfxU32 m_nOutputFramesNum;
 
@@ -781,6 +975,8 @@ struct ThreadTranscodeContext {
     FileBitstreamProcessor* pBSProcessor = nullptr;
     // Session implementation type
     mfxIMPL implType = MFX_IMPL_AUTO;
+    // CPUs the session thread runs on, empty - any
+    std::vector<mfxU32> cpuAffinity;
 
     // Session's starting status
     mfxStatus startStatus = MFX_ERR_NONE;
@@ -795,11 +991,24 @@ struct ThreadTranscodeContext {
     // Thread handle
     std::future<void> handle;
 
+    // Time when the launcher started the session
+    std::chrono::system_clock::time_point launchTime;
+    // Session is over, it is set by the launcher
+    bool isCompleted = false;
+    // Session is stopped by the operator, its resources are released once it is over
+    bool isRemoved = false;
+    // Description of the session kept after its pipeline is released
+    std::string sessionText;
+
     void TranscodeRoutine() {
         using namespace std::chrono;
         MSDK_CHECK_POINTER_NO_RET(pPipeline);
         transcodingSts = MFX_ERR_NONE;
 
+        // CPUs were checked when the session was created
+        if (!cpuAffinity.empty())
+            std::ignore = msdk_thread_set_affinity(cpuAffinity);
+
         auto start_time = system_clock::now();
         while (MFX_ERR_NONE == transcodingSts) {
             transcodingSts = pPipeline->Run();
@@ -809,6 +1018,39 @@ struct ThreadTranscodeContext {
         MSDK_IGNORE_MFX_STS(transcodingSts, MFX_WRN_VALUE_NOT_CHANGED);
         numTransFrames = pPipeline->GetProcessFrames();
     }
+
+    // Start of the session driven by SessionScheduler
+    std::chrono::system_clock::time_point stepStartTime;
+    bool isStepping = false;
+
+    // Step of TranscodeRoutine for SessionScheduler, returns false once the session is over
+    bool TranscodeStep(std::chrono::microseconds& delay) {
+        using namespace std::chrono;
+        if (!pPipeline) {
+            transcodingSts = MFX_ERR_NULL_PTR;
+            return false;
+        }
+
+        if (!isStepping) {
+            isStepping     = true;
+            stepStartTime  = system_clock::now();
+            transcodingSts = MFX_ERR_NONE;
+        }
+
+        mfxU32 delayUs = 0;
+        transcodingSts = pPipeline->RunStep(delayUs);
+        if (MFX_ERR_NONE == transcodingSts) {
+            delay = microseconds(delayUs);
+            return true;
+        }
+
+        isStepping   = false;
+        working_time = duration_cast<duration<mfxF64>>(system_clock::now() - stepStartTime).count();
+
+        MSDK_IGNORE_MFX_STS(transcodingSts, MFX_WRN_VALUE_NOT_CHANGED);
+        numTransFrames = pPipeline->GetProcessFrames();
+        return false;
+    }
 };
 } // namespace TranscodingSample
 
@@ -15,9 +15,13 @@
 #include "pipeline_transcode.h"
 #include "sample_utils.h"
 #include "smt_cli.h"
+#include "smt_control.h"
 #include "vpl_implementation_loader.h"
 
+#include <deque>
+#include <future>
 #include <memory>
+#include <mutex>
 #include <vector>
 #include "d3d11_allocator.h"
 #include "d3d11_device.h"
@@ -39,6 +43,8 @@
 #include "smt_cli_params.h"
 
 namespace TranscodingSample {
+class SessionCompletionQueue;
+
 class Launcher {
 public:
     Launcher();
@@ -59,12 +65,25 @@ protected:
                                            CTranscodingPipeline* pParentPipeline);
     virtual mfxStatus VerifyCrossSessionsOptions();
     virtual mfxStatus CreateSafetyBuffers();
+    mfxStatus SplitInputToSegments();
+    void ShareDecoders();
+    mfxStatus ResolveSessionPlacement();
+    void PrintSessionPlacement();
     CascadeScalerConfig& CreateCascadeScalerConfig();
+    mfxStatus CreateReader(const sInputParams& par, FileBitstreamProcessor* pProcessor);
     virtual void DoTranscoding();
     virtual void DoRobustTranscoding();
 
     virtual void Close();
 
+    // runtime control of sessions, commands are executed by the thread running DoTranscoding
+    std::string OnControlCommand(const std::string& line);
+    void ProcessControlRequests();
+    std::string ExecuteControlCommand(const std::string& line);
+    std::string GetSessionStats(mfxU32 index);
+    mfxStatus AddSession(const std::string& line);
+    void ReleaseSession(mfxU32 index);
+
     // command line parser
     std::string performance_file_name;
     std::string parameter_file_name;
@@ -96,6 +115,21 @@ protected:
     SMTTracer m_Tracer;
     std::shared_ptr<CSmplBitstreamWriter> m_GlobalBitstreamWriter{};
 
+    // device handle of the first session, sessions added at runtime share it
+    mfxHDL m_hdl;
+    std::string m_ControlSocket;
+    ControlServer m_ControlServer;
+
+    struct ControlRequest {
+        std::string Command;
+        std::promise<std::string> Reply;
+    };
+    std::mutex m_ControlMutex;
+    std::deque<std::shared_ptr<ControlRequest>> m_ControlRequests;
+    // set while sessions are running, control requests wake up DoTranscoding through it
+    SessionCompletionQueue* m_pCompletionQueue;
+    bool m_bQuit;
+
 private:
     DISALLOW_COPY_AND_ASSIGN(Launcher);
 
@@ -0,0 +1,100 @@
+/*############################################################################
+  # Copyright (C) 2024 Intel Corporation
+  #
+  # SPDX-License-Identifier: MIT
+  ############################################################################*/
+
+#ifndef __SESSION_SCHEDULER_H__
+#define __SESSION_SCHEDULER_H__
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "vpl/mfxdefs.h"
+
+namespace TranscodingSample {
+
+// Sessions report here that they are over, so launcher reacts at once instead of polling them.
+class SessionCompletionQueue {
+public:
+    SessionCompletionQueue() : m_mutex(), m_completed(), m_indices() {}
+
+    void Push(size_t index);
+    // waits for the next completed session
+    size_t Pop();
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_completed;
+    std::deque<size_t> m_indices;
+
+    SessionCompletionQueue(const SessionCompletionQueue&);
+    void operator=(const SessionCompletionQueue&);
+};
+
+// Drives sessions split into steps by a fixed number of threads instead of a thread per session.
+// Every worker owns a queue of tasks, runs them in turn for a time slice and takes tasks from
+// queues of other workers when its own queue is empty. Task step returns false once the task is
+// over, it may request a delay before the next step, e.g. to keep frame rate.
+class SessionScheduler {
+public:
+    typedef std::function<bool(std::chrono::microseconds& delay)> StepFunc;
+
+    SessionScheduler(mfxU32 numThreads);
+    ~SessionScheduler();
+
+    // tasks are submitted before Start
+    void Submit(const StepFunc& step);
+    void Start();
+    // waits till all tasks are over
+    void Wait();
+
+protected:
+    typedef std::chrono::steady_clock Clock;
+
+    struct Task {
+        StepFunc Step;
+        Clock::time_point DueTime;
+    };
+
+    struct Worker {
+        Worker() : mutex(), tasks(), thread() {}
+
+        std::mutex mutex;
+        std::deque<Task> tasks;
+        std::thread thread;
+    };
+
+    void WorkerLoop(size_t id);
+    // takes a task which is due from own queue or from queue of other worker, otherwise returns
+    // the closest due time of queued tasks
+    bool PopTask(size_t id, Task& task, Clock::time_point& nextDue);
+    void PushTask(size_t id, Task&& task);
+
+    // steps are run this long before the worker switches to the next task
+    enum { TIME_SLICE_US = 2000 };
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    size_t m_nextWorker; // worker which gets the next submitted task
+
+    std::atomic<size_t> m_numTasks; // tasks which aren't over
+    std::atomic<mfxU64> m_numPushes; // lets idle workers find out that queues were changed
+    std::atomic<size_t> m_numIdle;
+    std::mutex m_idleMutex;
+    std::condition_variable m_idle;
+
+private:
+    SessionScheduler(const SessionScheduler&);
+    void operator=(const SessionScheduler&);
+};
+
+} // namespace TranscodingSample
+
+#endif // __SESSION_SCHEDULER_H__
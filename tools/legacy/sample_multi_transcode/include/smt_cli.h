@@ -50,6 +50,8 @@ public:
     CmdProcessor();
     virtual ~CmdProcessor();
     mfxStatus ParseCmdLine(int argc, char* argv[]);
+    // parses one more session described as a line of par file
+    mfxStatus ParseSessionLine(const std::string& line);
     bool GetNextSessionParams(TranscodingSample::sInputParams& InputParams);
     std::string GetPerformanceFile() {
         return performance_file_name;
@@ -57,6 +59,9 @@ public:
     std::string GetParameterFile() {
         return parameter_file_name;
     };
+    std::string GetControlSocket() {
+        return control_socket_name;
+    };
     std::vector<std::string> GetSessionDescriptions() {
         return session_descriptions;
     };
@@ -83,12 +88,14 @@ protected:
     std::map<mfxU32, sPluginParams> m_encoderPlugins;
     std::string performance_file_name;
     std::string parameter_file_name;
+    std::string control_socket_name;
     mfxU32 statisticsWindowSize;
     FILE* statisticsLogFile;
     //store a name of a Logfile
     std::string DumpLogFileName;
     mfxU32 m_nTimeout;
     mfxU32 m_surface_wait_interval;
+    mfxU32 m_nParFileLine; // line of par file which is parsed, 0 - command line
     bool bRobustFlag;
     bool bSoftRobustFlag;
     bool shouldUseGreedyFormula;
@@ -8,6 +8,7 @@
 #define __SMT_CLI_PARAMS_H__
 
 #include "smt_tracer.h"
+#include "sysmem_allocator.h"
 #include "vpl/mfx.h"
 namespace TranscodingSample {
 
@@ -119,6 +120,11 @@ typedef struct sMCTFParam {
 } sMCTFParam;
 #endif
 
+enum {
+    SESSION_NUMA_NODE_ANY    = -1, // session threads aren't bound to a node
+    SESSION_NUMA_NODE_SPREAD = -2 // launcher picks node, sessions are spread across nodes
+};
+
 // the default api version is the latest one
 // it is located at 0
 typedef enum eAPIVersion { API_2X, API_1X } eAPIVersion;
@@ -126,10 +132,21 @@ typedef enum eAPIVersion { API_2X, API_1X } eAPIVersion;
 typedef struct sInputParams {
     mfxU32 TargetID;
     bool CascadeScaler;
+    bool CascadeScalerAuto;
     bool EnableTracing;
     mfxU32 TraceBufferSize;
+    bool TraceStreaming;
+    SMTTracer::TraceFormat TraceFormat;
     SMTTracer::LatencyType LatencyType;
     bool ParallelEncoding;
+    mfxU32 nSegments; // input is split at key frames into segments transcoded in parallel
+    mfxU32 nSegmentOverlap; // minimal number of frames decoded and encoded before segment
+    // set by launcher for each session of segment-parallel transcoding
+    mfxU32 SegmentFirstFrame;
+    mfxU64 SegmentOffset;
+    std::vector<mfxU8> SegmentParamSets; // sent to decoder before the data at SegmentOffset
+    mfxU32 SegmentSkipFrames;
+    mfxU32 nSeekFrame; // decoding starts from key frame at or before this frame
 
     // session parameters
     bool bIsJoin;
@@ -326,7 +343,19 @@ typedef struct sInputParams {
     sVppCompDstRect* pVppCompDstRects;
 
     bool bForceSysMem;
+    bool bSysMemHugePages;
+    mfxI32 nSysMemNumaNode; // node id or SYSMEM_NUMA_NODE_*
+    bool bSysMemSlab;
+    bool bSysMemPool;
+    bool bSysMemZeroInit;
+    mfxU32 nPoolAutoTuneFrames; // 0 - surface pools aren't shrunk
+    mfxU32 nSchedulerThreads; // 0 - every session runs on its own thread
+    std::vector<mfxU32> CpuAffinity; // CPUs session threads run on, empty - any
+    mfxI32 nNumaNode; // node id or SESSION_NUMA_NODE_*, narrows CpuAffinity to the node
     mfxU16 DecOutPattern;
+    bool bDecCompleteFrame; // decoder gets input by complete frames
+    bool bPrivateDecoder; // decoder isn't shared with sessions reading the same input
+    mfxU32 nParFileLine; // 1-based line of the session in par file, 0 - command line
     mfxU16 VppOutPattern;
     mfxU16 nGpuCopyMode;
 
@@ -423,10 +452,20 @@ typedef struct sInputParams {
     sInputParams()
             : TargetID(0),
               CascadeScaler(false),
+              CascadeScalerAuto(false),
               EnableTracing(false),
               TraceBufferSize(0),
+              TraceStreaming(false),
+              TraceFormat(SMTTracer::TraceFormat::JSON),
               LatencyType(SMTTracer::LatencyType::DEFAULT),
               ParallelEncoding(false),
+              nSegments(0),
+              nSegmentOverlap(0),
+              SegmentFirstFrame(0),
+              SegmentOffset(0),
+              SegmentParamSets(),
+              SegmentSkipFrames(0),
+              nSeekFrame(0),
               bIsJoin(false),
               priority(MFX_PRIORITY_NORMAL),
               libType(MFX_IMPL_SOFTWARE),
@@ -580,7 +619,19 @@ typedef struct sInputParams {
               EncoderFourCC(0),
               pVppCompDstRects(nullptr),
               bForceSysMem(false),
+              bSysMemHugePages(false),
+              nSysMemNumaNode(SYSMEM_NUMA_NODE_ANY),
+              bSysMemSlab(false),
+              bSysMemPool(false),
+              bSysMemZeroInit(false),
+              nPoolAutoTuneFrames(0),
+              nSchedulerThreads(0),
+              CpuAffinity(),
+              nNumaNode(SESSION_NUMA_NODE_ANY),
               DecOutPattern(0),
+              bDecCompleteFrame(false),
+              bPrivateDecoder(false),
+              nParFileLine(0),
               VppOutPattern(0),
               nGpuCopyMode(0),
               nRenderColorForamt(0),
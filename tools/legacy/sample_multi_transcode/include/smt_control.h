@@ -0,0 +1,55 @@
+/*############################################################################
+  # Copyright (C) 2024 Intel Corporation
+  #
+  # SPDX-License-Identifier: MIT
+  ############################################################################*/
+
+#ifndef __SMT_CONTROL_H__
+#define __SMT_CONTROL_H__
+
+#include <atomic>
+#include <functional>
+#include <string>
+#include <thread>
+
+#include "vpl/mfxdefs.h"
+
+namespace TranscodingSample {
+
+// Local control channel of the launcher. Operator connects to Unix domain socket and sends
+// commands one per line, every command gets one line of reply. Clients are served in turn by
+// the thread of the server, handler is called on this thread.
+class ControlServer {
+public:
+    typedef std::function<std::string(const std::string& command)> Handler;
+
+    ControlServer() : m_path(), m_handler(), m_listenFd(-1), m_stop(false), m_thread() {}
+    ~ControlServer();
+
+    mfxStatus Start(const std::string& path, const Handler& handler);
+    void Stop();
+
+    bool IsRunning() const {
+        return m_thread.joinable();
+    }
+
+    // splits "command arguments" line, leading and trailing spaces are dropped
+    static std::string SplitCommand(const std::string& line, std::string& args);
+
+private:
+    void ServeLoop();
+    void ServeClient(int fd);
+
+    std::string m_path;
+    Handler m_handler;
+    int m_listenFd;
+    std::atomic<bool> m_stop;
+    std::thread m_thread;
+
+    ControlServer(const ControlServer&);
+    void operator=(const ControlServer&);
+};
+
+} // namespace TranscodingSample
+
+#endif //__SMT_CONTROL_H__
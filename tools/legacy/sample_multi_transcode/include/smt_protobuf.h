@@ -0,0 +1,49 @@
+/*############################################################################
+  # Copyright (C) 2024 Intel Corporation
+  #
+  # SPDX-License-Identifier: MIT
+  ############################################################################*/
+
+#ifndef __SMT_PROTOBUF_H__
+#define __SMT_PROTOBUF_H__
+
+#include <string>
+
+#include "vpl/mfxdefs.h"
+
+namespace TranscodingSample {
+
+// Minimal protobuf encoder, it supports only what is needed to write perfetto traces.
+// Message is serialized to the buffer as fields are added, nested messages are encoded
+// separately and added as length delimited fields.
+class ProtoEncoder {
+public:
+    ProtoEncoder() : m_data() {}
+
+    void AddVarint(mfxU32 field, mfxU64 value);
+    void AddFixed64(mfxU32 field, mfxU64 value);
+    void AddString(mfxU32 field, const std::string& value);
+    void AddMessage(mfxU32 field, const ProtoEncoder& message);
+
+    bool IsEmpty() const {
+        return m_data.empty();
+    }
+    const std::string& GetData() const {
+        return m_data;
+    }
+    void Clear() {
+        m_data.clear();
+    }
+
+private:
+    enum WireType { WIRE_VARINT = 0, WIRE_FIXED64 = 1, WIRE_LENGTH_DELIMITED = 2 };
+
+    void WriteTag(mfxU32 field, WireType type);
+    void WriteVarint(mfxU64 value);
+
+    std::string m_data;
+};
+
+} // namespace TranscodingSample
+
+#endif //__SMT_PROTOBUF_H__
@@ -8,14 +8,18 @@
 #define __SMT_TRACER_H__
 
 #include <algorithm>
+#include <atomic>
 #include <chrono>
 #include <condition_variable>
 #include <fstream>
 #include <map>
 #include <mutex>
 #include <string>
+#include <thread>
+#include <tuple>
 #include <vector>
 
+#include "smt_protobuf.h"
 #include "vpl/mfxdefs.h"
 
 namespace TranscodingSample {
@@ -31,13 +35,17 @@ public:
 
     enum class LatencyType { DEFAULT, E2E, ENC };
 
+    enum class TraceFormat { JSON, PERFETTO };
+
     SMTTracer();
     ~SMTTracer();
 
     void Init(const PipelineType type,
               const mfxU32 numOfChannels,
               const LatencyType latency,
-              const mfxU32 TraceBufferSize);
+              const mfxU32 TraceBufferSize,
+              const bool streaming     = false,
+              const TraceFormat format = TraceFormat::JSON);
     void BeginEvent(const ThreadType thType,
                     const mfxU32 thID,
                     const EventName name,
@@ -52,6 +60,11 @@ public:
                          const mfxU32 thID,
                          const EventName name,
                          const mfxU64 counter);
+
+    bool IsEnabled() const {
+        return Enabled;
+    }
+
     void BeforeDecodeStart();
     void AfterDecodeStart();
     void BeforeEncodeStart();
@@ -79,7 +92,43 @@ private:
                   OutID(0),
                   TS(0) {}
     };
-    using EventIt = std::vector<Event>::iterator;
+
+    //events of one thread, ring is written by this thread only and read by the one who saves
+    //the trace, so neither of them locks
+    class ThreadLog {
+    public:
+        ThreadLog(size_t capacity);
+
+        bool Push(const Event& ev);
+        void Pop(std::vector<Event>& events);
+
+        std::vector<Event> Ring;
+        std::atomic<size_t> Head; //next event to read
+        std::atomic<size_t> Tail; //next event to write
+        std::atomic<size_t> MaxUsage;
+        std::atomic<mfxU64> NumOfDropped;
+        std::vector<std::pair<mfxU64, mfxU64>> LastCounters; //pool -> last value, writer only
+        ThreadLog* Next;
+    };
+
+    //duration event which has ended and what it depends on
+    class DurationEvent {
+    public:
+        Event Begin;
+        Event End;
+        bool HasChain; //chain of dependencies goes back to event without input
+        Event ChainBegin; //beginning of the first event in the chain
+    };
+
+    //duration event which has begun
+    class OpenDurationEvent {
+    public:
+        Event Begin;
+        bool HasProducer;
+        DurationEvent Producer; //event which has produced the input
+        bool HasChain;
+        Event ChainBegin;
+    };
 
     class TimeInterval {
     public:
@@ -96,25 +145,22 @@ private:
                   const void* inID,
                   const void* outID);
     mfxU64 GetCurrentTS();
+    ThreadLog* GetThreadLog();
 
     //log generation functions
-    void AdjustOverlappingEvents();
-    void SaveTrace(mfxU32 FileID);
+    void FlushLoop();
+    void Flush(bool last);
+    void AdjustOverlappingEvents(std::vector<Event>& events);
+    void AnalyzeEvent(const Event& ev);
+    bool OpenTraceFile();
+    void SaveTrace();
 
-    void AddFlowEvents();
     void AddFlowEvent(const Event a, const Event b);
 
-    void ComputeE2ELatency();
-    void ComputeEncLatency();
     void SaveLatency(LatencyType type,
                      mfxU32 FileID,
                      std::map<mfxU32, std::vector<TimeInterval>>& latency);
 
-    EventIt FindBeginningOfDependencyChain(EventIt it);
-    EventIt FindBeginningOfDurationEvent(EventIt it);
-    EventIt FindEndOfPreviosDurationEvent(EventIt it);
-    EventIt FindEventInThread(EventIt first, EventType type);
-
     void WriteEvent(std::ofstream& trace_file, const Event ev);
     void WriteDurationEvent(std::ofstream& trace_file, const Event ev);
     void WriteFlowEvent(std::ofstream& trace_file, const Event ev);
@@ -132,14 +178,57 @@ private:
     void WriteEvID(std::ofstream& trace_file, const Event ev);
     void WriteComma(std::ofstream& trace_file);
 
-    mfxU32 TraceBufferSizeInMBytes          = 7;
-    const mfxU32 MaxTraceBufferSizeInMBytes = 128;
+    std::string GetThreadName(const Event ev);
+    std::string GetEventName(const Event ev);
+
+    //perfetto format, see TracePacket and TrackEvent in perfetto protos
+    void WritePerfettoHeader();
+    void WritePerfettoChunk();
+    void WritePerfettoEvent(const Event ev, const std::vector<mfxU64>& flowIDs, bool terminating);
+    void WritePerfettoPacket();
+    mfxU64 GetPerfettoTrack(const std::string& name, bool counter);
+    mfxU64 GetPerfettoName(const std::string& name, mfxU32 type);
+
+    //total size of buffers, every thread gets a share of it, in streaming mode buffers are
+    //flushed to the file in background
+    mfxU32 TraceBufferSizeInMBytes           = 7;
+    const mfxU32 MaxTraceBufferSizeInMBytes  = 128;
+    const mfxU32 MinThreadBufferSizeInKBytes = 512;
+    size_t ThreadLogCapacity                 = 0; //events in buffer of one thread
+    const mfxU32 FlushPeriodInMilliseconds  = 100;
+    const mfxU64 FlushDelayInMicroseconds   = 1000; //time for events being pushed to get in
 
     bool Enabled                = false;
+    bool Streaming              = false;
+    TraceFormat Format          = TraceFormat::JSON;
     PipelineType TypeOfPipeline = PipelineType::unknown;
     mfxU32 EvID                 = 0;
-    std::vector<Event> Log;
-    std::vector<Event> AddonLog;
+    mfxU32 FileID               = 0;
+    std::string TraceFileName;
+
+    static std::atomic<mfxU64> NumOfTracers; //tells tracers apart in thread local data
+    const mfxU64 TracerID;
+    std::atomic<ThreadLog*> ThreadLogs;
+
+    std::thread Flusher;
+    std::mutex FlushMutex; //protects the file and analysis state, taken by flushing thread only
+    std::condition_variable FlushSync;
+    bool StopFlushing = false;
+    std::ofstream TraceFile;
+    std::vector<Event> Chunk;
+    std::vector<Event> Pending; //events newer than the previous chunk, written with the next one
+    std::vector<Event> FlowLog;
+    std::map<std::tuple<ThreadType, mfxU32, EventName>, OpenDurationEvent> OpenEvents;
+    std::map<std::pair<mfxU64, mfxU32>, DurationEvent> Producers; //by output ID and channel
+
+    //perfetto writer state, timestamps are deltas to the previous packet in the sequence
+    ProtoEncoder Packet;
+    ProtoEncoder TrackEvent;
+    ProtoEncoder InternedData;
+    std::map<std::string, mfxU64> PerfettoTracks; //name -> track uuid
+    std::map<std::string, mfxU64> PerfettoNames[2]; //event and annotation names -> iid
+    mfxU64 LastPacketTS = 0;
+
     std::map<mfxU32, std::vector<TimeInterval>> E2ELatency;
     std::map<mfxU32, std::vector<TimeInterval>> EncLatency;
     mfxU32 NumOfErrors = 0;
@@ -0,0 +1,76 @@
+/*############################################################################
+  # Copyright (C) 2024 Intel Corporation
+  #
+  # SPDX-License-Identifier: MIT
+  ############################################################################*/
+
+#include "bitstream_pool.h"
+
+#include <new>
+
+namespace TranscodingSample {
+
+BitstreamBufferPool& BitstreamBufferPool::GetInstance() {
+    static BitstreamBufferPool pool;
+    return pool;
+}
+
+BitstreamBufferPool::BitstreamBufferPool() : m_mutex(), m_FreeBuffers(), m_AllocatedSize(0) {}
+
+BitstreamBufferPool::~BitstreamBufferPool() {
+    for (auto& sizeClass : m_FreeBuffers) {
+        for (auto pData : sizeClass.second) {
+            delete[] pData;
+        }
+    }
+}
+
+mfxU32 BitstreamBufferPool::GetClassSize(mfxU32 size) {
+    mfxU64 classSize = MIN_CLASS_SIZE;
+    while (classSize < size) {
+        classSize <<= 1;
+    }
+    // sizes above 2 GB get a class of their own
+    return classSize > 0xFFFFFFFF ? size : (mfxU32)classSize;
+}
+
+mfxU32 BitstreamBufferPool::GetNextClassSize(mfxU32 size) {
+    mfxU32 classSize = GetClassSize(size);
+    return classSize > 0x7FFFFFFF ? 0xFFFFFFFF : classSize << 1;
+}
+
+mfxU8* BitstreamBufferPool::Borrow(mfxU32& size) {
+    size = GetClassSize(size);
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        auto& buffers = m_FreeBuffers[size];
+        if (!buffers.empty()) {
+            mfxU8* pData = buffers.back();
+            buffers.pop_back();
+            return pData;
+        }
+    }
+
+    mfxU8* pData = new (std::nothrow) mfxU8[size];
+    if (pData) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_AllocatedSize += size;
+    }
+    return pData;
+}
+
+void BitstreamBufferPool::Return(mfxU8* pData, mfxU32 size) {
+    if (!pData)
+        return;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_FreeBuffers[size].push_back(pData);
+}
+
+mfxU64 BitstreamBufferPool::GetAllocatedSize() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_AllocatedSize;
+}
+
+} // namespace TranscodingSample
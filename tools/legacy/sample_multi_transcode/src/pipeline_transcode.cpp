@@ -101,8 +101,14 @@ CTranscodingPipeline::CTranscodingPipeline()
           m_DecOutAllocReques({}),
           m_VPPOutAllocReques({}),
           m_CSSurfacePools(),
+          m_DecSurfaceTracker(),
+          m_EncSurfaceTracker(),
+          m_CSSurfaceTrackers(),
           m_EncSurfaceType(0),
           m_DecSurfaceType(0),
+          m_nPoolAutoTuneFrames(0),
+          m_bDecPoolTuned(false),
+          m_bEncPoolTuned(false),
           m_pPreEncAuxPool(),
           m_BSPool(),
           m_initPar(),
@@ -155,11 +161,16 @@ CTranscodingPipeline::CTranscodingPipeline()
           m_rawInput(false),
           m_shouldUseShifted10BitEnc(false),
           m_pBSStore(),
+          m_nEncBufferSize(0),
           m_FrameNumberPreference(0xFFFFFFFF),
           m_MaxFramesForTranscode(0xFFFFFFFF),
           m_MaxFramesForEncode(0),
+          m_bSegmentEncoding(false),
+          m_SegmentSkipFrames(0),
           m_pBSProcessor(NULL),
           m_nReqFrameTime(0),
+          m_TranscodeLoop(),
+          m_bPollSync(false),
           statisticsWindowSize(0),
           m_nOutputFramesNum(0),
           inputStatistics(),
@@ -494,6 +505,10 @@ mfxVideoParam CTranscodingPipeline::GetDecodeParam(mfxU32 ID) {
 };
 // 1 ms provides better result in range [0..5] ms
 enum { TIME_TO_SLEEP = 1 };
+// delay before the step which polls busy encoder or empty surface pool again
+enum { SYNC_POLL_INTERVAL_US = 500 };
+// surfaces kept above the peak usage of warm-up when pool is auto-tuned
+enum { POOL_AUTOTUNE_MARGIN = 2 };
 
 mfxStatus CTranscodingPipeline::CreateBlackFrame(ExtendedSurface* pExtSurface) {
     MFX_ITT_TASK("CreateBlackFrame");
@@ -989,11 +1004,10 @@ mfxStatus CTranscodingPipeline::VPPOneFrame(ExtendedSurface* pSurfaceIn,
     return sts;
 } // mfxStatus CTranscodingPipeline::DecodeOneFrame(ExtendedSurface *pExtSurface)
 
-mfxStatus CTranscodingPipeline::EncodeOneFrame(ExtendedSurface* pExtSurface,
-                                               mfxBitstreamWrapper* pBS) {
+mfxStatus CTranscodingPipeline::EncodeOneFrame(ExtendedSurface* pExtSurface, ExtendedBS* pBS) {
     mfxStatus sts = MFX_ERR_NONE;
 
-    if (!pBS->Data) {
+    if (!pBS->Bitstream.Data) {
         sts = AllocateSufficientBuffer(pBS);
         MSDK_CHECK_STATUS(sts, "AllocateSufficientBuffer failed");
     }
@@ -1013,7 +1027,7 @@ mfxStatus CTranscodingPipeline::EncodeOneFrame(ExtendedSurface* pExtSurface,
                                           nullptr);
         sts = m_pmfxENC->EncodeFrameAsync(pExtSurface->pEncCtrl,
                                           pExtSurface->pSurface,
-                                          pBS,
+                                          &pBS->Bitstream,
                                           &pExtSurface->Syncp);
         m_ScalerConfig.Tracer->EndEvent(SMTTracer::ThreadType::ENC,
                                         TargetID,
@@ -1064,6 +1078,8 @@ mfxStatus CTranscodingPipeline::ConfigTCBRCTest(mfxFrameSurface1* pSurf) {
             if (m_mfxEncParams.mfx.TargetKbps != newBitrate) {
                 m_mfxEncParams.mfx.TargetKbps = (mfxU16)newBitrate;
                 sts                           = m_pmfxENC->Reset(&m_mfxEncParams);
+                if (sts == MFX_ERR_NONE)
+                    sts = UpdateEncBufferSize();
             }
         }
     }
@@ -1094,6 +1110,13 @@ void CTranscodingPipeline::StopSession() {
     std::lock_guard<std::mutex> guard(m_mStopSession);
     m_bForceStop = true;
 
+    // wake up threads which are waiting for free surfaces so they notice the stop
+    m_DecSurfaceTracker.Notify();
+    m_EncSurfaceTracker.Notify();
+    for (auto& tracker : m_CSSurfaceTrackers) {
+        tracker.second->Notify();
+    }
+
     std::cout << "session [" << GetSessionText() << "] m_bForceStop is set" << std::endl;
 }
 
@@ -1260,29 +1283,44 @@ mfxStatus CTranscodingPipeline::Decode() {
                 }
                 else {
                     if (m_ScalerConfig.CascadeScalerRequired) {
-                        ExtendedSurface InSurface = DecExtSurface;
-                        for (auto desc : m_ScalerConfig.Targets) {
-                            if (desc.CascadeScaler) {
-                                sts = VPPOneFrame(&InSurface, &VppExtSurface, desc.TargetID);
-                                if (sts == MFX_ERR_NONE) {
-                                    IncreaseReference(*VppExtSurface.pSurface);
-                                    InSurface = VppExtSurface;
-                                }
-                                else if (sts == MFX_ERR_MORE_DATA && !bEndOfFile) {
-                                    sts = MFX_ERR_NONE; //important to continue processing
-                                    break;
-                                }
-                                else if (sts == MFX_ERR_MORE_DATA && bEndOfFile) {
-                                    VppExtSurface = InSurface;
-                                }
-                                else {
-                                    return MFX_ERR_UNKNOWN;
-                                }
+                        //output of each cascade stage, stage gets input from the pool with
+                        //smaller ID, so pools are processed in order of their IDs
+                        std::map<mfxU32, ExtendedSurface> PoolSurfaces;
+                        PoolSurfaces[DecoderPoolID] = DecExtSurface;
+                        for (const auto& p : m_ScalerConfig.Pools) {
+                            const auto& PoolDesc = p.second;
+                            if (PoolDesc.ID == DecoderPoolID) {
+                                continue;
+                            }
+
+                            auto InSurface = PoolSurfaces.find(PoolDesc.PrevID);
+                            if (InSurface == PoolSurfaces.end()) {
+                                continue; //previous stage needs more data, so does this one
+                            }
+
+                            sts = VPPOneFrame(&InSurface->second, &VppExtSurface, PoolDesc.TargetID);
+                            if (sts == MFX_ERR_NONE) {
+                                IncreaseReference(*VppExtSurface.pSurface);
+                                PoolSurfaces[PoolDesc.ID] = VppExtSurface;
+                            }
+                            else if (sts == MFX_ERR_MORE_DATA && !bEndOfFile) {
+                                sts = MFX_ERR_NONE; //important to continue processing
+                            }
+                            else if (sts == MFX_ERR_MORE_DATA && bEndOfFile) {
+                                PoolSurfaces[PoolDesc.ID] = InSurface->second;
                             }
                             else {
-                                VppExtSurface = InSurface;
+                                return MFX_ERR_UNKNOWN;
                             }
+                        }
 
+                        for (const auto& desc : m_ScalerConfig.Targets) {
+                            auto OutSurface = PoolSurfaces.find(desc.PoolID);
+                            if (OutSurface == PoolSurfaces.end()) {
+                                continue;
+                            }
+
+                            VppExtSurface = OutSurface->second;
                             VppExtSurface.TargetID =
                                 desc.TargetID; //we can't remove it, it is used for pass thorugh case
                             OutSurfaces.push_back(VppExtSurface);
@@ -1389,12 +1427,16 @@ mfxStatus CTranscodingPipeline::Decode() {
             std::reverse(buf.begin(), buf.end());
             pNextBuffer = buf[0];
 
-            for (mfxU32 i = 0; i < OutSurfaces.size(); i++) {
+            //some channels may have no output for this frame, e.g. after FRC
+            for (mfxU32 i = 0, j = 0; i < OutSurfaces.size(); i++, j++) {
+                while (j < buf.size() && buf[j]->TargetID != OutSurfaces[i].TargetID) {
+                    j++;
+                }
                 //sanity check
-                if (buf[i]->TargetID != OutSurfaces[i].TargetID) {
+                if (j == buf.size()) {
                     return MFX_ERR_UNKNOWN;
                 }
-                buf[i]->AddSurface(OutSurfaces[i]);
+                buf[j]->AddSurface(OutSurfaces[i]);
             }
 
             OutSurfaces.clear();
@@ -1623,9 +1665,8 @@ mfxStatus CTranscodingPipeline::Encode() {
 
         curBuffer = m_pBuffer;
 
-        pBS = m_pBSStore->GetNext();
-        if (!pBS)
-            return MFX_ERR_NOT_FOUND;
+        sts = GetFreeBS(pBS);
+        MSDK_CHECK_STATUS(sts, "GetFreeBS failed");
 
         m_BSPool.push_back(pBS);
 
@@ -1652,7 +1693,7 @@ mfxStatus CTranscodingPipeline::Encode() {
                     if (bPollFlag) {
                         VppExtSurface.pSurface = 0;
                     }
-                    sts = EncodeOneFrame(&VppExtSurface, &m_BSPool.back()->Bitstream);
+                    sts = EncodeOneFrame(&VppExtSurface, m_BSPool.back());
                     if (bAllBlackFrame && (1 == m_Prolonged)) {
                         isQuit = true;
                         if (m_nVPPCompMode > 0) {
@@ -1794,6 +1835,10 @@ mfxStatus CTranscodingPipeline::Encode() {
                 sts = PutBS();
                 MSDK_CHECK_STATUS(sts, "PutBS failed");
             }
+            while (m_HeldBS.size()) {
+                sts = WaitForWrittenBS();
+                MSDK_CHECK_STATUS(sts, "WaitForWrittenBS failed");
+            }
         }
     }
 
@@ -1996,244 +2041,300 @@ void CTranscodingPipeline::SetEncCtrlRT(ExtendedSurface& extSurface, bool bInser
 }
 
 mfxStatus CTranscodingPipeline::Transcode() {
-    mfxStatus sts                 = MFX_ERR_NONE;
-    ExtendedSurface DecExtSurface = { 0 };
-    ExtendedSurface VppExtSurface = { 0 };
-    ExtendedBS* pBS               = NULL;
-    bool bNeedDecodedFrames       = true; // indicates if we need to decode frames
-    bool bEndOfFile               = false;
-    bool bLastCycle               = false;
-    bool shouldReadNextFrame      = true;
-
-    time_t start = time(0);
+    mfxStatus sts  = MFX_ERR_NONE;
+    mfxU32 delayUs = 0;
+
     while (MFX_ERR_NONE == sts) {
-        msdk_tick nBeginTime = msdk_time_get_tick(); // microseconds.
+        delayUs = 0;
+        sts     = TranscodeStep(delayUs);
+        if (delayUs)
+            MSDK_USLEEP(delayUs);
+    }
+    m_TranscodeLoop.bStarted = false;
 
-        if (time(0) - start >= m_nTimeout)
-            bLastCycle = true;
-        if (m_MaxFramesForTranscode == m_nProcessedFramesNum) {
-            DecExtSurface.pSurface = NULL; // to get buffered VPP or ENC frames
-            bNeedDecodedFrames     = false; // no more decoded frames needed
+    return sts;
+} // mfxStatus CTranscodingPipeline::Transcode()
+
+mfxStatus CTranscodingPipeline::TranscodeStep(mfxU32& delayUs) {
+    mfxStatus sts             = MFX_ERR_NONE;
+    ExtendedBS* pBS           = NULL;
+    TranscodeLoopState& state = m_TranscodeLoop;
+
+    if (!state.bStarted) {
+        state                     = TranscodeLoopState();
+        state.bStarted            = true;
+        state.bNeedDecodedFrames  = true;
+        state.shouldReadNextFrame = true;
+        state.start               = time(0);
+    }
+
+    msdk_tick nBeginTime = msdk_time_get_tick(); // microseconds.
+
+    // scheduled session doesn't block its worker: oldest bitstream is synced with zero timeout
+    // and the step is repeated later while encoder or surface pool is busy
+    if (m_bPollSync) {
+        sts        = PollBS(state.bDraining ? 1 : m_AsyncDepth);
+        bool bBusy = MFX_WRN_IN_EXECUTION == sts ||
+                     (MFX_ERR_NONE == sts && !state.bDraining && IsSurfaceWaitNeeded());
+        if (bBusy) {
+            if (!state.waitStart)
+                state.waitStart = nBeginTime;
+            if (nBeginTime - state.waitStart <
+                (msdk_tick)GetSurfaceWaitInterval() * msdk_time_get_frequency() / 1000) {
+                delayUs = SYNC_POLL_INTERVAL_US;
+                return MFX_ERR_NONE;
+            }
+            // after the usual timeout the step waits, so errors are reported as before
+            if (MFX_WRN_IN_EXECUTION == sts)
+                sts = state.bDraining ? MFX_ERR_NONE : PutBS();
         }
+        state.waitStart = 0;
+        MSDK_CHECK_STATUS(sts, "PollBS failed");
 
-        // if need more decoded frames
-        // decode a frame
-        if (bNeedDecodedFrames && shouldReadNextFrame) {
-            if (!bEndOfFile) {
-                sts = DecodeOneFrame(&DecExtSurface);
-                if (MFX_ERR_MORE_DATA == sts) {
-                    if (!bLastCycle) {
-                        m_bInsertIDR = true;
+        if (state.bDraining)
+            return FinishTranscode();
+    }
 
-                        m_pBSProcessor->ResetInput();
-                        m_pBSProcessor->ResetOutput();
-                        bNeedDecodedFrames = true;
+    if (time(0) - state.start >= m_nTimeout)
+        state.bLastCycle = true;
+    if (m_MaxFramesForTranscode == m_nProcessedFramesNum) {
+        state.DecExtSurface.pSurface = NULL; // to get buffered VPP or ENC frames
+        state.bNeedDecodedFrames     = false; // no more decoded frames needed
+    }
 
-                        bEndOfFile = false;
-                        sts        = MFX_ERR_NONE;
-                        continue;
-                    }
-                    else {
-                        bEndOfFile = true;
-                    }
-                }
-            }
+    // if need more decoded frames
+    // decode a frame
+    if (state.bNeedDecodedFrames && state.shouldReadNextFrame) {
+        if (!state.bEndOfFile) {
+            sts = DecodeOneFrame(&state.DecExtSurface);
+            if (MFX_ERR_MORE_DATA == sts) {
+                if (!state.bLastCycle) {
+                    m_bInsertIDR = true;
 
-            if (bEndOfFile) {
-                sts = DecodeLastFrame(&DecExtSurface);
-            }
+                    m_pBSProcessor->ResetInput();
+                    m_pBSProcessor->ResetOutput();
+                    state.bNeedDecodedFrames = true;
 
-            if (sts == MFX_ERR_MORE_DATA) {
-                DecExtSurface.pSurface = NULL; // to get buffered VPP or ENC frames
-                sts                    = MFX_ERR_NONE;
+                    state.bEndOfFile = false;
+                    return MFX_ERR_NONE;
+                }
+                else {
+                    state.bEndOfFile = true;
+                }
             }
-            MSDK_CHECK_STATUS(sts, "Decode<One|Last>Frame failed");
-        }
-        if (m_bIsFieldWeaving && DecExtSurface.pSurface != NULL) {
-            m_mfxDecParams.mfx.FrameInfo.PicStruct = DecExtSurface.pSurface->Info.PicStruct;
         }
-        if (m_bIsFieldSplitting && DecExtSurface.pSurface != NULL) {
-            m_mfxDecParams.mfx.FrameInfo.PicStruct = DecExtSurface.pSurface->Info.PicStruct;
+
+        if (state.bEndOfFile) {
+            sts = DecodeLastFrame(&state.DecExtSurface);
         }
-        // pre-process a frame
-        if (m_pmfxVPP.get() && bNeedDecodedFrames && !m_rawInput) {
-            if (m_bIsFieldWeaving) {
-                // In case of field weaving output surface's parameters for ODD calls to VPPOneFrame will be ignored (because VPP will return ERR_MORE_DATA).
-                // So, we need to set output surface picstruct properly for EVEN calls (no matter what will be set for ODD calls).
-                // We might have 2 cases: decoder gives us pairs (TF BF)... or (BF)(TF). In first case we should set TFF for output, in second - BFF.
-                // So, if even input surface is BF, we set TFF for output and vise versa. For odd input surface - no matter what we set.
-                if (DecExtSurface.pSurface) {
-                    if ((DecExtSurface.pSurface->Info.PicStruct &
-                         MFX_PICSTRUCT_FIELD_TFF)) // Incoming Top Field in a single surface
-                    {
-                        m_mfxVppParams.vpp.Out.PicStruct = MFX_PICSTRUCT_FIELD_BFF;
-                    }
-                    if (DecExtSurface.pSurface->Info.PicStruct &
-                        MFX_PICSTRUCT_FIELD_BFF) // Incoming Bottom Field in a single surface
-                    {
-                        m_mfxVppParams.vpp.Out.PicStruct = MFX_PICSTRUCT_FIELD_TFF;
-                    }
+
+        if (sts == MFX_ERR_MORE_DATA) {
+            state.DecExtSurface.pSurface = NULL; // to get buffered VPP or ENC frames
+            sts                          = MFX_ERR_NONE;
+        }
+        MSDK_CHECK_STATUS(sts, "Decode<One|Last>Frame failed");
+    }
+    if (m_bIsFieldWeaving && state.DecExtSurface.pSurface != NULL) {
+        m_mfxDecParams.mfx.FrameInfo.PicStruct = state.DecExtSurface.pSurface->Info.PicStruct;
+    }
+    if (m_bIsFieldSplitting && state.DecExtSurface.pSurface != NULL) {
+        m_mfxDecParams.mfx.FrameInfo.PicStruct = state.DecExtSurface.pSurface->Info.PicStruct;
+    }
+    // pre-process a frame
+    if (m_pmfxVPP.get() && state.bNeedDecodedFrames && !m_rawInput) {
+        if (m_bIsFieldWeaving) {
+            // In case of field weaving output surface's parameters for ODD calls to VPPOneFrame will be ignored (because VPP will return ERR_MORE_DATA).
+            // So, we need to set output surface picstruct properly for EVEN calls (no matter what will be set for ODD calls).
+            // We might have 2 cases: decoder gives us pairs (TF BF)... or (BF)(TF). In first case we should set TFF for output, in second - BFF.
+            // So, if even input surface is BF, we set TFF for output and vise versa. For odd input surface - no matter what we set.
+            if (state.DecExtSurface.pSurface) {
+                if ((state.DecExtSurface.pSurface->Info.PicStruct &
+                     MFX_PICSTRUCT_FIELD_TFF)) // Incoming Top Field in a single surface
+                {
+                    m_mfxVppParams.vpp.Out.PicStruct = MFX_PICSTRUCT_FIELD_BFF;
+                }
+                if (state.DecExtSurface.pSurface->Info.PicStruct &
+                    MFX_PICSTRUCT_FIELD_BFF) // Incoming Bottom Field in a single surface
+                {
+                    m_mfxVppParams.vpp.Out.PicStruct = MFX_PICSTRUCT_FIELD_TFF;
                 }
-                sts = VPPOneFrame(&DecExtSurface, &VppExtSurface);
             }
-            else {
-                if (m_bIsFieldSplitting) {
-                    if (DecExtSurface.pSurface) {
-                        if (DecExtSurface.pSurface->Info.PicStruct & MFX_PICSTRUCT_FIELD_TFF ||
-                            DecExtSurface.pSurface->Info.PicStruct & MFX_PICSTRUCT_FIELD_BFF) {
-                            m_mfxVppParams.vpp.Out.PicStruct = MFX_PICSTRUCT_FIELD_SINGLE;
-                            sts = VPPOneFrame(&DecExtSurface, &VppExtSurface);
-                        }
-                        else {
-                            VppExtSurface.pSurface = DecExtSurface.pSurface;
-                            VppExtSurface.pAuxCtrl = DecExtSurface.pAuxCtrl;
-                            VppExtSurface.Syncp    = DecExtSurface.Syncp;
-                        }
+            sts = VPPOneFrame(&state.DecExtSurface, &state.VppExtSurface);
+        }
+        else {
+            if (m_bIsFieldSplitting) {
+                if (state.DecExtSurface.pSurface) {
+                    if (state.DecExtSurface.pSurface->Info.PicStruct & MFX_PICSTRUCT_FIELD_TFF ||
+                        state.DecExtSurface.pSurface->Info.PicStruct & MFX_PICSTRUCT_FIELD_BFF) {
+                        m_mfxVppParams.vpp.Out.PicStruct = MFX_PICSTRUCT_FIELD_SINGLE;
+                        sts = VPPOneFrame(&state.DecExtSurface, &state.VppExtSurface);
                     }
                     else {
-                        sts = VPPOneFrame(&DecExtSurface, &VppExtSurface);
+                        state.VppExtSurface.pSurface = state.DecExtSurface.pSurface;
+                        state.VppExtSurface.pAuxCtrl = state.DecExtSurface.pAuxCtrl;
+                        state.VppExtSurface.Syncp    = state.DecExtSurface.Syncp;
                     }
                 }
                 else {
-                    sts = VPPOneFrame(&DecExtSurface, &VppExtSurface);
+                    sts = VPPOneFrame(&state.DecExtSurface, &state.VppExtSurface);
                 }
             }
-            // check for interlaced stream
-
-            if (m_MemoryModel != GENERAL_ALLOC && DecExtSurface.pSurface) {
-                mfxStatus sts_release =
-                    DecExtSurface.pSurface->FrameInterface->Release(DecExtSurface.pSurface);
-                MSDK_CHECK_STATUS(sts_release, "FrameInterface->Release failed");
+            else {
+                sts = VPPOneFrame(&state.DecExtSurface, &state.VppExtSurface);
             }
         }
-        else // no VPP - just copy pointers
-        {
-            VppExtSurface.pSurface = DecExtSurface.pSurface;
-            VppExtSurface.pAuxCtrl = DecExtSurface.pAuxCtrl;
-            VppExtSurface.Syncp    = DecExtSurface.Syncp;
+        // check for interlaced stream
+
+        if (m_MemoryModel != GENERAL_ALLOC && state.DecExtSurface.pSurface) {
+            mfxStatus sts_release =
+                state.DecExtSurface.pSurface->FrameInterface->Release(state.DecExtSurface.pSurface);
+            MSDK_CHECK_STATUS(sts_release, "FrameInterface->Release failed");
         }
+    }
+    else // no VPP - just copy pointers
+    {
+        state.VppExtSurface.pSurface = state.DecExtSurface.pSurface;
+        state.VppExtSurface.pAuxCtrl = state.DecExtSurface.pAuxCtrl;
+        state.VppExtSurface.Syncp    = state.DecExtSurface.Syncp;
+    }
 
-        if (MFX_ERR_MORE_SURFACE == sts) {
-            shouldReadNextFrame = false;
-            sts                 = MFX_ERR_NONE;
+    if (MFX_ERR_MORE_SURFACE == sts) {
+        state.shouldReadNextFrame = false;
+        sts                       = MFX_ERR_NONE;
+    }
+    else {
+        state.shouldReadNextFrame = true;
+    }
+
+    if (sts == MFX_ERR_MORE_DATA) {
+        sts = MFX_ERR_NONE;
+        if (NULL == state.DecExtSurface.pSurface) // there are no more buffered frames in VPP
+        {
+            state.VppExtSurface.pSurface = NULL; // to get buffered ENC frames
         }
         else {
-            shouldReadNextFrame = true;
+            return MFX_ERR_NONE; // go get next frame from Decode
         }
+    }
 
-        if (sts == MFX_ERR_MORE_DATA) {
-            sts = MFX_ERR_NONE;
-            if (NULL == DecExtSurface.pSurface) // there are no more buffered frames in VPP
-            {
-                VppExtSurface.pSurface = NULL; // to get buffered ENC frames
-            }
-            else {
-                continue; // go get next frame from Decode
-            }
-        }
+    MSDK_CHECK_STATUS(sts, "Unexpected error!!");
 
-        MSDK_CHECK_STATUS(sts, "Unexpected error!!");
+    // encode frame
+    sts = GetFreeBS(pBS);
+    MSDK_CHECK_STATUS(sts, "GetFreeBS failed");
 
-        // encode frame
-        pBS = m_pBSStore->GetNext();
-        if (!pBS)
-            return MFX_ERR_NOT_FOUND;
+    m_BSPool.push_back(pBS);
 
-        m_BSPool.push_back(pBS);
+    // Set Encoding control if it is required.
 
-        // Set Encoding control if it is required.
+    // segment starts from IDR even if encoder has been warmed up by frames of previous segment
+    if (m_SegmentSkipFrames && m_nProcessedFramesNum == m_SegmentSkipFrames) {
+        m_bInsertIDR = true;
+    }
 
-        SetEncCtrlRT(VppExtSurface, m_bInsertIDR);
-        m_bInsertIDR = false;
+    SetEncCtrlRT(state.VppExtSurface, m_bInsertIDR);
+    m_bInsertIDR = false;
 
-        if (DecExtSurface.pSurface)
-            m_nProcessedFramesNum++;
+    if (state.DecExtSurface.pSurface)
+        m_nProcessedFramesNum++;
 
-        if (m_mfxEncParams.mfx.CodecId != MFX_CODEC_DUMP) {
-            if (VppExtSurface.pSurface &&
-                m_ScalerConfig.SkipFrame(TargetID, m_nProcessedFramesNum)) {
-                VppExtSurface.Syncp = nullptr;
-                sts                 = MFX_ERR_MORE_DATA;
-            }
-            else {
-                sts = EncodeOneFrame(&VppExtSurface, &m_BSPool.back()->Bitstream);
-            }
+    if (m_mfxEncParams.mfx.CodecId != MFX_CODEC_DUMP) {
+        if (state.VppExtSurface.pSurface &&
+            m_ScalerConfig.SkipFrame(TargetID, m_nProcessedFramesNum)) {
+            state.VppExtSurface.Syncp = nullptr;
+            sts                       = MFX_ERR_MORE_DATA;
         }
         else {
-            sts = Surface2BS(&VppExtSurface, &m_BSPool.back()->Bitstream, m_encoderFourCC);
+            sts = EncodeOneFrame(&state.VppExtSurface, m_BSPool.back());
         }
+    }
+    else {
+        sts = Surface2BS(&state.VppExtSurface, &m_BSPool.back()->Bitstream, m_encoderFourCC);
+    }
 
-        if (m_MemoryModel != GENERAL_ALLOC && VppExtSurface.pSurface) {
-            mfxStatus sts_release =
-                VppExtSurface.pSurface->FrameInterface->Release(VppExtSurface.pSurface);
-            MSDK_CHECK_STATUS(sts_release, "FrameInterface->Release failed");
-        }
+    if (m_MemoryModel != GENERAL_ALLOC && state.VppExtSurface.pSurface) {
+        mfxStatus sts_release =
+            state.VppExtSurface.pSurface->FrameInterface->Release(state.VppExtSurface.pSurface);
+        MSDK_CHECK_STATUS(sts_release, "FrameInterface->Release failed");
+    }
 
-        // check if we need one more frame from decode
-        if (MFX_ERR_MORE_DATA == sts) {
-            // the task in not in Encode queue
-            m_BSPool.pop_back();
-            m_pBSStore->Release(pBS);
+    // check if we need one more frame from decode
+    if (MFX_ERR_MORE_DATA == sts) {
+        // the task in not in Encode queue
+        m_BSPool.pop_back();
+        m_pBSStore->Release(pBS);
 
-            if (NULL == VppExtSurface.pSurface) // there are no more buffered frames in encoder
-            {
-                break;
+        if (NULL == state.VppExtSurface.pSurface) // there are no more buffered frames in encoder
+        {
+            if (m_bPollSync) {
+                state.bDraining = true;
+                return MFX_ERR_NONE;
             }
-            sts = MFX_ERR_NONE;
-            continue;
+            return FinishTranscode();
         }
+        return MFX_ERR_NONE;
+    }
 
-        // check encoding result
-        MSDK_CHECK_STATUS(sts, "<EncodeOneFrame|Surface2BS> failed");
+    // check encoding result
+    MSDK_CHECK_STATUS(sts, "<EncodeOneFrame|Surface2BS> failed");
 
-        if (statisticsWindowSize) {
-            if ((statisticsWindowSize && m_nOutputFramesNum &&
-                 0 == m_nProcessedFramesNum % statisticsWindowSize) ||
-                (statisticsWindowSize && (m_nProcessedFramesNum >= m_MaxFramesForTranscode))) {
-                inputStatistics.PrintStatistics(GetPipelineID());
-                outputStatistics.PrintStatistics(
-                    GetPipelineID(),
-                    (m_mfxEncParams.mfx.FrameInfo.FrameRateExtD)
-                        ? (mfxF64)m_mfxEncParams.mfx.FrameInfo.FrameRateExtN /
-                              (mfxF64)m_mfxEncParams.mfx.FrameInfo.FrameRateExtD
-                        : -1);
-                inputStatistics.ResetStatistics();
-                outputStatistics.ResetStatistics();
-            }
-        }
-        else if (0 == (m_nProcessedFramesNum - 1) % 100) {
-            printf(".");
+    if (statisticsWindowSize) {
+        if ((statisticsWindowSize && m_nOutputFramesNum &&
+             0 == m_nProcessedFramesNum % statisticsWindowSize) ||
+            (statisticsWindowSize && (m_nProcessedFramesNum >= m_MaxFramesForTranscode))) {
+            inputStatistics.PrintStatistics(GetPipelineID());
+            outputStatistics.PrintStatistics(
+                GetPipelineID(),
+                (m_mfxEncParams.mfx.FrameInfo.FrameRateExtD)
+                    ? (mfxF64)m_mfxEncParams.mfx.FrameInfo.FrameRateExtN /
+                          (mfxF64)m_mfxEncParams.mfx.FrameInfo.FrameRateExtD
+                    : -1);
+            inputStatistics.ResetStatistics();
+            outputStatistics.ResetStatistics();
         }
+    }
+    else if (0 == (m_nProcessedFramesNum - 1) % 100) {
+        printf(".");
+    }
 
-        m_BSPool.back()->Syncp = VppExtSurface.Syncp;
+    m_BSPool.back()->Syncp = state.VppExtSurface.Syncp;
 
-        if (m_BSPool.size() == m_AsyncDepth) {
-            sts = PutBS();
-            MSDK_CHECK_STATUS(sts, "PutBS failed");
-        }
+    // with polled sync the full pool is synced by the next step
+    if (m_BSPool.size() == m_AsyncDepth && !m_bPollSync) {
+        sts = PutBS();
+        MSDK_CHECK_STATUS(sts, "PutBS failed");
+    }
 
-        msdk_tick nFrameTime = msdk_time_get_tick() - nBeginTime;
-        if (nFrameTime < m_nReqFrameTime) {
-            MSDK_USLEEP((mfxU32)(m_nReqFrameTime - nFrameTime));
-        }
+    msdk_tick nFrameTime = msdk_time_get_tick() - nBeginTime;
+    if (nFrameTime < m_nReqFrameTime) {
+        delayUs = (mfxU32)(m_nReqFrameTime - nFrameTime);
     }
-    MSDK_IGNORE_MFX_STS(sts, MFX_ERR_MORE_DATA);
+
+    return MFX_ERR_NONE;
+} // mfxStatus CTranscodingPipeline::TranscodeStep()
+
+mfxStatus CTranscodingPipeline::FinishTranscode() {
+    mfxStatus sts = MFX_ERR_NONE;
 
     // need to get buffered bitstream
-    if (MFX_ERR_NONE == sts) {
-        while (m_BSPool.size()) {
-            sts = PutBS();
-            MSDK_CHECK_STATUS(sts, "PutBS failed");
-        }
+    while (m_BSPool.size()) {
+        sts = PutBS();
+        MSDK_CHECK_STATUS(sts, "PutBS failed");
+    }
+    // buffers of held frames can't be reused till writer has written them
+    while (m_HeldBS.size()) {
+        sts = WaitForWrittenBS();
+        MSDK_CHECK_STATUS(sts, "WaitForWrittenBS failed");
     }
 
-    if (MFX_ERR_NONE == sts)
-        sts = MFX_WRN_VALUE_NOT_CHANGED;
-
-    return sts;
-} // mfxStatus CTranscodingPipeline::Transcode()
+    return MFX_WRN_VALUE_NOT_CHANGED;
+} // mfxStatus CTranscodingPipeline::FinishTranscode()
 
 mfxStatus CTranscodingPipeline::PutBS() {
+    return PutBS(GetSyncOpTimeout());
+} //mfxStatus CTranscodingPipeline::PutBS()
+
+mfxStatus CTranscodingPipeline::PutBS(mfxU32 syncTimeout) {
     mfxStatus sts            = MFX_ERR_NONE;
     ExtendedBS* pBitstreamEx = m_BSPool.front();
     MSDK_CHECK_POINTER(pBitstreamEx, MFX_ERR_NULL_PTR);
@@ -2245,13 +2346,16 @@ mfxStatus CTranscodingPipeline::PutBS() {
                                           SMTTracer::EventName::SYNC,
                                           pBitstreamEx->Syncp,
                                           nullptr);
-        sts = m_pmfxSession->SyncOperation(pBitstreamEx->Syncp, GetSyncOpTimeout());
+        sts = m_pmfxSession->SyncOperation(pBitstreamEx->Syncp, syncTimeout);
 
         m_ScalerConfig.Tracer->EndEvent(SMTTracer::ThreadType::ENC,
                                         TargetID,
                                         SMTTracer::EventName::SYNC,
                                         pBitstreamEx->Syncp,
                                         nullptr);
+        // bitstream stays in the pool till the next poll
+        if (MFX_WRN_IN_EXECUTION == sts && !syncTimeout)
+            return sts;
         m_ScalerConfig.Tracer->AfterEncodeSync();
         HandlePossibleGpuHang(sts);
         MSDK_CHECK_ERR_NONE_STATUS(sts, MFX_ERR_ABORTED, "Encode: SyncOperation failed");
@@ -2273,7 +2377,7 @@ mfxStatus CTranscodingPipeline::PutBS() {
                                       SMTTracer::EventName::WRITE_BS,
                                       nullptr,
                                       nullptr);
-    if (!m_ScalerConfig.ParallelEncodingRequired) {
+    if (!m_ScalerConfig.ParallelEncodingRequired && !m_bSegmentEncoding) {
         sts = m_pBSProcessor->ProcessOutputBitstream(&pBitstreamEx->Bitstream);
     }
     else {
@@ -2290,15 +2394,99 @@ mfxStatus CTranscodingPipeline::PutBS() {
 
     UnPreEncAuxBuffer(pBitstreamEx->pCtrl);
 
-    pBitstreamEx->Bitstream.DataLength = 0;
-    pBitstreamEx->Bitstream.DataOffset = 0;
-
     if (m_BSPool.size())
         m_BSPool.pop_front();
+
+    if (sts == MFX_WRN_IN_EXECUTION) {
+        // this encoder is ahead of others, writer keeps the bitstream till its turn comes
+        m_HeldBS.push_back(pBitstreamEx);
+        return ReleaseWrittenBS();
+    }
+
+    pBitstreamEx->Bitstream.DataLength = 0;
+    pBitstreamEx->Bitstream.DataOffset = 0;
     m_pBSStore->Release(pBitstreamEx);
 
+    if (m_HeldBS.size()) {
+        return ReleaseWrittenBS();
+    }
+
     return sts;
-} //mfxStatus CTranscodingPipeline::PutBS()
+} //mfxStatus CTranscodingPipeline::PutBS(mfxU32 syncTimeout)
+
+mfxStatus CTranscodingPipeline::PollBS(size_t maxQueued) {
+    while (m_BSPool.size() && m_BSPool.size() >= maxQueued) {
+        mfxStatus sts = PutBS(0);
+        if (MFX_WRN_IN_EXECUTION == sts)
+            return sts;
+        MSDK_CHECK_STATUS(sts, "PutBS failed");
+    }
+
+    return MFX_ERR_NONE;
+} // mfxStatus CTranscodingPipeline::PollBS(size_t maxQueued)
+
+bool CTranscodingPipeline::IsSurfaceWaitNeeded() {
+    if (m_MemoryModel != GENERAL_ALLOC)
+        return false;
+
+    const TranscodeLoopState& state = m_TranscodeLoop;
+    bool bDecode = state.bNeedDecodedFrames && state.shouldReadNextFrame &&
+                   m_MaxFramesForTranscode != m_nProcessedFramesNum;
+    if (bDecode && !m_rawInput && !m_DecSurfaceTracker.GetFreeCount())
+        return true;
+    // raw frames and VPP output are taken from the encoder pool
+    if ((bDecode && m_rawInput) || (m_pmfxVPP.get() && state.bNeedDecodedFrames && !m_rawInput))
+        return !m_EncSurfaceTracker.GetFreeCount();
+
+    return false;
+} // bool CTranscodingPipeline::IsSurfaceWaitNeeded()
+
+mfxStatus CTranscodingPipeline::GetFreeBS(ExtendedBS*& pBS) {
+    mfxStatus sts = MFX_ERR_NONE;
+
+    // in parallel encoding all bitstreams may be held by writer, then encoded frames go to
+    // writer first, they may be the ones other encoders are waiting for
+    for (pBS = m_pBSStore->GetNext(); !pBS; pBS = m_pBSStore->GetNext()) {
+        if (m_BSPool.size()) {
+            sts = PutBS();
+            MSDK_CHECK_STATUS(sts, "PutBS failed");
+        }
+        else if (m_HeldBS.size()) {
+            sts = WaitForWrittenBS();
+            MSDK_CHECK_STATUS(sts, "WaitForWrittenBS failed");
+        }
+        else {
+            return MFX_ERR_NOT_FOUND;
+        }
+    }
+
+    return MFX_ERR_NONE;
+} // mfxStatus CTranscodingPipeline::GetFreeBS(ExtendedBS*& pBS)
+
+mfxStatus CTranscodingPipeline::ReleaseWrittenBS() {
+    std::vector<mfxBitstream*> written;
+    mfxStatus sts = m_pBSProcessor->GetWrittenFrames(TargetID, written);
+    MSDK_CHECK_STATUS(sts, "m_pBSProcessor->GetWrittenFrames failed");
+
+    for (mfxBitstream* pBitstream : written) {
+        auto it = std::find_if(m_HeldBS.begin(), m_HeldBS.end(), [pBitstream](ExtendedBS* pBS) {
+            return &pBS->Bitstream == pBitstream;
+        });
+        if (it != m_HeldBS.end()) {
+            m_pBSStore->Release(*it);
+            m_HeldBS.erase(it);
+        }
+    }
+
+    return MFX_ERR_NONE;
+} // mfxStatus CTranscodingPipeline::ReleaseWrittenBS()
+
+mfxStatus CTranscodingPipeline::WaitForWrittenBS() {
+    mfxStatus sts = m_pBSProcessor->WaitForWrittenFrames(TargetID, MSDK_ENC_WAIT_INTERVAL);
+    MSDK_CHECK_STATUS(sts, "m_pBSProcessor->WaitForWrittenFrames failed");
+
+    return ReleaseWrittenBS();
+} // mfxStatus CTranscodingPipeline::WaitForWrittenBS()
 
 mfxStatus CTranscodingPipeline::ReplaceBlackSurface(mfxFrameSurface1* pSurf) {
     mfxStatus sts = MFX_ERR_NONE;
@@ -3722,7 +3910,7 @@ mfxStatus CTranscodingPipeline::AllocFrames(mfxFrameAllocRequest* pRequest, bool
     MSDK_CHECK_STATUS(sts, "m_pMFXAllocator->Alloc failed");
 
     for (i = 0; i < nSurfNum; i++) {
-        auto surface  = std::make_unique<mfxFrameSurfaceWrap>();
+        auto surface  = std::make_unique<TrackedSurface>();
         surface->Info = pRequest->Info;
 
         if (m_rawInput) {
@@ -3740,7 +3928,12 @@ mfxStatus CTranscodingPipeline::AllocFrames(mfxFrameAllocRequest* pRequest, bool
         std::ignore = surface.release();
     }
 
+    FreeSurfaceTracker& tracker = isDecAlloc ? m_DecSurfaceTracker : m_EncSurfaceTracker;
+    tracker.Reset(isDecAlloc ? m_pSurfaceDecPool : m_pSurfaceEncPool);
+    tracker.EnableUsageStatistics(m_nPoolAutoTuneFrames != 0);
+
     (isDecAlloc) ? m_DecSurfaceType = pRequest->Type : m_EncSurfaceType = pRequest->Type;
+    (isDecAlloc) ? m_bDecPoolTuned = false : m_bEncPoolTuned = false;
 
     return MFX_ERR_NONE;
 
@@ -3758,6 +3951,14 @@ mfxStatus CTranscodingPipeline::AllocFramesForCS() {
             continue;
         }
 
+        //planned size covers all consumers of the pool
+        if (m_ScalerConfig.CascadeScalerAuto) {
+            PoolDesc.AllocReq.NumFrameSuggested =
+                std::max(PoolDesc.AllocReq.NumFrameSuggested, PoolDesc.Size);
+            PoolDesc.AllocReq.NumFrameMin =
+                std::max(PoolDesc.AllocReq.NumFrameMin, PoolDesc.Size);
+        }
+
         mfxStatus sts = MFX_ERR_NONE;
         sts =
             m_pMFXAllocator->Alloc(m_pMFXAllocator->pthis, &PoolDesc.AllocReq, &PoolDesc.AllocResp);
@@ -3765,7 +3966,7 @@ mfxStatus CTranscodingPipeline::AllocFramesForCS() {
 
         SurfPointersArray pool;
         for (mfxU32 i = 0; i < PoolDesc.AllocResp.NumFrameActual; i++) {
-            mfxFrameSurface1* surface = new mfxFrameSurface1();
+            mfxFrameSurface1* surface = new TrackedSurface();
             MSDK_CHECK_POINTER(surface, MFX_ERR_MEMORY_ALLOC);
             surface->Info       = PoolDesc.AllocReq.Info;
             surface->Data.MemId = PoolDesc.AllocResp.mids[i];
@@ -3773,6 +3974,12 @@ mfxStatus CTranscodingPipeline::AllocFramesForCS() {
             m_EncSurfaceType = PoolDesc.AllocReq.Type;
         }
         m_CSSurfacePools[PoolDesc.ID] = pool;
+
+        auto& tracker = m_CSSurfaceTrackers[PoolDesc.ID];
+        if (!tracker) {
+            tracker.reset(new FreeSurfaceTracker());
+        }
+        tracker->Reset(pool);
     }
 
     return MFX_ERR_NONE;
@@ -4104,14 +4311,20 @@ void CTranscodingPipeline::CorrectNumberOfAllocatedFrames(mfxFrameAllocRequest*
 }
 
 void CTranscodingPipeline::FreeFrames() {
+    m_DecSurfaceTracker.Clear();
+    m_EncSurfaceTracker.Clear();
+    for (auto& tracker : m_CSSurfaceTrackers) {
+        tracker.second->Clear();
+    }
+
     std::for_each(m_pSurfaceDecPool.begin(), m_pSurfaceDecPool.end(), [](mfxFrameSurface1* s) {
-        auto surface = static_cast<mfxFrameSurfaceWrap*>(s);
+        auto surface = static_cast<TrackedSurface*>(s);
         delete surface;
     });
     m_pSurfaceDecPool.clear();
 
     std::for_each(m_pSurfaceEncPool.begin(), m_pSurfaceEncPool.end(), [](mfxFrameSurface1* s) {
-        auto surface = static_cast<mfxFrameSurfaceWrap*>(s);
+        auto surface = static_cast<TrackedSurface*>(s);
         delete surface;
     });
     m_pSurfaceEncPool.clear();
@@ -4128,6 +4341,9 @@ void CTranscodingPipeline::FreeFrames() {
             continue;
         }
 
+        for (auto pSurf : m_CSSurfacePools[PoolDesc.ID]) {
+            delete static_cast<TrackedSurface*>(pSurf);
+        }
         m_CSSurfacePools[PoolDesc.ID].clear();
         if (m_pMFXAllocator) {
             m_pMFXAllocator->Free(m_pMFXAllocator->pthis, &PoolDesc.AllocResp);
@@ -4154,6 +4370,8 @@ mfxStatus CTranscodingPipeline::Init(sInputParams* pParams,
     m_MaxFramesForTranscode = pParams->MaxFrameNumber;
     m_ExactNframe           = pParams->ExactNframe;
     m_Prolonged             = pParams->prolonged;
+    m_bSegmentEncoding      = pParams->nSegments > 1;
+    m_SegmentSkipFrames     = pParams->SegmentSkipFrames;
     // if no number of frames for a particular session is undefined, default
     // value is 0xFFFFFFFF. Thus, use it as a marker to assign parent
     // MaxFramesForTranscode to m_MaxFramesForTranscode
@@ -4191,6 +4409,8 @@ mfxStatus CTranscodingPipeline::Init(sInputParams* pParams,
 
     m_MemoryModel = pParams->nMemoryModel;
 
+    m_nPoolAutoTuneFrames = pParams->nPoolAutoTuneFrames;
+
     m_bAllocHint   = pParams->useAllocHints;
     m_nPreallocate = pParams->preallocate;
 
@@ -4302,6 +4522,11 @@ mfxStatus CTranscodingPipeline::Init(sInputParams* pParams,
         auto threadsPar       = m_initPar.AddExtBuffer<mfxExtThreadsParam>();
         threadsPar->NumThread = pParams->nThreadsNum;
     }
+    else if (!pParams->CpuAffinity.empty()) {
+        // runtime threads inherit CPUs of the session, more threads than CPUs only compete
+        auto threadsPar       = m_initPar.AddExtBuffer<mfxExtThreadsParam>();
+        threadsPar->NumThread = (mfxU16)std::min<size_t>(pParams->CpuAffinity.size(), 0xffff);
+    }
 
     //--- GPU Copy settings
     m_initPar.GPUCopy = pParams->nGpuCopyMode;
@@ -4405,6 +4630,9 @@ mfxStatus CTranscodingPipeline::Init(sInputParams* pParams,
                 m_mfxDecParams.mfx.FrameInfo.FrameRateExtD;
             CSConfig.Targets[0].SrcPicStruct = m_mfxDecParams.mfx.FrameInfo.PicStruct;
             CSConfig.PropagateCascadeParameters();
+            if (CSConfig.CascadeScalerAuto) {
+                CSConfig.PrintCascade();
+            }
             m_ScalerConfig = CSConfig;
         }
     }
@@ -4513,6 +4741,9 @@ mfxStatus CTranscodingPipeline::Init(sInputParams* pParams,
         sts = m_pmfxENC->Init(&m_mfxEncParams);
         MSDK_CHECK_STATUS(sts, "m_pmfxENC->Init failed");
 
+        sts = UpdateEncBufferSize();
+        MSDK_CHECK_STATUS(sts, "UpdateEncBufferSize failed");
+
         if (pParams->bExtMBQP) {
             m_bUseQPMap = true;
         }
@@ -4633,6 +4864,9 @@ mfxStatus CTranscodingPipeline::CompleteInit() {
             MSDK_IGNORE_MFX_STS(sts, MFX_WRN_PARTIAL_ACCELERATION);
         }
         MSDK_CHECK_STATUS(sts, "m_pmfxENC->Init failed");
+
+        sts = UpdateEncBufferSize();
+        MSDK_CHECK_STATUS(sts, "UpdateEncBufferSize failed");
     }
 
     m_bIsInit = true;
@@ -4642,6 +4876,12 @@ mfxStatus CTranscodingPipeline::CompleteInit() {
 mfxFrameSurface1* CTranscodingPipeline::GetFreeSurface(bool isDec, mfxU64 timeout) {
     mfxFrameSurface1* pSurf = NULL;
 
+    FreeSurfaceTracker& tracker = isDec ? m_DecSurfaceTracker : m_EncSurfaceTracker;
+
+    if (m_nPoolAutoTuneFrames) {
+        TuneSurfacePool(isDec);
+    }
+
     CTimer t;
     t.Start();
     do {
@@ -4653,31 +4893,18 @@ mfxFrameSurface1* CTranscodingPipeline::GetFreeSurface(bool isDec, mfxU64 timeou
             }
         }
 
-        SurfPointersArray& workArray = isDec ? m_pSurfaceDecPool : m_pSurfaceEncPool;
-
-        int available =
-            (int)std::count_if(workArray.begin(), workArray.end(), [](mfxFrameSurface1* s) {
-                return s->Data.Locked == 0;
-            });
-        m_ScalerConfig.Tracer->AddCounterEvent(
-            isDec ? SMTTracer::ThreadType::DEC : SMTTracer::ThreadType::ENC,
-            TargetID,
-            SMTTracer::EventName::UNDEF,
-            available);
-
-        for (mfxU32 i = 0; i < workArray.size(); i++) {
-            if (!workArray[i]->Data.Locked) {
-                pSurf = workArray[i];
-                break;
-            }
+        if (m_ScalerConfig.Tracer->IsEnabled()) {
+            m_ScalerConfig.Tracer->AddCounterEvent(
+                isDec ? SMTTracer::ThreadType::DEC : SMTTracer::ThreadType::ENC,
+                TargetID,
+                SMTTracer::EventName::UNDEF,
+                tracker.GetFreeCount());
         }
-        if (pSurf) {
-            break;
-        }
-        else {
-            MSDK_SLEEP(TIME_TO_SLEEP);
-        }
-    } while (t.GetTime() < timeout / 1000);
+
+        // library unlocks surfaces without notification, so waiting is bounded by the old poll
+        // interval
+        pSurf = tracker.GetSurface(TIME_TO_SLEEP);
+    } while (!pSurf && t.GetTime() < timeout / 1000);
 
     return pSurf;
 } // mfxFrameSurface1* CTranscodingPipeline::GetFreeSurface(bool isDec)
@@ -4689,6 +4916,12 @@ mfxFrameSurface1* CTranscodingPipeline::GetFreeSurfaceForCS(bool isDec, mfxU64 t
 
     mfxFrameSurface1* pSurf = NULL;
 
+    auto desc      = m_ScalerConfig.GetDesc(ID);
+    auto& pTracker = m_CSSurfaceTrackers[desc.PoolID];
+    if (!pTracker) {
+        pTracker.reset(new FreeSurfaceTracker());
+    }
+
     CTimer t;
     t.Start();
     do {
@@ -4700,44 +4933,107 @@ mfxFrameSurface1* CTranscodingPipeline::GetFreeSurfaceForCS(bool isDec, mfxU64 t
             }
         }
 
-        auto desc                    = m_ScalerConfig.GetDesc(ID);
-        SurfPointersArray& workArray = m_CSSurfacePools[desc.PoolID];
+        if (m_ScalerConfig.Tracer->IsEnabled()) {
+            m_ScalerConfig.Tracer->AddCounterEvent(SMTTracer::ThreadType::CSVPP,
+                                                   desc.PoolID,
+                                                   SMTTracer::EventName::UNDEF,
+                                                   pTracker->GetFreeCount());
+        }
 
-        int available =
-            (int)std::count_if(workArray.begin(), workArray.end(), [](mfxFrameSurface1* s) {
-                return s->Data.Locked == 0;
-            });
-        m_ScalerConfig.Tracer->AddCounterEvent(SMTTracer::ThreadType::CSVPP,
-                                               desc.PoolID,
-                                               SMTTracer::EventName::UNDEF,
-                                               available);
+        pSurf = pTracker->GetSurface(TIME_TO_SLEEP);
+    } while (!pSurf && t.GetTime() < timeout / 1000);
 
-        for (mfxU32 i = 0; i < workArray.size(); i++) {
-            if (!workArray[i]->Data.Locked) {
-                pSurf = workArray[i];
-                break;
-            }
+    return pSurf;
+}
+
+mfxU32 CTranscodingPipeline::GetFreeSurfacesCount(bool isDec) {
+    return isDec ? m_DecSurfaceTracker.GetFreeCount() : m_EncSurfaceTracker.GetFreeCount();
+}
+
+void CTranscodingPipeline::TuneSurfacePool(bool isDec) {
+    bool& bTuned = isDec ? m_bDecPoolTuned : m_bEncPoolTuned;
+    if (bTuned) {
+        return;
+    }
+
+    FreeSurfaceTracker& tracker = isDec ? m_DecSurfaceTracker : m_EncSurfaceTracker;
+    if (tracker.GetHandedOutCount() < m_nPoolAutoTuneFrames) {
+        return;
+    }
+    bTuned = true;
+    tracker.EnableUsageStatistics(false);
+
+    const char* poolName = isDec ? "DecPool" : "EncPool";
+    mfxU16 surfaceType   = isDec ? m_DecSurfaceType : m_EncSurfaceType;
+
+    // only system memory frames can be released one by one
+    if (m_MemoryModel != GENERAL_ALLOC || !(surfaceType & MFX_MEMTYPE_SYSTEM_MEMORY)) {
+        printf("Surface pool auto-tune (%s): skipped, pool isn't in system memory\n", poolName);
+        return;
+    }
+
+    SurfPointersArray& pool          = isDec ? m_pSurfaceDecPool : m_pSurfaceEncPool;
+    mfxFrameAllocResponse* pResponse = isDec ? &m_mfxDecResponse : &m_mfxEncResponse;
+
+    mfxU32 poolSize  = (mfxU32)pool.size();
+    mfxU32 peakInUse = tracker.GetPeakInUse();
+
+    // pool is shrunk by this thread only, which is the only one who takes surfaces from it
+    SurfPointersArray removed = tracker.Shrink(peakInUse + POOL_AUTOTUNE_MARGIN);
+
+    mfxU32 numReleased   = 0;
+    mfxU64 bytesReleased = 0;
+    bool bKeptSurfaces   = false;
+    for (auto pSurf : removed) {
+        mfxU16 index = 0;
+        while (index < pResponse->NumFrameActual && pResponse->mids[index] != pSurf->Data.MemId) {
+            index++;
         }
-        if (pSurf) {
-            break;
+
+        if (m_rawInput) {
+            std::ignore = m_pMFXAllocator->Unlock(m_pMFXAllocator->pthis,
+                                                  pSurf->Data.MemId,
+                                                  &pSurf->Data);
         }
-        else {
-            MSDK_SLEEP(TIME_TO_SLEEP);
+
+        mfxStatus sts = MFX_ERR_NOT_FOUND;
+        if (index < pResponse->NumFrameActual) {
+            sts = m_pMFXAllocator->ReleaseResponseFrame(pResponse, index);
         }
-    } while (t.GetTime() < timeout / 1000);
 
-    return pSurf;
-}
+        if (MFX_ERR_NONE != sts) {
+            // e.g. response is shared with the library, the surface goes back to the pool
+            if (m_rawInput) {
+                std::ignore = m_pMFXAllocator->Lock(m_pMFXAllocator->pthis,
+                                                    pSurf->Data.MemId,
+                                                    &pSurf->Data);
+            }
+            bKeptSurfaces = true;
+            continue;
+        }
 
-mfxU32 CTranscodingPipeline::GetFreeSurfacesCount(bool isDec) {
-    SurfPointersArray& workArray = isDec ? m_pSurfaceDecPool : m_pSurfaceEncPool;
-    mfxU32 count                 = 0;
-    for (mfxU32 i = 0; i < workArray.size(); i++) {
-        if (!workArray[i]->Data.Locked) {
-            count++;
+        mfxU32 length = 0;
+        if (MFX_ERR_NONE ==
+            GetFrameLength(pSurf->Info.Width, pSurf->Info.Height, pSurf->Info.FourCC, length)) {
+            bytesReleased += length;
         }
+        numReleased++;
+
+        pool.erase(std::find(pool.begin(), pool.end(), pSurf));
+        delete static_cast<TrackedSurface*>(pSurf);
     }
-    return count;
+
+    if (bKeptSurfaces) {
+        tracker.Reset(pool);
+    }
+
+    printf("Surface pool auto-tune (%s): peak %u of %u surfaces in use, %u surfaces released "
+           "(%.1f MB)\n",
+           poolName,
+           (unsigned int)peakInUse,
+           (unsigned int)poolSize,
+           (unsigned int)numReleased,
+           bytesReleased / (1024.0 * 1024.0));
 }
 
 PreEncAuxBuffer* CTranscodingPipeline::GetFreePreEncAuxBuffer() {
@@ -4777,9 +5073,9 @@ void CTranscodingPipeline::HandlePossibleGpuHang(mfxStatus& sts) {
         printf("[WARNING] GPU hang happened. Inserting an IDR and continuing transcoding.\n");
         m_bInsertIDR = true;
         for (BSList::iterator it = m_BSPool.begin(); it != m_BSPool.end(); it++) {
-            (*it)->IsFree               = true;
             (*it)->Bitstream.DataOffset = 0;
             (*it)->Bitstream.DataLength = 0;
+            m_pBSStore->Release(*it);
         }
         m_BSPool.clear();
         sts = MFX_ERR_NONE;
@@ -4935,6 +5231,7 @@ mfxStatus CTranscodingPipeline::Reset() {
 
     // Release output bitstram pools
     m_BSPool.clear();
+    m_HeldBS.clear();
     m_pBSStore->ReleaseAll();
     m_pBSStore->FlushAll();
 
@@ -4972,6 +5269,9 @@ mfxStatus CTranscodingPipeline::Reset() {
     if (isEnc) {
         sts = m_pmfxENC->Init(&m_mfxEncParams);
         MSDK_CHECK_STATUS(sts, "m_pmfxENC->Init failed");
+
+        sts = UpdateEncBufferSize();
+        MSDK_CHECK_STATUS(sts, "UpdateEncBufferSize failed");
     }
 
     // Joining sessions if required
@@ -5028,6 +5328,7 @@ mfxStatus CTranscodingPipeline::Reset(VPLImplementationLoader* mfxLoader) {
 
     // Release output bitstram pools
     m_BSPool.clear();
+    m_HeldBS.clear();
     m_pBSStore->ReleaseAll();
     m_pBSStore->FlushAll();
 
@@ -5065,6 +5366,9 @@ mfxStatus CTranscodingPipeline::Reset(VPLImplementationLoader* mfxLoader) {
     if (isEnc) {
         sts = m_pmfxENC->Init(&m_mfxEncParams);
         MSDK_CHECK_STATUS(sts, "m_pmfxENC->Init failed");
+
+        sts = UpdateEncBufferSize();
+        MSDK_CHECK_STATUS(sts, "UpdateEncBufferSize failed");
     }
 
     // Joining sessions if required
@@ -5110,9 +5414,7 @@ void CTranscodingPipeline::FreeVppDoNotUse() {
         MSDK_SAFE_DELETE_ARRAY(doNotUse->AlgList);
 }
 
-mfxStatus CTranscodingPipeline::AllocateSufficientBuffer(mfxBitstreamWrapper* pBS) {
-    MSDK_CHECK_POINTER(pBS, MFX_ERR_NULL_PTR);
-
+mfxStatus CTranscodingPipeline::UpdateEncBufferSize() {
     mfxVideoParam par;
     MSDK_ZERO_MEMORY(par);
 
@@ -5120,21 +5422,37 @@ mfxStatus CTranscodingPipeline::AllocateSufficientBuffer(mfxBitstreamWrapper* pB
     mfxStatus sts = m_pmfxENC->GetVideoParam(&par);
     MSDK_CHECK_STATUS(sts, "m_pmfxENC->GetVideoParam failed");
 
-    mfxU32 new_size = 0;
-
     if (par.mfx.CodecId == MFX_CODEC_JPEG) {
-        new_size = 4 + (par.mfx.FrameInfo.Width * par.mfx.FrameInfo.Height * 3 + 1023);
+        m_nEncBufferSize = 4 + (par.mfx.FrameInfo.Width * par.mfx.FrameInfo.Height * 3 + 1023);
     }
     else {
         // temp solution for cpu (sw lib)
         mfxU16 tempBRCParamMultiplier =
             par.mfx.BRCParamMultiplier == 0 ? 1 : par.mfx.BRCParamMultiplier;
-        new_size = par.mfx.BufferSizeInKB * tempBRCParamMultiplier * 1000u;
+        m_nEncBufferSize = par.mfx.BufferSizeInKB * tempBRCParamMultiplier * 1000u;
     }
-    pBS->Extend(new_size);
 
     return MFX_ERR_NONE;
-} // CTranscodingPipeline::AllocateSufficientBuffer(mfxBitstreamWrapper* pBS)
+} // CTranscodingPipeline::UpdateEncBufferSize()
+
+mfxStatus CTranscodingPipeline::AllocateSufficientBuffer(ExtendedBS* pBS) {
+    MSDK_CHECK_POINTER(pBS, MFX_ERR_NULL_PTR);
+
+    // the size is cached at encoder Init/Reset, query it here only if that was missed
+    if (!m_nEncBufferSize) {
+        mfxStatus sts = UpdateEncBufferSize();
+        MSDK_CHECK_STATUS(sts, "UpdateEncBufferSize failed");
+    }
+
+    mfxU32 new_size = m_nEncBufferSize;
+
+    // buffer is already as large as encoder asks, so the last frame didn't fit into it
+    if (pBS->Bitstream.MaxLength >= new_size) {
+        new_size = BitstreamBufferPool::GetNextClassSize(pBS->Bitstream.MaxLength);
+    }
+
+    return m_pBSStore->AttachBuffer(pBS, new_size);
+} // CTranscodingPipeline::AllocateSufficientBuffer(ExtendedBS* pBS)
 
 mfxStatus CTranscodingPipeline::Join(MFXVideoSession* pChildSession) {
     mfxStatus sts = MFX_ERR_NONE;
@@ -5144,6 +5462,27 @@ mfxStatus CTranscodingPipeline::Join(MFXVideoSession* pChildSession) {
     return sts;
 } // CTranscodingPipeline::Join(MFXVideoSession *pChildSession)
 
+mfxStatus CTranscodingPipeline::RunStep(mfxU32& delayUs) {
+    m_bPollSync   = true;
+    mfxStatus sts = TranscodeStep(delayUs);
+    if (MFX_ERR_NONE == sts)
+        return sts;
+
+    m_TranscodeLoop.bStarted = false;
+
+    std::stringstream ss;
+    ss << "CTranscodingPipeline::RunStep::TranscodeStep() [" << GetSessionText() << "] failed";
+    MSDK_CHECK_STATUS(sts, ss.str());
+
+    return sts;
+}
+
+bool CTranscodingPipeline::IsSteppable() {
+    return m_bDecodeEnable && m_bEncodeEnable && !m_pBuffer && !IsOverlayUsed() &&
+           !m_ScalerConfig.CascadeScalerRequired && !m_ScalerConfig.ParallelEncodingRequired &&
+           !m_pSurfaceUtilizationSynchronizer;
+}
+
 mfxStatus CTranscodingPipeline::Run() {
     mfxStatus sts = MFX_ERR_NONE;
 
@@ -5177,17 +5516,156 @@ void IncreaseReference(mfxFrameSurface1& surf) {
 }
 
 void DecreaseReference(mfxFrameSurface1& surf) {
-    msdk_atomic_dec16((volatile mfxU16*)&surf.Data.Locked);
+    // tracker is taken while the surface is still referenced, a free surface may be removed from
+    // its pool by auto-tune; trackers themselves live as long as the pipeline
+    FreeSurfaceTracker* pTracker =
+        surf.FrameInterface ? nullptr : static_cast<TrackedSurface&>(surf).pTracker.load();
+
+    mfxU16 locked = msdk_atomic_dec16((volatile mfxU16*)&surf.Data.Locked);
     if (surf.FrameInterface) {
         std::ignore = surf.FrameInterface->Release(&surf);
     }
+    if (0 == locked && pTracker) {
+        pTracker->Notify();
+    }
+}
+
+FreeSurfaceTracker::FreeSurfaceTracker()
+        : m_mutex(),
+          m_released(),
+          m_releaseCount(0),
+          m_surfaces(),
+          m_next(0),
+          m_handedOut(0),
+          m_peakInUse(0),
+          m_bCollectUsage(false) {}
+
+FreeSurfaceTracker::~FreeSurfaceTracker() {
+    Clear();
+}
+
+void FreeSurfaceTracker::Reset(const SurfPointersArray& surfaces) {
+    Clear();
+
+    for (auto pSurf : surfaces) {
+        static_cast<TrackedSurface*>(pSurf)->pTracker = this;
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_surfaces  = surfaces;
+    m_next      = 0;
+    m_handedOut = 0;
+    m_peakInUse = 0;
+}
+
+void FreeSurfaceTracker::Clear() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    for (auto pSurf : m_surfaces) {
+        // the surface may be given to another pool already
+        FreeSurfaceTracker* pTracker = this;
+        static_cast<TrackedSurface*>(pSurf)->pTracker.compare_exchange_strong(pTracker, nullptr);
+    }
+    m_surfaces.clear();
+    m_next = 0;
+}
+
+mfxFrameSurface1* FreeSurfaceTracker::FindFreeSurface() {
+    for (size_t i = 0; i < m_surfaces.size(); i++) {
+        size_t idx = (m_next + i) % m_surfaces.size();
+        if (!m_surfaces[idx]->Data.Locked) {
+            m_next = (idx + 1) % m_surfaces.size();
+            m_handedOut++;
+
+            if (m_bCollectUsage) {
+                // the surface is counted as used, it is locked as soon as caller submits it
+                mfxU32 inUse = 1 + (mfxU32)std::count_if(m_surfaces.begin(),
+                                                         m_surfaces.end(),
+                                                         [](mfxFrameSurface1* s) {
+                                                             return s->Data.Locked != 0;
+                                                         });
+                m_peakInUse  = std::max(m_peakInUse, inUse);
+            }
+
+            return m_surfaces[idx];
+        }
+    }
+    return NULL;
+}
+
+mfxFrameSurface1* FreeSurfaceTracker::GetSurface(mfxU32 msec) {
+    std::unique_lock<std::mutex> lock(m_mutex);
+
+    mfxFrameSurface1* pSurf = FindFreeSurface();
+    if (pSurf || !msec) {
+        return pSurf;
+    }
+
+    mfxU64 releaseCount = m_releaseCount;
+    m_released.wait_for(lock, std::chrono::milliseconds(msec), [&] {
+        return m_releaseCount != releaseCount;
+    });
+
+    return FindFreeSurface();
+}
+
+mfxU32 FreeSurfaceTracker::GetFreeCount() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return (mfxU32)std::count_if(m_surfaces.begin(), m_surfaces.end(), [](mfxFrameSurface1* s) {
+        return s->Data.Locked == 0;
+    });
+}
+
+void FreeSurfaceTracker::Notify() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_releaseCount++;
+    }
+    m_released.notify_all();
+}
+
+void FreeSurfaceTracker::EnableUsageStatistics(bool bEnable) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_bCollectUsage = bEnable;
+}
+
+mfxU64 FreeSurfaceTracker::GetHandedOutCount() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_handedOut;
+}
+
+mfxU32 FreeSurfaceTracker::GetPeakInUse() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_peakInUse;
+}
+
+SurfPointersArray FreeSurfaceTracker::Shrink(mfxU32 limit) {
+    SurfPointersArray removed;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        // the first surface stays, pipeline uses it as a sample of the pool
+        for (size_t i = m_surfaces.size(); i > 1 && m_surfaces.size() > limit; i--) {
+            if (!m_surfaces[i - 1]->Data.Locked) {
+                static_cast<TrackedSurface*>(m_surfaces[i - 1])->pTracker = nullptr;
+                removed.push_back(m_surfaces[i - 1]);
+                m_surfaces.erase(m_surfaces.begin() + (i - 1));
+            }
+        }
+        m_next = 0;
+    }
+
+    return removed;
 }
 
 SafetySurfaceBuffer::SafetySurfaceBuffer(SafetySurfaceBuffer* pNext)
         : TargetID(0),
           m_pNext(pNext),
+          m_Ring(),
+          m_RingHead(0),
+          m_RingTail(0),
           m_mutex(),
-          m_SList(),
+          m_Overflow(),
+          m_OverflowSize(0),
           m_IsBufferingAllowed(true),
           pRelEvent(nullptr),
           pInsEvent(nullptr) {
@@ -5205,9 +5683,14 @@ SafetySurfaceBuffer::~SafetySurfaceBuffer() {
     delete pInsEvent;
 } //SafetySurfaceBuffer::~SafetySurfaceBuffer()
 
+void SafetySurfaceBuffer::Unlock(SurfaceDescriptor& sDescriptor) {
+    if (sDescriptor.Locked.exchange(0) && sDescriptor.ExtSurface.pSurface)
+        DecreaseReference(*sDescriptor.ExtSurface.pSurface);
+}
+
 mfxU32 SafetySurfaceBuffer::GetLength() {
-    std::lock_guard<std::mutex> guard(m_mutex);
-    return (mfxU32)m_SList.size();
+    mfxU32 head = m_RingHead;
+    return m_RingTail - head + m_OverflowSize;
 }
 
 mfxStatus SafetySurfaceBuffer::WaitForSurfaceRelease(mfxU32 msec) {
@@ -5219,77 +5702,101 @@ mfxStatus SafetySurfaceBuffer::WaitForSurfaceInsertion(mfxU32 msec) {
 }
 
 void SafetySurfaceBuffer::AddSurface(ExtendedSurface Surf) {
-    bool isBufferingAllowed = false;
-
-    {
-        std::lock_guard<std::mutex> guard(m_mutex);
+    if (!m_IsBufferingAllowed)
+        return;
 
-        isBufferingAllowed = m_IsBufferingAllowed;
-        if (isBufferingAllowed) {
-            SurfaceDescriptor sDescriptor;
-            // Locked is used to signal when we can free surface
-            sDescriptor.Locked     = 1;
-            sDescriptor.ExtSurface = Surf;
+    if (Surf.pSurface) {
+        IncreaseReference(*Surf.pSurface);
+    }
 
-            if (Surf.pSurface) {
-                IncreaseReference(*Surf.pSurface);
-            }
+    mfxU32 tail = m_RingTail;
+    // while overflow list isn't empty, the ring can't be used to keep order of surfaces
+    if (!m_OverflowSize && tail - m_RingHead < RING_SIZE) {
+        SurfaceDescriptor& sDescriptor = m_Ring[tail % RING_SIZE];
+        // Locked is used to signal when we can free surface
+        sDescriptor.ExtSurface = Surf;
+        sDescriptor.Locked     = 1;
+        m_RingTail             = tail + 1;
 
-            m_SList.push_back(sDescriptor);
+        // pairs with CancelBuffering and following clean up by reader: if reader has missed
+        // the surface, it is dropped here
+        if (!m_IsBufferingAllowed) {
+            Unlock(sDescriptor);
+            return;
         }
     }
+    else {
+        std::lock_guard<std::mutex> guard(m_mutex);
+
+        if (!m_IsBufferingAllowed) {
+            if (Surf.pSurface)
+                DecreaseReference(*Surf.pSurface);
+            return;
+        }
 
-    if (isBufferingAllowed) {
-        pInsEvent->Signal();
+        m_Overflow.emplace_back();
+        m_Overflow.back().ExtSurface = Surf;
+        m_Overflow.back().Locked     = 1;
+        m_OverflowSize++;
     }
 
+    pInsEvent->Signal();
+
 } // SafetySurfaceBuffer::AddSurface(mfxFrameSurface1 *pSurf)
 
 mfxStatus SafetySurfaceBuffer::GetSurface(ExtendedSurface& Surf) {
-    std::lock_guard<std::mutex> guard(m_mutex);
-
-    // no ready surfaces
-    if (0 == m_SList.size()) {
-        MSDK_ZERO_MEMORY(Surf)
-        return MFX_ERR_MORE_SURFACE;
+    mfxU32 head = m_RingHead;
+    if (head != m_RingTail) {
+        Surf = m_Ring[head % RING_SIZE].ExtSurface;
+        return MFX_ERR_NONE;
     }
 
-    SurfaceDescriptor sDescriptor = m_SList.front();
-
-    Surf = sDescriptor.ExtSurface;
+    if (m_OverflowSize) {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        if (m_Overflow.size()) {
+            Surf = m_Overflow.front().ExtSurface;
+            return MFX_ERR_NONE;
+        }
+    }
 
-    return MFX_ERR_NONE;
+    // no ready surfaces
+    MSDK_ZERO_MEMORY(Surf)
+    return MFX_ERR_MORE_SURFACE;
 
 } // SafetySurfaceBuffer::GetSurface()
 
 mfxStatus SafetySurfaceBuffer::ReleaseSurface(mfxFrameSurface1* pSurf) {
-    std::unique_lock<std::mutex> lock(m_mutex);
+    // reader always releases the surface it has got from GetSurface, i.e. the oldest one
+    mfxU32 head = m_RingHead;
+    if (head != m_RingTail) {
+        SurfaceDescriptor& sDescriptor = m_Ring[head % RING_SIZE];
+        if (pSurf != sDescriptor.ExtSurface.pSurface)
+            return MFX_ERR_UNKNOWN;
 
-    std::list<SurfaceDescriptor>::iterator it;
-    for (it = m_SList.begin(); it != m_SList.end(); it++) {
-        if (pSurf == it->ExtSurface.pSurface) {
-            it->Locked--;
-            if (it->ExtSurface.pSurface)
-                DecreaseReference(*it->ExtSurface.pSurface);
-            if (0 == it->Locked) {
-                m_SList.erase(it);
-                lock.unlock();
-
-                // event operation should be out of synced context
-                pRelEvent->Signal();
-            }
+        Unlock(sDescriptor);
+        m_RingHead = head + 1;
+    }
+    else {
+        std::lock_guard<std::mutex> guard(m_mutex);
+        if (m_Overflow.empty() || pSurf != m_Overflow.front().ExtSurface.pSurface)
+            return MFX_ERR_UNKNOWN;
 
-            return MFX_ERR_NONE;
-        }
+        Unlock(m_Overflow.front());
+        m_Overflow.pop_front();
+        m_OverflowSize--;
     }
 
-    return MFX_ERR_UNKNOWN;
+    pRelEvent->Signal();
+
+    return MFX_ERR_NONE;
 } // mfxStatus SafetySurfaceBuffer::ReleaseSurface(mfxFrameSurface1* pSurf)
 
 mfxStatus SafetySurfaceBuffer::ReleaseSurfaceAll() {
     std::lock_guard<std::mutex> guard(m_mutex);
 
-    m_SList.clear();
+    m_RingHead = m_RingTail.load();
+    m_Overflow.clear();
+    m_OverflowSize       = 0;
     m_IsBufferingAllowed = true;
     return MFX_ERR_NONE;
 
@@ -5346,11 +5853,7 @@ mfxStatus FileBitstreamProcessor::GetInputBitstream(mfxBitstreamWrapper** pBitst
             break;
         }
 
-        //check that bitstream buffer is empty before extending its size
-        if (m_Bitstream.DataLength != 0 || m_Bitstream.DataOffset != 0) {
-            return MFX_ERR_NOT_ENOUGH_BUFFER;
-        }
-
+        //data which is already in the bitstream is kept by Extend
         m_Bitstream.Extend(2 * m_Bitstream.MaxLength);
     }
 
@@ -5385,6 +5888,21 @@ mfxStatus FileBitstreamProcessor::ProcessOutputBitstream(mfxBitstreamWrapper* pB
     return MFX_ERR_NONE;
 }
 
+mfxStatus FileBitstreamProcessor::GetWrittenFrames(mfxU32 targetID,
+                                                   std::vector<mfxBitstream*>& written) {
+    if (m_pFileWriter.get())
+        return m_pFileWriter->GetWrittenFrames(targetID, written);
+
+    return MFX_ERR_NONE;
+}
+
+mfxStatus FileBitstreamProcessor::WaitForWrittenFrames(mfxU32 targetID, mfxU32 timeout) {
+    if (m_pFileWriter.get())
+        return m_pFileWriter->WaitForWrittenFrames(targetID, timeout);
+
+    return MFX_ERR_NONE;
+}
+
 mfxStatus FileBitstreamProcessor::ResetInput() {
     if (m_pFileReader.get()) {
         m_pFileReader->Reset();
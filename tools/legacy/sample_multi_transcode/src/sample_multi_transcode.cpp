@@ -9,7 +9,9 @@
     #include <windows.h>
 #endif
 
+#include "au_index.h"
 #include "sample_multi_transcode.h"
+#include "session_scheduler.h"
 
 #if defined(LIBVA_WAYLAND_SUPPORT)
     #include "class_wayland.h"
@@ -19,8 +21,12 @@
     #error MFX_VERSION not defined
 #endif
 
+#include <algorithm>
+#include <functional>
 #include <future>
 #include <iomanip>
+#include <iterator>
+#include <limits>
 #include <memory>
 
 // Intel® Video Processing Library (Intel® VPL)
@@ -94,13 +100,20 @@ Launcher::Launcher()
           m_pLoader(),
           m_VppDstRects(),
           m_CSConfig(),
-#if (defined(_WIN32) || defined(_WIN64))
           m_Tracer(),
+          m_hdl(NULL),
+          m_ControlSocket(),
+          m_ControlServer(),
+          m_ControlMutex(),
+          m_ControlRequests(),
+          m_pCompletionQueue(NULL),
+#if (defined(_WIN32) || defined(_WIN64))
+          m_bQuit(false),
           m_DisplaysData() {
     MSDK_ZERO_MEMORY(m_Adapters);
 }
 #else
-          m_Tracer() {
+          m_bQuit(false) {
 } // Launcher::Launcher()
 #endif
 
@@ -114,6 +127,30 @@ CTranscodingPipeline* CreatePipeline() {
     return new CTranscodingPipeline;
 }
 
+// Pins the calling thread to the CPUs while the object exists. Threads and memory pages created
+// by the thread meanwhile, e.g. threads of the runtime, get the same CPUs and NUMA node.
+class ScopedThreadAffinity {
+public:
+    ScopedThreadAffinity(const std::vector<mfxU32>& cpus) : m_prevCpus(), m_isPinned(false) {
+        if (cpus.empty() || MFX_ERR_NONE != msdk_thread_get_affinity(m_prevCpus))
+            return;
+        m_isPinned = MFX_ERR_NONE == msdk_thread_set_affinity(cpus);
+    }
+    ~ScopedThreadAffinity() {
+        if (m_isPinned)
+            std::ignore = msdk_thread_set_affinity(m_prevCpus);
+    }
+    bool IsPinned() const {
+        return m_isPinned;
+    }
+
+private:
+    std::vector<mfxU32> m_prevCpus;
+    bool m_isPinned;
+
+    DISALLOW_COPY_AND_ASSIGN(ScopedThreadAffinity);
+};
+
 mfxStatus Launcher::Init(int argc, char* argv[]) {
     mfxStatus sts;
     mfxU32 i                     = 0;
@@ -149,10 +186,16 @@ mfxStatus Launcher::Init(int argc, char* argv[]) {
         m_InputParamsArray.push_back(InputParams);
     }
 
+    sts = SplitInputToSegments();
+    MSDK_CHECK_STATUS(sts, "SplitInputToSegments failed");
+
     performance_file_name = parser.GetPerformanceFile();
     parameter_file_name   = parser.GetParameterFile();
     session_descriptions  = parser.GetSessionDescriptions();
     surface_wait_interval = parser.GetParameterSurfaceWaitInterval();
+    m_ControlSocket       = parser.GetControlSocket();
+
+    ShareDecoders();
 
     m_CSConfig.Tracer = &m_Tracer;
 
@@ -160,6 +203,14 @@ mfxStatus Launcher::Init(int argc, char* argv[]) {
     sts = VerifyCrossSessionsOptions();
     MSDK_CHECK_STATUS(sts, "VerifyCrossSessionsOptions failed");
 
+    if (!m_ControlSocket.empty() && m_InputParamsArray[0].bRobustFlag) {
+        PrintError("-control can't be used with -robust");
+        return MFX_ERR_UNSUPPORTED;
+    }
+
+    sts = ResolveSessionPlacement();
+    MSDK_CHECK_STATUS(sts, "ResolveSessionPlacement failed");
+
     if (InputParams.verSessionInit == API_1X) {
 #if (defined(_WIN32) || defined(_WIN64))
         // check available adapters
@@ -467,6 +518,7 @@ mfxStatus Launcher::Init(int argc, char* argv[]) {
             hdls.push_back(NULL);
         }
     }
+    m_hdl = hdls[0];
 
     // each pair of source and sink has own safety buffer
     sts = CreateSafetyBuffers();
@@ -492,8 +544,32 @@ mfxStatus Launcher::Init(int argc, char* argv[]) {
     // create sessions, allocators
     for (i = 0; i < m_InputParamsArray.size(); i++) {
         printf("Session %d:\n", (int)i);
+
+        // session is created on its CPUs, so runtime threads and memory of the session are there
+        ScopedThreadAffinity sessionAffinity(m_InputParamsArray[i].CpuAffinity);
+        if (!m_InputParamsArray[i].CpuAffinity.empty()) {
+            if (!sessionAffinity.IsPinned()) {
+                printf("error: failed to run session %d on CPUs %s\n",
+                       (int)i,
+                       CpuListToString(m_InputParamsArray[i].CpuAffinity).c_str());
+                return MFX_ERR_UNSUPPORTED;
+            }
+            // CPUs which aren't allowed to the process are dropped, keep the actual ones
+            sts = msdk_thread_get_affinity(m_InputParamsArray[i].CpuAffinity);
+            MSDK_CHECK_STATUS(sts, "msdk_thread_get_affinity failed");
+        }
+
         auto pAllocator = std::make_unique<GeneralAllocator>();
-        sts             = pAllocator->Init(m_pAllocParams[i].get());
+
+        SysMemPlacement placement;
+        placement.bHugePages = m_InputParamsArray[i].bSysMemHugePages;
+        placement.NumaNode   = m_InputParamsArray[i].nSysMemNumaNode;
+        pAllocator->SetSysMemPlacement(placement);
+        pAllocator->SetSysMemModes(m_InputParamsArray[i].bSysMemSlab,
+                                   m_InputParamsArray[i].bSysMemPool,
+                                   m_InputParamsArray[i].bSysMemZeroInit);
+
+        sts = pAllocator->Init(m_pAllocParams[i].get());
         MSDK_CHECK_STATUS(sts, "pAllocator->Init failed");
 
         m_pAllocArray.push_back(std::move(pAllocator));
@@ -522,44 +598,8 @@ mfxStatus Launcher::Init(int argc, char* argv[]) {
 
         pThreadPipeline->pBSProcessor = m_pExtBSProcArray.back().get();
 
-        std::unique_ptr<CSmplBitstreamReader> reader;
-        std::unique_ptr<CSmplYUVReader> yuvreader;
-        if (m_InputParamsArray[i].DecodeId == MFX_CODEC_VP9 ||
-            m_InputParamsArray[i].DecodeId == MFX_CODEC_VP8 ||
-            m_InputParamsArray[i].DecodeId == MFX_CODEC_AV1) {
-            reader.reset(new CIVFFrameReader());
-        }
-        else if (m_InputParamsArray[i].DecodeId == MFX_CODEC_RGB4 ||
-                 m_InputParamsArray[i].DecodeId == MFX_CODEC_I420 ||
-                 m_InputParamsArray[i].DecodeId == MFX_CODEC_NV12 ||
-                 m_InputParamsArray[i].DecodeId == MFX_CODEC_P010 ||
-                 m_InputParamsArray[i].DecodeId == MFX_CODEC_YUY2 ||
-                 m_InputParamsArray[i].DecodeId == MFX_CODEC_Y210) {
-            // YUV reader for RGB4 overlay and raw input
-            yuvreader.reset(new CSmplYUVReader());
-        }
-        else {
-            reader.reset(new CSmplBitstreamReader());
-        }
-
-        if (reader.get()) {
-            sts = reader->Init(m_InputParamsArray[i].strSrcFile.c_str());
-            if (sts == MFX_ERR_UNSUPPORTED && m_InputParamsArray[i].DecodeId == MFX_CODEC_AV1) {
-                reader.reset(new CSmplBitstreamReader());
-                printf("WARNING: Stream is not IVF, default reader\n");
-            }
-            MSDK_CHECK_STATUS(sts, "reader->Init failed");
-            sts = m_pExtBSProcArray.back()->SetReader(reader);
-            MSDK_CHECK_STATUS(sts, "m_pExtBSProcArray.back()->SetReader failed");
-        }
-        else if (yuvreader.get()) {
-            std::list<std::string> input;
-            input.push_back(m_InputParamsArray[i].strSrcFile);
-            sts = yuvreader->Init(input, m_InputParamsArray[i].DecodeId);
-            MSDK_CHECK_STATUS(sts, "m_YUVReader->Init failed");
-            sts = m_pExtBSProcArray.back()->SetReader(yuvreader);
-            MSDK_CHECK_STATUS(sts, "m_pExtBSProcArray.back()->SetReader failed");
-        }
+        sts = CreateReader(m_InputParamsArray[i], m_pExtBSProcArray.back().get());
+        MSDK_CHECK_STATUS(sts, "CreateReader failed");
 
         CreateCascadeScalerConfig();
         if (m_CSConfig.ParallelEncodingRequired) {
@@ -576,6 +616,21 @@ mfxStatus Launcher::Init(int argc, char* argv[]) {
                 m_pExtBSProcArray.back()->SetWriter(m_GlobalBitstreamWriter);
             }
         }
+        else if (m_InputParamsArray[i].nSegments > 1) {
+            auto writer = std::dynamic_pointer_cast<CBitstreamWriterForParallelEncoding>(
+                m_GlobalBitstreamWriter);
+            if (!writer) {
+                writer = std::make_shared<CBitstreamWriterForParallelEncoding>();
+                sts    = writer->Init(m_InputParamsArray[i].strDstFile.c_str());
+                MSDK_CHECK_STATUS(sts, "could not create destination file");
+                m_GlobalBitstreamWriter = writer;
+            }
+            writer->AddSegment(m_InputParamsArray[i].TargetID,
+                               m_InputParamsArray[i].SegmentFirstFrame,
+                               m_InputParamsArray[i].SegmentSkipFrames);
+            sts = m_pExtBSProcArray.back()->SetWriter(m_GlobalBitstreamWriter);
+            MSDK_CHECK_STATUS(sts, "m_pExtBSProcArray.back()->SetWriter failed");
+        }
         else if (!msdk_match(m_InputParamsArray[i].strDstFile, "null")) {
             auto writer = std::make_shared<CSmplBitstreamWriter>();
             sts         = writer->Init(m_InputParamsArray[i].strDstFile.c_str());
@@ -672,6 +727,7 @@ mfxStatus Launcher::Init(int argc, char* argv[]) {
         pThreadPipeline->startStatus = MFX_WRN_DEVICE_BUSY;
         // set other session's parameters
         pThreadPipeline->implType = m_InputParamsArray[i].libType;
+        pThreadPipeline->cpuAffinity = m_InputParamsArray[i].CpuAffinity;
         m_pThreadContextArray.push_back(std::move(pThreadPipeline));
 
         mfxVersion ver = { { 0, 0 } };
@@ -685,6 +741,7 @@ mfxStatus Launcher::Init(int argc, char* argv[]) {
     }
 
     for (i = 0; i < m_InputParamsArray.size(); i++) {
+        ScopedThreadAffinity sessionAffinity(m_InputParamsArray[i].CpuAffinity);
         sts = m_pThreadContextArray[i]->pPipeline->CompleteInit();
         MSDK_CHECK_STATUS(sts, "m_pThreadContextArray[i]->pPipeline->CompleteInit failed");
 
@@ -696,6 +753,8 @@ mfxStatus Launcher::Init(int argc, char* argv[]) {
         m_pThreadContextArray[i]->pPipeline->SetPipelineID(i);
     }
 
+    PrintSessionPlacement();
+
     if (m_InputParamsArray[0].forceSyncAllSession == MFX_CODINGOPTION_ON) {
         auto it = std::max_element(std::begin(m_pThreadContextArray),
                                    std::end(m_pThreadContextArray),
@@ -713,12 +772,94 @@ mfxStatus Launcher::Init(int argc, char* argv[]) {
         }
     }
 
+    if (!m_ControlSocket.empty()) {
+        sts = m_ControlServer.Start(m_ControlSocket, [this](const std::string& line) {
+            return OnControlCommand(line);
+        });
+        MSDK_CHECK_STATUS(sts, "m_ControlServer.Start failed");
+        printf("Waiting for commands on control socket %s\n", m_ControlSocket.c_str());
+    }
+
     printf("\n");
 
     return sts;
 
 } // mfxStatus Launcher::Init()
 
+mfxStatus Launcher::CreateReader(const sInputParams& par, FileBitstreamProcessor* pProcessor) {
+    mfxStatus sts = MFX_ERR_NONE;
+
+    std::unique_ptr<CSmplBitstreamReader> reader;
+    std::unique_ptr<CSmplYUVReader> yuvreader;
+    if (par.DecodeId == MFX_CODEC_VP9 || par.DecodeId == MFX_CODEC_VP8 ||
+        par.DecodeId == MFX_CODEC_AV1) {
+        reader.reset(new CIVFFrameReader());
+    }
+    else if (par.bDecCompleteFrame && par.DecodeId == MFX_CODEC_AVC) {
+        reader.reset(new CH264FrameReader());
+    }
+    else if (par.bDecCompleteFrame && par.DecodeId == MFX_CODEC_HEVC) {
+        reader.reset(new CHEVCFrameReader());
+    }
+    else if (par.DecodeId == MFX_CODEC_RGB4 || par.DecodeId == MFX_CODEC_I420 ||
+             par.DecodeId == MFX_CODEC_NV12 || par.DecodeId == MFX_CODEC_P010 ||
+             par.DecodeId == MFX_CODEC_YUY2 || par.DecodeId == MFX_CODEC_Y210) {
+        // YUV reader for RGB4 overlay and raw input
+        yuvreader.reset(new CSmplYUVReader());
+    }
+    else {
+        reader.reset(new CSmplBitstreamReader());
+    }
+
+    if (reader.get()) {
+        sts = reader->Init(par.strSrcFile.c_str());
+        if (sts == MFX_ERR_UNSUPPORTED && par.DecodeId == MFX_CODEC_AV1) {
+            // Annex B and low overhead streams are split into temporal units as well
+            reader.reset(new CAV1FrameReader());
+            printf("WARNING: Stream is not IVF, OBU stream reader\n");
+            sts = reader->Init(par.strSrcFile.c_str());
+        }
+        MSDK_CHECK_STATUS(sts, "reader->Init failed");
+
+        mfxU64 offset                = par.SegmentOffset;
+        std::vector<mfxU8> paramSets = par.SegmentParamSets;
+        if (par.nSeekFrame) {
+            // saved index lets following runs seek without scanning the input
+            CAUIndex index;
+            sts = index.LoadOrBuild(par.strSrcFile.c_str(), par.DecodeId);
+            MSDK_CHECK_STATUS(sts, "index.LoadOrBuild failed");
+
+            mfxI32 keyFrame = index.FindKeyFrame(par.nSeekFrame);
+            if (keyFrame < 0) {
+                printf("ERROR: input has no key frame at or before frame %u\n", par.nSeekFrame);
+                return MFX_ERR_UNSUPPORTED;
+            }
+            if ((mfxU32)keyFrame != par.nSeekFrame)
+                printf("WARNING: decoding starts from key frame %d\n", keyFrame);
+
+            offset = index.GetEntries()[keyFrame].Offset;
+            sts    = index.ReadParameterSets(par.strSrcFile.c_str(), (mfxU32)keyFrame, paramSets);
+            MSDK_CHECK_STATUS(sts, "index.ReadParameterSets failed");
+        }
+        if (offset) {
+            sts = reader->Seek(offset, paramSets);
+            MSDK_CHECK_STATUS(sts, "reader->Seek failed");
+        }
+        sts = pProcessor->SetReader(reader);
+        MSDK_CHECK_STATUS(sts, "pProcessor->SetReader failed");
+    }
+    else if (yuvreader.get()) {
+        std::list<std::string> input;
+        input.push_back(par.strSrcFile);
+        sts = yuvreader->Init(input, par.DecodeId);
+        MSDK_CHECK_STATUS(sts, "m_YUVReader->Init failed");
+        sts = pProcessor->SetReader(yuvreader);
+        MSDK_CHECK_STATUS(sts, "pProcessor->SetReader failed");
+    }
+
+    return sts;
+} // mfxStatus Launcher::CreateReader
+
 void Launcher::Run() {
     printf("Transcoding started\n");
 
@@ -737,93 +878,167 @@ void Launcher::Run() {
 
 } // mfxStatus Launcher::Init()
 
+// index pushed to the completion queue by the control thread instead of a session index
+static const size_t ControlRequestIndex = std::numeric_limits<size_t>::max();
+
 void Launcher::DoTranscoding() {
-    auto RunTranscodeRoutine = [](ThreadTranscodeContext* context) {
-        context->handle = std::async(std::launch::async, [context]() {
+    // Sessions report their completion here, so the launcher doesn't poll them
+    SessionCompletionQueue completionQueue;
+
+    auto RunTranscodeRoutine = [&completionQueue](ThreadTranscodeContext* context, size_t index) {
+        context->handle = std::async(std::launch::async, [context, index, &completionQueue]() {
             context->TranscodeRoutine();
+            completionQueue.Push(index);
         });
     };
 
-    bool isOverlayUsed = false;
     for (const auto& context : m_pThreadContextArray) {
         MSDK_CHECK_POINTER_NO_RET(context);
-        RunTranscodeRoutine(context.get());
-
         MSDK_CHECK_POINTER_NO_RET(context->pPipeline);
-        isOverlayUsed = isOverlayUsed || context->pPipeline->IsOverlayUsed();
     }
 
-    // Transcoding threads waiting cycle
-    bool aliveNonOverlaySessions = true;
-    while (aliveNonOverlaySessions) {
-        aliveNonOverlaySessions = false;
+    {
+        std::lock_guard<std::mutex> lock(m_ControlMutex);
+        m_pCompletionQueue = &completionQueue;
+    }
 
-        for (size_t i = 0; i < m_pThreadContextArray.size(); ++i) {
-            if (!m_pThreadContextArray[i]->handle.valid())
-                continue;
+    // Sessions which don't wait for other sessions are run by a pool of threads if it's requested
+    std::unique_ptr<SessionScheduler> scheduler;
+    if (m_InputParamsArray[0].nSchedulerThreads) {
+        scheduler.reset(new SessionScheduler(m_InputParamsArray[0].nSchedulerThreads));
+    }
 
-            //Payslip interval to check the state of working threads:
-            //such interval is usually a realtime, i.e. for 30 fps this would be 33ms,
-            //66ms typically mean either 1/fps or 2/fps payslip checks.
-            auto waitSts = m_pThreadContextArray[i]->handle.wait_for(std::chrono::milliseconds(66));
-            if (waitSts == std::future_status::ready) {
-                // Invoke get() of the handle just to reset the valid state.
-                // This allows to skip already processed sessions
-                m_pThreadContextArray[i]->handle.get();
-
-                // Session is completed, let's check for its status
-                if (m_pThreadContextArray[i]->transcodingSts < MFX_ERR_NONE) {
-                    // Stop all the sessions if an error happened in one
-                    // But do not stop in robust mode when gpu hang's happened
-                    if (m_pThreadContextArray[i]->transcodingSts != MFX_ERR_GPU_HANG ||
-                        !m_pThreadContextArray[i]->pPipeline->GetRobustFlag()) {
-                        std::cout << "\n\n session " << i << " ["
-                                  << m_pThreadContextArray[i]->pPipeline->GetSessionText()
-                                  << "] failed with status "
-                                  << StatusToString(m_pThreadContextArray[i]->transcodingSts)
-                                  << " shutting down the application..." << std::endl
-                                  << std::endl;
-
-                        for (const auto& context : m_pThreadContextArray) {
-                            context->pPipeline->StopSession();
-                        }
-                    }
-                }
-                else if (m_pThreadContextArray[i]->transcodingSts > MFX_ERR_NONE) {
-                    std::cout << "\n\n session " << i << " ["
-                              << m_pThreadContextArray[i]->pPipeline->GetSessionText()
-                              << "] returned warning status "
-                              << StatusToString(m_pThreadContextArray[i]->transcodingSts)
-                              << std::endl
-                              << std::endl;
-                }
-            }
-            else {
-                aliveNonOverlaySessions = aliveNonOverlaySessions ||
-                                          !m_pThreadContextArray[i]->pPipeline->IsOverlayUsed();
+    bool isOverlayUsed                = false;
+    size_t numAliveNonOverlaySessions = 0;
+    for (size_t i = 0; i < m_pThreadContextArray.size(); ++i) {
+        ThreadTranscodeContext* context = m_pThreadContextArray[i].get();
+        context->launchTime             = std::chrono::system_clock::now();
+
+        // pinned sessions keep own threads, tasks of the pool move between its threads
+        if (scheduler && context->pPipeline->IsSteppable() && context->cpuAffinity.empty()) {
+            scheduler->Submit([context, i, &completionQueue](std::chrono::microseconds& delay) {
+                if (context->TranscodeStep(delay))
+                    return true;
+
+                completionQueue.Push(i);
+                return false;
+            });
+        }
+        else {
+            RunTranscodeRoutine(context, i);
+        }
+
+        if (context->pPipeline->IsOverlayUsed())
+            isOverlayUsed = true;
+        else
+            numAliveNonOverlaySessions++;
+    }
+
+    if (scheduler) {
+        scheduler->Start();
+    }
+
+    // Transcoding sessions waiting cycle
+    // With control socket the application runs till quit command even if there are no sessions
+    size_t numAliveSessions = m_pThreadContextArray.size();
+    while (numAliveNonOverlaySessions || (m_ControlServer.IsRunning() && !m_bQuit)) {
+        size_t i = completionQueue.Pop();
+        if (i == ControlRequestIndex) {
+            size_t numSessions = m_pThreadContextArray.size();
+            ProcessControlRequests();
+
+            // sessions added by the operator run on own threads
+            for (; numSessions < m_pThreadContextArray.size(); numSessions++) {
+                ThreadTranscodeContext* context = m_pThreadContextArray[numSessions].get();
+                context->launchTime             = std::chrono::system_clock::now();
+                RunTranscodeRoutine(context, numSessions);
+                numAliveSessions++;
+                numAliveNonOverlaySessions++;
             }
+            continue;
+        }
+        numAliveSessions--;
+
+        // Invoke get() of the handle just to reset the valid state.
+        if (m_pThreadContextArray[i]->handle.valid())
+            m_pThreadContextArray[i]->handle.get();
+        m_pThreadContextArray[i]->isCompleted = true;
+
+        if (!m_pThreadContextArray[i]->pPipeline->IsOverlayUsed())
+            numAliveNonOverlaySessions--;
+
+        if (m_pThreadContextArray[i]->isRemoved) {
+            ReleaseSession((mfxU32)i);
+            continue;
         }
 
-        // Stop overlay sessions
-        // Note: Overlay sessions never stop themselves so they should be forcibly stopped
-        // after stopping of all non-overlay sessions
-        if (!aliveNonOverlaySessions && isOverlayUsed) {
-            // Sending stop message
-            for (const auto& context : m_pThreadContextArray) {
-                if (context->pPipeline->IsOverlayUsed()) {
-                    context->pPipeline->StopSession();
+        // Session is completed, let's check for its status
+        if (m_pThreadContextArray[i]->transcodingSts < MFX_ERR_NONE) {
+            // Stop all the sessions if an error happened in one
+            // But do not stop in robust mode when gpu hang's happened
+            // and when sessions are controlled by the operator
+            if ((m_pThreadContextArray[i]->transcodingSts != MFX_ERR_GPU_HANG ||
+                 !m_pThreadContextArray[i]->pPipeline->GetRobustFlag()) &&
+                !m_ControlServer.IsRunning()) {
+                std::cout << "\n\n session " << i << " ["
+                          << m_pThreadContextArray[i]->pPipeline->GetSessionText()
+                          << "] failed with status "
+                          << StatusToString(m_pThreadContextArray[i]->transcodingSts)
+                          << " shutting down the application..." << std::endl
+                          << std::endl;
+
+                for (const auto& context : m_pThreadContextArray) {
+                    if (context->pPipeline)
+                        context->pPipeline->StopSession();
                 }
             }
+        }
+        else if (m_pThreadContextArray[i]->transcodingSts > MFX_ERR_NONE) {
+            std::cout << "\n\n session " << i << " ["
+                      << m_pThreadContextArray[i]->pPipeline->GetSessionText()
+                      << "] returned warning status "
+                      << StatusToString(m_pThreadContextArray[i]->transcodingSts) << std::endl
+                      << std::endl;
+        }
+    }
 
-            // Waiting for them to be stopped
-            for (const auto& context : m_pThreadContextArray) {
-                if (!context->handle.valid())
-                    continue;
+    // Commands which came too late aren't executed
+    {
+        std::lock_guard<std::mutex> lock(m_ControlMutex);
+        m_pCompletionQueue = NULL;
+        for (auto& request : m_ControlRequests) {
+            request->Reply.set_value("error: sessions are over");
+        }
+        m_ControlRequests.clear();
+    }
 
-                context->handle.wait();
+    // Stop overlay sessions
+    // Note: Overlay sessions never stop themselves so they should be forcibly stopped
+    // after stopping of all non-overlay sessions
+    if (isOverlayUsed) {
+        // Sending stop message
+        for (const auto& context : m_pThreadContextArray) {
+            if (context->pPipeline && context->pPipeline->IsOverlayUsed()) {
+                context->pPipeline->StopSession();
             }
         }
     }
+
+    // Waiting for them to be stopped
+    while (numAliveSessions) {
+        size_t i = completionQueue.Pop();
+        if (i == ControlRequestIndex)
+            continue;
+
+        numAliveSessions--;
+        if (m_pThreadContextArray[i]->handle.valid())
+            m_pThreadContextArray[i]->handle.get();
+        m_pThreadContextArray[i]->isCompleted = true;
+    }
+
+    if (scheduler) {
+        scheduler->Wait();
+    }
 }
 
 void Launcher::DoRobustTranscoding() {
@@ -893,6 +1108,20 @@ mfxStatus Launcher::ProcessResult() {
         mfxF64 workTime          = m_pThreadContextArray[i]->working_time;
         mfxU32 framesNum         = m_pThreadContextArray[i]->numTransFrames;
 
+        // session stopped by the operator doesn't affect the result
+        if (m_pThreadContextArray[i]->isRemoved) {
+            std::stringstream session_info_sstr;
+            session_info_sstr << "*** session " << i << " ["
+                              << m_pThreadContextArray[i]->sessionText << "] REMOVED "
+                              << workTime << " sec, " << framesNum << " frames" << std::endl
+                              << std::endl;
+            std::cout << session_info_sstr.str();
+            if (performance_file.is_open()) {
+                performance_file << session_info_sstr.str();
+            }
+            continue;
+        }
+
         if (!FinalSts)
             FinalSts = transcodingSts;
 
@@ -904,6 +1133,11 @@ mfxStatus Launcher::ProcessResult() {
                           << SessionStsStr << " (" << StatusToString(transcodingSts) << ") "
                           << workTime << " sec, " << framesNum << " frames, " << std::fixed
                           << std::setprecision(3) << framesNum / workTime << " fps" << std::endl;
+        mfxU64 bitstreamPoolPeak = m_pThreadContextArray[i]->pPipeline->GetBitstreamPoolPeak();
+        if (bitstreamPoolPeak) {
+            session_info_sstr << "bitstream buffers peak " << bitstreamPoolPeak / 1024 << " KB"
+                              << std::endl;
+        }
         if (i < session_descriptions.size()) {
             session_info_sstr << session_descriptions[i] << std::endl;
         }
@@ -916,6 +1150,29 @@ mfxStatus Launcher::ProcessResult() {
             performance_file << session_info_sstr.str();
         }
     }
+
+    mfxU64 bitstreamPoolSize = BitstreamBufferPool::GetInstance().GetAllocatedSize();
+    if (bitstreamPoolSize) {
+        std::stringstream ssBitstreamPool;
+        ssBitstreamPool << "bitstream buffer pool: " << bitstreamPoolSize / 1024
+                        << " KB allocated for all sessions" << std::endl;
+        std::cout << ssBitstreamPool.str();
+        if (performance_file.is_open()) {
+            performance_file << ssBitstreamPool.str();
+        }
+    }
+
+    auto parallelWriter =
+        std::dynamic_pointer_cast<CBitstreamWriterForParallelEncoding>(m_GlobalBitstreamWriter);
+    if (parallelWriter) {
+        std::stringstream ssReorder;
+        ssReorder << "parallel encoding: reorder depth " << parallelWriter->GetMaxReorderDepth()
+                  << " frames" << std::endl;
+        std::cout << ssReorder.str();
+        if (performance_file.is_open()) {
+            performance_file << ssReorder.str();
+        }
+    }
     printf("-------------------------------------------------------------------------------\n");
 
     std::stringstream ssTest;
@@ -931,6 +1188,241 @@ mfxStatus Launcher::ProcessResult() {
     return FinalSts;
 } // mfxStatus Launcher::ProcessResult()
 
+std::string Launcher::OnControlCommand(const std::string& line) {
+    auto request     = std::make_shared<ControlRequest>();
+    request->Command = line;
+    std::future<std::string> reply = request->Reply.get_future();
+    {
+        std::lock_guard<std::mutex> lock(m_ControlMutex);
+        if (!m_pCompletionQueue)
+            return "error: sessions aren't running";
+
+        m_ControlRequests.push_back(request);
+        m_pCompletionQueue->Push(ControlRequestIndex);
+    }
+    return reply.get();
+} // std::string Launcher::OnControlCommand
+
+void Launcher::ProcessControlRequests() {
+    std::deque<std::shared_ptr<ControlRequest>> requests;
+    {
+        std::lock_guard<std::mutex> lock(m_ControlMutex);
+        requests.swap(m_ControlRequests);
+    }
+
+    for (auto& request : requests) {
+        request->Reply.set_value(ExecuteControlCommand(request->Command));
+    }
+} // void Launcher::ProcessControlRequests
+
+std::string Launcher::ExecuteControlCommand(const std::string& line) {
+    std::string args;
+    std::string command = ControlServer::SplitCommand(line, args);
+
+    if (command == "add") {
+        mfxStatus sts = AddSession(args);
+        if (sts != MFX_ERR_NONE)
+            return std::string("error: ") + StatusToString(sts);
+        return "ok: session " + std::to_string(m_pThreadContextArray.size() - 1);
+    }
+    else if (command == "list") {
+        std::stringstream ss;
+        ss << "sessions:";
+        for (size_t i = 0; i < m_pThreadContextArray.size(); i++) {
+            const ThreadTranscodeContext* context = m_pThreadContextArray[i].get();
+            ss << " " << i << ":"
+               << (context->isRemoved ? "removed" : context->isCompleted ? "finished" : "running");
+        }
+        return ss.str();
+    }
+    else if (command == "quit") {
+        m_bQuit = true;
+        for (const auto& context : m_pThreadContextArray) {
+            if (context->pPipeline && !context->isCompleted)
+                context->pPipeline->StopSession();
+        }
+        return "ok";
+    }
+    else if (command != "stats" && command != "stop") {
+        return "error: unknown command \"" + command + "\"";
+    }
+
+    mfxU32 index = 0;
+    if (msdk_opt_read(args.c_str(), index) != MFX_ERR_NONE ||
+        index >= m_pThreadContextArray.size()) {
+        return "error: session \"" + args + "\" not found";
+    }
+
+    if (command == "stats")
+        return GetSessionStats(index);
+
+    ThreadTranscodeContext* context = m_pThreadContextArray[index].get();
+    if (context->isRemoved)
+        return "error: session " + args + " is already removed";
+
+    // sessions sharing surfaces or joined with other sessions can't be stopped alone
+    if (m_InputParamsArray[index].eMode != Native || m_InputParamsArray[index].bIsJoin)
+        return "error: session " + args + " is a part of 1:N, N:1 or joined pipeline";
+
+    context->isRemoved   = true;
+    context->sessionText = context->pPipeline->GetSessionText();
+    if (context->isCompleted)
+        ReleaseSession(index);
+    else
+        context->pPipeline->StopSession();
+    return "ok";
+} // std::string Launcher::ExecuteControlCommand
+
+std::string Launcher::GetSessionStats(mfxU32 index) {
+    using namespace std::chrono;
+    const ThreadTranscodeContext* context = m_pThreadContextArray[index].get();
+
+    std::stringstream ss;
+    ss << "session " << index << " [";
+    mfxU32 framesNum = context->numTransFrames;
+    mfxF64 workTime  = context->working_time;
+    if (context->isRemoved) {
+        ss << context->sessionText << "] removed";
+    }
+    else if (context->isCompleted) {
+        ss << context->pPipeline->GetSessionText() << "] finished ("
+           << StatusToString(context->transcodingSts) << ")";
+    }
+    else {
+        // counter is updated by the session thread, the value may be a bit behind
+        framesNum = context->pPipeline->GetProcessFrames();
+        workTime  = duration_cast<duration<mfxF64>>(system_clock::now() - context->launchTime).count();
+        ss << context->pPipeline->GetSessionText() << "] running";
+    }
+
+    ss << ", " << workTime << " sec, " << framesNum << " frames, " << std::fixed
+       << std::setprecision(3) << (workTime > 0 ? framesNum / workTime : 0.) << " fps";
+    return ss.str();
+} // std::string Launcher::GetSessionStats
+
+mfxStatus Launcher::AddSession(const std::string& line) {
+    CmdProcessor parser;
+    sInputParams par;
+    mfxStatus sts = parser.ParseSessionLine(line);
+    MSDK_CHECK_STATUS(sts, "parser.ParseSessionLine failed");
+    if (!parser.GetNextSessionParams(par)) {
+        printf("error: session description not found\n");
+        return MFX_ERR_UNSUPPORTED;
+    }
+
+    // new session reuses the loader and the device created for the first session
+    const sInputParams& first = m_InputParamsArray[0];
+    if (par.eMode != Native || par.eModeExt != Native || par.bIsJoin || par.nSegments > 1 ||
+        par.ParallelEncoding || par.CascadeScaler || par.CascadeScalerAuto) {
+        printf("error: only independent transcoding session can be added at runtime\n");
+        return MFX_ERR_UNSUPPORTED;
+    }
+    if (!m_pLoader || par.verSessionInit != API_2X || par.libType != first.libType ||
+        par.dGfxIdx >= 0 || par.adapterNum >= 0) {
+        printf("error: session added at runtime should use implementation and adapter of "
+               "the first session\n");
+        return MFX_ERR_UNSUPPORTED;
+    }
+    if (par.nMemoryModel == UNKNOWN_ALLOC) {
+        par.nMemoryModel = GENERAL_ALLOC;
+    }
+    par.TargetID = DecoderTargetID + (mfxU32)m_InputParamsArray.size();
+
+    mfxU32 index = (mfxU32)m_pThreadContextArray.size();
+    printf("Session %d:\n", (int)index);
+
+    ScopedThreadAffinity sessionAffinity(par.CpuAffinity);
+    if (!par.CpuAffinity.empty()) {
+        if (!sessionAffinity.IsPinned()) {
+            printf("error: failed to run session %d on CPUs %s\n",
+                   (int)index,
+                   CpuListToString(par.CpuAffinity).c_str());
+            return MFX_ERR_UNSUPPORTED;
+        }
+        sts = msdk_thread_get_affinity(par.CpuAffinity);
+        MSDK_CHECK_STATUS(sts, "msdk_thread_get_affinity failed");
+    }
+
+    auto pAllocator = std::make_unique<GeneralAllocator>();
+
+    SysMemPlacement placement;
+    placement.bHugePages = par.bSysMemHugePages;
+    placement.NumaNode   = par.nSysMemNumaNode;
+    pAllocator->SetSysMemPlacement(placement);
+    pAllocator->SetSysMemModes(par.bSysMemSlab, par.bSysMemPool, par.bSysMemZeroInit);
+
+    sts = pAllocator->Init(m_pAllocParams[0].get());
+    MSDK_CHECK_STATUS(sts, "pAllocator->Init failed");
+
+    auto pBSProcessor    = std::make_unique<FileBitstreamProcessor>();
+    auto pThreadPipeline = std::make_unique<ThreadTranscodeContext>();
+    pThreadPipeline->pPipeline.reset(CreatePipeline());
+    pThreadPipeline->pPipeline->SetAdapterType(m_pLoader->GetAdapterType());
+    pThreadPipeline->pPipeline->SetPreferdGfx(par.dGfxIdx);
+    pThreadPipeline->pPipeline->SetAdapterNum(m_pLoader->GetDeviceIDAndAdapter().second);
+    pThreadPipeline->pPipeline->SetSurfaceWaitInterval(surface_wait_interval);
+    pThreadPipeline->pPipeline->SetSyncOpTimeout(par.nSyncOpTimeout);
+    pThreadPipeline->pBSProcessor = pBSProcessor.get();
+
+    sts = CreateReader(par, pBSProcessor.get());
+    MSDK_CHECK_STATUS(sts, "CreateReader failed");
+
+    if (!msdk_match(par.strDstFile, "null")) {
+        auto writer = std::make_shared<CSmplBitstreamWriter>();
+        sts         = writer->Init(par.strDstFile.c_str());
+        MSDK_CHECK_STATUS(sts, "could not create destination file");
+
+        sts = pBSProcessor->SetWriter(writer);
+        MSDK_CHECK_STATUS(sts, "pBSProcessor->SetWriter failed");
+    }
+
+    sts = pThreadPipeline->pPipeline->Init(&par,
+                                           pAllocator.get(),
+                                           m_hdl,
+                                           NULL,
+                                           NULL,
+                                           pBSProcessor.get(),
+                                           m_pLoader.get(),
+                                           CreateCascadeScalerConfig());
+    MSDK_CHECK_STATUS(sts, "pThreadPipeline->pPipeline->Init failed");
+
+    sts = pThreadPipeline->pPipeline->CompleteInit();
+    MSDK_CHECK_STATUS(sts, "pThreadPipeline->pPipeline->CompleteInit failed");
+    pThreadPipeline->pPipeline->SetPipelineID(index);
+
+    pThreadPipeline->startStatus = MFX_WRN_DEVICE_BUSY;
+    pThreadPipeline->implType    = par.libType;
+    pThreadPipeline->cpuAffinity = par.CpuAffinity;
+
+    mfxVersion ver = { { 0, 0 } };
+    sts            = pThreadPipeline->pPipeline->QueryMFXVersion(&ver);
+    MSDK_CHECK_STATUS(sts, "pThreadPipeline->pPipeline->QueryMFXVersion failed");
+    PrintStreamInfo(index, &par, &ver);
+
+    m_InputParamsArray.push_back(par);
+    m_pAllocArray.push_back(std::move(pAllocator));
+    m_pExtBSProcArray.push_back(std::move(pBSProcessor));
+    m_pThreadContextArray.push_back(std::move(pThreadPipeline));
+    if (session_descriptions.size() == index) {
+        session_descriptions.push_back(line);
+    }
+
+    return MFX_ERR_NONE;
+} // mfxStatus Launcher::AddSession
+
+void Launcher::ReleaseSession(mfxU32 index) {
+    ThreadTranscodeContext* context = m_pThreadContextArray[index].get();
+    if (!context->pPipeline)
+        return;
+
+    context->numTransFrames = context->pPipeline->GetProcessFrames();
+    context->pPipeline.reset();
+    context->pBSProcessor = nullptr;
+    m_pExtBSProcArray[index].reset();
+    m_pAllocArray[index].reset();
+    printf("Session %d is removed\n", (int)index);
+} // void Launcher::ReleaseSession
+
 #if (defined(_WIN32) || defined(_WIN64))
 mfxStatus Launcher::QueryAdapters() {
     mfxU32 num_adapters_available;
@@ -1364,6 +1856,234 @@ mfxStatus Launcher::VerifyCrossSessionsOptions() {
 
 } // mfxStatus Launcher::VerifyCrossSessionsOptions()
 
+mfxStatus Launcher::SplitInputToSegments() {
+    bool isSegmented = std::any_of(m_InputParamsArray.begin(),
+                                   m_InputParamsArray.end(),
+                                   [](const sInputParams& params) {
+                                       return params.nSegments > 1;
+                                   });
+    if (!isSegmented)
+        return MFX_ERR_NONE;
+
+    sInputParams par = m_InputParamsArray[0];
+    if (m_InputParamsArray.size() != 1 || par.eMode != Native) {
+        printf("ERROR: -segments can't be combined with other sessions\n");
+        return MFX_ERR_UNSUPPORTED;
+    }
+    if (par.DecodeId != MFX_CODEC_AVC && par.DecodeId != MFX_CODEC_HEVC) {
+        printf("ERROR: -segments is supported for h264 and h265 input only\n");
+        return MFX_ERR_UNSUPPORTED;
+    }
+    if (par.ParallelEncoding || par.nTimeout || par.MaxFrameNumber != MFX_INFINITE ||
+        par.nSeekFrame || msdk_match(par.strDstFile, "null")) {
+        printf("ERROR: -segments can't be combined with -parallel_encoding, -timeout, -n, "
+               "-seek_frame and null output\n");
+        return MFX_ERR_UNSUPPORTED;
+    }
+
+    CAUIndex index;
+    mfxStatus sts = index.Build(par.strSrcFile.c_str(), par.DecodeId);
+    MSDK_CHECK_STATUS(sts, "index.Build failed");
+
+    // sessions can start decoding only from IDR frames
+    if (!index.GetEntries()[0].KeyFrame) {
+        printf("ERROR: -segments requires input starting from IDR frame\n");
+        return MFX_ERR_UNSUPPORTED;
+    }
+
+    std::vector<AUIndexRange> ranges = index.SplitToRanges(par.nSegments);
+    if (ranges.size() < par.nSegments) {
+        printf("WARNING: input has %d IDR frames only, %d segments are used\n",
+               (int)ranges.size(),
+               (int)ranges.size());
+    }
+
+    m_InputParamsArray.clear();
+    for (const AUIndexRange& range : ranges) {
+        // overlap is decoded and encoded from the key frame before the segment and discarded
+        mfxU32 firstAU = range.FirstAU;
+        if (par.nSegmentOverlap && range.FirstAU) {
+            mfxI32 keyFrame =
+                index.FindKeyFrame(range.FirstAU - std::min(range.FirstAU, par.nSegmentOverlap));
+            if (keyFrame >= 0)
+                firstAU = (mfxU32)keyFrame;
+        }
+
+        sInputParams segment      = par;
+        segment.TargetID          = DecoderTargetID + (mfxU32)m_InputParamsArray.size();
+        segment.SegmentFirstFrame = range.FirstAU;
+        segment.SegmentOffset     = index.GetEntries()[firstAU].Offset;
+        // parameter sets of the stream aren't necessarily repeated at every IDR
+        sts = index.ReadParameterSets(par.strSrcFile.c_str(), firstAU, segment.SegmentParamSets);
+        MSDK_CHECK_STATUS(sts, "index.ReadParameterSets failed");
+        segment.SegmentSkipFrames = range.FirstAU - firstAU;
+        segment.MaxFrameNumber    = range.NumAU + segment.SegmentSkipFrames;
+        // segments are stitched together, so frames can't refer to other segments
+        segment.GopOptFlag |= MFX_GOP_CLOSED;
+        m_InputParamsArray.push_back(segment);
+
+        printf("Segment %d: frames %u-%u, %u overlap frames\n",
+               (int)m_InputParamsArray.size() - 1,
+               range.FirstAU,
+               range.FirstAU + range.NumAU - 1,
+               segment.SegmentSkipFrames);
+    }
+
+    return MFX_ERR_NONE;
+} // mfxStatus Launcher::SplitInputToSegments
+
+void Launcher::ShareDecoders() {
+    // sessions with own topology are left as is, only one 1:N pipeline is supported
+    for (const sInputParams& par : m_InputParamsArray) {
+        if (par.eMode != Native || par.eModeExt != Native)
+            return;
+    }
+
+    auto isShareable = [](const sInputParams& par) {
+        return !par.bPrivateDecoder && !par.rawInput && !par.bIsMVC && !par.ParallelEncoding &&
+               par.nSegments <= 1;
+    };
+    auto isSameDecoder = [](const sInputParams& a, const sInputParams& b) {
+        return a.strSrcFile == b.strSrcFile && a.DecodeId == b.DecodeId &&
+               a.libType == b.libType && a.bIsJoin == b.bIsJoin &&
+               a.nMemoryModel == b.nMemoryModel && a.bForceSysMem == b.bForceSysMem &&
+               a.DecoderFourCC == b.DecoderFourCC &&
+               a.dDecoderFrameRateOverride == b.dDecoderFrameRateOverride &&
+               a.MaxFrameNumber == b.MaxFrameNumber && a.nTimeout == b.nTimeout &&
+               a.bDecCompleteFrame == b.bDecCompleteFrame && a.DecOutPattern == b.DecOutPattern &&
+               a.bDecoderPostProcessing == b.bDecoderPostProcessing &&
+               a.m_decode_cfg == b.m_decode_cfg &&
+               a.decoderPluginParams.strPluginPath == b.decoderPluginParams.strPluginPath &&
+               a.dGfxIdx == b.dGfxIdx && a.adapterNum == b.adapterNum &&
+               a.verSessionInit == b.verSessionInit;
+    };
+
+    // group sessions by decoder, the biggest group gets shared decoder
+    std::vector<std::vector<mfxU32>> groups;
+    for (mfxU32 i = 0; i < m_InputParamsArray.size(); i++) {
+        if (!isShareable(m_InputParamsArray[i]))
+            continue;
+
+        auto group = std::find_if(groups.begin(), groups.end(), [&](std::vector<mfxU32>& g) {
+            return isSameDecoder(m_InputParamsArray[g[0]], m_InputParamsArray[i]);
+        });
+        if (group != groups.end())
+            group->push_back(i);
+        else
+            groups.push_back({ i });
+    }
+
+    auto shared = std::max_element(groups.begin(),
+                                   groups.end(),
+                                   [](const std::vector<mfxU32>& a, const std::vector<mfxU32>& b) {
+                                       return a.size() < b.size();
+                                   });
+    if (shared == groups.end() || shared->size() < 2)
+        return;
+
+    const std::vector<mfxU32> members = *shared;
+    for (const std::vector<mfxU32>& group : groups) {
+        if (group.size() > 1 && &group != &*shared) {
+            printf("WARNING: %d sessions reading %s keep own decoders, only one shared decoder "
+                   "is supported\n",
+                   (int)group.size(),
+                   m_InputParamsArray[group[0]].strSrcFile.c_str());
+        }
+    }
+
+    // decoder session gets session and device options of the first session, but no VPP
+    const sInputParams defaults;
+    sInputParams sink         = m_InputParamsArray[members[0]];
+    sink.eMode                = Sink;
+    sink.EncodeId             = 0;
+    sink.EncoderFourCC        = 0;
+    sink.nDstWidth            = 0;
+    sink.nDstHeight           = 0;
+    sink.bEnableDeinterlacing = false;
+    sink.bVppDenoiser         = false;
+    sink.VppDenoiseLevel      = defaults.VppDenoiseLevel;
+    sink.DetailLevel          = defaults.DetailLevel;
+    sink.FRCAlgorithm         = 0;
+    sink.dVPPOutFramerate     = 0;
+    sink.fieldProcessingMode  = FC_NONE;
+    sink.nRotationAngle       = 0;
+    sink.bEnable3DLut         = false;
+    sink.nFPS                 = 0;
+    sink.statisticsLogFile    = NULL;
+    sink.strDstFile.clear();
+    sink.strVPPPluginDLLPath.clear();
+    sink.DumpLogFileName.clear();
+#ifdef ENABLE_MCTF
+    sink.mctfParam = defaults.mctfParam;
+#endif
+#ifdef ONEVPL_EXPERIMENTAL
+    sink.PercEncPrefilter = false;
+#endif
+    if (!sink.nAsyncDepth)
+        sink.nAsyncDepth = 4;
+
+    // decoder session goes first, encoders follow it in par file order
+    std::vector<sInputParams> params;
+    std::vector<std::string> descriptions;
+    std::vector<mfxU32> newIndex(m_InputParamsArray.size());
+    bool hasDescriptions = session_descriptions.size() == m_InputParamsArray.size();
+    for (mfxU32 i = 0; i < m_InputParamsArray.size(); i++) {
+        if (i == members[0]) {
+            params.push_back(sink);
+            if (hasDescriptions)
+                descriptions.push_back("shared decoder");
+
+            for (mfxU32 idx : members) {
+                sInputParams source  = m_InputParamsArray[idx];
+                source.eMode         = Source;
+                source.DecodeId      = 0;
+                source.DecoderFourCC = 0;
+                source.strSrcFile.clear();
+                newIndex[idx] = (mfxU32)params.size();
+                params.push_back(source);
+                if (hasDescriptions)
+                    descriptions.push_back(session_descriptions[idx]);
+            }
+        }
+        else if (std::find(members.begin(), members.end(), i) == members.end()) {
+            newIndex[i] = (mfxU32)params.size();
+            params.push_back(m_InputParamsArray[i]);
+            if (hasDescriptions)
+                descriptions.push_back(session_descriptions[i]);
+        }
+    }
+
+    for (mfxU32 i = 0; i < params.size(); i++) {
+        params[i].TargetID = DecoderTargetID + i;
+    }
+
+    printf("Shared decoder: %s is decoded once by session %d for %d sessions, %d decoders "
+           "eliminated\n",
+           sink.strSrcFile.c_str(),
+           (int)members[0],
+           (int)members.size(),
+           (int)members.size() - 1);
+    // every session which got a new index is reported, including the ones behind the decoder
+    for (mfxU32 i = 0; i < newIndex.size(); i++) {
+        if (newIndex[i] == i)
+            continue;
+
+        const sInputParams& par = m_InputParamsArray[i];
+        std::string origin      = par.nParFileLine
+                                      ? "par file line " + std::to_string(par.nParFileLine)
+                                      : "command line";
+        printf("  %s: session %d -> session %d%s\n",
+               origin.c_str(),
+               (int)i,
+               (int)newIndex[i],
+               params[newIndex[i]].eMode == Source ? ", shares the decoder" : "");
+    }
+
+    m_InputParamsArray = std::move(params);
+    if (hasDescriptions)
+        session_descriptions = std::move(descriptions);
+} // void Launcher::ShareDecoders
+
 mfxStatus Launcher::CreateSafetyBuffers() {
     SafetySurfaceBuffer* pBuffer     = NULL;
     SafetySurfaceBuffer* pPrevBuffer = NULL;
@@ -1391,6 +2111,99 @@ mfxStatus Launcher::CreateSafetyBuffers() {
 
 } // mfxStatus Launcher::CreateSafetyBuffers
 
+mfxStatus Launcher::ResolveSessionPlacement() {
+    bool isNodeRequested = std::any_of(m_InputParamsArray.begin(),
+                                       m_InputParamsArray.end(),
+                                       [](const sInputParams& params) {
+                                           return params.nNumaNode != SESSION_NUMA_NODE_ANY;
+                                       });
+    if (!isNodeRequested)
+        return MFX_ERR_NONE;
+
+    std::vector<mfxU32> nodes;
+    if (MFX_ERR_NONE != msdk_get_numa_nodes(nodes) || nodes.empty()) {
+        printf("error: NUMA nodes of the system are unknown, -numa_node can't be used\n");
+        return MFX_ERR_UNSUPPORTED;
+    }
+
+    // spread: every session which isn't fed by another session takes the next node and the
+    // sessions with -i::source run on the node of the last session with -o::sink
+    size_t nextNode = 0;
+    mfxI32 sinkNode = SESSION_NUMA_NODE_ANY;
+    for (mfxU32 i = 0; i < m_InputParamsArray.size(); i++) {
+        sInputParams& params = m_InputParamsArray[i];
+
+        mfxI32 node = params.nNumaNode;
+        if (SESSION_NUMA_NODE_SPREAD == node) {
+            if (Source == params.eMode && sinkNode >= 0)
+                node = sinkNode;
+            else
+                node = (mfxI32)nodes[nextNode++ % nodes.size()];
+        }
+        if (Sink == params.eMode)
+            sinkNode = node;
+        if (node < 0)
+            continue;
+
+        std::vector<mfxU32> nodeCpus;
+        if (MFX_ERR_NONE != msdk_get_numa_node_cpus((mfxU32)node, nodeCpus) || nodeCpus.empty()) {
+            printf("error: session %d: NUMA node %d has no CPUs\n", (int)i, node);
+            return MFX_ERR_UNSUPPORTED;
+        }
+
+        if (!params.CpuAffinity.empty()) {
+            std::vector<mfxU32> cpus;
+            std::set_intersection(params.CpuAffinity.begin(),
+                                  params.CpuAffinity.end(),
+                                  nodeCpus.begin(),
+                                  nodeCpus.end(),
+                                  std::back_inserter(cpus));
+            if (cpus.empty()) {
+                printf("error: session %d: CPUs %s don't belong to NUMA node %d\n",
+                       (int)i,
+                       CpuListToString(params.CpuAffinity).c_str(),
+                       node);
+                return MFX_ERR_UNSUPPORTED;
+            }
+            nodeCpus = cpus;
+        }
+
+        params.CpuAffinity = nodeCpus;
+        params.nNumaNode   = node;
+    }
+
+    return MFX_ERR_NONE;
+
+} // mfxStatus Launcher::ResolveSessionPlacement
+
+void Launcher::PrintSessionPlacement() {
+    bool isPinned = std::any_of(m_InputParamsArray.begin(),
+                                m_InputParamsArray.end(),
+                                [](const sInputParams& params) {
+                                    return !params.CpuAffinity.empty();
+                                });
+    if (!isPinned)
+        return;
+
+    // CPUs are the ones which session threads actually got
+    printf("Session placement:\n");
+    for (mfxU32 i = 0; i < m_InputParamsArray.size(); i++) {
+        const sInputParams& params = m_InputParamsArray[i];
+        if (params.CpuAffinity.empty()) {
+            printf("  session %d: any CPU\n", (int)i);
+        }
+        else if (params.nNumaNode >= 0) {
+            printf("  session %d: CPUs %s, NUMA node %d\n",
+                   (int)i,
+                   CpuListToString(params.CpuAffinity).c_str(),
+                   params.nNumaNode);
+        }
+        else {
+            printf("  session %d: CPUs %s\n", (int)i, CpuListToString(params.CpuAffinity).c_str());
+        }
+    }
+} // void Launcher::PrintSessionPlacement
+
 CascadeScalerConfig::TargetDescriptor CascadeScalerConfig::GetDesc(mfxU32 id) {
     auto itr = std::find_if(Targets.begin(), Targets.end(), [id](TargetDescriptor& d) {
         return d.TargetID == id;
@@ -1447,6 +2260,10 @@ CascadeScalerConfig& Launcher::CreateCascadeScalerConfig() {
             cfg.ParallelEncodingRequired = true;
         }
 
+        if (par.CascadeScalerAuto && cfg.type == SMTTracer::PipelineType::_1xN) {
+            cfg.CascadeScalerAuto = true;
+        }
+
         if (par.eMode == Source || par.eMode == Native) {
             //this is encoder, import par file params
             CascadeScalerConfig::TargetDescriptor desc;
@@ -1487,7 +2304,9 @@ CascadeScalerConfig& Launcher::CreateCascadeScalerConfig() {
             cfg.Tracer->Init(cfg.type,
                              (mfxU32)cfg.Targets.size(),
                              par.LatencyType,
-                             par.TraceBufferSize);
+                             par.TraceBufferSize,
+                             par.TraceStreaming,
+                             par.TraceFormat);
             break;
         }
     }
@@ -1502,57 +2321,62 @@ void TranscodingSample::CascadeScalerConfig::PropagateCascadeParameters() {
         return;
     }
 
-    //special case for first channel output, should be incorporated into loop below, somehow
-    if (!Targets[0].FRC) {
-        Targets[0].DstFrameRate = Targets[0].SrcFrameRate;
-    }
-    if (!Targets[0].DI) {
-        Targets[0].DstPicStruct = Targets[0].SrcPicStruct;
-    }
-
-    //set current parameters equal to decoder output
-    mfxU16 Width     = Targets[0].SrcWidth;
-    mfxU16 Height    = Targets[0].SrcHeight;
-    double FrameRate = Targets[0].SrcFrameRate;
-    mfxU16 PicStruct = Targets[0].SrcPicStruct;
-
-    for (mfxU32 i = 1; i < Targets.size(); i++) {
-        //resolution
-        if (Targets[i - 1].CascadeScaler) {
-            Width = Targets[i].SrcWidth = Targets[i - 1].DstWidth;
-            Height = Targets[i].SrcHeight = Targets[i - 1].DstHeight;
-        }
-        else {
-            Targets[i].SrcWidth  = Width;
-            Targets[i].SrcHeight = Height;
+    //decoder output is set as source of the first channel
+    TargetDescriptor decoder;
+    decoder.DstWidth     = Targets[0].SrcWidth;
+    decoder.DstHeight    = Targets[0].SrcHeight;
+    decoder.DstFrameRate = Targets[0].SrcFrameRate;
+    decoder.DstPicStruct = Targets[0].SrcPicStruct;
+
+    //output of each pool, key is pool ID
+    std::map<mfxU32, TargetDescriptor> PoolOutput;
+    PoolOutput[DecoderPoolID] = decoder;
+
+    auto propagate = [](TargetDescriptor& desc, const TargetDescriptor& src) {
+        desc.SrcWidth     = src.DstWidth;
+        desc.SrcHeight    = src.DstHeight;
+        desc.SrcFrameRate = src.DstFrameRate;
+        desc.SrcPicStruct = src.DstPicStruct;
+
+        if (!desc.DstWidth) {
+            desc.DstWidth = desc.SrcWidth;
         }
-
-        //framerate
-        if (Targets[i - 1].CascadeScaler && Targets[i - 1].FRC) {
-            FrameRate = Targets[i].SrcFrameRate = Targets[i - 1].DstFrameRate;
+        if (!desc.DstHeight) {
+            desc.DstHeight = desc.SrcHeight;
         }
-        else {
-            Targets[i].SrcFrameRate = FrameRate;
+        if (!desc.FRC) {
+            desc.DstFrameRate = desc.SrcFrameRate;
         }
-        if (!Targets[i].FRC) {
-            Targets[i].DstFrameRate = Targets[i].SrcFrameRate;
+        if (!desc.DI) {
+            desc.DstPicStruct = desc.SrcPicStruct;
         }
+    };
 
-        //PicStruct
-        if (Targets[i - 1].CascadeScaler && Targets[i - 1].DI) {
-            PicStruct = Targets[i].SrcPicStruct = Targets[i - 1].DstPicStruct;
+    //every cascade stage gets input from the pool with smaller ID
+    for (const auto& p : Pools) {
+        const PoolDescritpor& PoolDesc = p.second;
+        if (PoolDesc.ID == DecoderPoolID) {
+            continue;
         }
-        else {
-            Targets[i].SrcPicStruct = PicStruct;
+
+        for (TargetDescriptor& desc : Targets) {
+            if (desc.TargetID == PoolDesc.TargetID) {
+                propagate(desc, PoolOutput[PoolDesc.PrevID]);
+                PoolOutput[PoolDesc.ID] = desc;
+            }
         }
-        if (!Targets[i].DI) {
-            Targets[i].DstPicStruct = Targets[i].SrcPicStruct;
+    }
+
+    //the rest of channels take pool output as is
+    for (TargetDescriptor& desc : Targets) {
+        if (!desc.CascadeScaler) {
+            propagate(desc, PoolOutput[desc.PoolID]);
         }
     }
 
     PoolDescritpor& pool = Pools[DecoderPoolID];
-    pool.SurfaceWidth    = Targets[0].SrcWidth;
-    pool.SurfaceHeight   = Targets[0].SrcHeight;
+    pool.SurfaceWidth    = decoder.DstWidth;
+    pool.SurfaceHeight   = decoder.DstHeight;
 }
 
 void TranscodingSample::CascadeScalerConfig::CreatePoolList() {
@@ -1560,6 +2384,11 @@ void TranscodingSample::CascadeScalerConfig::CreatePoolList() {
         return;
     }
 
+    if (CascadeScalerAuto) {
+        PlanCascade();
+        return;
+    }
+
     PoolDescritpor pool;
     pool.PrevID        = 0;
     pool.ID            = DecoderPoolID;
@@ -1580,6 +2409,204 @@ void TranscodingSample::CascadeScalerConfig::CreatePoolList() {
     }
 }
 
+//builds cascade of minimal cost instead of order of par file. Every channel which needs VPP
+//becomes cascade stage produced from the cheapest already produced pool with enough resolution
+//and frame rate, so FRC is done once by the biggest channel which needs it. If any channel
+//deinterlaces, DI is moved to the stages fed by decoder and all other stages get progressive frames.
+void TranscodingSample::CascadeScalerConfig::PlanCascade() {
+    //size and frame rate which are not set are equal to decoder output, the biggest one
+    const double unknown = std::numeric_limits<double>::infinity();
+    auto dim             = [unknown](mfxU16 value) {
+        return value ? (double)value : unknown;
+    };
+    auto area = [dim](const TargetDescriptor& desc) {
+        return dim(desc.DstWidth) * dim(desc.DstHeight);
+    };
+    auto rate = [unknown](const TargetDescriptor& desc) {
+        return (desc.FRC && desc.DstFrameRate > 0) ? desc.DstFrameRate : unknown;
+    };
+
+    //DI parameters of the first channel which deinterlaces are used by the shared DI stages
+    const TargetDescriptor* DIDesc = nullptr;
+    for (const TargetDescriptor& desc : Targets) {
+        if (desc.DI) {
+            DIDesc = &desc;
+            break;
+        }
+    }
+    const bool SharedDI = (DIDesc != nullptr);
+
+    auto covers = [&](const TargetDescriptor& from, const TargetDescriptor& to) {
+        return dim(from.DstWidth) >= dim(to.DstWidth) && dim(from.DstHeight) >= dim(to.DstHeight) &&
+               rate(from) >= rate(to) && (SharedDI || to.DI || !from.DI);
+    };
+
+    std::vector<TargetDescriptor*> stages;
+    for (TargetDescriptor& desc : Targets) {
+        desc.CascadeScaler = desc.DstWidth || desc.DstHeight || desc.FRC || desc.DI;
+        desc.PoolID        = DecoderPoolID;
+        if (desc.CascadeScaler) {
+            stages.push_back(&desc);
+        }
+    }
+
+    //stage parameters are taken from InParams, so they are changed together with descriptor
+    auto setDI = [&](TargetDescriptor& desc, bool DI) {
+        desc.DI = DI;
+        if (DI) {
+            desc.DstPicStruct = MFX_PICSTRUCT_PROGRESSIVE;
+        }
+
+        auto par = InParams.find(desc.TargetID);
+        if (par == InParams.end()) {
+            return;
+        }
+        par->second.bEnableDeinterlacing = DI;
+        if (DI) {
+            auto DIPar = InParams.find(DIDesc->TargetID);
+            if (DIPar != InParams.end()) {
+                par->second.DeinterlacingMode = DIPar->second.DeinterlacingMode;
+            }
+        }
+    };
+
+    //possible sources of each stage go before it
+    std::stable_sort(stages.begin(),
+                     stages.end(),
+                     [&](const TargetDescriptor* a, const TargetDescriptor* b) {
+                         if (area(*a) != area(*b)) {
+                             return area(*a) > area(*b);
+                         }
+                         if (rate(*a) != rate(*b)) {
+                             return rate(*a) > rate(*b);
+                         }
+                         return !a->DI && b->DI;
+                     });
+
+    Pools.clear();
+    PoolDescritpor pool;
+    pool.ID        = DecoderPoolID;
+    Pools[pool.ID] = pool;
+
+    //cost of the stage is proportional to number of input pixels per second,
+    //stages without FRC run at decoder frame rate which isn't known before decoding
+    //in most cases, then smaller size wins and frame rate only breaks the tie
+    const double srcRate = Targets[0].SrcFrameRate > 0 ? Targets[0].SrcFrameRate : unknown;
+    auto inputRate       = [&](const TargetDescriptor& desc) {
+        return (desc.FRC && desc.DstFrameRate > 0) ? desc.DstFrameRate : srcRate;
+    };
+    auto cheaper = [&](const TargetDescriptor& a, const TargetDescriptor& b) {
+        if (inputRate(a) != unknown && inputRate(b) != unknown &&
+            area(a) * inputRate(a) != area(b) * inputRate(b)) {
+            return area(a) * inputRate(a) < area(b) * inputRate(b);
+        }
+        if (area(a) != area(b)) {
+            return area(a) < area(b);
+        }
+        if (inputRate(a) != inputRate(b)) {
+            return inputRate(a) < inputRate(b);
+        }
+        return a.DI && !b.DI;
+    };
+
+    std::vector<TargetDescriptor*> planned;
+    for (TargetDescriptor* desc : stages) {
+        TargetDescriptor* from = nullptr;
+        for (TargetDescriptor* candidate : planned) {
+            if (covers(*candidate, *desc) && (!from || cheaper(*candidate, *from))) {
+                from = candidate;
+            }
+        }
+
+        if (SharedDI) {
+            setDI(*desc, !from);
+        }
+
+        pool.ID            = DecoderPoolID + 1 + (mfxU32)planned.size();
+        pool.PrevID        = from ? from->PoolID : DecoderPoolID;
+        pool.TargetID      = desc->TargetID;
+        pool.SurfaceWidth  = desc->DstWidth;
+        pool.SurfaceHeight = desc->DstHeight;
+        Pools[pool.ID]     = pool;
+        desc->PoolID       = pool.ID;
+        planned.push_back(desc);
+    }
+
+    //every consumer keeps up to async depth surfaces of the pool, one more is being written
+    for (auto& p : Pools) {
+        p.second.Size = 1;
+    }
+    for (const TargetDescriptor& desc : Targets) {
+        auto par          = InParams.find(desc.TargetID);
+        mfxU16 AsyncDepth = (par != InParams.end()) ? par->second.nAsyncDepth : 0;
+        AsyncDepth        = std::max<mfxU16>(AsyncDepth, 1);
+
+        PoolDescritpor& PoolDesc = Pools[desc.PoolID];
+        PoolDesc.Size += AsyncDepth;
+        if (desc.CascadeScaler) {
+            Pools[PoolDesc.PrevID].Size += AsyncDepth;
+        }
+    }
+
+    CascadeScalerRequired = !stages.empty();
+}
+
+void TranscodingSample::CascadeScalerConfig::PrintCascade() {
+    const TargetDescriptor& first = Targets[0];
+    printf("Cascade scaling plan:\n");
+    printf("  decoder: %dx%d %.2f fps, channels:",
+           (int)first.SrcWidth,
+           (int)first.SrcHeight,
+           first.SrcFrameRate);
+    for (const TargetDescriptor& target : Targets) {
+        if (target.PoolID == DecoderPoolID) {
+            printf(" %d", (int)(target.TargetID - DecoderTargetID));
+        }
+    }
+    printf("\n");
+
+    double pixels          = 0.;
+    double pixelsNoCascade = 0.;
+
+    std::function<void(mfxU32, int)> printPool = [&](mfxU32 PrevID, int depth) {
+        for (const auto& p : Pools) {
+            const PoolDescritpor& PoolDesc = p.second;
+            if (PoolDesc.ID == DecoderPoolID || PoolDesc.PrevID != PrevID) {
+                continue;
+            }
+
+            const TargetDescriptor desc = GetDesc(PoolDesc.TargetID);
+            printf("%*spool %d: %dx%d %.2f fps%s, %d surfaces, channels:",
+                   2 * depth,
+                   "",
+                   (int)PoolDesc.ID,
+                   (int)desc.DstWidth,
+                   (int)desc.DstHeight,
+                   desc.DstFrameRate,
+                   desc.DI ? " DI" : "",
+                   (int)PoolDesc.Size);
+            for (const TargetDescriptor& target : Targets) {
+                if (target.PoolID == PoolDesc.ID) {
+                    printf(" %d", (int)(target.TargetID - DecoderTargetID));
+                }
+            }
+            printf("\n");
+
+            //stage reads all frames of its source
+            double frames = first.SrcFrameRate > 0 ? desc.SrcFrameRate / first.SrcFrameRate : 1.;
+            pixels += (double)desc.SrcWidth * desc.SrcHeight * frames;
+            pixelsNoCascade += (double)first.SrcWidth * first.SrcHeight;
+
+            printPool(PoolDesc.ID, depth + 1);
+        }
+    };
+    printPool(DecoderPoolID, 2);
+
+    printf("  VPP input: %.2f Mpixels per decoded frame, %.2f without cascade\n",
+           pixels / 1000000,
+           pixelsNoCascade / 1000000);
+}
+
 bool TranscodingSample::CascadeScalerConfig::SkipFrame(mfxU32 targetID, mfxU32 frameNum) {
     if (!ParallelEncodingRequired) {
         return false;
@@ -1604,6 +2631,8 @@ bool TranscodingSample::CascadeScalerConfig::SkipFrame(mfxU32 targetID, mfxU32 f
 }
 
 void Launcher::Close() {
+    m_ControlServer.Stop();
+
     while (m_pThreadContextArray.size()) {
         m_pThreadContextArray[m_pThreadContextArray.size() - 1].reset();
         m_pThreadContextArray.pop_back();
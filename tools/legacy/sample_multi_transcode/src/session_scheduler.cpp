@@ -0,0 +1,146 @@
+/*############################################################################
+  # Copyright (C) 2024 Intel Corporation
+  #
+  # SPDX-License-Identifier: MIT
+  ############################################################################*/
+
+#include "session_scheduler.h"
+
+#include <algorithm>
+
+namespace TranscodingSample {
+
+void SessionCompletionQueue::Push(size_t index) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_indices.push_back(index);
+    m_completed.notify_one();
+}
+
+size_t SessionCompletionQueue::Pop() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_completed.wait(lock, [this] {
+        return !m_indices.empty();
+    });
+
+    size_t index = m_indices.front();
+    m_indices.pop_front();
+    return index;
+}
+
+SessionScheduler::SessionScheduler(mfxU32 numThreads)
+        : m_workers(),
+          m_nextWorker(0),
+          m_numTasks(0),
+          m_numPushes(0),
+          m_numIdle(0),
+          m_idleMutex(),
+          m_idle() {
+    for (mfxU32 i = 0; i < (numThreads ? numThreads : 1); i++) {
+        m_workers.emplace_back(new Worker);
+    }
+}
+
+SessionScheduler::~SessionScheduler() {
+    Wait();
+}
+
+void SessionScheduler::Submit(const StepFunc& step) {
+    Task task;
+    task.Step    = step;
+    task.DueTime = Clock::now();
+
+    m_numTasks++;
+    PushTask(m_nextWorker, std::move(task));
+    m_nextWorker = (m_nextWorker + 1) % m_workers.size();
+}
+
+void SessionScheduler::Start() {
+    for (size_t i = 0; i < m_workers.size(); i++) {
+        m_workers[i]->thread = std::thread(&SessionScheduler::WorkerLoop, this, i);
+    }
+}
+
+void SessionScheduler::Wait() {
+    for (auto& worker : m_workers) {
+        if (worker->thread.joinable())
+            worker->thread.join();
+    }
+}
+
+void SessionScheduler::PushTask(size_t id, Task&& task) {
+    {
+        std::lock_guard<std::mutex> lock(m_workers[id]->mutex);
+        m_workers[id]->tasks.push_back(std::move(task));
+    }
+
+    // pairs with m_numIdle increment in WorkerLoop: either worker sees the push or it is woken up
+    m_numPushes++;
+    if (m_numIdle) {
+        std::lock_guard<std::mutex> lock(m_idleMutex);
+        m_idle.notify_all();
+    }
+}
+
+bool SessionScheduler::PopTask(size_t id, Task& task, Clock::time_point& nextDue) {
+    Clock::time_point now = Clock::now();
+    nextDue               = Clock::time_point::max();
+
+    // own queue is run in order tasks were put there, other queues are robbed from the back
+    for (size_t n = 0; n < m_workers.size(); n++) {
+        Worker& worker = *m_workers[(id + n) % m_workers.size()];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+
+        for (size_t i = 0; i < worker.tasks.size(); i++) {
+            auto it = n ? worker.tasks.end() - 1 - i : worker.tasks.begin() + i;
+            if (it->DueTime <= now) {
+                task = std::move(*it);
+                worker.tasks.erase(it);
+                return true;
+            }
+            nextDue = std::min(nextDue, it->DueTime);
+        }
+    }
+
+    return false;
+}
+
+void SessionScheduler::WorkerLoop(size_t id) {
+    while (m_numTasks) {
+        mfxU64 numPushes = m_numPushes;
+        Task task;
+        Clock::time_point nextDue;
+
+        if (!PopTask(id, task, nextDue)) {
+            std::unique_lock<std::mutex> lock(m_idleMutex);
+            m_numIdle++;
+            auto isChanged = [&] {
+                return m_numPushes != numPushes || !m_numTasks;
+            };
+            if (nextDue == Clock::time_point::max())
+                m_idle.wait(lock, isChanged);
+            else
+                m_idle.wait_until(lock, nextDue, isChanged);
+            m_numIdle--;
+            continue;
+        }
+
+        Clock::time_point sliceEnd = Clock::now() + std::chrono::microseconds(TIME_SLICE_US);
+        std::chrono::microseconds delay(0);
+        bool isAlive = true;
+        do {
+            delay   = std::chrono::microseconds(0);
+            isAlive = task.Step(delay);
+        } while (isAlive && !delay.count() && Clock::now() < sliceEnd);
+
+        if (isAlive) {
+            task.DueTime = Clock::now() + delay;
+            PushTask(id, std::move(task));
+        }
+        else if (!--m_numTasks) {
+            std::lock_guard<std::mutex> lock(m_idleMutex);
+            m_idle.notify_all();
+        }
+    }
+}
+
+} // namespace TranscodingSample
@@ -176,6 +176,17 @@ void PrintHelp() {
     HELP_LINE("  -greedy");
     HELP_LINE("                Use greedy formula to calculate number of surfaces");
     HELP_LINE("");
+    HELP_LINE("  -control <socket-path>");
+    HELP_LINE("                Accept commands on Unix domain socket, one command per line:");
+    HELP_LINE("                add <session options> - start new session, options are the");
+    HELP_LINE("                                        same as a line of par file");
+    HELP_LINE("                stop <session>        - stop session and release its resources");
+    HELP_LINE("                stats <session>       - print session status and frame rate");
+    HELP_LINE("                list                  - print status of all sessions");
+    HELP_LINE("                quit                  - stop all sessions and exit");
+    HELP_LINE("                Application keeps running when all sessions are over till");
+    HELP_LINE("                quit command");
+    HELP_LINE("");
     HELP_LINE("Pipeline description (general options):");
     HELP_LINE("");
     HELP_LINE("  -i::<h265|h264|mpeg2|vc1|mvc|jpeg|vp9|av1> <file-name>");
@@ -342,6 +353,40 @@ void PrintHelp() {
     HELP_LINE("");
     HELP_LINE("  -sys          Force usage of external system allocator");
     HELP_LINE("");
+    HELP_LINE("  -huge_pages   Back system memory surfaces with 2 MB pages (Linux only)");
+    HELP_LINE("");
+    HELP_LINE("  -mem_numa_node <node|local>");
+    HELP_LINE("                Allocate system memory surfaces on the NUMA node (Linux only),");
+    HELP_LINE("                local - node of CPUs the allocating thread is pinned to");
+    HELP_LINE("");
+    HELP_LINE("  -mem_slab     Allocate all system memory surfaces of a pool at once");
+    HELP_LINE("");
+    HELP_LINE("  -mem_pool     Reuse released system memory surfaces on reallocation and");
+    HELP_LINE("                resolution change, reused surfaces keep their content");
+    HELP_LINE("");
+    HELP_LINE("  -mem_zero     Zero slab system memory surfaces, also the reused ones");
+    HELP_LINE("");
+    HELP_LINE("  -pool_autotune <frames>");
+    HELP_LINE("                Shrink system memory surface pools to the peak usage observed");
+    HELP_LINE("                while the given number of surfaces is taken from the pool");
+    HELP_LINE("");
+    HELP_LINE("  -sched_pool <threads>");
+    HELP_LINE("                Run sessions frame by frame on the given number of threads instead");
+    HELP_LINE("                of a thread per session. Sessions joined by -o::sink/-i::source,");
+    HELP_LINE("                overlay and cascade scaling sessions keep their own threads.");
+    HELP_LINE("                Threads don't wait for busy encoder or empty surface pool, the");
+    HELP_LINE("                session is run again a bit later");
+    HELP_LINE("");
+    HELP_LINE("  -affinity <cpu list>");
+    HELP_LINE("                Run threads of the session and of its runtime on the CPUs, e.g.");
+    HELP_LINE("                0-3,8 (Linux only). Pinned sessions keep their own threads");
+    HELP_LINE("                with -sched_pool");
+    HELP_LINE("");
+    HELP_LINE("  -numa_node <node|spread>");
+    HELP_LINE("                Run threads of the session on CPUs of the NUMA node (Linux only),");
+    HELP_LINE("                spread - launcher assigns nodes in turn to sessions, sinks of");
+    HELP_LINE("                1:N pipeline share the node of their source");
+    HELP_LINE("");
     HELP_LINE("  -MemType::opaque");
     HELP_LINE("                Force usage of internal allocator");
     HELP_LINE("");
@@ -375,6 +420,12 @@ void PrintHelp() {
     HELP_LINE("");
     HELP_LINE("  -dec::sys     Set dec output to system memory");
     HELP_LINE("");
+    HELP_LINE("  -dec::complete_frame");
+    HELP_LINE("                Read H.264 and H.265 input by complete frames to lower latency.");
+    HELP_LINE("                VP8, VP9 and AV1 input is always read by complete frames");
+    HELP_LINE("  -dec::private Don't share decoder of this session. By default sessions with");
+    HELP_LINE("                the same input and decoder options use one decoder");
+    HELP_LINE("");
     HELP_LINE("  -vpp::sys     Set vpp output to system memory");
     HELP_LINE("");
     HELP_LINE("  -vpp::vid     Set vpp output to video memory");
@@ -825,18 +876,46 @@ void PrintHelp() {
     HELP_LINE("");
     HELP_LINE("  -cs           turn on cascade scaling");
     HELP_LINE("");
+    HELP_LINE("  -cs::auto     turn on cascade scaling, cascade of minimal cost is built");
+    HELP_LINE("                automatically for all channels, -cs options are ignored.");
+    HELP_LINE("                If any channel deinterlaces, DI is done once by the stages");
+    HELP_LINE("                fed by decoder and all scaled channels get progressive frames");
+    HELP_LINE("");
     HELP_LINE("  -trace        turn on tracing");
     HELP_LINE("");
     HELP_LINE("  -trace::ENC   turn on tracing, tune pipeline for ENC latency");
     HELP_LINE("");
     HELP_LINE("  -trace::E2E   turn on tracing, tune pipeline for E2E latency");
     HELP_LINE("");
+    HELP_LINE("  -trace::stream");
+    HELP_LINE("                turn on tracing, write trace to the file periodically");
+    HELP_LINE("                while pipeline is running");
+    HELP_LINE("");
+    HELP_LINE("  -trace::perfetto");
+    HELP_LINE("                turn on tracing, write trace in perfetto protobuf format");
+    HELP_LINE("                instead of JSON, it is smaller and faster to load");
+    HELP_LINE("");
     HELP_LINE("  -trace_buffer_size <x>");
-    HELP_LINE("                trace buffer size in MBytes");
+    HELP_LINE("                total trace buffer size in MBytes, default 7. It's shared by the");
+    HELP_LINE("                traced threads, each of them gets at least 0.5 MBytes");
     HELP_LINE("");
     HELP_LINE("  -parallel_encoding");
     HELP_LINE("                use several encoders to encode single bitstream,");
     HELP_LINE("                see readme for more details");
+    HELP_LINE("");
+    HELP_LINE("  -segments <K>");
+    HELP_LINE("                split h264 or h265 input at IDR frames into K segments and");
+    HELP_LINE("                transcode them in K parallel sessions to single bitstream,");
+    HELP_LINE("                see readme for more details");
+    HELP_LINE("");
+    HELP_LINE("  -segment_overlap <N>");
+    HELP_LINE("                each segment starts encoding at least N frames earlier to");
+    HELP_LINE("                settle rate control, these frames are discarded");
+    HELP_LINE("");
+    HELP_LINE("  -seek_frame <N>");
+    HELP_LINE("                start decoding of h264, h265 or IVF input from the key frame at");
+    HELP_LINE("                or before frame N, the input is indexed once and the index is");
+    HELP_LINE("                saved next to it as <input>.auidx for following runs");
 #if defined(LIBVA_X11_SUPPORT)
     HELP_LINE("");
     HELP_LINE("  -rx11        use libva X11 backend");
@@ -933,11 +1012,13 @@ CmdProcessor::CmdProcessor()
           m_encoderPlugins(),
           performance_file_name(),
           parameter_file_name(),
+          control_socket_name(),
           statisticsWindowSize(0),
           statisticsLogFile(nullptr),
           DumpLogFileName(),
           m_nTimeout(0),
           m_surface_wait_interval(MSDK_SURFACE_WAIT_INTERVAL),
+          m_nParFileLine(0),
           bRobustFlag(false),
           bSoftRobustFlag(false),
           shouldUseGreedyFormula(false),
@@ -1007,6 +1088,15 @@ mfxStatus CmdProcessor::ParseCmdLine(int argc, char* argv[]) {
         else if (msdk_match(argv[0], "-greedy")) {
             shouldUseGreedyFormula = true;
         }
+        else if (msdk_match(argv[0], "-control")) {
+            --argc;
+            ++argv;
+            if (!argv[0]) {
+                printf("error: no argument given for '-control' option\n");
+                return MFX_ERR_UNSUPPORTED;
+            }
+            control_socket_name = std::string(argv[0]);
+        }
         else if (msdk_match(argv[0], "-p")) {
             if (!performance_file_name.empty()) {
                 printf("error: only one performance file is supported");
@@ -1116,11 +1206,15 @@ mfxStatus CmdProcessor::ParseParFile(const std::string& filename) {
         return MFX_ERR_UNSUPPORTED;
     }
     std::string line;
+    mfxU32 lineNum = 0;
     while (std::getline(in_stream, line)) {
+        lineNum++;
         if (line.empty()) {
             continue;
         }
-        sts = TokenizeLine(line);
+        m_nParFileLine = lineNum;
+        sts            = TokenizeLine(line);
+        m_nParFileLine = 0;
         MSDK_CHECK_STATUS(sts, "TokenizeLine failed");
     }
     return MFX_ERR_NONE;
@@ -1264,6 +1358,13 @@ static void split_cmd(std::string const& cmd, std::vector<std::string>& args) {
 
 #endif
 
+mfxStatus CmdProcessor::ParseSessionLine(const std::string& line) {
+    if (line.empty()) {
+        return MFX_ERR_UNSUPPORTED;
+    }
+    return TokenizeLine(line);
+}
+
 mfxStatus CmdProcessor::TokenizeLine(const std::string& line) {
     std::vector<std::string> args;
     split_cmd(line, args);
@@ -1661,6 +1762,12 @@ mfxStatus ParseAdditionalParams(char* argv[],
     else if (msdk_match(argv[i], "-dec::sys")) {
         InputParams.DecOutPattern = MFX_IOPATTERN_OUT_SYSTEM_MEMORY;
     }
+    else if (msdk_match(argv[i], "-dec::complete_frame")) {
+        InputParams.bDecCompleteFrame = true;
+    }
+    else if (msdk_match(argv[i], "-dec::private")) {
+        InputParams.bPrivateDecoder = true;
+    }
 
     else if (msdk_match(argv[i], "-HdrSEI:mdcv")) {
         InputParams.bEnableMDCV = true;
@@ -1817,6 +1924,63 @@ mfxStatus ParseAdditionalParams(char* argv[],
     else if (msdk_match(argv[i], "-sys") || msdk_match(argv[i], "-MemType::system")) {
         InputParams.bForceSysMem = true;
     }
+    else if (msdk_match(argv[i], "-huge_pages")) {
+        InputParams.bSysMemHugePages = true;
+    }
+    else if (msdk_match(argv[i], "-mem_numa_node")) {
+        VAL_CHECK(i + 1 >= argc, i, argv[i]);
+        if (msdk_match(argv[++i], "local")) {
+            InputParams.nSysMemNumaNode = SYSMEM_NUMA_NODE_LOCAL;
+        }
+        else if (MFX_ERR_NONE != msdk_opt_read(argv[i], InputParams.nSysMemNumaNode) ||
+                 InputParams.nSysMemNumaNode < 0) {
+            PrintError("-mem_numa_node %s is invalid", argv[i]);
+            return MFX_ERR_UNSUPPORTED;
+        }
+    }
+    else if (msdk_match(argv[i], "-mem_slab")) {
+        InputParams.bSysMemSlab = true;
+    }
+    else if (msdk_match(argv[i], "-mem_pool")) {
+        InputParams.bSysMemPool = true;
+    }
+    else if (msdk_match(argv[i], "-mem_zero")) {
+        InputParams.bSysMemZeroInit = true;
+    }
+    else if (msdk_match(argv[i], "-pool_autotune")) {
+        VAL_CHECK(i + 1 >= argc, i, argv[i]);
+        if (MFX_ERR_NONE != msdk_opt_read(argv[++i], InputParams.nPoolAutoTuneFrames) ||
+            !InputParams.nPoolAutoTuneFrames) {
+            PrintError("-pool_autotune %s is invalid", argv[i]);
+            return MFX_ERR_UNSUPPORTED;
+        }
+    }
+    else if (msdk_match(argv[i], "-sched_pool")) {
+        VAL_CHECK(i + 1 >= argc, i, argv[i]);
+        if (MFX_ERR_NONE != msdk_opt_read(argv[++i], InputParams.nSchedulerThreads) ||
+            !InputParams.nSchedulerThreads) {
+            PrintError("-sched_pool %s is invalid", argv[i]);
+            return MFX_ERR_UNSUPPORTED;
+        }
+    }
+    else if (msdk_match(argv[i], "-affinity")) {
+        VAL_CHECK(i + 1 >= argc, i, argv[i]);
+        if (MFX_ERR_NONE != ParseCpuList(argv[++i], InputParams.CpuAffinity)) {
+            PrintError("-affinity %s is invalid", argv[i]);
+            return MFX_ERR_UNSUPPORTED;
+        }
+    }
+    else if (msdk_match(argv[i], "-numa_node")) {
+        VAL_CHECK(i + 1 >= argc, i, argv[i]);
+        if (msdk_match(argv[++i], "spread")) {
+            InputParams.nNumaNode = SESSION_NUMA_NODE_SPREAD;
+        }
+        else if (MFX_ERR_NONE != msdk_opt_read(argv[i], InputParams.nNumaNode) ||
+                 InputParams.nNumaNode < 0) {
+            PrintError("-numa_node %s is invalid", argv[i]);
+            return MFX_ERR_UNSUPPORTED;
+        }
+    }
     else if (msdk_match(argv[i], "-opaq") || msdk_match(argv[i], "-MemType::opaque")) {
         printf("WARNING: -opaq option is ignored, opaque memory support is disabled in opeVPL.\n");
     }
@@ -1879,6 +2043,9 @@ mfxStatus ParseAdditionalParams(char* argv[],
     else if (msdk_match(argv[i], "-cs")) {
         InputParams.CascadeScaler = true;
     }
+    else if (msdk_match(argv[i], "-cs::auto")) {
+        InputParams.CascadeScalerAuto = true;
+    }
     else if (msdk_match(argv[i], "-trace")) {
         InputParams.EnableTracing = true;
     }
@@ -1898,9 +2065,38 @@ mfxStatus ParseAdditionalParams(char* argv[],
         InputParams.EnableTracing = true;
         InputParams.LatencyType   = SMTTracer::LatencyType::ENC;
     }
+    else if (msdk_match(argv[i], "-trace::stream")) {
+        InputParams.EnableTracing  = true;
+        InputParams.TraceStreaming = true;
+    }
+    else if (msdk_match(argv[i], "-trace::perfetto")) {
+        InputParams.EnableTracing = true;
+        InputParams.TraceFormat   = SMTTracer::TraceFormat::PERFETTO;
+    }
     else if (msdk_match(argv[i], "-parallel_encoding")) {
         InputParams.ParallelEncoding = true;
     }
+    else if (msdk_match(argv[i], "-segments")) {
+        VAL_CHECK(i + 1 >= argc, i, argv[i]);
+        if (MFX_ERR_NONE != msdk_opt_read(argv[++i], InputParams.nSegments)) {
+            PrintError("-segments %s is invalid", argv[i]);
+            return MFX_ERR_UNSUPPORTED;
+        }
+    }
+    else if (msdk_match(argv[i], "-segment_overlap")) {
+        VAL_CHECK(i + 1 >= argc, i, argv[i]);
+        if (MFX_ERR_NONE != msdk_opt_read(argv[++i], InputParams.nSegmentOverlap)) {
+            PrintError("-segment_overlap %s is invalid", argv[i]);
+            return MFX_ERR_UNSUPPORTED;
+        }
+    }
+    else if (msdk_match(argv[i], "-seek_frame")) {
+        VAL_CHECK(i + 1 >= argc, i, argv[i]);
+        if (MFX_ERR_NONE != msdk_opt_read(argv[++i], InputParams.nSeekFrame)) {
+            PrintError("-seek_frame %s is invalid", argv[i]);
+            return MFX_ERR_UNSUPPORTED;
+        }
+    }
 #if (defined(_WIN64) || defined(_WIN32))
     else if (msdk_match(argv[i], "-dual_gfx::on")) {
         InputParams.isDualMode = true;
@@ -2375,6 +2571,7 @@ mfxStatus CmdProcessor::ParseParamsForOneSession(mfxU32 argc, char* argv[]) {
     session_descriptions.push_back(cmd.str());
 
     TranscodingSample::sInputParams InputParams;
+    InputParams.nParFileLine = m_nParFileLine;
     if (m_nTimeout)
         InputParams.nTimeout = m_nTimeout;
     if (bRobustFlag)
@@ -0,0 +1,177 @@
+/*############################################################################
+  # Copyright (C) 2024 Intel Corporation
+  #
+  # SPDX-License-Identifier: MIT
+  ############################################################################*/
+
+#include "smt_control.h"
+
+#include <cstdio>
+
+#if !defined(_WIN32) && !defined(_WIN64)
+    #include <poll.h>
+    #include <sys/socket.h>
+    #include <sys/stat.h>
+    #include <sys/un.h>
+    #include <unistd.h>
+    #include <cstring>
+#endif
+
+namespace TranscodingSample {
+
+// how often the server checks that it is stopped
+static const int ControlPollIntervalMs = 100;
+// client which sends longer line without end of line is dropped
+static const size_t ControlMaxLineSize = 64 * 1024;
+
+ControlServer::~ControlServer() {
+    Stop();
+}
+
+std::string ControlServer::SplitCommand(const std::string& line, std::string& args) {
+    const char* spaces = " \t\r\n";
+
+    size_t start = line.find_first_not_of(spaces);
+    if (start == std::string::npos) {
+        args.clear();
+        return std::string();
+    }
+    size_t end = line.find_last_not_of(spaces) + 1;
+
+    size_t cmdEnd = line.find_first_of(spaces, start);
+    if (cmdEnd == std::string::npos || cmdEnd > end)
+        cmdEnd = end;
+
+    size_t argsStart = line.find_first_not_of(spaces, cmdEnd);
+    args = (argsStart < end) ? line.substr(argsStart, end - argsStart) : std::string();
+    return line.substr(start, cmdEnd - start);
+}
+
+#if defined(_WIN32) || defined(_WIN64)
+
+mfxStatus ControlServer::Start(const std::string&, const Handler&) {
+    printf("error: control socket is supported on Linux only\n");
+    return MFX_ERR_UNSUPPORTED;
+}
+
+void ControlServer::Stop() {}
+
+void ControlServer::ServeLoop() {}
+
+void ControlServer::ServeClient(int) {}
+
+#else
+
+mfxStatus ControlServer::Start(const std::string& path, const Handler& handler) {
+    if (IsRunning())
+        return MFX_ERR_UNDEFINED_BEHAVIOR;
+
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+        printf("error: control socket path \"%s\" is invalid\n", path.c_str());
+        return MFX_ERR_UNSUPPORTED;
+    }
+    memcpy(addr.sun_path, path.c_str(), path.size());
+
+    // socket left by the previous run is replaced, anything else at the path is kept
+    struct stat st;
+    if (!lstat(path.c_str(), &st)) {
+        if (!S_ISSOCK(st.st_mode)) {
+            printf("error: control socket path \"%s\" exists and isn't a socket\n",
+                   path.c_str());
+            return MFX_ERR_UNSUPPORTED;
+        }
+        unlink(path.c_str());
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0) {
+        printf("error: failed to create control socket\n");
+        return MFX_ERR_UNKNOWN;
+    }
+
+    if (bind(fd, (sockaddr*)&addr, sizeof(addr)) || listen(fd, 1)) {
+        printf("error: failed to listen on control socket \"%s\"\n", path.c_str());
+        close(fd);
+        return MFX_ERR_UNKNOWN;
+    }
+
+    m_path     = path;
+    m_handler  = handler;
+    m_listenFd = fd;
+    m_stop     = false;
+    m_thread   = std::thread(&ControlServer::ServeLoop, this);
+    return MFX_ERR_NONE;
+}
+
+void ControlServer::Stop() {
+    if (!IsRunning())
+        return;
+
+    m_stop = true;
+    m_thread.join();
+
+    close(m_listenFd);
+    m_listenFd = -1;
+    unlink(m_path.c_str());
+}
+
+void ControlServer::ServeLoop() {
+    while (!m_stop) {
+        pollfd pfd = { m_listenFd, POLLIN, 0 };
+        if (poll(&pfd, 1, ControlPollIntervalMs) <= 0)
+            continue;
+
+        int fd = accept(m_listenFd, NULL, NULL);
+        if (fd < 0)
+            continue;
+
+        ServeClient(fd);
+        close(fd);
+    }
+}
+
+void ControlServer::ServeClient(int fd) {
+    std::string input;
+    char buffer[1024];
+
+    while (!m_stop) {
+        pollfd pfd = { fd, POLLIN, 0 };
+        int res    = poll(&pfd, 1, ControlPollIntervalMs);
+        if (res < 0)
+            return;
+        if (res == 0)
+            continue;
+
+        ssize_t size = read(fd, buffer, sizeof(buffer));
+        if (size <= 0)
+            return;
+        input.append(buffer, size);
+
+        size_t eol;
+        while ((eol = input.find('\n')) != std::string::npos) {
+            std::string reply = m_handler(input.substr(0, eol)) + "\n";
+            input.erase(0, eol + 1);
+
+            for (size_t written = 0; written < reply.size();) {
+                ssize_t sent =
+                    send(fd, reply.data() + written, reply.size() - written, MSG_NOSIGNAL);
+                if (sent <= 0)
+                    return;
+                written += sent;
+            }
+        }
+
+        if (input.size() > ControlMaxLineSize) {
+            printf("error: control command is longer than %d bytes, client is dropped\n",
+                   (int)ControlMaxLineSize);
+            return;
+        }
+    }
+}
+
+#endif
+
+} // namespace TranscodingSample
@@ -0,0 +1,46 @@
+/*############################################################################
+  # Copyright (C) 2024 Intel Corporation
+  #
+  # SPDX-License-Identifier: MIT
+  ############################################################################*/
+
+#include "smt_protobuf.h"
+
+namespace TranscodingSample {
+
+void ProtoEncoder::AddVarint(mfxU32 field, mfxU64 value) {
+    WriteTag(field, WIRE_VARINT);
+    WriteVarint(value);
+}
+
+void ProtoEncoder::AddFixed64(mfxU32 field, mfxU64 value) {
+    WriteTag(field, WIRE_FIXED64);
+    for (int i = 0; i < 8; i++) {
+        m_data.push_back(static_cast<char>(value & 0xff));
+        value >>= 8;
+    }
+}
+
+void ProtoEncoder::AddString(mfxU32 field, const std::string& value) {
+    WriteTag(field, WIRE_LENGTH_DELIMITED);
+    WriteVarint(value.size());
+    m_data.append(value);
+}
+
+void ProtoEncoder::AddMessage(mfxU32 field, const ProtoEncoder& message) {
+    AddString(field, message.m_data);
+}
+
+void ProtoEncoder::WriteTag(mfxU32 field, WireType type) {
+    WriteVarint((static_cast<mfxU64>(field) << 3) | type);
+}
+
+void ProtoEncoder::WriteVarint(mfxU64 value) {
+    while (value >= 0x80) {
+        m_data.push_back(static_cast<char>((value & 0x7f) | 0x80));
+        value >>= 7;
+    }
+    m_data.push_back(static_cast<char>(value));
+}
+
+} // namespace TranscodingSample
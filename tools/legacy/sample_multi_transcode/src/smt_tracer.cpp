@@ -8,31 +8,119 @@
 
 namespace TranscodingSample {
 
-SMTTracer::SMTTracer() : Log(), AddonLog(), E2ELatency(), EncLatency(), TracerMutex() {
+namespace {
+//field numbers and values from perfetto protos: trace.proto, trace_packet.proto,
+//track_event.proto, track_descriptor.proto, clock_snapshot.proto, interned_data.proto
+enum : mfxU32 {
+    TRACE_PACKET = 1,
+
+    PACKET_CLOCK_SNAPSHOT     = 6,
+    PACKET_TIMESTAMP          = 8,
+    PACKET_SEQUENCE_ID        = 10,
+    PACKET_TRACK_EVENT        = 11,
+    PACKET_INTERNED_DATA      = 12,
+    PACKET_SEQUENCE_FLAGS     = 13,
+    PACKET_TIMESTAMP_CLOCK_ID = 58,
+    PACKET_DEFAULTS           = 59,
+    PACKET_TRACK_DESCRIPTOR   = 60,
+
+    DEFAULTS_TIMESTAMP_CLOCK_ID = 58,
+
+    CLOCK_SNAPSHOT_CLOCKS    = 1,
+    CLOCK_ID                 = 1,
+    CLOCK_TIMESTAMP          = 2,
+    CLOCK_IS_INCREMENTAL     = 3,
+    CLOCK_UNIT_MULTIPLIER_NS = 4,
+
+    TRACK_UUID        = 1,
+    TRACK_NAME        = 2,
+    TRACK_PROCESS     = 3,
+    TRACK_PARENT_UUID = 5,
+    TRACK_COUNTER     = 8,
+
+    PROCESS_PID  = 1,
+    PROCESS_NAME = 6,
+
+    EVENT_DEBUG_ANNOTATIONS    = 4,
+    EVENT_TYPE                 = 9,
+    EVENT_NAME_IID             = 10,
+    EVENT_TRACK_UUID           = 11,
+    EVENT_COUNTER_VALUE        = 30,
+    EVENT_FLOW_IDS             = 47,
+    EVENT_TERMINATING_FLOW_IDS = 48,
+
+    ANNOTATION_NAME_IID   = 1,
+    ANNOTATION_UINT_VALUE = 3,
+
+    INTERNED_EVENT_NAMES      = 2,
+    INTERNED_ANNOTATION_NAMES = 3,
+    INTERNED_IID              = 1,
+    INTERNED_NAME             = 2,
+
+    TYPE_SLICE_BEGIN = 1,
+    TYPE_SLICE_END   = 2,
+    TYPE_INSTANT     = 3,
+    TYPE_COUNTER     = 4,
+
+    SEQ_INCREMENTAL_STATE_CLEARED = 1,
+    SEQ_NEEDS_INCREMENTAL_STATE   = 2,
+
+    BUILTIN_CLOCK_MONOTONIC = 3, //timestamps are taken from steady_clock
+    SEQUENCE_CLOCK          = 64, //first clock ID which is local for the sequence
+
+    PERFETTO_SEQUENCE_ID   = 1,
+    PERFETTO_PID           = 1,
+    PERFETTO_PROCESS_TRACK = 1,
+};
+} // namespace
+
+std::atomic<mfxU64> SMTTracer::NumOfTracers(0);
+
+SMTTracer::SMTTracer()
+        : TracerID(++NumOfTracers),
+          ThreadLogs(nullptr),
+          Flusher(),
+          FlushMutex(),
+          FlushSync(),
+          TraceFile(),
+          Chunk(),
+          Pending(),
+          FlowLog(),
+          OpenEvents(),
+          Producers(),
+          E2ELatency(),
+          EncLatency(),
+          TracerMutex() {
     TimeBase = GetCurrentTS();
 }
 
 SMTTracer::~SMTTracer() {
-    if (!Enabled)
-        return;
-
-    //these functions are intentionally called from destructor to try to save traces in case of a crash
-    AdjustOverlappingEvents();
-    AddFlowEvents();
-    mfxU32 FileID = 0xfffffff & GetCurrentTS();
-    SaveTrace(FileID);
+    if (Enabled) {
+        if (Flusher.joinable()) {
+            {
+                std::lock_guard<std::mutex> guard(FlushMutex);
+                StopFlushing = true;
+            }
+            FlushSync.notify_one();
+            Flusher.join();
+        }
 
-    ComputeE2ELatency();
-    SaveLatency(LatencyType::E2E, FileID, E2ELatency);
+        //this function is intentionally called from destructor to try to save traces in case of a crash
+        SaveTrace();
+    }
 
-    ComputeEncLatency();
-    SaveLatency(LatencyType::ENC, FileID, EncLatency);
+    while (ThreadLog* log = ThreadLogs.load()) {
+        ThreadLogs = log->Next;
+        delete log;
+    }
 }
 
 void SMTTracer::Init(const PipelineType type,
                      const mfxU32 numOfChannels,
                      const LatencyType latency,
-                     const mfxU32 TraceBufferSize) {
+                     const mfxU32 TraceBufferSize,
+                     const bool streaming,
+                     const TraceFormat format) {
     if (Enabled) {
         return;
     }
@@ -41,11 +129,31 @@ void SMTTracer::Init(const PipelineType type,
     if (TraceBufferSize > TraceBufferSizeInMBytes && TraceBufferSize < MaxTraceBufferSizeInMBytes) {
         TraceBufferSizeInMBytes = TraceBufferSize;
     }
-    Log.reserve(TraceBufferSizeInMBytes * 1024 * 1024 / sizeof(Event));
+
+    //budget is shared by threads which trace: decoder, cascade VPP and encoder of every
+    //channel, threads started above that count get the same share
+    size_t numOfThreads = numOfChannels + 2;
+    size_t share        = (size_t)TraceBufferSizeInMBytes * 1024 * 1024 / numOfThreads;
+    ThreadLogCapacity =
+        std::max<size_t>(share, (size_t)MinThreadBufferSizeInKBytes * 1024) / sizeof(Event);
 
     TypeOfPipeline = type;
     NumOfChannels  = numOfChannels;
     TypeOfLatency  = latency;
+    Format         = format;
+    FileID         = 0xfffffff & GetCurrentTS();
+    TraceFileName  = "smt_trace_" + std::to_string(FileID) +
+                    (Format == TraceFormat::PERFETTO ? ".pftrace" : ".json");
+
+    if (streaming) {
+        if (!OpenTraceFile()) {
+            printf("WARNING: can't open %s, trace is kept in memory\n", TraceFileName.c_str());
+            return;
+        }
+
+        Streaming = true;
+        Flusher   = std::thread(&SMTTracer::FlushLoop, this);
+    }
 }
 
 void SMTTracer::BeginEvent(const ThreadType thType,
@@ -74,6 +182,25 @@ void SMTTracer::AddCounterEvent(const ThreadType thType,
                                 const mfxU64 counter) {
     if (!Enabled)
         return;
+
+    //surface waiting loops report the same number again and again, only changes are kept
+    ThreadLog* log = GetThreadLog();
+    mfxU64 pool    = (static_cast<mfxU64>(thType) << 32) | thID;
+    auto it        = std::find_if(log->LastCounters.begin(),
+                           log->LastCounters.end(),
+                           [pool](const std::pair<mfxU64, mfxU64>& c) {
+                               return c.first == pool;
+                           });
+    if (it == log->LastCounters.end()) {
+        log->LastCounters.push_back(std::make_pair(pool, counter));
+    }
+    else if (it->second == counter) {
+        return;
+    }
+    else {
+        it->second = counter;
+    }
+
     AddEvent(EventType::Counter, thType, thID, name, reinterpret_cast<void*>(counter), nullptr);
 }
 
@@ -130,10 +257,74 @@ void SMTTracer::AfterEncodeSync() {
     }
 }
 
-void SMTTracer::AdjustOverlappingEvents() {
+void SMTTracer::FlushLoop() {
+    std::unique_lock<std::mutex> guard(FlushMutex);
+    while (!StopFlushing) {
+        FlushSync.wait_for(guard, std::chrono::milliseconds(FlushPeriodInMilliseconds));
+        Flush(false);
+    }
+}
+
+void SMTTracer::Flush(bool last) {
+    //FlushMutex should be locked by the caller
+    //Rings are popped one after another, so each of them ends at different time. The chunk is cut
+    //at the time taken before popping, newer events wait for the next chunk. Then the chunk has
+    //all events of all threads up to the cut and producer of every flow comes before consumer.
+    mfxU64 cut = GetCurrentTS() - FlushDelayInMicroseconds;
+
+    Chunk.clear();
+    Chunk.swap(Pending);
+    for (ThreadLog* log = ThreadLogs.load(); log; log = log->Next) {
+        log->Pop(Chunk);
+    }
+
+    //events of every thread are already in time order, stable sort keeps it for equal TS
+    std::stable_sort(Chunk.begin(), Chunk.end(), [](const Event& a, const Event& b) {
+        return a.TS < b.TS;
+    });
+
+    if (!last) {
+        auto newer =
+            std::upper_bound(Chunk.begin(), Chunk.end(), cut, [](mfxU64 ts, const Event& ev) {
+                return ts < ev.TS;
+            });
+        Pending.assign(newer, Chunk.end());
+        Chunk.erase(newer, Chunk.end());
+    }
+
+    AdjustOverlappingEvents(Chunk);
+
+    FlowLog.clear();
+    for (const Event& ev : Chunk) {
+        AnalyzeEvent(ev);
+    }
+
+    if (Format == TraceFormat::PERFETTO) {
+        WritePerfettoChunk();
+    }
+    else {
+        for (const Event& ev : Chunk) {
+            WriteEvent(TraceFile, ev);
+        }
+        for (const Event& ev : FlowLog) {
+            WriteEvent(TraceFile, ev);
+        }
+    }
+    TraceFile.flush();
+}
+
+void SMTTracer::AdjustOverlappingEvents(std::vector<Event>& events) {
     //If two duration events in the same thread overlap, then they or related flow event
     //may be displayed incorrectly. We move event a bit to avoid overlapping.
-    for (EventIt evABegin = Log.begin(); evABegin != Log.end(); evABegin++) {
+    //In streaming mode only events of the same chunk are checked.
+    using EventIt           = std::vector<Event>::iterator;
+    auto FindEventInThread = [&events](EventIt first, EventType type) {
+        return std::find_if(first, events.end(), [&first, &type](const Event& ev) {
+            return ev.EvType == type && first->ThType == ev.ThType && first->ThID == ev.ThID;
+        });
+    };
+
+    for (EventIt evABegin = events.begin(); evABegin != events.end(); evABegin++) {
         //find beginning of event A
         if (evABegin->EvType != EventType::DurationStart) {
             continue;
@@ -142,7 +333,7 @@ void SMTTracer::AdjustOverlappingEvents() {
         auto evAEnd   = FindEventInThread(evABegin, EventType::DurationEnd);
         auto evBBegin = FindEventInThread(evAEnd, EventType::DurationStart);
         auto evBEnd   = FindEventInThread(evBBegin, EventType::DurationEnd);
-        if (evAEnd == Log.end() || evBBegin == Log.end() || evBEnd == Log.end()) {
+        if (evAEnd == events.end() || evBBegin == events.end() || evBEnd == events.end()) {
             continue;
         }
 
@@ -165,26 +356,125 @@ void SMTTracer::AdjustOverlappingEvents() {
     }
 }
 
-void SMTTracer::SaveTrace(mfxU32 FileID) {
-    std::string FileName = "smt_trace_" + std::to_string(FileID) + ".json";
-    std::ofstream trace_file(FileName, std::ios::out);
-    if (!trace_file) {
-        return;
+void SMTTracer::AnalyzeEvent(const Event& ev) {
+    //Events come in time order, so input of duration event is produced by the last event which
+    //has ended with the same output ID. It is searched in the same channel except 1toN pipeline
+    //where decoder feeds all channels.
+    auto ProducerKey = [this](mfxU64 id, mfxU32 thID) {
+        return std::make_pair(id, TypeOfPipeline == PipelineType::_1xN ? 0 : thID);
+    };
+
+    if (ev.EvType == EventType::DurationStart) {
+        OpenDurationEvent& open = OpenEvents[std::make_tuple(ev.ThType, ev.ThID, ev.Name)];
+        open.Begin              = ev;
+        open.HasProducer        = false;
+        open.HasChain           = ev.InID == 0;
+        open.ChainBegin         = ev;
+
+        if (ev.InID == 0) {
+            return;
+        }
+
+        auto it = Producers.find(ProducerKey(ev.InID, ev.ThID));
+        if (it == Producers.end()) {
+            return;
+        }
+
+        open.HasProducer = true;
+        open.Producer    = it->second;
+        open.HasChain    = it->second.HasChain;
+        open.ChainBegin  = it->second.ChainBegin;
+        AddFlowEvent(it->second.End, ev);
+    }
+    else if (ev.EvType == EventType::DurationEnd) {
+        auto it = OpenEvents.find(std::make_tuple(ev.ThType, ev.ThID, ev.Name));
+        if (it == OpenEvents.end()) {
+            return;
+        }
+        const OpenDurationEvent& open = it->second;
+
+        if (ev.OutID) {
+            DurationEvent& produced = Producers[ProducerKey(ev.OutID, ev.ThID)];
+            produced.Begin          = open.Begin;
+            produced.End            = ev;
+            produced.HasChain       = open.HasChain;
+            produced.ChainBegin     = open.ChainBegin;
+        }
+
+        //end of sync operation in enc channel completes processing of the frame
+        if (ev.ThType != ThreadType::ENC || ev.Name != EventName::SYNC) {
+            return;
+        }
+
+        if (open.HasChain && open.ChainBegin.ThType == ThreadType::DEC) {
+            E2ELatency[ev.ThID].push_back(
+                TimeInterval(open.ChainBegin.TS, ev.TS - open.ChainBegin.TS));
+        }
+        else {
+            NumOfErrors++;
+        }
+
+        //sync operation waits for the output of encoding
+        if (open.HasProducer && open.Producer.Begin.ThType == ThreadType::ENC) {
+            EncLatency[open.Producer.Begin.ThID].push_back(
+                TimeInterval(open.Producer.Begin.TS, ev.TS - open.Producer.Begin.TS));
+        }
+        else {
+            NumOfErrors++;
+        }
+    }
+}
+
+bool SMTTracer::OpenTraceFile() {
+    if (Format == TraceFormat::PERFETTO) {
+        TraceFile.open(TraceFileName, std::ios::out | std::ios::binary);
+        if (!TraceFile) {
+            return false;
+        }
+        WritePerfettoHeader();
     }
+    else {
+        TraceFile.open(TraceFileName, std::ios::out);
+        if (!TraceFile) {
+            return false;
+        }
+        TraceFile << "[" << std::endl;
+    }
+    return true;
+}
 
-    printf("\n### trace buffer usage %.2f%%\n", 100. * Log.size() / Log.capacity());
-    printf("trace file name %s\n", FileName.c_str());
+void SMTTracer::SaveTrace() {
+    {
+        std::lock_guard<std::mutex> guard(FlushMutex);
+        if (!Streaming && !OpenTraceFile()) {
+            return;
+        }
 
-    trace_file << "[" << std::endl;
+        Flush(true);
+        TraceFile.close();
+    }
 
-    for (const Event ev : Log) {
-        WriteEvent(trace_file, ev);
+    size_t maxUsage   = 0;
+    size_t numOfLogs  = 0;
+    mfxU64 numDropped = 0;
+    for (ThreadLog* log = ThreadLogs.load(); log; log = log->Next) {
+        maxUsage = std::max<size_t>(maxUsage, log->MaxUsage);
+        numDropped += log->NumOfDropped;
+        numOfLogs++;
     }
-    for (const Event ev : AddonLog) {
-        WriteEvent(trace_file, ev);
+
+    printf("\n### trace buffer usage %.2f%%, %llu threads, %.2f MBytes per thread\n",
+           100. * maxUsage / std::max<size_t>(ThreadLogCapacity, 1),
+           (unsigned long long)numOfLogs,
+           (double)ThreadLogCapacity * sizeof(Event) / (1024 * 1024));
+    if (numDropped) {
+        printf("### %llu trace events were dropped, buffer was full\n",
+               (unsigned long long)numDropped);
     }
+    printf("trace file name %s\n", TraceFileName.c_str());
 
-    trace_file.close();
+    SaveLatency(LatencyType::E2E, FileID, E2ELatency);
+    SaveLatency(LatencyType::ENC, FileID, EncLatency);
 }
 
 SMTTracer::TimeInterval::TimeInterval(mfxU64 ts, mfxU64 duration) {
@@ -192,6 +482,41 @@ SMTTracer::TimeInterval::TimeInterval(mfxU64 ts, mfxU64 duration) {
     Duration = duration;
 }
 
+SMTTracer::ThreadLog::ThreadLog(size_t capacity)
+        : Ring(std::max<size_t>(capacity, 1)),
+          Head(0),
+          Tail(0),
+          MaxUsage(0),
+          NumOfDropped(0),
+          LastCounters(),
+          Next(nullptr) {}
+
+bool SMTTracer::ThreadLog::Push(const Event& ev) {
+    size_t tail  = Tail.load(std::memory_order_relaxed);
+    size_t usage = tail - Head.load(std::memory_order_acquire);
+    if (usage == Ring.size()) {
+        NumOfDropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+    Ring[tail % Ring.size()] = ev;
+    Tail.store(tail + 1, std::memory_order_release);
+
+    if (usage + 1 > MaxUsage.load(std::memory_order_relaxed)) {
+        MaxUsage.store(usage + 1, std::memory_order_relaxed);
+    }
+    return true;
+}
+
+void SMTTracer::ThreadLog::Pop(std::vector<Event>& events) {
+    size_t head = Head.load(std::memory_order_relaxed);
+    size_t tail = Tail.load(std::memory_order_acquire);
+    for (; head != tail; head++) {
+        events.push_back(Ring[head % Ring.size()]);
+    }
+    Head.store(head, std::memory_order_release);
+}
+
 void SMTTracer::AddEvent(const EventType evType,
                          const ThreadType thType,
                          const mfxU32 thID,
@@ -207,12 +532,27 @@ void SMTTracer::AddEvent(const EventType evType,
     ev.OutID  = reinterpret_cast<mfxU64>(outID);
     ev.TS     = GetCurrentTS();
 
-    if (Log.size() == Log.capacity()) {
-        return;
+    //event is dropped if buffer of the thread is full
+    GetThreadLog()->Push(ev);
+}
+
+SMTTracer::ThreadLog* SMTTracer::GetThreadLog() {
+    //thread keeps the log of the tracer it has written to last time, new log is prepended to
+    //the list without lock
+    thread_local mfxU64 threadTracerID  = 0;
+    thread_local ThreadLog* pThreadLog = nullptr;
+    if (threadTracerID == TracerID) {
+        return pThreadLog;
+    }
+
+    ThreadLog* log = new ThreadLog(ThreadLogCapacity);
+    log->Next      = ThreadLogs.load();
+    while (!ThreadLogs.compare_exchange_weak(log->Next, log)) {
     }
 
-    std::lock_guard<std::mutex> guard(TracerMutex);
-    Log.push_back(ev);
+    threadTracerID = TracerID;
+    pThreadLog     = log;
+    return log;
 }
 
 mfxU64 SMTTracer::GetCurrentTS() {
@@ -223,74 +563,6 @@ mfxU64 SMTTracer::GetCurrentTS() {
     return duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count();
 }
 
-void SMTTracer::AddFlowEvents() {
-    for (auto it = Log.begin(); it != Log.end(); ++it) {
-        if (it->EvType != EventType::DurationStart) {
-            continue;
-        }
-
-        if (it->InID == 0) {
-            continue;
-        }
-
-        auto itc = std::reverse_iterator<decltype(it)>(it);
-
-        auto itp = find_if(itc, Log.rend(), [&it, this](Event ev) {
-            return ev.EvType == EventType::DurationEnd && it->InID == ev.OutID &&
-                   (TypeOfPipeline == PipelineType::_1xN || it->ThID == ev.ThID);
-        });
-        if (itp == Log.rend()) {
-            continue;
-        }
-
-        AddFlowEvent(*itp, *it);
-    }
-}
-
-void SMTTracer::ComputeE2ELatency() {
-    NumOfErrors = 0;
-
-    for (auto it = Log.begin(); it != Log.end(); ++it) {
-        //look for end of sync operation in enc channel
-        if (it->EvType != EventType::DurationEnd || it->ThType != ThreadType::ENC ||
-            it->Name != EventName::SYNC) {
-            continue;
-        }
-
-        EventIt bit = FindBeginningOfDependencyChain(it);
-        if (bit == Log.end() || bit->ThType != ThreadType::DEC) {
-            NumOfErrors++;
-            continue;
-        }
-
-        E2ELatency[it->ThID].push_back(TimeInterval(bit->TS, it->TS - bit->TS));
-    }
-}
-
-void SMTTracer::ComputeEncLatency() {
-    NumOfErrors = 0;
-
-    for (auto it = Log.begin(); it != Log.end(); ++it) {
-        if (it->EvType != EventType::DurationEnd || it->ThType != ThreadType::ENC ||
-            it->Name != EventName::SYNC) {
-            continue;
-        }
-
-        EventIt syncEnd   = it;
-        EventIt syncBegin = FindBeginningOfDurationEvent(syncEnd);
-        EventIt encEnd    = FindEndOfPreviosDurationEvent(syncBegin);
-        EventIt encBegin  = FindBeginningOfDurationEvent(encEnd);
-
-        if (encBegin == Log.end() || encBegin->ThType != ThreadType::ENC) {
-            NumOfErrors++;
-            continue;
-        }
-
-        EncLatency[encBegin->ThID].push_back(
-            TimeInterval(encBegin->TS, syncEnd->TS - encBegin->TS));
-    }
-}
-
 void SMTTracer::SaveLatency(LatencyType type,
                             mfxU32 FileID,
                             std::map<mfxU32, std::vector<TimeInterval>>& latency) {
@@ -352,86 +624,293 @@ void SMTTracer::SaveLatency(LatencyType type,
     trace_file.close();
 }
 
-SMTTracer::EventIt SMTTracer::FindBeginningOfDependencyChain(EventIt it) {
-    //"it" should point to the end of duration event
-    if (it == Log.begin() || it == Log.end() || it->EvType != EventType::DurationEnd) {
-        return Log.end();
+void SMTTracer::AddFlowEvent(const Event a, const Event b) {
+    if (a.EvType != EventType::DurationEnd || b.EvType != EventType::DurationStart) {
+        return;
     }
 
-    for (;;) {
-        it = FindBeginningOfDurationEvent(it);
-        if (it == Log.end() || it->InID == 0)
-            break;
+    Event ev;
+    ev.EvType = EventType::FlowStart;
+    ev.ThType = a.ThType;
+    ev.ThID   = a.ThID;
+    ev.EvID   = ++EvID;
+    ev.TS     = a.TS;
+    FlowLog.push_back(ev);
 
-        it = FindEndOfPreviosDurationEvent(it);
-        if (it == Log.end())
-            break;
-    }
+    ev.EvType = EventType::FlowEnd;
+    ev.ThType = b.ThType;
+    ev.ThID   = b.ThID;
+    ev.EvID   = EvID;
+    ev.TS     = b.TS;
 
-    return it;
+    FlowLog.push_back(ev);
 }
 
-SMTTracer::EventIt SMTTracer::FindBeginningOfDurationEvent(EventIt it) {
-    //"it" should point to the end of duration event
-    if (it == Log.begin() || it == Log.end() || it->EvType != EventType::DurationEnd) {
-        return Log.end();
+void SMTTracer::WritePerfettoHeader() {
+    //timestamps of the sequence are deltas in microseconds, tracer creation is the base
+    ProtoEncoder clock, snapshot, defaults;
+    clock.AddVarint(CLOCK_ID, BUILTIN_CLOCK_MONOTONIC);
+    clock.AddVarint(CLOCK_TIMESTAMP, TimeBase * 1000);
+    snapshot.AddMessage(CLOCK_SNAPSHOT_CLOCKS, clock);
+    clock.Clear();
+    clock.AddVarint(CLOCK_ID, SEQUENCE_CLOCK);
+    clock.AddVarint(CLOCK_TIMESTAMP, TimeBase);
+    clock.AddVarint(CLOCK_IS_INCREMENTAL, 1);
+    clock.AddVarint(CLOCK_UNIT_MULTIPLIER_NS, 1000);
+    snapshot.AddMessage(CLOCK_SNAPSHOT_CLOCKS, clock);
+    defaults.AddVarint(DEFAULTS_TIMESTAMP_CLOCK_ID, SEQUENCE_CLOCK);
+
+    Packet.Clear();
+    Packet.AddMessage(PACKET_CLOCK_SNAPSHOT, snapshot);
+    Packet.AddVarint(PACKET_SEQUENCE_FLAGS, SEQ_INCREMENTAL_STATE_CLEARED);
+    Packet.AddMessage(PACKET_DEFAULTS, defaults);
+    WritePerfettoPacket();
+    LastPacketTS = TimeBase;
+
+    //all threads and counters are tracks of one process
+    ProtoEncoder process, track;
+    process.AddVarint(PROCESS_PID, PERFETTO_PID);
+    process.AddString(PROCESS_NAME, "smt");
+    track.AddVarint(TRACK_UUID, PERFETTO_PROCESS_TRACK);
+    track.AddMessage(TRACK_PROCESS, process);
+
+    Packet.Clear();
+    Packet.AddMessage(PACKET_TRACK_DESCRIPTOR, track);
+    WritePerfettoPacket();
+}
+
+void SMTTracer::WritePerfettoChunk() {
+    //Flow begins at the end of producer and terminates at the beginning of consumer. Producer may
+    //have been written with one of the previous chunks in streaming mode, then flow begins at
+    //instant event.
+    std::multimap<std::tuple<EventType, ThreadType, mfxU32, mfxU64>, const Event*> flows;
+    for (const Event& ev : FlowLog) {
+        EventType type =
+            ev.EvType == EventType::FlowStart ? EventType::DurationEnd : EventType::DurationStart;
+        flows.emplace(std::make_tuple(type, ev.ThType, ev.ThID, ev.TS), &ev);
     }
 
-    EventIt itc = it;
-    for (; itc != Log.begin();) {
-        --itc;
-        if (itc->EvType == EventType::DurationStart && itc->ThType == it->ThType &&
-            itc->ThID == it->ThID && itc->Name == it->Name) {
-            return itc;
+    std::vector<mfxU64> flowIDs;
+    for (const Event& ev : Chunk) {
+        flowIDs.clear();
+        auto range = flows.equal_range(std::make_tuple(ev.EvType, ev.ThType, ev.ThID, ev.TS));
+        for (auto it = range.first; it != range.second; it++) {
+            flowIDs.push_back(it->second->EvID);
         }
+        flows.erase(range.first, range.second);
+
+        WritePerfettoEvent(ev, flowIDs, ev.EvType == EventType::DurationStart);
     }
 
-    return Log.end();
+    for (const auto& flow : flows) {
+        flowIDs.assign(1, flow.second->EvID);
+        WritePerfettoEvent(*flow.second, flowIDs, flow.second->EvType == EventType::FlowEnd);
+    }
 }
 
-SMTTracer::EventIt SMTTracer::FindEndOfPreviosDurationEvent(EventIt it) {
-    //"it" should point to the beginnig of duration event
-    if (it == Log.begin() || it == Log.end() || it->EvType != EventType::DurationStart) {
-        return Log.end();
+void SMTTracer::WritePerfettoEvent(const Event ev,
+                                   const std::vector<mfxU64>& flowIDs,
+                                   bool terminating) {
+    TrackEvent.Clear();
+    switch (ev.EvType) {
+        case EventType::DurationStart:
+            TrackEvent.AddVarint(EVENT_TYPE, TYPE_SLICE_BEGIN);
+            TrackEvent.AddVarint(EVENT_TRACK_UUID, GetPerfettoTrack(GetThreadName(ev), false));
+            TrackEvent.AddVarint(EVENT_NAME_IID,
+                                 GetPerfettoName(GetEventName(ev), INTERNED_EVENT_NAMES));
+            for (const auto& id : { std::make_pair("InID", ev.InID),
+                                    std::make_pair("OutID", ev.OutID) }) {
+                ProtoEncoder annotation;
+                annotation.AddVarint(ANNOTATION_NAME_IID,
+                                     GetPerfettoName(id.first, INTERNED_ANNOTATION_NAMES));
+                annotation.AddVarint(ANNOTATION_UINT_VALUE, id.second);
+                TrackEvent.AddMessage(EVENT_DEBUG_ANNOTATIONS, annotation);
+            }
+            break;
+        case EventType::DurationEnd:
+            TrackEvent.AddVarint(EVENT_TYPE, TYPE_SLICE_END);
+            TrackEvent.AddVarint(EVENT_TRACK_UUID, GetPerfettoTrack(GetThreadName(ev), false));
+            break;
+        case EventType::FlowStart:
+        case EventType::FlowEnd:
+            TrackEvent.AddVarint(EVENT_TYPE, TYPE_INSTANT);
+            TrackEvent.AddVarint(EVENT_TRACK_UUID, GetPerfettoTrack(GetThreadName(ev), false));
+            TrackEvent.AddVarint(EVENT_NAME_IID,
+                                 GetPerfettoName(GetEventName(ev), INTERNED_EVENT_NAMES));
+            break;
+        case EventType::Counter:
+            TrackEvent.AddVarint(EVENT_TYPE, TYPE_COUNTER);
+            TrackEvent.AddVarint(EVENT_TRACK_UUID, GetPerfettoTrack(GetEventName(ev), true));
+            TrackEvent.AddVarint(EVENT_COUNTER_VALUE, ev.InID);
+            break;
+        default:
+            return;
+    }
+
+    for (mfxU64 id : flowIDs) {
+        TrackEvent.AddFixed64(terminating ? EVENT_TERMINATING_FLOW_IDS : EVENT_FLOW_IDS, id);
     }
 
-    EventIt itc = it;
-    for (; itc != Log.begin();) {
-        --itc;
-        if (itc->EvType == EventType::DurationEnd && itc->OutID == it->InID &&
-            (TypeOfPipeline == PipelineType::_1xN || itc->ThID == it->ThID)) {
-            return itc;
-        }
+    Packet.Clear();
+    if (ev.TS >= LastPacketTS) {
+        Packet.AddVarint(PACKET_TIMESTAMP, ev.TS - LastPacketTS);
+        LastPacketTS = ev.TS;
     }
-    return Log.end();
+    else {
+        //event is late for the sequence, e.g. it has been added while previous chunk was written,
+        //so absolute time is used instead of delta
+        Packet.AddVarint(PACKET_TIMESTAMP, ev.TS * 1000);
+        Packet.AddVarint(PACKET_TIMESTAMP_CLOCK_ID, BUILTIN_CLOCK_MONOTONIC);
+    }
+    Packet.AddMessage(PACKET_TRACK_EVENT, TrackEvent);
+    if (!InternedData.IsEmpty()) {
+        Packet.AddMessage(PACKET_INTERNED_DATA, InternedData);
+        InternedData.Clear();
+    }
+    Packet.AddVarint(PACKET_SEQUENCE_FLAGS, SEQ_NEEDS_INCREMENTAL_STATE);
+    WritePerfettoPacket();
 }
 
-SMTTracer::EventIt SMTTracer::FindEventInThread(EventIt first, EventType type) {
-    return std::find_if(first, Log.end(), [&first, &type](Event ev) {
-        return ev.EvType == type && first->ThType == ev.ThType && first->ThID == ev.ThID;
-    });
+void SMTTracer::WritePerfettoPacket() {
+    Packet.AddVarint(PACKET_SEQUENCE_ID, PERFETTO_SEQUENCE_ID);
+
+    ProtoEncoder trace;
+    trace.AddMessage(TRACE_PACKET, Packet);
+    TraceFile.write(trace.GetData().data(), trace.GetData().size());
 }
 
-void SMTTracer::AddFlowEvent(const Event a, const Event b) {
-    if (a.EvType != EventType::DurationEnd || b.EvType != EventType::DurationStart) {
-        return;
+mfxU64 SMTTracer::GetPerfettoTrack(const std::string& name, bool counter) {
+    auto it = PerfettoTracks.find(name);
+    if (it != PerfettoTracks.end()) {
+        return it->second;
     }
 
-    Event ev;
-    ev.EvType = EventType::FlowStart;
-    ev.ThType = a.ThType;
-    ev.ThID   = a.ThID;
-    ev.EvID   = ++EvID;
-    ev.TS     = a.TS;
-    AddonLog.push_back(ev);
+    //track is described once, before its first event
+    mfxU64 uuid          = PERFETTO_PROCESS_TRACK + PerfettoTracks.size() + 1;
+    PerfettoTracks[name] = uuid;
 
-    ev.EvType = EventType::FlowEnd;
-    ev.ThType = b.ThType;
-    ev.ThID   = b.ThID;
-    ev.EvID   = EvID;
-    ev.TS     = b.TS;
+    ProtoEncoder track;
+    track.AddVarint(TRACK_UUID, uuid);
+    track.AddVarint(TRACK_PARENT_UUID, PERFETTO_PROCESS_TRACK);
+    track.AddString(TRACK_NAME, name);
+    if (counter) {
+        track.AddMessage(TRACK_COUNTER, ProtoEncoder());
+    }
+
+    Packet.Clear();
+    Packet.AddMessage(PACKET_TRACK_DESCRIPTOR, track);
+    WritePerfettoPacket();
+    return uuid;
+}
+
+mfxU64 SMTTracer::GetPerfettoName(const std::string& name, mfxU32 type) {
+    //names are interned, full name is written with the first event which uses it
+    std::map<std::string, mfxU64>& names =
+        PerfettoNames[type == INTERNED_EVENT_NAMES ? 0 : 1];
+    auto it = names.find(name);
+    if (it != names.end()) {
+        return it->second;
+    }
+
+    mfxU64 iid  = names.size() + 1;
+    names[name] = iid;
+
+    ProtoEncoder entry;
+    entry.AddVarint(INTERNED_IID, iid);
+    entry.AddString(INTERNED_NAME, name);
+    InternedData.AddMessage(type, entry);
+    return iid;
+}
+
+std::string SMTTracer::GetThreadName(const Event ev) {
+    std::string name;
+    switch (ev.ThType) {
+        case ThreadType::DEC:
+            name = "dec" + std::to_string(ev.ThID);
+            break;
+        case ThreadType::VPP:
+            name = "enc" + std::to_string(ev.ThID); //it puts VPP events in enc thread
+            break;
+        case ThreadType::ENC:
+            name = "enc" + std::to_string(ev.ThID);
+            break;
+        case ThreadType::CSVPP:
+            name = "vpp" + std::to_string(ev.ThID);
+            break;
+        default:
+            name = "unknown";
+            break;
+    }
+    return name;
+}
 
-    AddonLog.push_back(ev);
+std::string SMTTracer::GetEventName(const Event ev) {
+    std::string name;
+    if (ev.EvType == EventType::FlowStart || ev.EvType == EventType::FlowEnd) {
+        name = "link";
+    }
+    else if (ev.EvType == EventType::Counter) {
+        switch (ev.ThType) {
+            case ThreadType::DEC:
+                name = "dec_pool" + std::to_string(ev.ThID);
+                break;
+            case ThreadType::VPP:
+                name = "enc_pool" + std::to_string(ev.ThID);
+                break;
+            case ThreadType::ENC:
+                name = "enc_pool" + std::to_string(ev.ThID);
+                break;
+            case ThreadType::CSVPP:
+                name = "vpp_pool" + std::to_string(ev.ThID);
+                break;
+            default:
+                name = "unknown";
+                break;
+        }
+    }
+    else if (ev.Name != EventName::UNDEF) {
+        switch (ev.Name) {
+            case EventName::BUSY:
+                name = "busy";
+                break;
+            case EventName::SYNC:
+                name = "syncp";
+                break;
+            case EventName::READ_YUV:
+            case EventName::READ_BS:
+                name = "read";
+                break;
+            case EventName::WRITE_BS:
+                name = "write";
+                break;
+            case EventName::SURF_WAIT:
+                name = "wait";
+                break;
+            default:
+                name = "unknown";
+                break;
+        }
+    }
+    else {
+        switch (ev.ThType) {
+            case ThreadType::DEC:
+                name = "dec";
+                break;
+            case ThreadType::VPP:
+                name = "vpp";
+                break;
+            case ThreadType::ENC:
+                name = "enc";
+                break;
+            case ThreadType::CSVPP:
+                name = "csvpp";
+                break;
+            default:
+                name = "unknown";
+                break;
+        }
+    }
+    return name;
 }
 
 void SMTTracer::WriteEvent(std::ofstream& trace_file, const Event ev) {
@@ -464,7 +943,7 @@ void SMTTracer::WriteDurationEvent(std::ofstream& trace_file, const Event ev) {
     WriteEventName(trace_file, ev);
     WriteComma(trace_file);
     WriteEventInOutIDs(trace_file, ev);
-    trace_file << "}," << std::endl;
+    trace_file << "},\n";
 }
 
 void SMTTracer::WriteFlowEvent(std::ofstream& trace_file, const Event ev) {
@@ -484,7 +963,7 @@ void SMTTracer::WriteFlowEvent(std::ofstream& trace_file, const Event ev) {
     WriteEventCategory(trace_file);
     WriteComma(trace_file);
     WriteEvID(trace_file, ev);
-    trace_file << "}," << std::endl;
+    trace_file << "},\n";
 }
 
 void SMTTracer::WriteCounterEvent(std::ofstream& trace_file, const Event ev) {
@@ -500,7 +979,7 @@ void SMTTracer::WriteCounterEvent(std::ofstream& trace_file, const Event ev) {
     WriteEventName(trace_file, ev);
     WriteComma(trace_file);
     WriteEventCounter(trace_file, ev);
-    trace_file << "}," << std::endl;
+    trace_file << "},\n";
 }
 
 void SMTTracer::WriteEventPID(std::ofstream& trace_file) {
@@ -508,25 +987,7 @@ void SMTTracer::WriteEventPID(std::ofstream& trace_file) {
 }
 
 void SMTTracer::WriteEventTID(std::ofstream& trace_file, const Event ev) {
-    trace_file << "\"tid\":\"";
-    switch (ev.ThType) {
-        case ThreadType::DEC:
-            trace_file << "dec" << ev.ThID;
-            break;
-        case ThreadType::VPP:
-            trace_file << "enc" << ev.ThID; //it puts VPP events in enc thread
-            break;
-        case ThreadType::ENC:
-            trace_file << "enc" << ev.ThID;
-            break;
-        case ThreadType::CSVPP:
-            trace_file << "vpp" << ev.ThID;
-            break;
-        default:
-            trace_file << "unknown";
-            break;
-    }
-    trace_file << "\"";
+    trace_file << "\"tid\":\"" << GetThreadName(ev) << "\"";
 }
 
 void SMTTracer::WriteEventTS(std::ofstream& trace_file, const Event ev) {
@@ -560,72 +1021,7 @@ void SMTTracer::WriteEventPhase(std::ofstream& trace_file, const Event ev) {
 }
 
 void SMTTracer::WriteEventName(std::ofstream& trace_file, const Event ev) {
-    trace_file << "\"name\":\"";
-    if (ev.EvType == EventType::FlowStart || ev.EvType == EventType::FlowEnd) {
-        trace_file << "link";
-    }
-    else if (ev.EvType == EventType::Counter) {
-        switch (ev.ThType) {
-            case ThreadType::DEC:
-                trace_file << "dec_pool" << ev.ThID;
-                break;
-            case ThreadType::VPP:
-                trace_file << "enc_pool" << ev.ThID;
-                break;
-            case ThreadType::ENC:
-                trace_file << "enc_pool" << ev.ThID;
-                break;
-            case ThreadType::CSVPP:
-                trace_file << "vpp_pool" << ev.ThID;
-                break;
-            default:
-                trace_file << "unknown";
-                break;
-        }
-    }
-    else if (ev.Name != EventName::UNDEF) {
-        switch (ev.Name) {
-            case EventName::BUSY:
-                trace_file << "busy";
-                break;
-            case EventName::SYNC:
-                trace_file << "syncp";
-                break;
-            case EventName::READ_YUV:
-            case EventName::READ_BS:
-                trace_file << "read";
-                break;
-            case EventName::WRITE_BS:
-                trace_file << "write";
-                break;
-            case EventName::SURF_WAIT:
-                trace_file << "wait";
-                break;
-            default:
-                trace_file << "unknown";
-                break;
-        }
-    }
-    else {
-        switch (ev.ThType) {
-            case ThreadType::DEC:
-                trace_file << "dec";
-                break;
-            case ThreadType::VPP:
-                trace_file << "vpp";
-                break;
-            case ThreadType::ENC:
-                trace_file << "enc";
-                break;
-            case ThreadType::CSVPP:
-                trace_file << "csvpp";
-                break;
-            default:
-                trace_file << "unknown";
-                break;
-        }
-    }
-    trace_file << "\"";
+    trace_file << "\"name\":\"" << GetEventName(ev) << "\"";
 }
 
 void SMTTracer::WriteBindingPoint(std::ofstream& trace_file, const Event ev) {
@@ -4,7 +4,22 @@
   # SPDX-License-Identifier: MIT
   ############################################################################*/
 
+#include <cstddef>
+#include <filesystem>
+#include <new>
+#include <random>
 #include <regex>
+#include <set>
+#if !defined(_WIN32) && !defined(_WIN64)
+    #include <sched.h>
+    #include <sys/socket.h>
+    #include <sys/un.h>
+    #include <unistd.h>
+#endif
+#include "au_index.h"
+#include "avc_bitstream.h"
+#include "avc_nal_spl.h"
+#include "mfx_buffering.h"
 #include "gtest/gtest.h"
 #include "sample_defs.h"
 #include "sample_multi_transcode.h"
@@ -85,7 +100,9 @@ init_result init_no_extras(std::vector<std::string> opts,
     for (auto& opt : opts) {
         args.push_back(&opt[0]);
     }
-    return init((int)args.size(), &args[0], cmd_override);
+    // argv of main is terminated by null pointer
+    args.push_back(nullptr);
+    return init((int)args.size() - 1, &args[0], cmd_override);
 }
 
 init_result init_session(std::vector<std::string> opts,
@@ -99,7 +116,9 @@ init_result init_session(std::vector<std::string> opts,
     for (auto& opt : opts) {
         args.push_back(&opt[0]);
     }
-    return init((int)args.size(), &args[0], cmd_override);
+    // argv of main is terminated by null pointer
+    args.push_back(nullptr);
+    return init((int)args.size() - 1, &args[0], cmd_override);
 }
 
 init_result init(std::vector<std::string> opts,
@@ -109,7 +128,9 @@ init_result init(std::vector<std::string> opts,
     for (auto& opt : opts) {
         args.push_back(&opt[0]);
     }
-    return init((int)args.size(), &args[0], cmd_override);
+    // argv of main is terminated by null pointer
+    args.push_back(nullptr);
+    return init((int)args.size() - 1, &args[0], cmd_override);
 }
 
 TEST(Transcode_CLI, build_env) {
@@ -161,11 +182,17 @@ TEST(Transcode_CLI, TrivialSessionOptions) {
     EXPECT_EQ(result.status, MFX_ERR_NONE);
     EXPECT_EQ(result.parsed[0].TargetID, 0);
     EXPECT_EQ(result.parsed[0].CascadeScaler, false);
+    EXPECT_EQ(result.parsed[0].CascadeScalerAuto, false);
     EXPECT_EQ(result.parsed[0].EnableTracing, false);
     EXPECT_EQ(result.parsed[0].TraceBufferSize, 0);
+    EXPECT_EQ(result.parsed[0].TraceStreaming, false);
+    EXPECT_EQ(result.parsed[0].TraceFormat, TranscodingSample::SMTTracer::TraceFormat::JSON);
     EXPECT_EQ(result.parsed[0].LatencyType, TranscodingSample::SMTTracer::LatencyType::DEFAULT);
     EXPECT_EQ(result.parsed[0].ParallelEncoding, false);
+    EXPECT_EQ(result.parsed[0].nSegments, 0);
+    EXPECT_EQ(result.parsed[0].nSegmentOverlap, 0);
     EXPECT_EQ(result.parsed[0].bIsJoin, false);
+    EXPECT_EQ(result.parsed[0].bPrivateDecoder, false);
     EXPECT_EQ(result.parsed[0].priority, MFX_PRIORITY_NORMAL);
 #if defined(_WIN32) || defined(_WIN64)
     EXPECT_EQ(result.parsed[0].libType, MFX_IMPL_HARDWARE_ANY | MFX_IMPL_VIA_D3D11);
@@ -347,7 +374,14 @@ TEST(Transcode_CLI, TrivialSessionOptions) {
     EXPECT_EQ(result.parsed[0].EncoderFourCC, 0);
     EXPECT_EQ(result.parsed[0].pVppCompDstRects, nullptr);
     EXPECT_EQ(result.parsed[0].bForceSysMem, false);
+    EXPECT_EQ(result.parsed[0].bSysMemHugePages, false);
+    EXPECT_EQ(result.parsed[0].nSysMemNumaNode, SYSMEM_NUMA_NODE_ANY);
+    EXPECT_EQ(result.parsed[0].nPoolAutoTuneFrames, 0);
+    EXPECT_EQ(result.parsed[0].nSchedulerThreads, 0);
+    EXPECT_TRUE(result.parsed[0].CpuAffinity.empty());
+    EXPECT_EQ(result.parsed[0].nNumaNode, TranscodingSample::SESSION_NUMA_NODE_ANY);
     EXPECT_EQ(result.parsed[0].DecOutPattern, 0);
+    EXPECT_EQ(result.parsed[0].bDecCompleteFrame, false);
     EXPECT_EQ(result.parsed[0].VppOutPattern, 0);
     EXPECT_EQ(result.parsed[0].nGpuCopyMode, 0);
     EXPECT_EQ(result.parsed[0].nRenderColorForamt, 0);
@@ -771,4 +805,2220 @@ TEST(Transcode_CLI, OptionRobustSoft) {
     auto result = init_session({ "-robust:soft" });
     EXPECT_EQ(result.status, MFX_ERR_NONE);
     EXPECT_EQ(result.parsed[0].bSoftRobustFlag, true);
-}
\ No newline at end of file
+}
+
+TEST(Transcode_CLI, OptionDecCompleteFrame) {
+    auto result = init_session({ "-dec::complete_frame" });
+    EXPECT_EQ(result.status, MFX_ERR_NONE);
+    EXPECT_EQ(result.parsed[0].bDecCompleteFrame, true);
+}
+
+TEST(Transcode_CLI, OptionHugePages) {
+    auto result = init_session({ "-huge_pages" });
+    EXPECT_EQ(result.status, MFX_ERR_NONE);
+    EXPECT_EQ(result.parsed[0].bSysMemHugePages, true);
+}
+
+TEST(Transcode_CLI, OptionMemNumaNode) {
+    auto result = init_session({ "-mem_numa_node", "1" });
+    EXPECT_EQ(result.status, MFX_ERR_NONE);
+    EXPECT_EQ(result.parsed[0].nSysMemNumaNode, 1);
+
+    result = init_session({ "-mem_numa_node", "local" });
+    EXPECT_EQ(result.status, MFX_ERR_NONE);
+    EXPECT_EQ(result.parsed[0].nSysMemNumaNode, SYSMEM_NUMA_NODE_LOCAL);
+
+    result = init_session({ "-mem_numa_node", "-1" });
+    EXPECT_EQ(result.status, MFX_ERR_UNSUPPORTED);
+
+    result = init_session({ "-mem_numa_node" });
+    EXPECT_EQ(result.status, MFX_ERR_UNSUPPORTED);
+}
+
+TEST(Transcode_CLI, OptionMemModes) {
+    auto result = init_session({});
+    EXPECT_EQ(result.status, MFX_ERR_NONE);
+    EXPECT_EQ(result.parsed[0].bSysMemSlab, false);
+    EXPECT_EQ(result.parsed[0].bSysMemPool, false);
+    EXPECT_EQ(result.parsed[0].bSysMemZeroInit, false);
+
+    result = init_session({ "-mem_slab", "-mem_pool", "-mem_zero" });
+    EXPECT_EQ(result.status, MFX_ERR_NONE);
+    EXPECT_EQ(result.parsed[0].bSysMemSlab, true);
+    EXPECT_EQ(result.parsed[0].bSysMemPool, true);
+    EXPECT_EQ(result.parsed[0].bSysMemZeroInit, true);
+}
+
+TEST(Transcode_CLI, OptionPoolAutoTune) {
+    auto result = init_session({ "-pool_autotune", "120" });
+    EXPECT_EQ(result.status, MFX_ERR_NONE);
+    EXPECT_EQ(result.parsed[0].nPoolAutoTuneFrames, 120);
+
+    result = init_session({ "-pool_autotune", "0" });
+    EXPECT_EQ(result.status, MFX_ERR_UNSUPPORTED);
+
+    result = init_session({ "-pool_autotune" });
+    EXPECT_EQ(result.status, MFX_ERR_UNSUPPORTED);
+}
+
+TEST(Transcode_CLI, OptionSchedPool) {
+    auto result = init_session({ "-sched_pool", "4" });
+    EXPECT_EQ(result.status, MFX_ERR_NONE);
+    EXPECT_EQ(result.parsed[0].nSchedulerThreads, 4);
+
+    result = init_session({ "-sched_pool", "0" });
+    EXPECT_EQ(result.status, MFX_ERR_UNSUPPORTED);
+
+    result = init_session({ "-sched_pool" });
+    EXPECT_EQ(result.status, MFX_ERR_UNSUPPORTED);
+}
+
+TEST(Transcode_CLI, OptionAffinity) {
+    auto result = init_session({ "-affinity", "8,0-3,2" });
+    EXPECT_EQ(result.status, MFX_ERR_NONE);
+    EXPECT_EQ(result.parsed[0].CpuAffinity, std::vector<mfxU32>({ 0, 1, 2, 3, 8 }));
+    EXPECT_EQ(CpuListToString(result.parsed[0].CpuAffinity), "0-3,8");
+
+    result = init_session({ "-affinity", "3-1" });
+    EXPECT_EQ(result.status, MFX_ERR_UNSUPPORTED);
+
+    result = init_session({ "-affinity", "0,,1" });
+    EXPECT_EQ(result.status, MFX_ERR_UNSUPPORTED);
+
+#if !defined(_WIN32) && !defined(_WIN64)
+    //CPU which doesn't fit into cpu_set_t
+    result = init_session({ "-affinity", std::to_string(CPU_SETSIZE - 1) });
+    EXPECT_EQ(result.status, MFX_ERR_NONE);
+    result = init_session({ "-affinity", "0-" + std::to_string(CPU_SETSIZE) });
+    EXPECT_EQ(result.status, MFX_ERR_UNSUPPORTED);
+#endif
+
+    result = init_session({ "-affinity" });
+    EXPECT_EQ(result.status, MFX_ERR_UNSUPPORTED);
+}
+
+TEST(Transcode_CLI, OptionNumaNode) {
+    auto result = init_session({ "-numa_node", "1" });
+    EXPECT_EQ(result.status, MFX_ERR_NONE);
+    EXPECT_EQ(result.parsed[0].nNumaNode, 1);
+
+    result = init_session({ "-numa_node", "spread" });
+    EXPECT_EQ(result.status, MFX_ERR_NONE);
+    EXPECT_EQ(result.parsed[0].nNumaNode, TranscodingSample::SESSION_NUMA_NODE_SPREAD);
+
+    result = init_session({ "-numa_node", "-1" });
+    EXPECT_EQ(result.status, MFX_ERR_UNSUPPORTED);
+
+    result = init_session({ "-numa_node" });
+    EXPECT_EQ(result.status, MFX_ERR_UNSUPPORTED);
+}
+
+TEST(Transcode_CLI, OptionTraceStream) {
+    auto result = init_session({ "-trace::stream", "-trace_buffer_size", "16" });
+    EXPECT_EQ(result.status, MFX_ERR_NONE);
+    EXPECT_EQ(result.parsed[0].EnableTracing, true);
+    EXPECT_EQ(result.parsed[0].TraceStreaming, true);
+    EXPECT_EQ(result.parsed[0].TraceBufferSize, 16);
+}
+
+TEST(Transcode_CLI, OptionTracePerfetto) {
+    auto result = init_session({ "-trace::perfetto" });
+    EXPECT_EQ(result.status, MFX_ERR_NONE);
+    EXPECT_EQ(result.parsed[0].EnableTracing, true);
+    EXPECT_EQ(result.parsed[0].TraceFormat,
+              TranscodingSample::SMTTracer::TraceFormat::PERFETTO);
+}
+
+TEST(Transcode_CLI, OptionSegments) {
+    auto result = init_session({ "-segments", "4", "-segment_overlap", "16" });
+    EXPECT_EQ(result.status, MFX_ERR_NONE);
+    EXPECT_EQ(result.parsed[0].nSegments, 4);
+    EXPECT_EQ(result.parsed[0].nSegmentOverlap, 16);
+
+    result = init_session({ "-segments" });
+    EXPECT_EQ(result.status, MFX_ERR_UNSUPPORTED);
+
+    result = init_session({ "-segment_overlap", "x" });
+    EXPECT_EQ(result.status, MFX_ERR_UNSUPPORTED);
+}
+
+TEST(Transcode_CLI, OptionSeekFrame) {
+    auto result = init_session({ "-seek_frame", "120" });
+    EXPECT_EQ(result.status, MFX_ERR_NONE);
+    EXPECT_EQ(result.parsed[0].nSeekFrame, 120);
+
+    result = init_session({ "-seek_frame" });
+    EXPECT_EQ(result.status, MFX_ERR_UNSUPPORTED);
+
+    result = init_session({ "-seek_frame", "x" });
+    EXPECT_EQ(result.status, MFX_ERR_UNSUPPORTED);
+}
+
+TEST(Transcode_CLI, OptionCascadeScalerAuto) {
+    auto result = init_session({ "-cs::auto" });
+    EXPECT_EQ(result.status, MFX_ERR_NONE);
+    EXPECT_EQ(result.parsed[0].CascadeScalerAuto, true);
+    EXPECT_EQ(result.parsed[0].CascadeScaler, false);
+}
+
+TEST(Transcode_CLI, OptionDecPrivate) {
+    auto result = init_session({ "-dec::private" });
+    EXPECT_EQ(result.status, MFX_ERR_NONE);
+    EXPECT_EQ(result.parsed[0].bPrivateDecoder, true);
+}
+
+TEST(Transcode_CLI, OptionParFileLines) {
+    const char* fileName = "smt_lines_test.par";
+    {
+        std::ofstream file(fileName);
+        file << "-i::h264 in_file -o::h265 out_file\n"
+             << "\n"
+             << "-i::h264 in_file -o::h265 out_file2\n";
+    }
+
+    //sessions remember their lines, empty ones are counted too
+    auto result = init({ "-par", fileName });
+    std::remove(fileName);
+    EXPECT_EQ(result.status, MFX_ERR_NONE);
+    ASSERT_EQ(result.parsed.size(), 2u);
+    EXPECT_EQ(result.parsed[0].nParFileLine, 1u);
+    EXPECT_EQ(result.parsed[1].nParFileLine, 3u);
+
+    result = init_session({});
+    ASSERT_EQ(result.parsed.size(), 1u);
+    EXPECT_EQ(result.parsed[0].nParFileLine, 0u);
+}
+
+TEST(Transcode_CLI, OptionControl) {
+    TranscodingSample::CmdProcessor cmd;
+    auto result = init({ "-control", "smt.sock", "-i::h264", "in_file", "-o::h265", "out_file" },
+                       &cmd);
+    EXPECT_EQ(result.status, MFX_ERR_NONE);
+    EXPECT_EQ(cmd.GetControlSocket(), "smt.sock");
+
+    // session sent by "add" command is parsed as a line of par file
+    TranscodingSample::CmdProcessor session;
+    EXPECT_EQ(session.ParseSessionLine("-i::h264 in_file -o::h265 out_file -n 10"),
+              MFX_ERR_NONE);
+    TranscodingSample::sInputParams par;
+    EXPECT_TRUE(session.GetNextSessionParams(par));
+    EXPECT_EQ(par.MaxFrameNumber, 10);
+    EXPECT_EQ(session.ParseSessionLine(""), MFX_ERR_UNSUPPORTED);
+}
+
+// exposes surface pool of decoder to check auto-tune decisions without a session
+class TestPipeline : public TranscodingSample::CTranscodingPipeline {
+public:
+    mfxStatus AllocDecPool(MFXFrameAllocator* pAllocator, mfxU16 numSurfaces, mfxU32 tuneFrames) {
+        m_pMFXAllocator       = pAllocator;
+        m_MemoryModel         = TranscodingSample::GENERAL_ALLOC;
+        m_nPoolAutoTuneFrames = tuneFrames;
+
+        mfxFrameAllocRequest request = {};
+        request.Info.FourCC          = MFX_FOURCC_NV12;
+        request.Info.ChromaFormat    = MFX_CHROMAFORMAT_YUV420;
+        request.Info.Width           = 64;
+        request.Info.Height          = 64;
+        request.Type = MFX_MEMTYPE_SYSTEM_MEMORY | MFX_MEMTYPE_FROM_DECODE |
+                       MFX_MEMTYPE_EXTERNAL_FRAME;
+        request.NumFrameSuggested = numSurfaces;
+        return AllocFrames(&request, true);
+    }
+
+    // hands out surfaces, at most inFlight of them are locked at once
+    void Run(mfxU32 numFrames, size_t inFlight) {
+        std::deque<mfxFrameSurface1*> locked;
+        for (mfxU32 i = 0; i < numFrames; i++) {
+            mfxFrameSurface1* pSurf = m_DecSurfaceTracker.GetSurface(0);
+            ASSERT_NE(pSurf, nullptr);
+            pSurf->Data.Locked = 1;
+            locked.push_back(pSurf);
+            if (locked.size() == inFlight) {
+                locked.front()->Data.Locked = 0;
+                locked.pop_front();
+            }
+        }
+        for (auto pSurf : locked) {
+            pSurf->Data.Locked = 0;
+        }
+    }
+
+    using CTranscodingPipeline::m_DecSurfaceTracker;
+    using CTranscodingPipeline::m_pSurfaceDecPool;
+    using CTranscodingPipeline::TuneSurfacePool;
+    using CTranscodingPipeline::IsSurfaceWaitNeeded;
+    using CTranscodingPipeline::m_TranscodeLoop;
+};
+
+// heap allocations of the current thread, lets tests check that a code path doesn't allocate
+static thread_local size_t g_numOfAllocations = 0;
+
+// every replaced form goes through these two, they are kept out of line so that an inlined
+// free() isn't matched against operator new by -Wmismatched-new-delete
+#if defined(_MSC_VER)
+    #define TEST_NOINLINE __declspec(noinline)
+#else
+    #define TEST_NOINLINE __attribute__((noinline))
+#endif
+
+static TEST_NOINLINE void* CountedAlloc(size_t size, size_t alignment) noexcept {
+    g_numOfAllocations++;
+    size = size ? size : 1;
+#if defined(_WIN32) || defined(_WIN64)
+    return _aligned_malloc(size, std::max(alignment, alignof(std::max_align_t)));
+#else
+    if (alignment <= alignof(std::max_align_t))
+        return malloc(size);
+    //aligned_alloc wants the size to be a multiple of the alignment
+    return aligned_alloc(alignment, (size + alignment - 1) / alignment * alignment);
+#endif
+}
+
+static TEST_NOINLINE void CountedFree(void* ptr) noexcept {
+#if defined(_WIN32) || defined(_WIN64)
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+}
+
+static void* CountedAllocOrThrow(size_t size, size_t alignment) {
+    if (void* ptr = CountedAlloc(size, alignment))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void* operator new(size_t size) {
+    return CountedAllocOrThrow(size, 0);
+}
+void* operator new[](size_t size) {
+    return CountedAllocOrThrow(size, 0);
+}
+void* operator new(size_t size, std::align_val_t al) {
+    return CountedAllocOrThrow(size, (size_t)al);
+}
+void* operator new[](size_t size, std::align_val_t al) {
+    return CountedAllocOrThrow(size, (size_t)al);
+}
+void* operator new(size_t size, const std::nothrow_t&) noexcept {
+    return CountedAlloc(size, 0);
+}
+void* operator new[](size_t size, const std::nothrow_t&) noexcept {
+    return CountedAlloc(size, 0);
+}
+void* operator new(size_t size, std::align_val_t al, const std::nothrow_t&) noexcept {
+    return CountedAlloc(size, (size_t)al);
+}
+void* operator new[](size_t size, std::align_val_t al, const std::nothrow_t&) noexcept {
+    return CountedAlloc(size, (size_t)al);
+}
+
+void operator delete(void* ptr) noexcept {
+    CountedFree(ptr);
+}
+void operator delete[](void* ptr) noexcept {
+    CountedFree(ptr);
+}
+void operator delete(void* ptr, size_t) noexcept {
+    CountedFree(ptr);
+}
+void operator delete[](void* ptr, size_t) noexcept {
+    CountedFree(ptr);
+}
+void operator delete(void* ptr, std::align_val_t) noexcept {
+    CountedFree(ptr);
+}
+void operator delete[](void* ptr, std::align_val_t) noexcept {
+    CountedFree(ptr);
+}
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept {
+    CountedFree(ptr);
+}
+void operator delete[](void* ptr, size_t, std::align_val_t) noexcept {
+    CountedFree(ptr);
+}
+void operator delete(void* ptr, const std::nothrow_t&) noexcept {
+    CountedFree(ptr);
+}
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept {
+    CountedFree(ptr);
+}
+void operator delete(void* ptr, std::align_val_t, const std::nothrow_t&) noexcept {
+    CountedFree(ptr);
+}
+void operator delete[](void* ptr, std::align_val_t, const std::nothrow_t&) noexcept {
+    CountedFree(ptr);
+}
+
+// attaches numBuffers buffers of given size, every buffer is filled with its index
+static void AddTestBuffers(MfxVideoParamsWrapper& par, mfxU32 numBuffers, mfxU32 size) {
+    for (mfxU32 i = 0; i < numBuffers; i++) {
+        mfxExtBuffer* buf = par.AddExtBuffer(MFX_MAKEFOURCC('T', 'S', 'T', 'A' + i), size);
+        memset(buf + 1, (int)i, size - sizeof(mfxExtBuffer));
+    }
+}
+
+static void CheckTestBuffers(const mfxVideoParam& par, mfxU32 numBuffers, mfxU32 size) {
+    ASSERT_EQ(par.NumExtParam, numBuffers);
+    ASSERT_NE(par.ExtParam, nullptr);
+    for (mfxU32 i = 0; i < numBuffers; i++) {
+        const mfxExtBuffer* buf = par.ExtParam[i];
+        ASSERT_NE(buf, nullptr);
+        EXPECT_EQ(buf->BufferId, MFX_MAKEFOURCC('T', 'S', 'T', 'A' + i));
+        EXPECT_EQ(buf->BufferSz, size);
+        const mfxU8* data = (const mfxU8*)(buf + 1);
+        EXPECT_EQ(std::count(data, data + size - sizeof(mfxExtBuffer), (mfxU8)i),
+                  (std::ptrdiff_t)(size - sizeof(mfxExtBuffer)));
+    }
+}
+
+TEST(Transcode_ExtBufHolder, SpillsToHeap) {
+    //10 buffers of 64 bytes don't fit into 8 inline entries and 256 inline bytes
+    MfxVideoParamsWrapper par;
+    AddTestBuffers(par, 10, 64);
+    CheckTestBuffers(par, 10, 64);
+
+    //the same id isn't attached twice
+    EXPECT_EQ(par.AddExtBuffer(MFX_MAKEFOURCC('T', 'S', 'T', 'A'), 64), par.ExtParam[0]);
+    EXPECT_EQ(par.NumExtParam, 10);
+
+    //buffer bigger than a heap chunk
+    mfxExtBuffer* big = par.AddExtBuffer(MFX_MAKEFOURCC('B', 'I', 'G', ' '), 10000);
+    EXPECT_EQ(big->BufferSz, 10000u);
+    EXPECT_EQ(par.NumExtParam, 11);
+    EXPECT_EQ(par.ExtParam[10], big);
+}
+
+TEST(Transcode_ExtBufHolder, MoveConstruction) {
+    for (mfxU32 numBuffers : { 2, 10 }) {
+        MfxVideoParamsWrapper src;
+        src.AsyncDepth = 3;
+        AddTestBuffers(src, numBuffers, 64);
+
+        MfxVideoParamsWrapper dst(std::move(src));
+        EXPECT_EQ(dst.AsyncDepth, 3);
+        CheckTestBuffers(dst, numBuffers, 64);
+        EXPECT_EQ(src.NumExtParam, 0);
+        EXPECT_EQ(src.ExtParam, nullptr);
+
+        //buffers of the destination don't point into the source
+        for (mfxU32 i = 0; i < numBuffers; i++) {
+            const mfxU8* buf = (const mfxU8*)dst.ExtParam[i];
+            EXPECT_FALSE(buf >= (const mfxU8*)&src && buf < (const mfxU8*)(&src + 1));
+        }
+
+        //moved-from holder is usable
+        AddTestBuffers(src, 1, 64);
+        CheckTestBuffers(src, 1, 64);
+        CheckTestBuffers(dst, numBuffers, 64);
+    }
+}
+
+TEST(Transcode_ExtBufHolder, MoveAssignment) {
+    for (mfxU32 numBuffers : { 2, 10 }) {
+        MfxVideoParamsWrapper src;
+        AddTestBuffers(src, numBuffers, 64);
+
+        MfxVideoParamsWrapper dst;
+        AddTestBuffers(dst, 12, 32);
+        dst = std::move(src);
+        CheckTestBuffers(dst, numBuffers, 64);
+        EXPECT_EQ(src.NumExtParam, 0);
+        EXPECT_EQ(src.ExtParam, nullptr);
+
+        //holders in a vector keep their buffers when the vector grows
+        std::vector<MfxVideoParamsWrapper> pars(1);
+        AddTestBuffers(pars[0], numBuffers, 64);
+        pars.resize(pars.capacity() + 1);
+        CheckTestBuffers(pars[0], numBuffers, 64);
+    }
+}
+
+TEST(Transcode_ExtBufHolder, ReuseAfterReset) {
+    MfxVideoParamsWrapper par;
+    par.AsyncDepth = 3;
+    AddTestBuffers(par, 10, 64);
+    std::vector<mfxExtBuffer*> first(par.ExtParam, par.ExtParam + par.NumExtParam);
+
+    par.Reset();
+    EXPECT_EQ(par.AsyncDepth, 0);
+    EXPECT_EQ(par.NumExtParam, 0);
+    EXPECT_EQ(par.ExtParam, nullptr);
+
+    //the same memory is handed out again
+    AddTestBuffers(par, 10, 64);
+    CheckTestBuffers(par, 10, 64);
+    EXPECT_EQ(std::vector<mfxExtBuffer*>(par.ExtParam, par.ExtParam + par.NumExtParam), first);
+}
+
+TEST(Transcode_ExtBufHolder, NoAllocationsInSteadyState) {
+    MfxVideoParamsWrapper par;
+    AddTestBuffers(par, 10, 64);
+    par.AddExtBuffer(MFX_MAKEFOURCC('B', 'I', 'G', ' '), 10000);
+
+    //holder reused for every frame stops allocating once it has seen the largest set
+    size_t numOfAllocations = g_numOfAllocations;
+    for (int frame = 0; frame < 100; frame++) {
+        par.Reset();
+        AddTestBuffers(par, frame % 2 ? 10 : 3, 64);
+        if (frame % 3 == 0)
+            par.AddExtBuffer(MFX_MAKEFOURCC('B', 'I', 'G', ' '), 10000);
+    }
+    EXPECT_EQ(g_numOfAllocations - numOfAllocations, 0u);
+}
+
+TEST(Transcode_Allocator, PooledFrameIsCleared) {
+    GeneralAllocator allocator;
+    allocator.SetSysMemModes(true, true, true);
+    ASSERT_EQ(allocator.Init(NULL), MFX_ERR_NONE);
+
+    mfxFrameAllocRequest request = {};
+    request.Info.FourCC          = MFX_FOURCC_NV12;
+    request.Info.ChromaFormat    = MFX_CHROMAFORMAT_YUV420;
+    request.Info.Width           = 64;
+    request.Info.Height          = 64;
+    request.Type              = MFX_MEMTYPE_SYSTEM_MEMORY | MFX_MEMTYPE_FROM_VPPOUT;
+    request.NumFrameSuggested = 1;
+
+    mfxFrameAllocResponse response = {};
+    ASSERT_EQ(allocator.Alloc(allocator.pthis, &request, &response), MFX_ERR_NONE);
+    mfxMemId mid      = response.mids[0];
+    mfxFrameData data = {};
+    ASSERT_EQ(allocator.Lock(allocator.pthis, mid, &data), MFX_ERR_NONE);
+    memset(data.Y, 0xAB, 64 * 64);
+    ASSERT_EQ(allocator.Unlock(allocator.pthis, mid, &data), MFX_ERR_NONE);
+    ASSERT_EQ(allocator.Free(allocator.pthis, &response), MFX_ERR_NONE);
+
+    //released frame is taken from the pool and cleared
+    ASSERT_EQ(allocator.Alloc(allocator.pthis, &request, &response), MFX_ERR_NONE);
+    EXPECT_EQ(response.mids[0], mid);
+    ASSERT_EQ(allocator.Lock(allocator.pthis, response.mids[0], &data), MFX_ERR_NONE);
+    std::vector<mfxU8> zero(64 * 64, 0);
+    EXPECT_EQ(memcmp(data.Y, zero.data(), zero.size()), 0);
+    ASSERT_EQ(allocator.Unlock(allocator.pthis, response.mids[0], &data), MFX_ERR_NONE);
+    ASSERT_EQ(allocator.Free(allocator.pthis, &response), MFX_ERR_NONE);
+}
+
+// allocates and frees a pool of 30 NV12 frames, returns average time in milliseconds
+static double RunPoolAllocation(GeneralAllocator& allocator, mfxU16 width, mfxU16 height) {
+    mfxFrameAllocRequest request = {};
+    request.Info.FourCC          = MFX_FOURCC_NV12;
+    request.Info.ChromaFormat    = MFX_CHROMAFORMAT_YUV420;
+    request.Info.Width           = width;
+    request.Info.Height          = height;
+    request.Type              = MFX_MEMTYPE_SYSTEM_MEMORY | MFX_MEMTYPE_FROM_DECODE;
+    request.NumFrameSuggested = 30;
+
+    const int numRuns = 10;
+    auto start        = std::chrono::steady_clock::now();
+    for (int i = 0; i < numRuns; i++) {
+        mfxFrameAllocResponse response = {};
+        EXPECT_EQ(allocator.Alloc(allocator.pthis, &request, &response), MFX_ERR_NONE);
+        EXPECT_EQ(response.NumFrameActual, 30);
+        EXPECT_EQ(allocator.Free(allocator.pthis, &response), MFX_ERR_NONE);
+    }
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / numRuns;
+}
+
+TEST(Transcode_Allocator, InitTime) {
+    const struct {
+        const char* name;
+        mfxU16 width;
+        mfxU16 height;
+    } sizes[] = { { "1080p", 1920, 1088 }, { "4K", 3840, 2160 }, { "8K", 7680, 4320 } };
+
+    for (const auto& size : sizes) {
+        GeneralAllocator plain, slab, pool;
+        slab.SetSysMemModes(true, false, false);
+        pool.SetSysMemModes(true, true, false);
+        ASSERT_EQ(plain.Init(NULL), MFX_ERR_NONE);
+        ASSERT_EQ(slab.Init(NULL), MFX_ERR_NONE);
+        ASSERT_EQ(pool.Init(NULL), MFX_ERR_NONE);
+
+        double plainTime = RunPoolAllocation(plain, size.width, size.height);
+        double slabTime  = RunPoolAllocation(slab, size.width, size.height);
+        double poolTime  = RunPoolAllocation(pool, size.width, size.height);
+        std::cout << size.name << " 30 NV12 frames, alloc + free: " << std::fixed
+                  << std::setprecision(3) << plainTime << " ms, slab " << slabTime
+                  << " ms, slab + pool " << poolTime << " ms" << std::endl;
+
+        EXPECT_EQ(plain.Close(), MFX_ERR_NONE);
+        EXPECT_EQ(slab.Close(), MFX_ERR_NONE);
+        EXPECT_EQ(pool.Close(), MFX_ERR_NONE);
+    }
+}
+
+// reallocates 8 NV12 frames on every resolution switch, returns average time of one
+// reallocation in microseconds, with and without writing the whole frame after it
+static void RunFrameRealloc(GeneralAllocator& allocator,
+                            const std::vector<std::pair<mfxU16, mfxU16>>& ladder,
+                            double& reallocTime,
+                            double& writeTime) {
+    mfxFrameAllocRequest request = {};
+    request.Info.FourCC          = MFX_FOURCC_NV12;
+    request.Info.ChromaFormat    = MFX_CHROMAFORMAT_YUV420;
+    request.Info.Width           = ladder[0].first;
+    request.Info.Height          = ladder[0].second;
+    request.Type              = MFX_MEMTYPE_SYSTEM_MEMORY | MFX_MEMTYPE_FROM_VPPOUT;
+    request.NumFrameSuggested = 8;
+
+    mfxFrameAllocResponse response = {};
+    ASSERT_EQ(allocator.Alloc(allocator.pthis, &request, &response), MFX_ERR_NONE);
+
+    const mfxU32 numSwitches = 100;
+    std::chrono::duration<double, std::micro> realloc(0), write(0);
+    for (mfxU32 n = 1; n <= numSwitches; n++) {
+        mfxFrameInfo info = request.Info;
+        info.Width        = ladder[n % ladder.size()].first;
+        info.Height       = ladder[n % ladder.size()].second;
+        for (mfxU16 i = 0; i < response.NumFrameActual; i++) {
+            auto start = std::chrono::steady_clock::now();
+            ASSERT_EQ(allocator.ReallocFrame(response.mids[i],
+                                             &info,
+                                             request.Type,
+                                             &response.mids[i]),
+                      MFX_ERR_NONE);
+            auto reallocated = std::chrono::steady_clock::now();
+
+            mfxFrameData data = {};
+            ASSERT_EQ(allocator.Lock(allocator.pthis, response.mids[i], &data), MFX_ERR_NONE);
+            memset(data.Y, n, (size_t)data.Pitch * info.Height);
+            memset(data.UV, n, (size_t)data.Pitch * info.Height / 2);
+            ASSERT_EQ(allocator.Unlock(allocator.pthis, response.mids[i], &data), MFX_ERR_NONE);
+
+            realloc += reallocated - start;
+            write += std::chrono::steady_clock::now() - start;
+        }
+    }
+    EXPECT_EQ(allocator.Free(allocator.pthis, &response), MFX_ERR_NONE);
+
+    reallocTime = realloc.count() / (numSwitches * request.NumFrameSuggested);
+    writeTime   = write.count() / (numSwitches * request.NumFrameSuggested);
+}
+
+TEST(Transcode_Allocator, ReallocTime) {
+    const struct {
+        const char* name;
+        std::vector<std::pair<mfxU16, mfxU16>> ladder;
+    } ladders[] = { { "1080p/720p", { { 1920, 1088 }, { 1280, 720 } } },
+                    { "1080-720-368-720", { { 1920, 1088 }, { 1280, 720 }, { 640, 368 },
+                                            { 1280, 720 } } } };
+    const struct {
+        const char* name;
+        bool bUseSlab;
+        bool bUsePool;
+    } modes[] = { { "plain", false, false },
+                  { "pool", false, true },
+                  { "slab", true, false },
+                  { "slab + pool", true, true } };
+
+    for (const auto& ladder : ladders) {
+        for (const auto& mode : modes) {
+            GeneralAllocator allocator;
+            allocator.SetSysMemModes(mode.bUseSlab, mode.bUsePool, false);
+            ASSERT_EQ(allocator.Init(NULL), MFX_ERR_NONE);
+
+            double reallocTime = 0, writeTime = 0;
+            RunFrameRealloc(allocator, ladder.ladder, reallocTime, writeTime);
+            std::cout << ladder.name << ", " << mode.name << ": realloc " << std::fixed
+                      << std::setprecision(1) << reallocTime << " us, realloc + first write "
+                      << writeTime << " us" << std::endl;
+
+            EXPECT_EQ(allocator.Close(), MFX_ERR_NONE);
+        }
+    }
+}
+
+TEST(Transcode_Pipeline, SurfaceWaitNeeded) {
+    GeneralAllocator allocator;
+    ASSERT_EQ(allocator.Init(NULL), MFX_ERR_NONE);
+
+    TestPipeline pipeline;
+    ASSERT_EQ(pipeline.AllocDecPool(&allocator, 2, 0), MFX_ERR_NONE);
+    pipeline.m_TranscodeLoop.bNeedDecodedFrames  = true;
+    pipeline.m_TranscodeLoop.shouldReadNextFrame = true;
+    EXPECT_FALSE(pipeline.IsSurfaceWaitNeeded());
+
+    //scheduled step is put off while decoder pool is empty
+    mfxFrameSurface1* pSurf1 = pipeline.m_DecSurfaceTracker.GetSurface(0);
+    mfxFrameSurface1* pSurf2 = pipeline.m_DecSurfaceTracker.GetSurface(0);
+    ASSERT_TRUE(pSurf1 && pSurf2);
+    pSurf1->Data.Locked = pSurf2->Data.Locked = 1;
+    EXPECT_TRUE(pipeline.IsSurfaceWaitNeeded());
+
+    //no decoding - no wait
+    pipeline.m_TranscodeLoop.shouldReadNextFrame = false;
+    EXPECT_FALSE(pipeline.IsSurfaceWaitNeeded());
+    pipeline.m_TranscodeLoop.shouldReadNextFrame = true;
+
+    pSurf2->Data.Locked = 0;
+    EXPECT_FALSE(pipeline.IsSurfaceWaitNeeded());
+    pSurf1->Data.Locked = 0;
+}
+
+TEST(Transcode_Pipeline, TuneSurfacePool) {
+    GeneralAllocator allocator;
+    ASSERT_EQ(allocator.Init(NULL), MFX_ERR_NONE);
+
+    //pool is trimmed to peak usage plus margin once given number of frames is handed out
+    TestPipeline pipeline;
+    testing::internal::CaptureStdout();
+    ASSERT_EQ(pipeline.AllocDecPool(&allocator, 10, 20), MFX_ERR_NONE);
+    pipeline.Run(19, 3);
+    pipeline.TuneSurfacePool(true);
+    EXPECT_EQ(pipeline.m_pSurfaceDecPool.size(), 10u);
+
+    pipeline.Run(1, 3);
+    pipeline.TuneSurfacePool(true);
+    std::string out = testing::internal::GetCapturedStdout();
+    EXPECT_EQ(pipeline.m_DecSurfaceTracker.GetPeakInUse(), 3u);
+    EXPECT_EQ(pipeline.m_pSurfaceDecPool.size(), 5u);
+    EXPECT_CONTAINS(out, "peak 3 of 10 surfaces in use, 5 surfaces released");
+
+    //the pool is tuned once
+    pipeline.Run(20, 5);
+    pipeline.TuneSurfacePool(true);
+    EXPECT_EQ(pipeline.m_pSurfaceDecPool.size(), 5u);
+
+    //without auto-tune peak usage isn't collected
+    TestPipeline untuned;
+    testing::internal::CaptureStdout();
+    ASSERT_EQ(untuned.AllocDecPool(&allocator, 10, 0), MFX_ERR_NONE);
+    testing::internal::GetCapturedStdout();
+    untuned.Run(20, 3);
+    EXPECT_EQ(untuned.m_DecSurfaceTracker.GetHandedOutCount(), 20u);
+    EXPECT_EQ(untuned.m_DecSurfaceTracker.GetPeakInUse(), 0u);
+}
+
+TEST(Transcode_Launcher, ShareDecoders) {
+    using TranscodingSample::sInputParams;
+
+    class TestLauncher : public TranscodingSample::Launcher {
+    public:
+        using Launcher::m_InputParamsArray;
+        using Launcher::ShareDecoders;
+    };
+
+    auto session = [](const char* src, const char* dst, mfxU16 width, mfxU32 line) {
+        sInputParams par;
+        par.DecodeId     = MFX_CODEC_AVC;
+        par.EncodeId     = MFX_CODEC_HEVC;
+        par.strSrcFile   = src;
+        par.strDstFile   = dst;
+        par.nDstWidth    = width;
+        par.nParFileLine = line;
+        return par;
+    };
+
+    TestLauncher launcher;
+    launcher.m_InputParamsArray.push_back(session("other.h264", "out0.h265", 0, 1));
+    launcher.m_InputParamsArray.push_back(session("in.h264", "out1.h265", 1280, 3));
+    launcher.m_InputParamsArray.push_back(session("in.h264", "out2.h265", 640, 4));
+    launcher.m_InputParamsArray.push_back(session("in.h264", "out3.h265", 0, 5));
+    launcher.m_InputParamsArray[3].bPrivateDecoder = true;
+    launcher.m_InputParamsArray.push_back(session("in.h264", "out4.h265", 320, 7));
+    testing::internal::CaptureStdout();
+    launcher.ShareDecoders();
+    std::string out = testing::internal::GetCapturedStdout();
+
+    //report names par file lines and every session which got a new index
+    EXPECT_CONTAINS(out, "in.h264 is decoded once by session 1 for 3 sessions");
+    EXPECT_CONTAINS(out, "par file line 3: session 1 -> session 2, shares the decoder");
+    EXPECT_CONTAINS(out, "par file line 4: session 2 -> session 3, shares the decoder");
+    EXPECT_CONTAINS(out, "par file line 5: session 3 -> session 5\n");
+    EXPECT_EQ(out.find("par file line 1:"), std::string::npos);
+    EXPECT_EQ(out.find("par file line 7:"), std::string::npos);
+
+    const auto& params = launcher.m_InputParamsArray;
+    ASSERT_EQ(params.size(), 6u);
+    EXPECT_EQ(params[0].eMode, TranscodingSample::Native);
+    EXPECT_EQ(params[0].strSrcFile, "other.h264");
+
+    EXPECT_EQ(params[1].eMode, TranscodingSample::Sink);
+    EXPECT_EQ(params[1].strSrcFile, "in.h264");
+    EXPECT_EQ(params[1].nDstWidth, 0);
+    EXPECT_TRUE(params[1].strDstFile.empty());
+
+    EXPECT_EQ(params[2].eMode, TranscodingSample::Source);
+    EXPECT_EQ(params[2].strDstFile, "out1.h265");
+    EXPECT_EQ(params[2].nDstWidth, 1280);
+    EXPECT_EQ(params[3].strDstFile, "out2.h265");
+    EXPECT_EQ(params[4].strDstFile, "out4.h265");
+    EXPECT_EQ(params[4].eMode, TranscodingSample::Source);
+
+    EXPECT_EQ(params[5].eMode, TranscodingSample::Native);
+    EXPECT_EQ(params[5].strDstFile, "out3.h265");
+
+    for (mfxU32 i = 0; i < params.size(); i++) {
+        EXPECT_EQ(params[i].TargetID, TranscodingSample::DecoderTargetID + i);
+    }
+
+    // sessions with own topology aren't changed
+    TestLauncher joined;
+    joined.m_InputParamsArray = params;
+    joined.ShareDecoders();
+    EXPECT_EQ(joined.m_InputParamsArray.size(), 6u);
+}
+
+TEST(Transcode_CascadeScalerConfig, PlanCascade) {
+    using TranscodingSample::CascadeScalerConfig;
+    using TranscodingSample::DecoderPoolID;
+    using TranscodingSample::DecoderTargetID;
+
+    auto target = [](mfxU32 id, mfxU16 w, mfxU16 h, mfxF64 fps, bool di) {
+        CascadeScalerConfig::TargetDescriptor desc;
+        desc.TargetID     = DecoderTargetID + id;
+        desc.DstWidth     = w;
+        desc.DstHeight    = h;
+        desc.FRC          = (fps != 0);
+        desc.DstFrameRate = fps;
+        desc.DI           = di;
+        return desc;
+    };
+
+    CascadeScalerConfig cfg;
+    cfg.CascadeScalerAuto = true;
+    cfg.Targets.push_back(target(1, 1280, 720, 30, false));
+    cfg.Targets.push_back(target(2, 640, 360, 30, false));
+    cfg.Targets.push_back(target(3, 1920, 1080, 0, true));
+    cfg.Targets.push_back(target(4, 320, 180, 15, false));
+    cfg.Targets.push_back(target(5, 0, 0, 0, false));
+    cfg.CreatePoolList();
+
+    EXPECT_EQ(cfg.CascadeScalerRequired, true);
+    ASSERT_EQ(cfg.Pools.size(), 5u);
+
+    //the biggest channels first, each one is produced from the cheapest suitable pool
+    EXPECT_EQ(cfg.GetDesc(DecoderTargetID + 3).PoolID, DecoderPoolID + 1);
+    EXPECT_EQ(cfg.GetDesc(DecoderTargetID + 1).PoolID, DecoderPoolID + 2);
+    EXPECT_EQ(cfg.GetDesc(DecoderTargetID + 2).PoolID, DecoderPoolID + 3);
+    EXPECT_EQ(cfg.GetDesc(DecoderTargetID + 4).PoolID, DecoderPoolID + 4);
+    EXPECT_EQ(cfg.GetDesc(DecoderTargetID + 5).PoolID, DecoderPoolID);
+    EXPECT_EQ(cfg.GetDesc(DecoderTargetID + 5).CascadeScaler, false);
+
+    //deinterlaced pool is shared by all scaled channels
+    EXPECT_EQ(cfg.Pools[DecoderPoolID + 1].PrevID, DecoderPoolID);
+    EXPECT_EQ(cfg.Pools[DecoderPoolID + 2].PrevID, DecoderPoolID + 1);
+    EXPECT_EQ(cfg.Pools[DecoderPoolID + 3].PrevID, DecoderPoolID + 2);
+    EXPECT_EQ(cfg.Pools[DecoderPoolID + 4].PrevID, DecoderPoolID + 3);
+
+    EXPECT_EQ(cfg.Pools[DecoderPoolID].Size, 3);
+    EXPECT_EQ(cfg.Pools[DecoderPoolID + 1].Size, 3);
+    EXPECT_EQ(cfg.Pools[DecoderPoolID + 2].Size, 3);
+    EXPECT_EQ(cfg.Pools[DecoderPoolID + 4].Size, 2);
+
+    cfg.Targets[0].SrcWidth     = 1920;
+    cfg.Targets[0].SrcHeight    = 1080;
+    cfg.Targets[0].SrcFrameRate = 60;
+    cfg.PropagateCascadeParameters();
+
+    auto desc = cfg.GetDesc(DecoderTargetID + 4);
+    EXPECT_EQ(desc.SrcWidth, 640);
+    EXPECT_EQ(desc.SrcHeight, 360);
+    EXPECT_EQ(desc.SrcFrameRate, 30);
+    EXPECT_EQ(desc.DstFrameRate, 15);
+
+    desc = cfg.GetDesc(DecoderTargetID + 5);
+    EXPECT_EQ(desc.SrcWidth, 1920);
+    EXPECT_EQ(desc.DstWidth, 1920);
+    EXPECT_EQ(desc.DstFrameRate, 60);
+}
+
+TEST(Transcode_CascadeScalerConfig, PlanCascadeSharedDI) {
+    using TranscodingSample::CascadeScalerConfig;
+    using TranscodingSample::DecoderPoolID;
+    using TranscodingSample::DecoderTargetID;
+
+    auto target = [](mfxU32 id, mfxU16 w, mfxU16 h, bool di) {
+        CascadeScalerConfig::TargetDescriptor desc;
+        desc.TargetID  = DecoderTargetID + id;
+        desc.DstWidth  = w;
+        desc.DstHeight = h;
+        desc.DI        = di;
+        return desc;
+    };
+
+    //only the small channel deinterlaces, DI is moved to the stage fed by decoder
+    CascadeScalerConfig cfg;
+    cfg.CascadeScalerAuto = true;
+    cfg.Targets.push_back(target(1, 1920, 1080, false));
+    cfg.Targets.push_back(target(2, 640, 360, true));
+    cfg.Targets.push_back(target(3, 1280, 720, false));
+    for (const auto& desc : cfg.Targets) {
+        TranscodingSample::sInputParams par;
+        par.bEnableDeinterlacing    = desc.DI;
+        par.DeinterlacingMode       = desc.DI ? MFX_DEINTERLACING_ADVANCED : 0;
+        cfg.InParams[desc.TargetID] = par;
+    }
+    cfg.CreatePoolList();
+
+    ASSERT_EQ(cfg.Pools.size(), 4u);
+    EXPECT_EQ(cfg.GetDesc(DecoderTargetID + 1).PoolID, DecoderPoolID + 1);
+    EXPECT_EQ(cfg.GetDesc(DecoderTargetID + 3).PoolID, DecoderPoolID + 2);
+    EXPECT_EQ(cfg.GetDesc(DecoderTargetID + 2).PoolID, DecoderPoolID + 3);
+    EXPECT_EQ(cfg.Pools[DecoderPoolID + 2].PrevID, DecoderPoolID + 1);
+    EXPECT_EQ(cfg.Pools[DecoderPoolID + 3].PrevID, DecoderPoolID + 2);
+
+    EXPECT_EQ(cfg.GetDesc(DecoderTargetID + 1).DI, true);
+    EXPECT_EQ(cfg.GetDesc(DecoderTargetID + 2).DI, false);
+    EXPECT_EQ(cfg.GetDesc(DecoderTargetID + 3).DI, false);
+    EXPECT_EQ(cfg.InParams[DecoderTargetID + 1].bEnableDeinterlacing, true);
+    EXPECT_EQ(cfg.InParams[DecoderTargetID + 1].DeinterlacingMode, MFX_DEINTERLACING_ADVANCED);
+    EXPECT_EQ(cfg.InParams[DecoderTargetID + 2].bEnableDeinterlacing, false);
+
+    //every channel down the cascade gets progressive frames
+    cfg.Targets[0].SrcWidth     = 1920;
+    cfg.Targets[0].SrcHeight    = 1080;
+    cfg.Targets[0].SrcPicStruct = MFX_PICSTRUCT_FIELD_TFF;
+    cfg.PropagateCascadeParameters();
+    for (const auto& desc : cfg.Targets) {
+        EXPECT_EQ(desc.DstPicStruct, MFX_PICSTRUCT_PROGRESSIVE);
+    }
+}
+
+TEST(Transcode_CascadeScalerConfig, PlanCascadeWithoutFRC) {
+    using TranscodingSample::CascadeScalerConfig;
+    using TranscodingSample::DecoderPoolID;
+    using TranscodingSample::DecoderTargetID;
+
+    auto target = [](mfxU32 id, mfxU16 w, mfxU16 h, mfxF64 fps) {
+        CascadeScalerConfig::TargetDescriptor desc;
+        desc.TargetID     = DecoderTargetID + id;
+        desc.DstWidth     = w;
+        desc.DstHeight    = h;
+        desc.FRC          = (fps != 0);
+        desc.DstFrameRate = fps;
+        return desc;
+    };
+
+    //scaling only ladder, every channel is produced from the next bigger one
+    CascadeScalerConfig cfg;
+    cfg.CascadeScalerAuto = true;
+    cfg.Targets.push_back(target(1, 640, 360, 0));
+    cfg.Targets.push_back(target(2, 1280, 720, 0));
+    cfg.Targets.push_back(target(3, 960, 540, 0));
+    cfg.CreatePoolList();
+
+    EXPECT_EQ(cfg.GetDesc(DecoderTargetID + 2).PoolID, DecoderPoolID + 1);
+    EXPECT_EQ(cfg.GetDesc(DecoderTargetID + 3).PoolID, DecoderPoolID + 2);
+    EXPECT_EQ(cfg.GetDesc(DecoderTargetID + 1).PoolID, DecoderPoolID + 3);
+    EXPECT_EQ(cfg.Pools[DecoderPoolID + 1].PrevID, DecoderPoolID);
+    EXPECT_EQ(cfg.Pools[DecoderPoolID + 2].PrevID, DecoderPoolID + 1);
+    EXPECT_EQ(cfg.Pools[DecoderPoolID + 3].PrevID, DecoderPoolID + 2);
+
+    //with known decoder frame rate 720p at 30 fps is cheaper than 540p at 60 fps
+    cfg = CascadeScalerConfig();
+    cfg.CascadeScalerAuto = true;
+    cfg.Targets.push_back(target(1, 1280, 720, 30));
+    cfg.Targets.push_back(target(2, 960, 540, 0));
+    cfg.Targets.push_back(target(3, 640, 360, 30));
+    cfg.Targets[0].SrcFrameRate = 60;
+    cfg.CreatePoolList();
+
+    EXPECT_EQ(cfg.GetDesc(DecoderTargetID + 3).PoolID, DecoderPoolID + 3);
+    EXPECT_EQ(cfg.Pools[DecoderPoolID + 3].PrevID, cfg.GetDesc(DecoderTargetID + 1).PoolID);
+}
+
+TEST(Transcode_ControlServer, SplitCommand) {
+    using TranscodingSample::ControlServer;
+
+    std::string args;
+    EXPECT_EQ(ControlServer::SplitCommand("  add -i::h264 in.h264 -o::h265 out.h265\r", args),
+              "add");
+    EXPECT_EQ(args, "-i::h264 in.h264 -o::h265 out.h265");
+    EXPECT_EQ(ControlServer::SplitCommand("list", args), "list");
+    EXPECT_EQ(args, "");
+    EXPECT_EQ(ControlServer::SplitCommand(" \t ", args), "");
+    EXPECT_EQ(args, "");
+}
+
+#if !defined(_WIN32) && !defined(_WIN64)
+TEST(Transcode_ControlServer, Commands) {
+    using TranscodingSample::ControlServer;
+    const char* path = "smt_control_test.sock";
+
+    ControlServer server;
+    ASSERT_EQ(server.Start(path,
+                           [](const std::string& line) {
+                               return "echo " + line;
+                           }),
+              MFX_ERR_NONE);
+    EXPECT_TRUE(server.IsRunning());
+
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    ASSERT_GE(fd, 0);
+    sockaddr_un addr = {};
+    addr.sun_family  = AF_UNIX;
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    ASSERT_EQ(connect(fd, (sockaddr*)&addr, sizeof(addr)), 0);
+
+    // two commands in one packet get two replies
+    std::string request = "stats 1\nlist\n";
+    ASSERT_EQ(write(fd, request.data(), request.size()), (ssize_t)request.size());
+
+    std::string reply;
+    char buffer[256];
+    while (std::count(reply.begin(), reply.end(), '\n') < 2) {
+        ssize_t size = read(fd, buffer, sizeof(buffer));
+        ASSERT_GT(size, 0);
+        reply.append(buffer, size);
+    }
+    EXPECT_EQ(reply, "echo stats 1\necho list\n");
+    close(fd);
+
+    //client which doesn't send end of line is dropped after the line limit
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(connect(fd, (sockaddr*)&addr, sizeof(addr)), 0);
+    testing::internal::CaptureStdout();
+    std::string garbage(128 * 1024, 'x');
+    std::ignore = send(fd, garbage.data(), garbage.size(), MSG_NOSIGNAL);
+    EXPECT_LE(read(fd, buffer, sizeof(buffer)), 0);
+    close(fd);
+    std::string out = testing::internal::GetCapturedStdout();
+    EXPECT_CONTAINS(out, "client is dropped");
+
+    server.Stop();
+    EXPECT_FALSE(server.IsRunning());
+    EXPECT_NE(access(path, F_OK), 0);
+
+    //file which isn't a socket isn't replaced
+    {
+        std::ofstream file(path);
+        file << "data";
+    }
+    testing::internal::CaptureStdout();
+    EXPECT_EQ(server.Start(path,
+                           [](const std::string& line) {
+                               return line;
+                           }),
+              MFX_ERR_UNSUPPORTED);
+    testing::internal::GetCapturedStdout();
+    EXPECT_FALSE(server.IsRunning());
+    EXPECT_EQ(access(path, F_OK), 0);
+    std::remove(path);
+}
+#endif
+
+TEST(Transcode_ProtoEncoder, Encoding) {
+    using TranscodingSample::ProtoEncoder;
+
+    ProtoEncoder inner;
+    inner.AddVarint(1, 300);
+    inner.AddString(2, "ab");
+    EXPECT_EQ(inner.GetData(), std::string("\x08\xac\x02\x12\x02" "ab"));
+
+    ProtoEncoder outer;
+    outer.AddFixed64(47, 1);
+    outer.AddMessage(60, inner);
+    EXPECT_EQ(outer.GetData(),
+              std::string("\xf9\x02\x01\x00\x00\x00\x00\x00\x00\x00"
+                          "\xe2\x03\x07\x08\xac\x02\x12\x02" "ab",
+                          20));
+}
+
+// GOP parallel encoding: two encoders with GOP of two frames, the second encoder is ahead.
+// Its frames are held by reference and written to the file in display order with frames of
+// the first encoder.
+TEST(Transcode_ParallelEncodingWriter, ReorderGOPs) {
+    const char* fileName = "parallel_encoding_writer_test.bin";
+    CBitstreamWriterForParallelEncoding writer;
+    writer.m_GopSize          = 2;
+    writer.m_NumberOfEncoders = 2;
+    writer.m_BaseEncoderID    = 10;
+    ASSERT_EQ(writer.Init(fileName), MFX_ERR_NONE);
+
+    mfxU8 data[4] = { 'a', 'b', 'c', 'd' }; //display order
+    mfxBitstream frames[4];
+    for (int i = 0; i < 4; i++) {
+        frames[i]            = {};
+        frames[i].Data       = &data[i];
+        frames[i].DataLength = 1;
+        frames[i].MaxLength  = 1;
+    }
+
+    EXPECT_EQ(writer.WriteNextFrame(&frames[2], 11, 1), MFX_WRN_IN_EXECUTION);
+    EXPECT_EQ(writer.WriteNextFrame(&frames[3], 11, 2), MFX_WRN_IN_EXECUTION);
+    EXPECT_EQ(frames[2].DataLength, 1u);
+    EXPECT_EQ(writer.WaitForWrittenFrames(11, 1), MFX_ERR_UNDEFINED_BEHAVIOR);
+
+    EXPECT_EQ(writer.WriteNextFrame(&frames[0], 10, 1), MFX_ERR_NONE);
+    EXPECT_EQ(writer.WriteNextFrame(&frames[1], 10, 2), MFX_ERR_NONE);
+    EXPECT_EQ(writer.WaitForWrittenFrames(11, 1), MFX_ERR_NONE);
+
+    std::vector<mfxBitstream*> written;
+    EXPECT_EQ(writer.GetWrittenFrames(11, written), MFX_ERR_NONE);
+    EXPECT_EQ(written, std::vector<mfxBitstream*>({ &frames[2], &frames[3] }));
+    EXPECT_EQ(frames[2].DataLength, 0u);
+    EXPECT_EQ(writer.GetMaxReorderDepth(), 2u);
+    EXPECT_EQ(writer.m_nProcessedFramesNum, 4u);
+    writer.Close();
+
+    std::ifstream file(fileName, std::ios::binary);
+    std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    file.close();
+    std::remove(fileName);
+    EXPECT_EQ(content, "abcd");
+}
+
+// Segment-parallel transcoding: the second encoder starts one frame before its segment to
+// warm up rate control, this frame is discarded and the rest follows the first segment.
+TEST(Transcode_ParallelEncodingWriter, StitchSegments) {
+    const char* fileName = "parallel_encoding_segments_test.bin";
+    CBitstreamWriterForParallelEncoding writer;
+    writer.AddSegment(1, 0, 0);
+    writer.AddSegment(2, 2, 1);
+    ASSERT_EQ(writer.Init(fileName), MFX_ERR_NONE);
+
+    mfxU8 data[5] = { 'a', 'b', 'x', 'c', 'd' }; //x is the overlap frame
+    mfxBitstream frames[5];
+    for (int i = 0; i < 5; i++) {
+        frames[i]            = {};
+        frames[i].Data       = &data[i];
+        frames[i].DataLength = 1;
+        frames[i].MaxLength  = 1;
+    }
+
+    EXPECT_EQ(writer.WriteNextFrame(&frames[2], 2, 1), MFX_ERR_NONE);
+    EXPECT_EQ(frames[2].DataLength, 0u);
+    EXPECT_EQ(writer.WriteNextFrame(&frames[3], 2, 2), MFX_WRN_IN_EXECUTION);
+    EXPECT_EQ(writer.WriteNextFrame(&frames[4], 2, 3), MFX_WRN_IN_EXECUTION);
+    EXPECT_EQ(writer.WriteNextFrame(&frames[0], 1, 1), MFX_ERR_NONE);
+    EXPECT_EQ(writer.WriteNextFrame(&frames[1], 1, 2), MFX_ERR_NONE);
+    EXPECT_EQ(writer.WriteNextFrame(&frames[1], 3, 1), MFX_ERR_UNDEFINED_BEHAVIOR);
+
+    std::vector<mfxBitstream*> written;
+    EXPECT_EQ(writer.GetWrittenFrames(2, written), MFX_ERR_NONE);
+    EXPECT_EQ(written, std::vector<mfxBitstream*>({ &frames[3], &frames[4] }));
+    EXPECT_EQ(writer.m_nProcessedFramesNum, 4u);
+    writer.Close();
+
+    std::ifstream file(fileName, std::ios::binary);
+    std::string content((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    file.close();
+    std::remove(fileName);
+    EXPECT_EQ(content, "abcd");
+}
+
+// 1:N join session: one decoder passes every surface to N sinks through their
+// SafetySurfaceBuffers. Surfaces are system memory ones, no implementation is needed.
+static double RunSurfaceFanOut(mfxU32 numSinks, mfxU32 numFrames) {
+    using namespace TranscodingSample;
+
+    std::vector<TrackedSurface> surfaces(8);
+    SurfPointersArray pool;
+    for (auto& surf : surfaces) {
+        pool.push_back(&surf);
+    }
+    FreeSurfaceTracker tracker;
+    tracker.Reset(pool);
+
+    std::vector<std::unique_ptr<SafetySurfaceBuffer>> buffers;
+    SafetySurfaceBuffer* pHead = nullptr;
+    for (mfxU32 i = 0; i < numSinks; i++) {
+        pHead = new SafetySurfaceBuffer(pHead);
+        buffers.emplace_back(pHead);
+    }
+
+    std::vector<mfxU32> received(numSinks, 0);
+    std::vector<std::thread> sinks;
+    for (mfxU32 i = 0; i < numSinks; i++) {
+        sinks.emplace_back([&buffers, &received, i]() {
+            SafetySurfaceBuffer* pBuffer = buffers[i].get();
+            ExtendedSurface surf         = {};
+            for (;;) {
+                while (pBuffer->GetSurface(surf) == MFX_ERR_MORE_SURFACE) {
+                    pBuffer->WaitForSurfaceInsertion(10);
+                }
+                pBuffer->ReleaseSurface(surf.pSurface);
+                if (!surf.pSurface)
+                    break;
+                received[i]++;
+            }
+        });
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (mfxU32 n = 0; n < numFrames; n++) {
+        ExtendedSurface surf = {};
+        while (!surf.pSurface) {
+            surf.pSurface = tracker.GetSurface(1000);
+        }
+        for (SafetySurfaceBuffer* pBuffer = pHead; pBuffer; pBuffer = pBuffer->m_pNext) {
+            pBuffer->AddSurface(surf);
+        }
+    }
+    ExtendedSurface eos = {};
+    for (SafetySurfaceBuffer* pBuffer = pHead; pBuffer; pBuffer = pBuffer->m_pNext) {
+        pBuffer->AddSurface(eos);
+    }
+    for (auto& sink : sinks) {
+        sink.join();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+    for (mfxU32 i = 0; i < numSinks; i++) {
+        EXPECT_EQ(received[i], numFrames);
+        EXPECT_EQ(buffers[i]->GetLength(), 0u);
+    }
+    for (auto& surf : surfaces) {
+        EXPECT_EQ(surf.Data.Locked, 0);
+    }
+    tracker.Clear();
+
+    return numFrames / elapsed.count();
+}
+
+TEST(Transcode_SafetySurfaceBuffer, FanOutThroughput) {
+    const mfxU32 numFrames = 20000;
+    for (mfxU32 numSinks : { 1, 2, 4, 8, 16 }) {
+        double fps = RunSurfaceFanOut(numSinks, numFrames);
+        std::cout << "1->" << numSinks << " sinks: " << std::fixed << std::setprecision(0) << fps
+                  << " frames/s" << std::endl;
+    }
+}
+
+// auto-reset event on mutex and condition variable, the way MSDKEvent was built before futexes
+class CondVarEvent {
+public:
+    void Signal() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        if (!m_state) {
+            m_state = true;
+            m_event.notify_one();
+        }
+    }
+    void Wait() {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_event.wait(lock, [this] {
+            return m_state;
+        });
+        m_state = false;
+    }
+
+private:
+    std::mutex m_mutex;
+    std::condition_variable m_event;
+    bool m_state = false;
+};
+
+// two threads pass the turn to each other, returns microseconds per round trip
+template <typename TEvent>
+static double RunPingPong(TEvent& ping, TEvent& pong, mfxU32 numRounds) {
+    std::thread partner([&] {
+        for (mfxU32 i = 0; i < numRounds; i++) {
+            ping.Wait();
+            pong.Signal();
+        }
+    });
+
+    auto start = std::chrono::steady_clock::now();
+    for (mfxU32 i = 0; i < numRounds; i++) {
+        ping.Signal();
+        pong.Wait();
+    }
+    std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+    partner.join();
+
+    return elapsed.count() / numRounds;
+}
+
+TEST(Transcode_MSDKEvent, PingPongLatency) {
+    const mfxU32 numRounds = 20000;
+
+    CondVarEvent oldPing, oldPong;
+    double oldTime = RunPingPong(oldPing, oldPong, numRounds);
+
+    mfxStatus sts = MFX_ERR_NONE;
+    MSDKEvent ping(sts, false, false), pong(sts, false, false);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    double newTime = RunPingPong(ping, pong, numRounds);
+
+    MSDKSemaphore semPing(sts), semPong(sts);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    struct SemaphoreEvent {
+        MSDKSemaphore& sem;
+        void Signal() {
+            sem.Post();
+        }
+        void Wait() {
+            sem.Wait();
+        }
+    } semPingEvent{ semPing }, semPongEvent{ semPong };
+    double semTime = RunPingPong(semPingEvent, semPongEvent, numRounds);
+
+    std::cout << std::fixed << std::setprecision(2) << "ping-pong round trip: mutex/condvar "
+              << oldTime << " us, MSDKEvent " << newTime << " us, MSDKSemaphore " << semTime
+              << " us" << std::endl;
+}
+
+TEST(Transcode_MSDKEvent, TimedWait) {
+    using namespace std::chrono;
+    mfxStatus sts = MFX_ERR_NONE;
+    MSDKEvent event(sts, false, false);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+
+    //wait times out when nobody signals
+    auto start = steady_clock::now();
+    EXPECT_EQ(event.TimedWait(20), MFX_TASK_WORKING);
+    EXPECT_GE(duration_cast<milliseconds>(steady_clock::now() - start).count(), 20);
+    EXPECT_EQ(event.TimedWait(0), MFX_TASK_WORKING);
+
+    //parked waiter is woken up before the timeout
+    std::thread signaler([&] {
+        std::this_thread::sleep_for(milliseconds(10));
+        event.Signal();
+    });
+    start = steady_clock::now();
+    EXPECT_EQ(event.TimedWait(10000), MFX_ERR_NONE);
+    EXPECT_LT(duration_cast<milliseconds>(steady_clock::now() - start).count(), 5000);
+    signaler.join();
+
+    //auto-reset event is consumed by the wait, manual one stays signaled till Reset
+    EXPECT_EQ(event.TimedWait(0), MFX_TASK_WORKING);
+    MSDKEvent manual(sts, true, true);
+    ASSERT_EQ(sts, MFX_ERR_NONE);
+    EXPECT_EQ(manual.TimedWait(0), MFX_ERR_NONE);
+    EXPECT_EQ(manual.TimedWait(10), MFX_ERR_NONE);
+    manual.Reset();
+    EXPECT_EQ(manual.TimedWait(10), MFX_TASK_WORKING);
+}
+
+// IVF file with VP8 frames of given sizes, the first byte of key frame is even
+static void WriteIVF(const char* fileName, const std::vector<std::pair<mfxU32, bool>>& frames) {
+    std::ofstream file(fileName, std::ios::binary | std::ios::trunc);
+    mfxU8 hdr[32] = { 'D', 'K', 'I', 'F', 0, 0, 32, 0, 'V', 'P', '8', '0' };
+    hdr[16]       = 30; // frame rate
+    hdr[20]       = 1; // time scale
+    file.write((const char*)hdr, sizeof(hdr));
+    for (size_t i = 0; i < frames.size(); i++) {
+        mfxU8 frameHdr[12] = {};
+        mfxU32 size        = frames[i].first;
+        memcpy(frameHdr, &size, sizeof(size));
+        frameHdr[4] = (mfxU8)i;
+        file.write((const char*)frameHdr, sizeof(frameHdr));
+        std::vector<char> data(std::min<mfxU32>(size, 64), frames[i].second ? 0 : 1);
+        file.write(data.data(), data.size());
+    }
+}
+
+TEST(Transcode_AUIndex, LoadValidatesIndex) {
+    const char* streamName = "au_index_test.ivf";
+    std::string indexName  = CAUIndex::GetDefaultIndexName(streamName);
+    std::remove(indexName.c_str());
+
+    WriteIVF(streamName, { { 16, true }, { 8, false }, { 16, true } });
+    CAUIndex index;
+    ASSERT_EQ(index.LoadOrBuild(streamName, MFX_CODEC_VP8), MFX_ERR_NONE);
+    ASSERT_EQ(index.GetEntries().size(), 3u);
+    EXPECT_EQ(index.GetEntries()[1].KeyFrame, 0);
+    EXPECT_EQ(index.GetEntries()[2].KeyFrame, 1);
+    EXPECT_EQ(index.GetEntries()[2].Offset, 32u + 12 + 16 + 12 + 8);
+
+    CAUIndex loaded;
+    EXPECT_EQ(loaded.Load(indexName.c_str(), streamName), MFX_ERR_NONE);
+    EXPECT_EQ(loaded.GetEntries().size(), 3u);
+    EXPECT_EQ(loaded.GetCodecId(), (mfxU32)MFX_CODEC_VP8);
+
+    //index of the previous version of the stream is rebuilt
+    WriteIVF(streamName, { { 16, true }, { 8, false }, { 16, true }, { 8, false } });
+    EXPECT_EQ(loaded.Load(indexName.c_str(), streamName), MFX_ERR_UNSUPPORTED);
+    ASSERT_EQ(loaded.LoadOrBuild(streamName, MFX_CODEC_VP8), MFX_ERR_NONE);
+    EXPECT_EQ(loaded.GetEntries().size(), 4u);
+
+    //number of entries which doesn't match size of the index isn't trusted
+    {
+        std::fstream file(indexName, std::ios::binary | std::ios::in | std::ios::out);
+        mfxU32 numEntries = 0x7fffffff;
+        file.seekp(12);
+        file.write((const char*)&numEntries, sizeof(numEntries));
+    }
+    EXPECT_EQ(loaded.Load(indexName.c_str(), streamName), MFX_ERR_UNSUPPORTED);
+    EXPECT_TRUE(loaded.GetEntries().empty());
+
+    //frame which is bigger than the rest of the file ends the stream
+    WriteIVF(streamName, { { 16, true }, { 8, false }, { 0xfffffff0, true } });
+    ASSERT_EQ(index.Build(streamName, MFX_CODEC_VP8), MFX_ERR_NONE);
+    EXPECT_EQ(index.GetEntries().size(), 2u);
+
+    std::remove(indexName.c_str());
+    std::remove(streamName);
+}
+
+// content of the examples, tests which need a real stream are skipped if it isn't there
+static std::string GetExampleContent(const char* fileName) {
+    std::string path = __FILE__;
+    for (int i = 0; i < 5; i++) {
+        path = path.substr(0, path.find_last_of("/\\"));
+    }
+    path += std::string("/examples/content/") + fileName;
+    return std::ifstream(path).good() ? path : std::string();
+}
+
+// reads all frames like a decoder which consumes every frame, the bitstream is extended
+// whenever the reader reports that a frame doesn't fit it
+static std::vector<std::vector<mfxU8>> ReadAllFrames(CSmplBitstreamReader& reader,
+                                                     mfxU32 bitstreamSize) {
+    std::vector<std::vector<mfxU8>> frames;
+    mfxBitstreamWrapper bs(bitstreamSize);
+    for (;;) {
+        mfxStatus sts = reader.ReadNextFrame(&bs);
+        if (sts == MFX_ERR_NOT_ENOUGH_BUFFER) {
+            bs.Extend(2 * bs.MaxLength);
+            continue;
+        }
+        if (sts != MFX_ERR_NONE || !bs.DataLength)
+            break;
+        frames.emplace_back(bs.Data + bs.DataOffset, bs.Data + bs.DataOffset + bs.DataLength);
+        bs.DataOffset = 0;
+        bs.DataLength = 0;
+    }
+    return frames;
+}
+
+TEST(Transcode_FrameReader, SmallBitstreamIsExtended) {
+    for (mfxU32 codecId : { MFX_CODEC_AVC, MFX_CODEC_HEVC }) {
+        std::string fileName = GetExampleContent(codecId == MFX_CODEC_AVC ? "cars_320x240.h264"
+                                                                          : "cars_320x240.h265");
+        if (fileName.empty())
+            GTEST_SKIP();
+
+        CSplitterFrameReader reader(codecId);
+        ASSERT_EQ(reader.Init(fileName.c_str()), MFX_ERR_NONE);
+        auto frames = ReadAllFrames(reader, 1024 * 1024);
+        EXPECT_EQ(frames.size(), 30u);
+
+        //frames which don't fit the bitstream are kept by the splitter and not cut
+        reader.Reset();
+        EXPECT_EQ(ReadAllFrames(reader, 64), frames);
+    }
+}
+
+TEST(Transcode_FrameReader, AUThroughput) {
+    const mfxU32 numCopies = 64;
+    for (mfxU32 codecId : { MFX_CODEC_AVC, MFX_CODEC_HEVC }) {
+        const char* name =
+            codecId == MFX_CODEC_AVC ? "cars_320x240.h264" : "cars_320x240.h265";
+        std::string fileName = GetExampleContent(name);
+        if (fileName.empty())
+            GTEST_SKIP();
+
+        //every copy starts with parameter sets and IDR, so they are decodable one after another
+        std::string streamName = std::string("au_throughput_") + name;
+        {
+            std::ifstream in(fileName, std::ios::binary);
+            std::string content((std::istreambuf_iterator<char>(in)),
+                                std::istreambuf_iterator<char>());
+            std::ofstream out(streamName, std::ios::binary | std::ios::trunc);
+            for (mfxU32 i = 0; i < numCopies; i++) {
+                out << content;
+            }
+        }
+
+        CSplitterFrameReader reader(codecId);
+        ASSERT_EQ(reader.Init(streamName.c_str()), MFX_ERR_NONE);
+        mfxBitstreamWrapper bs(1024 * 1024);
+        mfxU32 numFrames = 0;
+        mfxU64 numBytes  = 0;
+        auto start       = std::chrono::steady_clock::now();
+        while (reader.ReadNextFrame(&bs) == MFX_ERR_NONE && bs.DataLength) {
+            numFrames++;
+            numBytes += bs.DataLength;
+            bs.DataLength = 0;
+        }
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        reader.Close();
+        std::remove(streamName.c_str());
+
+        EXPECT_EQ(numFrames, 30 * numCopies);
+        std::cout << name << ": " << numFrames << " AUs, " << std::fixed << std::setprecision(0)
+                  << numFrames / elapsed.count() << " AU/s, " << std::setprecision(1)
+                  << numBytes / elapsed.count() / (1024 * 1024) << " MB/s" << std::endl;
+    }
+}
+
+TEST(Transcode_AUIndex, KeyFramesAndRanges) {
+    const char* streamName = "au_index_ranges.ivf";
+    WriteIVF(streamName,
+             { { 16, true },
+               { 8, false },
+               { 8, false },
+               { 16, true },
+               { 8, false },
+               { 16, true },
+               { 8, false },
+               { 8, false },
+               { 8, false } });
+    CAUIndex index;
+    ASSERT_EQ(index.Build(streamName, MFX_CODEC_VP8), MFX_ERR_NONE);
+    ASSERT_EQ(index.GetEntries().size(), 9u);
+    EXPECT_EQ(index.FindKeyFrame(0), 0);
+    EXPECT_EQ(index.FindKeyFrame(4), 3);
+    EXPECT_EQ(index.FindKeyFrame(5), 5);
+    EXPECT_EQ(index.FindKeyFrame(100), 5);
+    //IVF frames have no parameter sets
+    EXPECT_TRUE(index.GetParameterSets(3).empty());
+
+    auto gops = index.SplitToRanges(0);
+    ASSERT_EQ(gops.size(), 3u);
+    EXPECT_EQ(gops[1].FirstAU, 3u);
+    EXPECT_EQ(gops[1].NumAU, 2u);
+    EXPECT_EQ(gops[1].Offset, index.GetEntries()[3].Offset);
+    EXPECT_EQ(gops[1].Size, 12u + 16 + 12 + 8);
+    EXPECT_EQ(index.SplitToRanges(10).size(), 3u);
+
+    //ranges are contiguous and cover the whole stream
+    auto ranges = index.SplitToRanges(2);
+    ASSERT_EQ(ranges.size(), 2u);
+    EXPECT_EQ(ranges[0].FirstAU, 0u);
+    EXPECT_EQ(ranges[1].FirstAU, ranges[0].NumAU);
+    EXPECT_EQ(ranges[0].NumAU + ranges[1].NumAU, 9u);
+    EXPECT_EQ(ranges[1].Offset, ranges[0].Offset + ranges[0].Size);
+
+    //access units before the first key frame can't be decoded
+    WriteIVF(streamName, { { 8, false }, { 16, true }, { 8, false } });
+    ASSERT_EQ(index.Build(streamName, MFX_CODEC_VP8), MFX_ERR_NONE);
+    EXPECT_EQ(index.FindKeyFrame(0), -1);
+    EXPECT_EQ(index.FindKeyFrame(2), 1);
+
+    std::remove(streamName);
+}
+
+// NAL units of Annex-B stream with their start codes
+static std::vector<std::string> SplitNalUnits(const std::string& stream) {
+    const std::string startCode("\0\0\1", 3);
+    std::vector<std::string> nalUnits;
+    for (size_t pos = stream.find(startCode); pos != std::string::npos;) {
+        size_t next = stream.find(startCode, pos + startCode.size());
+        nalUnits.push_back(stream.substr(pos, next == std::string::npos ? next : next - pos));
+        pos = next;
+    }
+    return nalUnits;
+}
+
+// payload of NAL unit without start code and zero bytes of the next one
+static std::string GetNalPayload(const std::string& nalUnit) {
+    size_t begin = nalUnit.find('\1') + 1;
+    size_t end   = nalUnit.find_last_not_of('\0') + 1;
+    return nalUnit.substr(begin, end - begin);
+}
+
+static bool IsParamSet(mfxU32 codecId, const std::string& nalUnit) {
+    mfxU8 header = (mfxU8)GetNalPayload(nalUnit)[0];
+    return codecId == MFX_CODEC_AVC ? ((header & 0x1f) == 7 || (header & 0x1f) == 8)
+                                    : ((header >> 1) >= 32 && (header >> 1) <= 34);
+}
+
+TEST(Transcode_AUIndex, ParameterSetsAreSentBeforeKeyFrame) {
+    for (mfxU32 codecId : { MFX_CODEC_AVC, MFX_CODEC_HEVC }) {
+        const char* name =
+            codecId == MFX_CODEC_AVC ? "cars_320x240.h264" : "cars_320x240.h265";
+        std::string fileName = GetExampleContent(name);
+        if (fileName.empty())
+            GTEST_SKIP();
+
+        std::ifstream in(fileName, std::ios::binary);
+        std::string content((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        std::vector<std::string> paramSets;
+        for (const std::string& nalUnit : SplitNalUnits(content)) {
+            if (IsParamSet(codecId, nalUnit))
+                paramSets.push_back(GetNalPayload(nalUnit));
+        }
+        ASSERT_EQ(paramSets.size(), codecId == MFX_CODEC_AVC ? 2u : 3u);
+
+        //the second copy has no parameter sets, like a stream which sends them once
+        std::string streamName = std::string("au_index_ps_") + name;
+        {
+            std::ofstream out(streamName, std::ios::binary | std::ios::trunc);
+            out << content;
+            for (const std::string& nalUnit : SplitNalUnits(content)) {
+                if (!IsParamSet(codecId, nalUnit))
+                    out << nalUnit;
+            }
+        }
+
+        CAUIndex index;
+        ASSERT_EQ(index.Build(streamName.c_str(), codecId), MFX_ERR_NONE);
+        ASSERT_EQ(index.GetEntries().size(), 60u);
+        EXPECT_EQ(index.FindKeyFrame(45), 30);
+        EXPECT_EQ(index.SplitToRanges(2).size(), 2u);
+
+        //the first IDR carries parameter sets itself
+        EXPECT_TRUE(index.GetParameterSets(0).empty());
+        auto sets = index.GetParameterSets(30);
+        ASSERT_EQ(sets.size(), paramSets.size());
+        for (size_t i = 0; i < sets.size(); i++) {
+            EXPECT_EQ(sets[i].Type, (codecId == MFX_CODEC_AVC ? AU_INDEX_SPS : AU_INDEX_VPS) + i);
+            EXPECT_EQ(sets[i].Id, 0);
+            EXPECT_LT(sets[i].Offset, index.GetEntries()[1].Offset);
+        }
+
+        std::vector<mfxU8> data;
+        ASSERT_EQ(index.ReadParameterSets(streamName.c_str(), 30, data), MFX_ERR_NONE);
+        std::vector<std::string> nalUnits = SplitNalUnits(std::string(data.begin(), data.end()));
+        ASSERT_EQ(nalUnits.size(), paramSets.size());
+        for (size_t i = 0; i < nalUnits.size(); i++) {
+            EXPECT_EQ(GetNalPayload(nalUnits[i]), paramSets[i]);
+        }
+
+        //parameter sets are saved with the index
+        std::string indexName = CAUIndex::GetDefaultIndexName(streamName.c_str());
+        ASSERT_EQ(index.Save(indexName.c_str()), MFX_ERR_NONE);
+        CAUIndex loaded;
+        ASSERT_EQ(loaded.Load(indexName.c_str(), streamName.c_str()), MFX_ERR_NONE);
+        std::vector<mfxU8> loadedData;
+        ASSERT_EQ(loaded.ReadParameterSets(streamName.c_str(), 30, loadedData), MFX_ERR_NONE);
+        EXPECT_EQ(loadedData, data);
+
+        //reader which seeks to the key frame returns parameter sets before it
+        CSplitterFrameReader reader(codecId);
+        ASSERT_EQ(reader.Init(fileName.c_str()), MFX_ERR_NONE);
+        auto frames = ReadAllFrames(reader, 1024 * 1024);
+        reader.Close();
+
+        ASSERT_EQ(reader.Init(streamName.c_str()), MFX_ERR_NONE);
+        ASSERT_EQ(reader.Seek(index.GetEntries()[30].Offset, data), MFX_ERR_NONE);
+        auto seekFrames = ReadAllFrames(reader, 1024 * 1024);
+        reader.Close();
+
+        ASSERT_EQ(seekFrames.size(), 30u);
+        nalUnits = SplitNalUnits(std::string(seekFrames[0].begin(), seekFrames[0].end()));
+        ASSERT_GT(nalUnits.size(), paramSets.size());
+        for (size_t i = 0; i < paramSets.size(); i++) {
+            EXPECT_EQ(GetNalPayload(nalUnits[i]), paramSets[i]);
+        }
+        for (size_t i = 1; i < seekFrames.size(); i++) {
+            EXPECT_EQ(seekFrames[i], frames[i]);
+        }
+
+        std::remove(indexName.c_str());
+        std::remove(streamName.c_str());
+    }
+}
+
+using ProtectedLibrary::FindStartCodePrefix;
+using ProtectedLibrary::NALUnitSplitter;
+
+// byte by byte search which FindStartCodePrefix has to match
+static mfxU8* FindStartCodePrefixRef(mfxU8* begin, mfxU8* end) {
+    for (mfxU8* pb = begin; pb + 3 <= end; pb++) {
+        if (!pb[0] && !pb[1] && pb[2] == 1)
+            return pb;
+    }
+    return end;
+}
+
+TEST(Transcode_StartCode, FindStartCodePrefix) {
+    //prefix at every position of buffers around SSE2 and AVX2 block sizes
+    for (size_t size : { 3, 15, 16, 17, 18, 19, 31, 32, 33, 34, 35, 64, 67 }) {
+        for (size_t pos = 0; pos + 3 <= size; pos++) {
+            std::vector<mfxU8> buf(size, 0x80);
+            buf[pos + 2] = 1;
+            buf[pos + 1] = buf[pos] = 0;
+            EXPECT_EQ(FindStartCodePrefix(buf.data(), buf.data() + size), buf.data() + pos)
+                << "size " << size << " pos " << pos;
+            //prefix which doesn't fit the buffer isn't found
+            EXPECT_EQ(FindStartCodePrefix(buf.data(), buf.data() + pos + 2), buf.data() + pos + 2);
+        }
+    }
+
+    //4 bytes start code is found by its last 3 bytes, the leading zero is before the prefix
+    mfxU8 sc4[] = { 0x80, 0, 0, 0, 1, 0x65 };
+    EXPECT_EQ(FindStartCodePrefix(sc4, sc4 + sizeof(sc4)), sc4 + 2);
+
+    //emulation prevention and trailing zeros are not start codes
+    mfxU8 epb[] = { 0, 0, 3, 1, 0x80, 0, 0, 2, 0, 0 };
+    EXPECT_EQ(FindStartCodePrefix(epb, epb + sizeof(epb)), epb + sizeof(epb));
+    EXPECT_EQ(FindStartCodePrefix(epb, epb), epb);
+    EXPECT_EQ(FindStartCodePrefix(nullptr, nullptr), nullptr);
+
+    //random data with many zeros, every search position is compared with byte by byte search
+    std::mt19937 gen(27);
+    const mfxU8 alphabet[] = { 0, 0, 0, 1, 3, 0x80 };
+    std::vector<mfxU8> buf(4096);
+    for (int n = 0; n < 16; n++) {
+        for (mfxU8& b : buf) {
+            b = alphabet[gen() % sizeof(alphabet)];
+        }
+        mfxU8* end = buf.data() + buf.size();
+        for (mfxU8* pb = buf.data(); pb < end; pb++) {
+            ASSERT_EQ(FindStartCodePrefix(pb, end), FindStartCodePrefixRef(pb, end));
+        }
+    }
+}
+
+// NAL units found by the splitter in the stream fed by chunks of given size
+static std::vector<std::vector<mfxU8>> SplitByChunks(const std::vector<mfxU8>& stream,
+                                                     size_t chunkSize) {
+    NALUnitSplitter splitter;
+    splitter.Init();
+
+    std::vector<std::vector<mfxU8>> nalUnits;
+    std::vector<mfxU8> pending;
+    mfxBitstream* nal = nullptr;
+    for (size_t pos = 0; pos < stream.size(); pos += chunkSize) {
+        pending.insert(pending.end(),
+                       stream.begin() + pos,
+                       stream.begin() + std::min(pos + chunkSize, stream.size()));
+
+        mfxBitstream bs = {};
+        bs.Data         = pending.data();
+        bs.DataLength   = (mfxU32)pending.size();
+        bs.MaxLength    = bs.DataLength;
+        for (;;) {
+            splitter.GetNalUnits(&bs, nal);
+            if (!nal)
+                break;
+            nalUnits.emplace_back(nal->Data + nal->DataOffset,
+                                  nal->Data + nal->DataOffset + nal->DataLength);
+        }
+        pending.erase(pending.begin(), pending.begin() + bs.DataOffset);
+    }
+    splitter.GetNalUnits(nullptr, nal);
+    if (nal)
+        nalUnits.emplace_back(nal->Data + nal->DataOffset,
+                              nal->Data + nal->DataOffset + nal->DataLength);
+    return nalUnits;
+}
+
+TEST(Transcode_StartCode, StartCodeSplitBetweenChunks) {
+    //3 and 4 bytes start codes, emulation prevention and trailing zeros in between
+    std::vector<mfxU8> stream;
+    std::mt19937 gen(27);
+    const mfxU32 numNalUnits = 40;
+    for (mfxU32 i = 0; i < numNalUnits; i++) {
+        if (i % 2)
+            stream.push_back(0);
+        stream.insert(stream.end(), { 0, 0, 1, (mfxU8)(0x41 + i % 8) });
+        for (mfxU32 n = gen() % 50; n; n--) {
+            stream.push_back((mfxU8)(gen() % 4 ? 0x80 + gen() % 0x80 : 0));
+        }
+        stream.insert(stream.end(), { 0, 0, 3, 0x80 });
+        if (i % 3 == 0)
+            stream.insert(stream.end(), { 0, 0 });
+    }
+
+    auto whole = SplitByChunks(stream, stream.size());
+    ASSERT_EQ(whole.size(), numNalUnits);
+    //NAL units are returned without start codes
+    for (mfxU32 i = 0; i < numNalUnits; i++) {
+        ASSERT_FALSE(whole[i].empty());
+        EXPECT_EQ(whole[i][0], 0x41 + i % 8);
+    }
+
+    //every chunk size puts some start codes across chunk boundaries
+    for (size_t chunkSize = 1; chunkSize <= 19; chunkSize++) {
+        EXPECT_EQ(SplitByChunks(stream, chunkSize), whole) << "chunk size " << chunkSize;
+    }
+}
+
+static double RunStartCodeSearch(mfxU8* (*find)(mfxU8*, mfxU8*),
+                                 std::vector<mfxU8>& buf,
+                                 mfxU32 numPasses,
+                                 size_t& numFound) {
+    numFound   = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (mfxU32 n = 0; n < numPasses; n++) {
+        mfxU8* end = buf.data() + buf.size();
+        for (mfxU8* pb = find(buf.data(), end); pb != end; pb = find(pb + 3, end)) {
+            numFound++;
+        }
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return (double)buf.size() * numPasses / elapsed.count() / (1024 * 1024 * 1024);
+}
+
+TEST(Transcode_StartCode, SearchThroughput) {
+    const mfxU32 numPasses = 8;
+    std::mt19937 gen(27);
+    std::vector<mfxU8> buf(16 * 1024 * 1024);
+    //NAL unit of 64 bytes is a small slice, of 64 KB a typical frame
+    for (size_t nalSize : { 64, 4096, 65536 }) {
+        for (mfxU8& b : buf) {
+            b = (mfxU8)(gen() % 255 + 1);
+        }
+        for (size_t pos = 0; pos + 3 <= buf.size(); pos += nalSize) {
+            buf[pos] = buf[pos + 1] = 0;
+            buf[pos + 2]            = 1;
+        }
+
+        size_t numFound = 0, numFoundRef = 0;
+        double gbps    = RunStartCodeSearch(FindStartCodePrefix, buf, numPasses, numFound);
+        double gbpsRef = RunStartCodeSearch(FindStartCodePrefixRef, buf, numPasses, numFoundRef);
+        EXPECT_EQ(numFound, numFoundRef);
+        std::cout << "NAL unit " << nalSize << " bytes: " << std::fixed << std::setprecision(2)
+                  << gbps << " GB/s, byte by byte " << gbpsRef << " GB/s" << std::endl;
+    }
+}
+
+using ProtectedLibrary::AVC_exception;
+using ProtectedLibrary::AVCBaseBitstream;
+using ProtectedLibrary::SwapMemoryAndRemovePreventingBytes;
+
+// writes bits MSB first and inserts emulation prevention bytes the way encoders do
+class TestBitWriter {
+public:
+    void PutBits(mfxU64 value, mfxU32 nbits) {
+        for (mfxU32 i = nbits; i; i--) {
+            m_byte = (mfxU8)((m_byte << 1) | ((value >> (i - 1)) & 1));
+            if (++m_numBits == 8)
+                PutByte();
+        }
+    }
+
+    void PutUE(mfxU32 value) {
+        mfxU64 code   = (mfxU64)value + 1;
+        mfxU32 length = 0;
+        while (code >> (length + 1))
+            length++;
+        PutBits(0, length);
+        PutBits(code, length + 1);
+    }
+
+    void PutSE(mfxI32 value) {
+        PutUE(value > 0 ? 2 * (mfxU32)value - 1 : 2 * (mfxU32)(-(mfxI64)value));
+    }
+
+    // rbsp_trailing_bits
+    std::vector<mfxU8>& Finish() {
+        PutBits(1, 1);
+        while (m_numBits)
+            PutBits(0, 1);
+        return m_data;
+    }
+
+protected:
+    void PutByte() {
+        if (m_zeros >= 2 && m_byte <= 3) {
+            m_data.push_back(3);
+            m_zeros = 0;
+        }
+        m_zeros = m_byte ? 0 : m_zeros + 1;
+        m_data.push_back(m_byte);
+        m_byte    = 0;
+        m_numBits = 0;
+    }
+
+    std::vector<mfxU8> m_data;
+    mfxU8 m_byte     = 0;
+    mfxU32 m_numBits = 0;
+    mfxU32 m_zeros   = 0;
+};
+
+// removes emulation prevention bytes and swaps dwords, the reader is given the result
+static std::vector<mfxU8> SwapForReader(std::vector<mfxU8> data) {
+    std::vector<mfxU8> swapped(data.size() + 8);
+    mfxU32 size = 0;
+    SwapMemoryAndRemovePreventingBytes(swapped.data(), size, data.data(), (mfxU32)data.size());
+    swapped.resize(size);
+    return swapped;
+}
+
+// bytes of swapped buffer in stream order
+static std::vector<mfxU8> UnswapDwords(const std::vector<mfxU8>& swapped) {
+    std::vector<mfxU8> data;
+    for (size_t i = 0; i + 4 <= swapped.size(); i += 4) {
+        mfxU32 dword;
+        memcpy(&dword, &swapped[i], sizeof(dword));
+        data.insert(data.end(),
+                    { (mfxU8)(dword >> 24), (mfxU8)(dword >> 16), (mfxU8)(dword >> 8), (mfxU8)dword });
+    }
+    return data;
+}
+
+TEST(Transcode_BitReader, ReadsAcrossDwordBoundaries) {
+    //32 bit value after every offset in the cache, read at once and in pieces
+    std::mt19937 gen(30);
+    for (mfxU32 offset = 0; offset < 64; offset++) {
+        mfxU32 value = gen();
+        TestBitWriter writer;
+        writer.PutBits(~0ull, offset);
+        writer.PutBits(value, 32);
+        writer.PutBits(value, 32);
+        writer.PutBits(0xabc, 12);
+        std::vector<mfxU8> data = SwapForReader(writer.Finish());
+
+        AVCBaseBitstream bs(data.data(), (mfxU32)data.size());
+        for (mfxU32 left = offset; left;) {
+            mfxU32 n = std::min<mfxU32>(left, 7);
+            EXPECT_EQ(bs.GetBits(n), (1u << n) - 1);
+            left -= n;
+        }
+        EXPECT_EQ(bs.BitsDecoded(), offset);
+        EXPECT_EQ(bs.PeekBits(32), value) << "offset " << offset;
+        EXPECT_EQ(bs.GetBits(32), value) << "offset " << offset;
+        EXPECT_EQ(bs.GetBits(20), value >> 12);
+        EXPECT_EQ(bs.GetBits(12), value & 0xfff);
+        bs.SkipBits(0);
+        EXPECT_EQ(bs.GetBits(12), 0xabcu);
+        EXPECT_EQ(bs.BitsDecoded(), offset + 76);
+        EXPECT_FALSE(bs.More_RBSP_Data());
+    }
+
+    //reads past the end of the buffer return zero bits
+    mfxU8 word[] = { 0xff, 0xff, 0xff, 0xff };
+    AVCBaseBitstream bs(word, sizeof(word));
+    EXPECT_EQ(bs.GetBits(24), 0xffffffu);
+    EXPECT_EQ(bs.GetBits(16), 0xff00u);
+    EXPECT_EQ(bs.GetBits(32), 0u);
+}
+
+TEST(Transcode_BitReader, ExpGolombNear32Bits) {
+    const std::vector<mfxU32> ue = { 0,          1,          2,          0xfffe,
+                                     0xffff,     0x10000,    0x7ffffffe, 0x7fffffff,
+                                     0x80000000, 0xfffffffd, 0xfffffffe };
+    const std::vector<mfxI32> se = { 0, 1, -1, 0x7fff, -0x8000, 0x7fffffff, -0x7fffffff };
+
+    //every code is read at every bit offset, long codes don't fit the cache at once
+    for (mfxU32 offset = 0; offset < 32; offset++) {
+        TestBitWriter writer;
+        writer.PutBits(1, offset);
+        for (mfxU32 value : ue) {
+            writer.PutUE(value);
+        }
+        for (mfxI32 value : se) {
+            writer.PutSE(value);
+        }
+        std::vector<mfxU8> data = SwapForReader(writer.Finish());
+
+        AVCBaseBitstream bs(data.data(), (mfxU32)data.size());
+        bs.SkipBits(offset);
+        for (mfxU32 value : ue) {
+            EXPECT_EQ((mfxU32)bs.GetVLCElement(false), value) << "offset " << offset;
+        }
+        for (mfxI32 value : se) {
+            EXPECT_EQ(bs.GetVLCElement(true), value) << "offset " << offset;
+        }
+        EXPECT_FALSE(bs.More_RBSP_Data());
+    }
+
+    //32 leading zeros don't make a 32 bit value
+    TestBitWriter writer;
+    writer.PutBits(0, 32);
+    writer.PutBits(3, 33);
+    std::vector<mfxU8> data = SwapForReader(writer.Finish());
+    AVCBaseBitstream bs(data.data(), (mfxU32)data.size());
+    EXPECT_THROW(bs.GetVLCElement(false), AVC_exception);
+}
+
+// 7.4.1 of AVC standard, 0x03 after two zero bytes is removed
+static std::vector<mfxU8> RemovePreventingBytesRef(const std::vector<mfxU8>& data) {
+    std::vector<mfxU8> rbsp;
+    mfxU32 zeros = 0;
+    for (mfxU8 b : data) {
+        if (zeros >= 2 && b == 3) {
+            zeros = 0;
+            continue;
+        }
+        zeros = b ? 0 : zeros + 1;
+        rbsp.push_back(b);
+    }
+    return rbsp;
+}
+
+static void ExpectPreventingBytesRemoved(const std::vector<mfxU8>& data) {
+    std::vector<mfxU8> rbsp = RemovePreventingBytesRef(data);
+    std::vector<mfxU8> out  = UnswapDwords(SwapForReader(data));
+    ASSERT_EQ(out.size(), (rbsp.size() + 3) / 4 * 4);
+    EXPECT_TRUE(std::equal(rbsp.begin(), rbsp.end(), out.begin()));
+    //padding is zero
+    EXPECT_TRUE(std::all_of(out.begin() + rbsp.size(), out.end(), [](mfxU8 b) {
+        return b == 0;
+    }));
+}
+
+TEST(Transcode_BitReader, RemovePreventingBytesAtEdges) {
+    //at the beginning, at the end and one after another
+    ExpectPreventingBytesRemoved({ 0, 0, 3, 1, 0x80 });
+    ExpectPreventingBytesRemoved({ 0x80, 0, 0, 3 });
+    ExpectPreventingBytesRemoved({ 0, 0, 3 });
+    ExpectPreventingBytesRemoved({ 0, 0, 3, 0, 0, 3, 0, 0, 3 });
+    ExpectPreventingBytesRemoved({ 0, 3, 0, 0, 2, 0, 0 });
+    ExpectPreventingBytesRemoved({});
+
+    //at every position of buffers around SSE2 and AVX2 block sizes
+    for (size_t size : { 3, 4, 5, 16, 17, 18, 19, 32, 33, 34, 35, 70 }) {
+        for (size_t pos = 0; pos + 3 <= size; pos++) {
+            std::vector<mfxU8> data(size, 0x80);
+            data[pos] = data[pos + 1] = 0;
+            data[pos + 2]             = 3;
+            ExpectPreventingBytesRemoved(data);
+            //sequence cut by the end of buffer is kept
+            data.resize(pos + 2);
+            ExpectPreventingBytesRemoved(data);
+        }
+    }
+
+    //random data with many zeros
+    std::mt19937 gen(30);
+    const mfxU8 alphabet[] = { 0, 0, 0, 1, 3, 3, 0x80 };
+    for (int n = 0; n < 200; n++) {
+        std::vector<mfxU8> data(gen() % 300);
+        for (mfxU8& b : data) {
+            b = alphabet[gen() % sizeof(alphabet)];
+        }
+        ExpectPreventingBytesRemoved(data);
+    }
+}
+
+TEST(Transcode_BitReader, Throughput) {
+    //slice header like mix of flags, fixed length fields and exp-Golomb codes
+    std::mt19937 gen(30);
+    TestBitWriter writer;
+    const mfxU32 numGroups = 200000;
+    for (mfxU32 i = 0; i < numGroups; i++) {
+        writer.PutBits(gen() & 1, 1);
+        writer.PutUE(gen() % 64);
+        writer.PutSE((mfxI32)(gen() % 52) - 26);
+        writer.PutBits(gen() & 0xffff, 16);
+        writer.PutUE(gen() % 100000);
+    }
+    std::vector<mfxU8> data = writer.Finish();
+
+    const mfxU32 numPasses = 20;
+    std::vector<mfxU8> swapped(data.size() + 8);
+    mfxU32 size = 0;
+    auto start  = std::chrono::steady_clock::now();
+    for (mfxU32 n = 0; n < numPasses; n++) {
+        SwapMemoryAndRemovePreventingBytes(swapped.data(), size, data.data(), (mfxU32)data.size());
+    }
+    std::chrono::duration<double> swapTime = std::chrono::steady_clock::now() - start;
+
+    mfxU64 sum = 0;
+    start      = std::chrono::steady_clock::now();
+    for (mfxU32 n = 0; n < numPasses; n++) {
+        AVCBaseBitstream bs(swapped.data(), size);
+        for (mfxU32 i = 0; i < numGroups; i++) {
+            sum += bs.Get1Bit();
+            sum += bs.GetVLCElement(false);
+            sum += bs.GetVLCElement(true);
+            sum += bs.GetBits(16);
+            sum += bs.GetVLCElement(false);
+        }
+    }
+    std::chrono::duration<double> readTime = std::chrono::steady_clock::now() - start;
+    EXPECT_NE(sum, 0u);
+
+    std::cout << "emulation prevention removal: " << std::fixed << std::setprecision(0)
+              << data.size() * numPasses / swapTime.count() / (1024 * 1024) << " MB/s"
+              << std::endl;
+    std::cout << "header reads: " << std::setprecision(1)
+              << 5.0 * numGroups * numPasses / readTime.count() / 1000000 << " M/s" << std::endl;
+}
+
+TEST(Transcode_MSDKAtomic, DecReturnsNewValue) {
+    volatile mfxU16 value16 = 2;
+    EXPECT_EQ(msdk_atomic_dec16(&value16), 1);
+    EXPECT_EQ(msdk_atomic_dec16(&value16), 0);
+    EXPECT_EQ(msdk_atomic_dec16(&value16), 0xffff);
+    EXPECT_EQ(msdk_atomic_inc16(&value16), 0);
+    EXPECT_EQ(msdk_atomic_inc16(&value16), 1);
+
+    volatile mfxU32 value32 = 2;
+    EXPECT_EQ(msdk_atomic_dec32(&value32), 1u);
+    EXPECT_EQ(msdk_atomic_dec32(&value32), 0u);
+    EXPECT_EQ(msdk_atomic_dec32(&value32), 0xffffffffu);
+    EXPECT_EQ(msdk_atomic_inc32(&value32), 0u);
+    EXPECT_EQ(msdk_atomic_inc32(&value32), 1u);
+
+    //every increment is matched by a decrement, only the last one sees zero
+    const mfxU32 numThreads = 4, numRounds = 100000;
+    volatile mfxU16 render_lock = 1;
+    std::atomic<mfxU32> numZeros(0);
+    std::vector<std::thread> threads;
+    for (mfxU32 i = 0; i < numThreads; i++) {
+        threads.emplace_back([&]() {
+            for (mfxU32 n = 0; n < numRounds; n++) {
+                msdk_atomic_inc16(&render_lock);
+                if (!msdk_atomic_dec16(&render_lock))
+                    numZeros++;
+            }
+        });
+    }
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    EXPECT_EQ(numZeros, 0u);
+    EXPECT_EQ(msdk_atomic_dec16(&render_lock), 0);
+}
+
+class TestBuffering : public CBuffering {
+public:
+    ~TestBuffering() {
+        FreeBuffers();
+    }
+
+    // decoder thread takes free surfaces and keeps the last numRefs of them locked as references,
+    // deliver thread releases render lock of every surface it gets
+    double RunDecodeDeliver(mfxU32 numSurfaces, mfxU32 numFrames, mfxU32 numRefs) {
+        EXPECT_EQ(AllocBuffers(numSurfaces), MFX_ERR_NONE);
+
+        std::thread deliver([&]() {
+            for (mfxU32 n = 0; n < numFrames;) {
+                msdkOutputSurface* out = m_OutputSurfacesPool.GetSurface();
+                if (!out) {
+                    std::this_thread::yield();
+                    continue;
+                }
+                ReturnSurfaceToBuffers(out);
+                n++;
+            }
+        });
+
+        std::deque<msdkFrameSurface*> refs;
+        auto start = std::chrono::steady_clock::now();
+        for (mfxU32 n = 0; n < numFrames; n++) {
+            msdkFrameSurface* surface = m_FreeSurfacesPool.GetSurface();
+            while (!surface) {
+                SyncFrameSurfaces();
+                surface = m_FreeSurfacesPool.GetSurface();
+                if (!surface)
+                    std::this_thread::yield();
+            }
+
+            //decoded frame stands in for the runtime which locks references
+            surface->frame.Data.Locked = 1;
+            m_UsedSurfacesPool.AddSurface(surface);
+            refs.push_back(surface);
+            if (refs.size() > numRefs) {
+                refs.front()->frame.Data.Locked = 0;
+                refs.pop_front();
+            }
+
+            LockSurfaceForRendering(m_UsedSurfacesPool, surface);
+            msdkOutputSurface* out = GetFreeOutputSurface();
+            out->surface           = surface;
+            out->syncp             = (mfxSyncPoint)surface;
+            m_OutputSurfacesPool.AddSurface(out);
+        }
+        deliver.join();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        //every surface comes back once references are released
+        for (msdkFrameSurface* surface : refs) {
+            surface->frame.Data.Locked = 0;
+        }
+        SyncFrameSurfaces();
+        mfxU32 numFree = 0;
+        while (m_FreeSurfacesPool.GetSurface())
+            numFree++;
+        EXPECT_EQ(numFree, numSurfaces);
+
+        FreeBuffers();
+        return numFrames / elapsed.count();
+    }
+};
+
+TEST(Transcode_Buffering, SurfaceContention) {
+    const mfxU32 numFrames = 200000;
+    for (mfxU32 numSurfaces : { 8, 16, 64 }) {
+        TestBuffering buffering;
+        double fps = buffering.RunDecodeDeliver(numSurfaces, numFrames, 4);
+        std::cout << numSurfaces << " surfaces: " << std::fixed << std::setprecision(2)
+                  << fps / 1000000 << " Mframes/s" << std::endl;
+    }
+}
+
+TEST(Transcode_Tracer, StreamingKeepsFlowsBetweenChunks) {
+    using TranscodingSample::SMTTracer;
+    namespace fs = std::filesystem;
+
+    auto traceFiles = []() {
+        std::set<std::string> files;
+        for (const auto& entry : fs::directory_iterator(".")) {
+            std::string name = entry.path().filename().string();
+            if (name.rfind("smt_trace_", 0) == 0) {
+                files.insert(name);
+            }
+        }
+        return files;
+    };
+    std::set<std::string> before = traceFiles();
+
+    //decoder output is consumed by encoder in other thread, frames go through several chunks.
+    //Encoder writes to its log first, so the log of decoder is popped before it and a frame
+    //may be decoded and consumed while the log of decoder is being popped.
+    mfxU64 numFrames = 0;
+    {
+        SMTTracer tracer;
+        tracer.Init(SMTTracer::PipelineType::_1xN, 1, SMTTracer::LatencyType::DEFAULT, 64, true);
+
+        std::atomic<mfxU64> decoded(0);
+        std::atomic<bool> started(false), stopped(false);
+        std::thread encoder([&]() {
+            tracer.AddCounterEvent(SMTTracer::ThreadType::ENC, 0, SMTTracer::EventName::UNDEF, 1);
+            started = true;
+
+            for (mfxU64 frame = 1;; frame++) {
+                while (decoded < frame) {
+                    if (stopped && decoded < frame) {
+                        return;
+                    }
+                    std::this_thread::yield();
+                }
+
+                void* id = reinterpret_cast<void*>(frame);
+                tracer.BeginEvent(SMTTracer::ThreadType::ENC,
+                                  0,
+                                  SMTTracer::EventName::BUSY,
+                                  id,
+                                  nullptr);
+                tracer.EndEvent(SMTTracer::ThreadType::ENC,
+                                0,
+                                SMTTracer::EventName::BUSY,
+                                id,
+                                nullptr);
+            }
+        });
+        while (!started) {
+            std::this_thread::yield();
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        while (std::chrono::steady_clock::now() - start < std::chrono::milliseconds(350)) {
+            mfxU64 frame = numFrames + 1;
+            void* id     = reinterpret_cast<void*>(frame);
+            tracer.BeginEvent(SMTTracer::ThreadType::DEC,
+                              0,
+                              SMTTracer::EventName::BUSY,
+                              nullptr,
+                              id);
+            tracer.EndEvent(SMTTracer::ThreadType::DEC,
+                            0,
+                            SMTTracer::EventName::BUSY,
+                            nullptr,
+                            id);
+            numFrames = frame;
+            decoded   = frame;
+
+            auto decodedAt = std::chrono::steady_clock::now();
+            while (std::chrono::steady_clock::now() - decodedAt < std::chrono::microseconds(5)) {
+            }
+        }
+        stopped = true;
+        encoder.join();
+    }
+
+    std::vector<std::string> created;
+    for (const std::string& name : traceFiles()) {
+        if (!before.count(name)) {
+            created.push_back(name);
+        }
+    }
+    ASSERT_EQ(created.size(), 1u);
+
+    std::ifstream trace(created[0]);
+    std::string line;
+    mfxU64 numFlowStarts = 0, numFlowEnds = 0;
+    while (std::getline(trace, line)) {
+        numFlowStarts += line.find("\"ph\":\"s\"") != std::string::npos;
+        numFlowEnds += line.find("\"ph\":\"f\"") != std::string::npos;
+    }
+    trace.close();
+    std::remove(created[0].c_str());
+
+    //every encoded frame is bound to its decoding
+    EXPECT_EQ(numFlowStarts, numFrames);
+    EXPECT_EQ(numFlowEnds, numFrames);
+}
@@ -49,6 +49,7 @@
     #include "vpl/mfxvideo.h"
 
     #include "base_allocator.h"
+    #include "sysmem_allocator.h"
     #include "sample_vpp_config.h"
     #include "sample_vpp_roi.h"
 
@@ -192,6 +193,9 @@ struct sInputParams {
     mfxI32 adapterNum;
     bool dispFullSearch;
 
+    bool bSysMemHugePages;
+    mfxI32 nSysMemNumaNode; // node id or SYSMEM_NUMA_NODE_*
+
     #if (defined(_WIN64) || defined(_WIN32)) && (MFX_VERSION >= 1031)
     bool bPreferdGfx;
     bool bPreferiGfx;
@@ -314,6 +318,8 @@ struct sInputParams {
               dGfxIdx(-1),
               adapterNum(-1),
               dispFullSearch(DEF_DISP_FULLSEARCH),
+              bSysMemHugePages(false),
+              nSysMemNumaNode(SYSMEM_NUMA_NODE_ANY),
     #if (defined(_WIN64) || defined(_WIN32)) && (MFX_VERSION >= 1031)
               bPreferdGfx(false),
               bPreferiGfx(false),
@@ -59,6 +59,12 @@ void vppPrintHelp(const char* strAppName, const char* strErrorMessage) {
         "   [-dispatcher:fullSearch]    - enable search for all available implementations in Intel® VPL dispatcher\n");
     printf(
         "   [-dispatcher:lowLatency]    - enable limited implementation search and query in Intel® VPL dispatcher\n");
+    printf(
+        "   [-huge_pages]               - back system memory surfaces with 2 MB pages (Linux only)\n");
+    printf(
+        "   [-mem_numa_node node]       - allocate system memory surfaces on the NUMA node (Linux only),\n");
+    printf(
+        "                                 'local' - node of CPUs the allocating thread is pinned to\n");
 #if defined(D3D_SURFACES_SUPPORT)
     printf("   [-d3d]                      - use d3d9 surfaces\n\n");
 #endif
@@ -1806,6 +1812,20 @@ mfxStatus vppParseInputString(char* strInput[],
             else if (msdk_match(strInput[i], "-dispatcher:lowLatency")) {
                 pParams->dispFullSearch = false;
             }
+            else if (msdk_match(strInput[i], "-huge_pages")) {
+                pParams->bSysMemHugePages = true;
+            }
+            else if (msdk_match(strInput[i], "-mem_numa_node")) {
+                VAL_CHECK(1 + i == nArgNum);
+                if (msdk_match(strInput[++i], "local")) {
+                    pParams->nSysMemNumaNode = SYSMEM_NUMA_NODE_LOCAL;
+                }
+                else if (MFX_ERR_NONE != msdk_opt_read(strInput[i], pParams->nSysMemNumaNode) ||
+                         pParams->nSysMemNumaNode < 0) {
+                    printf("value of -mem_numa_node is invalid");
+                    return MFX_ERR_UNSUPPORTED;
+                }
+            }
 #if defined(D3D_SURFACES_SUPPORT)
             else if (msdk_match(strInput[i], "-d3d")) {
                 pParams->IOPattern = MFX_IOPATTERN_IN_VIDEO_MEMORY | MFX_IOPATTERN_OUT_VIDEO_MEMORY;
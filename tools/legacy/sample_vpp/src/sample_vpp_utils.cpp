@@ -634,7 +634,13 @@ mfxStatus InitMemoryAllocator(sFrameProcessor* pProcessor,
 
     MSDK_ZERO_MEMORY(request);
 
-    pAllocator->pMfxAllocator = new GeneralAllocator;
+    GeneralAllocator* pGeneralAllocator = new GeneralAllocator;
+    pAllocator->pMfxAllocator           = pGeneralAllocator;
+
+    SysMemPlacement placement;
+    placement.bHugePages = pInParams->bSysMemHugePages;
+    placement.NumaNode   = pInParams->nSysMemNumaNode;
+    pGeneralAllocator->SetSysMemPlacement(placement);
 
     bool isHWLib = (MFX_IMPL_HARDWARE & pInParams->ImpLib) ? true : false;
 